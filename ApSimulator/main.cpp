@@ -0,0 +1,379 @@
+
+// Simulated USB RF access point on a pseudo terminal, Linux only. ChronosApInterface is pointed to the printed
+// device path in place of the real dongle. The BM_* handshake is answered the way the access point firmware
+// does it and, once started, the configured number of watches stream SimpliciTI packets at the configured rate,
+// optionally with transmission faults mixed in.
+
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <cstdint>
+#include <cstdio>
+#include <cstdlib>
+#include <iostream>
+#include <mutex>
+#include <random>
+#include <stdexcept>
+#include <string>
+#include <thread>
+#include <vector>
+
+#include <fcntl.h>
+#include <poll.h>
+#include <termios.h>
+#include <unistd.h>
+
+#define USB_PACKET_HEADER_LENGTH		0x03
+#define USB_PACKET_START_BYTE			0xFF
+#define USB_PACKET_COMMAND_BYTE_INDEX	0x01
+#define USB_PACKET_LENGTH_BYTE_INDEX	0x02
+
+#define BM_START_SIMPLICITI 0x07
+#define BM_STOP_SIMPLICITI 0x09
+
+#define SHM_SYNC_TIMESTAMP 0x51
+
+#define HW_NO_ERROR 0x06
+
+namespace
+{
+	std::vector<std::string> parameters;
+
+	size_t watchCount = 4;
+	double packetRate = 10.0;			// Packets per second of every watch.
+	size_t payloadLength = 20;			// Application data after the link, timestamp and milliseconds.
+	size_t faultRate = 0;				// Faulty packets out of 1000.
+
+	// Link byte, device timestamp and milliseconds in front of the payload.
+	const size_t packetHeaderLength = 7;
+	const size_t maxPayloadLength = 255 - USB_PACKET_HEADER_LENGTH - packetHeaderLength;
+	// Pseudo terminal buffer is small, when the reader does not keep up for this long the data is thrown away.
+	const int writeTimeoutMs = 100;
+
+	int masterDescriptor = -1;
+	std::mutex writeLock;
+
+	std::atomic<bool> streaming(false);
+	std::atomic<bool> stopRequested(false);
+	// Device time set by SHM_SYNC_TIMESTAMP and the host time it was received at.
+	std::mutex syncLock;
+	uint32_t syncTimestamp = 0;
+	std::chrono::steady_clock::time_point syncTime = std::chrono::steady_clock::now();
+
+	std::atomic<uint64_t> packetsSent(0);
+	std::atomic<uint64_t> bytesSent(0);
+	std::atomic<uint64_t> bytesOverrun(0);
+	std::atomic<uint64_t> droppedByteFaults(0);
+	std::atomic<uint64_t> garbageFaults(0);
+	std::atomic<uint64_t> splitFaults(0);
+}
+
+static void fillParameters(int argc, char* argv[]);
+static std::string openPseudoTerminal();
+static bool writeToMaster(const uint8_t* data, size_t length);
+static void answerCommands();
+static void handleCommand(std::vector<uint8_t>& command);
+static void streamPackets();
+static void buildPacket(size_t watch, uint32_t sequence, std::vector<uint8_t>& packet);
+static void writePacket(std::vector<uint8_t>& packet, std::mt19937& random);
+
+int main(int argc, char* argv[])
+{
+	fillParameters(argc, argv);
+
+	if (parameters.size() > 0)
+		watchCount = std::max<size_t>(1, std::stoul(parameters.at(0)));
+	if (parameters.size() > 1)
+		packetRate = std::stod(parameters.at(1));
+	if (parameters.size() > 2)
+		payloadLength = std::min(maxPayloadLength, static_cast<size_t>(std::stoul(parameters.at(2))));
+	if (parameters.size() > 3)
+		faultRate = std::min<size_t>(1000, std::stoul(parameters.at(3)));
+
+	std::string devicePath;
+	try
+	{
+		devicePath = openPseudoTerminal();
+	}
+	catch (const std::exception& e)
+	{
+		std::cout << e.what() << std::endl;
+		return -1;
+	}
+
+	std::cout << "Access point on " << devicePath << ", " << watchCount << " watches at " << packetRate << " packets/s, "
+		<< payloadLength << " byte payloads, " << faultRate << " faults per 1000 packets." << std::endl;
+	std::cout << "Enter x to quit." << std::endl;
+
+	std::thread commandTask(answerCommands);
+	std::thread streamTask(streamPackets);
+
+	int lastCharFromConsole = 0;
+	while (lastCharFromConsole != 'x' && lastCharFromConsole != EOF)
+		lastCharFromConsole = getc(stdin);
+
+	stopRequested = true;
+	commandTask.join();
+	streamTask.join();
+
+	std::cout << "Sent " << packetsSent << " packets, " << bytesSent << " bytes. " << bytesOverrun << " bytes thrown away, the reader was behind." << std::endl;
+	std::cout << "Faults: " << droppedByteFaults << " with dropped bytes, " << garbageFaults << " garbage, " << splitFaults << " split." << std::endl;
+
+	close(masterDescriptor);
+
+	return 0;
+}
+
+static void fillParameters(int argc, char* argv[])
+{
+	for (uint32_t i = 1; i < (uint32_t)argc; i++)
+		parameters.push_back(std::string(argv[i]));
+}
+
+static std::string openPseudoTerminal()
+{
+	masterDescriptor = posix_openpt(O_RDWR | O_NOCTTY);
+	if (masterDescriptor < 0 || grantpt(masterDescriptor) != 0 || unlockpt(masterDescriptor) != 0)
+		throw std::runtime_error("Could not open a pseudo terminal.");
+
+	std::string devicePath = ptsname(masterDescriptor);
+
+	// Slave side is kept open as well, otherwise the master reports a hangup every time the client closes it.
+	// It is raw from the start so nothing is echoed back before the client has configured it.
+	auto slaveDescriptor = open(devicePath.c_str(), O_RDWR | O_NOCTTY);
+	if (slaveDescriptor < 0)
+		throw std::runtime_error("Could not open " + devicePath + ".");
+
+	termios settings;
+	tcgetattr(slaveDescriptor, &settings);
+	cfmakeraw(&settings);
+	tcsetattr(slaveDescriptor, TCSANOW, &settings);
+
+	fcntl(masterDescriptor, F_SETFL, fcntl(masterDescriptor, F_GETFL) | O_NONBLOCK);
+
+	return devicePath;
+}
+
+// Writes everything unless the reader has not taken anything for the write timeout, then the rest is dropped.
+static bool writeToMaster(const uint8_t* data, size_t length)
+{
+	std::lock_guard<std::mutex> guard(writeLock);
+
+	size_t written = 0;
+	while (written < length)
+	{
+		auto result = write(masterDescriptor, data + written, length - written);
+		if (result > 0)
+		{
+			written += static_cast<size_t>(result);
+			continue;
+		}
+
+		pollfd descriptor = {masterDescriptor, POLLOUT, 0};
+		if (poll(&descriptor, 1, writeTimeoutMs) <= 0)
+		{
+			bytesOverrun += length - written;
+			bytesSent += written;
+			return false;
+		}
+	}
+
+	bytesSent += written;
+
+	return true;
+}
+
+static void answerCommands()
+{
+	std::vector<uint8_t> received;
+	uint8_t buffer[256];
+
+	while (!stopRequested)
+	{
+		pollfd descriptor = {masterDescriptor, POLLIN, 0};
+		if (poll(&descriptor, 1, 20) <= 0)
+			continue;
+
+		auto readBytes = read(masterDescriptor, buffer, sizeof(buffer));
+		if (readBytes <= 0)
+			continue;
+
+		received.insert(received.end(), buffer, buffer + readBytes);
+
+		// Commands are framed the same way as the data, 0xFF, command, total length.
+		while (received.size() >= USB_PACKET_HEADER_LENGTH)
+		{
+			auto length = received[USB_PACKET_LENGTH_BYTE_INDEX];
+			if (received[0] != USB_PACKET_START_BYTE || length < USB_PACKET_HEADER_LENGTH)
+			{
+				received.erase(received.begin());
+				continue;
+			}
+
+			if (received.size() < length)
+				break;
+
+			std::vector<uint8_t> command(received.begin(), received.begin() + length);
+			received.erase(received.begin(), received.begin() + length);
+			handleCommand(command);
+		}
+	}
+}
+
+// Every command is acknowledged by sending it back with HW_NO_ERROR in place of the command byte.
+static void handleCommand(std::vector<uint8_t>& command)
+{
+	switch (command[USB_PACKET_COMMAND_BYTE_INDEX])
+	{
+	case SHM_SYNC_TIMESTAMP:
+		if (command.size() >= USB_PACKET_HEADER_LENGTH + 4)
+		{
+			std::lock_guard<std::mutex> guard(syncLock);
+			syncTimestamp = command[3] | (command[4] << 8) | (command[5] << 16) | (static_cast<uint32_t>(command[6]) << 24);
+			syncTime = std::chrono::steady_clock::now();
+		}
+		break;
+	case BM_START_SIMPLICITI:
+		streaming = true;
+		break;
+	case BM_STOP_SIMPLICITI:
+		streaming = false;
+		break;
+	default:
+		break;
+	}
+
+	command[USB_PACKET_COMMAND_BYTE_INDEX] = HW_NO_ERROR;
+
+	// Writes hold the lock, so the acknowledgement never lands inside a packet, except a split one.
+	writeToMaster(command.data(), command.size());
+}
+
+// Watches send at even intervals, each one shifted by a fraction of the interval so they would not all
+// send at the same moment.
+static void streamPackets()
+{
+	std::mt19937 random(12345);
+	std::vector<uint8_t> packet;
+	packet.reserve(255);
+
+	auto interval = std::chrono::duration_cast<std::chrono::steady_clock::duration>(std::chrono::duration<double>(1.0 / packetRate));
+	std::vector<std::chrono::steady_clock::time_point> nextSend(watchCount);
+	std::vector<uint32_t> sequences(watchCount, 0);
+	auto wasStreaming = false;
+
+	while (!stopRequested)
+	{
+		if (!streaming)
+		{
+			wasStreaming = false;
+			std::this_thread::sleep_for(std::chrono::milliseconds(1));
+			continue;
+		}
+
+		auto now = std::chrono::steady_clock::now();
+
+		if (!wasStreaming)
+		{
+			for (size_t i = 0; i < watchCount; i++)
+				nextSend[i] = now + interval * i / watchCount;
+
+			wasStreaming = true;
+		}
+
+		for (size_t i = 0; i < watchCount && streaming; i++)
+		{
+			while (nextSend[i] <= now && streaming)
+			{
+				buildPacket(i, sequences[i]++, packet);
+				writePacket(packet, random);
+				nextSend[i] += interval;
+			}
+		}
+
+		auto earliest = *std::min_element(nextSend.begin(), nextSend.end());
+		std::this_thread::sleep_until(std::min(earliest, now + std::chrono::milliseconds(10)));
+	}
+}
+
+static void buildPacket(size_t watch, uint32_t sequence, std::vector<uint8_t>& packet)
+{
+	uint32_t timestamp;
+	uint16_t milliseconds;
+	{
+		std::lock_guard<std::mutex> guard(syncLock);
+		auto elapsed = std::chrono::duration_cast<std::chrono::milliseconds>(std::chrono::steady_clock::now() - syncTime).count();
+		timestamp = syncTimestamp + static_cast<uint32_t>(elapsed / 1000);
+		milliseconds = static_cast<uint16_t>(elapsed % 1000);
+	}
+
+	packet.clear();
+	packet.push_back(USB_PACKET_START_BYTE);
+	packet.push_back(HW_NO_ERROR);
+	packet.push_back(static_cast<uint8_t>(USB_PACKET_HEADER_LENGTH + packetHeaderLength + payloadLength));
+	packet.push_back(static_cast<uint8_t>(watch + 1));
+	for (int i = 0; i < 4; i++)
+		packet.push_back(static_cast<uint8_t>(timestamp >> (8 * i)));
+	packet.push_back(static_cast<uint8_t>(milliseconds & 0xFF));
+	packet.push_back(static_cast<uint8_t>(milliseconds >> 8));
+
+	// Sequence number first so lost packets can be told from the log, the rest is filler.
+	for (size_t i = 0; i < payloadLength; i++)
+		packet.push_back(i < 4 ? static_cast<uint8_t>(sequence >> (8 * i)) : static_cast<uint8_t>(i));
+}
+
+static void writePacket(std::vector<uint8_t>& packet, std::mt19937& random)
+{
+	if (faultRate == 0 || random() % 1000 >= faultRate)
+	{
+		writeToMaster(packet.data(), packet.size());
+		packetsSent++;
+		return;
+	}
+
+	switch (random() % 3)
+	{
+	case 0:
+	{
+		// Some bytes lost on the way, anywhere in the packet including the header.
+		auto position = random() % packet.size();
+		auto count = std::min<size_t>(1 + random() % 5, packet.size() - position);
+		packet.erase(packet.begin() + position, packet.begin() + position + count);
+		droppedByteFaults++;
+		writeToMaster(packet.data(), packet.size());
+		break;
+	}
+	case 1:
+	{
+		// Noise in front of the packet, with the header bytes overrepresented to cause false matches.
+		std::vector<uint8_t> garbage(1 + random() % 20);
+		for (auto& aByte : garbage)
+		{
+			auto choice = random() % 4;
+			aByte = (choice == 0 ? USB_PACKET_START_BYTE : (choice == 1 ? HW_NO_ERROR : static_cast<uint8_t>(random())));
+		}
+
+		garbageFaults++;
+		writeToMaster(garbage.data(), garbage.size());
+		writeToMaster(packet.data(), packet.size());
+		break;
+	}
+	default:
+	{
+		// Intact packet arriving in pieces, so the reader sees it over several reads.
+		size_t written = 0;
+		while (written < packet.size())
+		{
+			auto piece = std::min<size_t>(1 + random() % 8, packet.size() - written);
+			writeToMaster(packet.data() + written, piece);
+			written += piece;
+			std::this_thread::sleep_for(std::chrono::microseconds(500));
+		}
+
+		splitFaults++;
+		break;
+	}
+	}
+
+	packetsSent++;
+}
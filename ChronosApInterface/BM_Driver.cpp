@@ -28,6 +28,8 @@
 // Generic RS232 functions based on DS2480 reference code. 
 // Original filename was "Win32Lnk.C", http://www.koders.com/c/fidDAEC3C64150B7DD361249A5869EC63954A2A6EAA.aspx
 // *************************************************************************************************
+#ifdef _WIN32
+
 #include <tchar.h>
 #include <stdlib.h>
 
@@ -44,15 +46,12 @@
 #endif
 
 // exportable functions 
-bool OpenCOM(int, char *);
+bool OpenCOM(int, char *, DWORD);
 void CloseCOM(int);
 void FlushCOM(int);
 int  WriteCOM(int, int, UCHAR *);
 int  ReadCOM(int, int, UCHAR *);
 
-// defines
-#define MAX_PORTNUM 1
-
 // Win32 globals needed
 HANDLE ComID[MAX_PORTNUM];
 OVERLAPPED osRead[MAX_PORTNUM],osWrite[MAX_PORTNUM];   
@@ -60,7 +59,7 @@ OVERLAPPED osRead[MAX_PORTNUM],osWrite[MAX_PORTNUM];
 
 //---------------------------------------------------------------------------
 // Attempt to open a com port.  Keep the handle in ComID.
-// Set the starting baud rate to 115200.
+// Set the starting baud rate to 'baudrate', 115200 by default.
 //
 // 'portnum'   - number 0 to MAX_PORTNUM-1.  This number provided will 
 //               be used to indicate the port number desired when calling
@@ -69,11 +68,12 @@ OVERLAPPED osRead[MAX_PORTNUM],osWrite[MAX_PORTNUM];
 // 'port_zstr' - zero terminate port name.  For this platform
 //               use format COMX where X is the port number.
 //
+// 'baudrate'  - one of the CBR_* values or any other rate the port supports.
 //
 // Returns: TRUE(1)  - success, COM port opened
 //          FALSE(0) - failure, could not open specified port
 //
-bool OpenCOM(int portnum, char *port_zstr)
+bool OpenCOM(int portnum, char *port_zstr, DWORD baudrate)
 {
    char tempstr[80];
    short fRetVal;
@@ -119,7 +119,7 @@ bool OpenCOM(int portnum, char *port_zstr)
       // setup the com port
       GetCommState(ComID[portnum], &dcb);
 
-	  dcb.BaudRate = CBR_115200;             // current baud rate 
+	  dcb.BaudRate = baudrate;               // current baud rate 
       dcb.fBinary = TRUE;                    // binary mode, no EOF check 
       dcb.fParity = FALSE;                   // enable parity checking 
       dcb.fOutxCtsFlow = FALSE;              // CTS output flow control 
@@ -293,3 +293,4 @@ int ReadCOM(int portnum, int inlen, UCHAR *inbuf)
       return 0;
 }
 
+#endif
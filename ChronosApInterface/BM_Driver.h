@@ -25,7 +25,10 @@
 //---------------------------------------------------------------------------
 #include <windows.h>
 
-bool OpenCOM(int, char *);
+// Number of COM ports that can be open at the same time.
+#define MAX_PORTNUM 8
+
+bool OpenCOM(int, char *, DWORD baudrate = CBR_115200);
 void CloseCOM(int);
 void FlushCOM(int);
 int  WriteCOM(int, int, UCHAR *);
@@ -0,0 +1,87 @@
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+
+// Binary capture file layout. Structures are written as they are in memory, little endian, every one of
+// them and every record starts at an 8 byte boundary so a mapped file can be read in place.
+//
+//   CaptureFileHeader
+//   block: CaptureBlockHeader, then recordCount times CaptureRecordHeader [+ int64 device time] + payload padded to 8 bytes
+//   ... more blocks ...
+//   CaptureIndexEntry for every block
+//   CaptureFileTrailer
+//
+// Index and trailer are written when the capture is closed. Without them (the capture was cut short)
+// the blocks can still be found by walking them from the start of the file.
+
+const char captureFileMagic[8] = {'S', 'H', 'M', 'C', 'A', 'P', '0', '1'};
+// Version 2 added captureRecordDeviceTimeFollows, version 1 files are read as well.
+const uint32_t captureFileVersion = 2;
+const uint32_t captureFileOldestVersion = 1;
+const uint32_t captureBlockMagic = 0x4B4C4253;		// "SBLK"
+const uint32_t captureTrailerMagic = 0x58444953;	// "SIDX"
+
+// Frame was too short for the packet header, payload holds the whole raw frame instead.
+const uint8_t captureRecordShortFrame = 0x01;
+// Device time is too far from the host time for deviceTimeOffsetMs (more than 24 days, a watch that was never
+// set), it follows the header as int64 milliseconds since the epoch instead and the offset is zero.
+const uint8_t captureRecordDeviceTimeFollows = 0x02;
+
+struct CaptureFileHeader
+{
+	char magic[8];
+	uint32_t version;
+	uint32_t accessPointCount;
+	int64_t startTimeNs;		// Host time when the capture was started, nanoseconds since the epoch.
+};
+
+struct CaptureBlockHeader
+{
+	uint32_t magic;
+	uint32_t recordCount;
+	uint32_t dataLength;		// Bytes of records following this header.
+	uint32_t reserved;
+	int64_t firstTimeNs;		// Receive time range of the records in the block.
+	int64_t lastTimeNs;
+};
+
+struct CaptureRecordHeader
+{
+	int64_t hostTimeNs;			// Host receive time, nanoseconds since the epoch.
+	uint32_t deviceTimestamp;
+	uint16_t accessPointId;
+	uint16_t milliseconds;
+	uint8_t link;
+	uint8_t payloadLength;
+	uint8_t flags;
+	uint8_t reserved;
+	int32_t deviceTimeOffsetMs;	// Device time corrected for drift, from the host time in whole milliseconds. Zero for short frames.
+};
+
+struct CaptureIndexEntry
+{
+	int64_t firstTimeNs;
+	int64_t lastTimeNs;
+	uint64_t offset;			// File offset of the block header.
+	uint32_t recordCount;
+	uint32_t reserved;
+};
+
+struct CaptureFileTrailer
+{
+	uint64_t indexOffset;
+	uint32_t blockCount;
+	uint32_t magic;
+};
+
+static_assert(sizeof(CaptureFileHeader) == 24, "Capture file header layout changed.");
+static_assert(sizeof(CaptureBlockHeader) == 32, "Capture block header layout changed.");
+static_assert(sizeof(CaptureRecordHeader) == 24, "Capture record header layout changed.");
+static_assert(sizeof(CaptureIndexEntry) == 32, "Capture index entry layout changed.");
+static_assert(sizeof(CaptureFileTrailer) == 16, "Capture file trailer layout changed.");
+
+inline size_t capturePaddedLength(size_t length)
+{
+	return (length + 7) & ~static_cast<size_t>(7);
+}
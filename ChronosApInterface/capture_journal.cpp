@@ -0,0 +1,471 @@
+#include "capture_journal.h"
+
+#include <algorithm>
+#include <cstring>
+#include <fstream>
+#include <stdexcept>
+
+#ifdef _WIN32
+#include <Windows.h>
+#else
+#include <cerrno>
+#include <fcntl.h>
+#include <unistd.h>
+#endif
+
+#include "capture_writer.h"
+
+namespace
+{
+	const std::chrono::milliseconds idleWait(1);
+
+	std::array<uint32_t, 256> makeCrcTable()
+	{
+		// CRC-32C (Castagnoli), reflected.
+		std::array<uint32_t, 256> table;
+		for (uint32_t i = 0; i < 256; i++)
+		{
+			auto crc = i;
+			for (int bit = 0; bit < 8; bit++)
+				crc = (crc & 1) ? (crc >> 1) ^ 0x82F63B78 : crc >> 1;
+			table[i] = crc;
+		}
+
+		return table;
+	}
+
+	const std::array<uint32_t, 256> crcTable = makeCrcTable();
+
+	uint32_t updateCrc(uint32_t crc, const uint8_t* data, size_t length)
+	{
+		for (size_t i = 0; i < length; i++)
+			crc = crcTable[(crc ^ data[i]) & 0xFF] ^ (crc >> 8);
+
+		return crc;
+	}
+
+	// Covers the header after the checksum field and the frame.
+	uint32_t recordChecksum(const JournalRecordHeader& header, const uint8_t* frame)
+	{
+		auto fields = reinterpret_cast<const uint8_t*>(&header) + sizeof(header.checksum);
+		auto crc = updateCrc(0xFFFFFFFF, fields, sizeof(header) - sizeof(header.checksum));
+		return ~updateCrc(crc, frame, header.length);
+	}
+}
+
+JournalReader::JournalReader(const std::string& path) : m_file(path), m_offset(0)
+{
+	// Crashed before the header was complete, nothing was ever written to it.
+	if (m_file.size() < sizeof(JournalFileHeader))
+		return;
+
+	auto fileHeader = reinterpret_cast<const JournalFileHeader*>(m_file.data());
+	if (std::memcmp(fileHeader->magic, journalFileMagic, sizeof(journalFileMagic)) != 0 || fileHeader->version != journalFileVersion)
+		throw std::runtime_error(path + " is not a supported capture journal.");
+
+	m_offset = sizeof(JournalFileHeader);
+}
+
+bool JournalReader::next(Record& record)
+{
+	if (m_offset == 0 || m_offset + sizeof(JournalRecordHeader) > m_file.size())
+		return false;
+
+	// Records are not aligned.
+	JournalRecordHeader header;
+	std::memcpy(&header, m_file.data() + m_offset, sizeof(header));
+
+	auto frame = m_file.data() + m_offset + sizeof(header);
+	if (m_offset + sizeof(header) + header.length > m_file.size() || recordChecksum(header, frame) != header.checksum)
+		return false;
+
+	record.accessPointId = header.accessPointId;
+	record.receiveTime = fromCaptureTime(header.receiveTimeNs);
+	record.deviceTime = fromCaptureTime(header.deviceTimeNs);
+	record.data = frame;
+	record.length = header.length;
+
+	m_offset += sizeof(header) + header.length;
+
+	return true;
+}
+
+CaptureJournal::CaptureJournal(const std::string& path, Durability durability, std::chrono::milliseconds syncInterval, size_t syncSize, size_t queueSize) :
+	m_durability(durability),
+	m_syncInterval(syncInterval),
+	m_syncSize(syncSize),
+#ifdef _WIN32
+	m_fileHandle(INVALID_HANDLE_VALUE),
+#else
+	m_fileDescriptor(-1),
+#endif
+	m_queue(queueSize),
+	m_fileLength(0),
+	m_unsyncedBytes(0),
+	m_stopWriting(false),
+	m_running(false),
+	m_recoveredRecords(0),
+	m_truncatedBytes(0),
+	m_recordsWritten(0),
+	m_bytesWritten(0),
+	m_syncs(0),
+	m_writeErrors(0),
+	m_producerStalls(0)
+{
+	// A full queue of the largest records fits without the buffer growing.
+	m_buffer.reserve(queueSize * (sizeof(JournalRecordHeader) + 255));
+	m_bufferedReceiveTimes.reserve(queueSize);
+	m_unsyncedReceiveTimes.reserve(queueSize);
+
+	open(path);
+}
+
+void CaptureJournal::recover(const std::string& path)
+{
+	if (!std::ifstream(path, std::ios::binary).is_open())
+		return;
+
+	JournalReader reader(path);
+	JournalReader::Record record;
+	while (reader.next(record))
+		m_recoveredRecords++;
+
+	m_truncatedBytes = reader.fileLength() - reader.validLength();
+}
+
+#ifdef _WIN32
+
+void CaptureJournal::open(const std::string& path)
+{
+	// The reader is gone by the time the file is cut, Windows does not cut a mapped file.
+	recover(path);
+
+	m_fileHandle = CreateFileA(path.c_str(), GENERIC_WRITE, FILE_SHARE_READ, nullptr, OPEN_ALWAYS, FILE_ATTRIBUTE_NORMAL, nullptr);
+	if (m_fileHandle == INVALID_HANDLE_VALUE)
+		throw std::runtime_error("Could not open the journal " + path + ".");
+
+	LARGE_INTEGER fileSize;
+	GetFileSizeEx(m_fileHandle, &fileSize);
+
+	LARGE_INTEGER validLength;
+	validLength.QuadPart = fileSize.QuadPart - static_cast<LONGLONG>(m_truncatedBytes);
+	if (!SetFilePointerEx(m_fileHandle, validLength, nullptr, FILE_BEGIN) || !SetEndOfFile(m_fileHandle))
+	{
+		CloseHandle(m_fileHandle);
+		throw std::runtime_error("Could not cut the torn end off the journal " + path + ".");
+	}
+
+	auto written = true;
+	if (validLength.QuadPart == 0)
+	{
+		JournalFileHeader fileHeader = {};
+		std::memcpy(fileHeader.magic, journalFileMagic, sizeof(fileHeader.magic));
+		fileHeader.version = journalFileVersion;
+
+		DWORD headerWritten = 0;
+		written = (WriteFile(m_fileHandle, &fileHeader, sizeof(fileHeader), &headerWritten, nullptr) && headerWritten == sizeof(fileHeader));
+		validLength.QuadPart = sizeof(fileHeader);
+	}
+
+	if (!written || !FlushFileBuffers(m_fileHandle))
+	{
+		CloseHandle(m_fileHandle);
+		throw std::runtime_error("Could not write the journal " + path + ".");
+	}
+
+	m_fileLength = static_cast<uint64_t>(validLength.QuadPart);
+}
+
+void CaptureJournal::writeBuffer()
+{
+	if (m_buffer.empty())
+		return;
+
+	DWORD written = 0;
+	auto complete = (WriteFile(m_fileHandle, m_buffer.data(), static_cast<DWORD>(m_buffer.size()), &written, nullptr) && written == m_buffer.size());
+	if (!complete)
+	{
+		// A partial record would hide every record after it from the recovery.
+		LARGE_INTEGER fileLength;
+		fileLength.QuadPart = static_cast<LONGLONG>(m_fileLength);
+		SetFilePointerEx(m_fileHandle, fileLength, nullptr, FILE_BEGIN);
+		SetEndOfFile(m_fileHandle);
+	}
+
+	finishWrite(complete);
+}
+
+void CaptureJournal::sync()
+{
+	if (m_unsyncedBytes > 0 && FlushFileBuffers(m_fileHandle))
+		m_syncs++;
+	else if (m_unsyncedBytes > 0)
+		syncFailed();
+
+	recordDurable();
+}
+
+CaptureJournal::~CaptureJournal()
+{
+	stop();
+	CloseHandle(m_fileHandle);
+}
+
+#else
+
+void CaptureJournal::open(const std::string& path)
+{
+	auto created = !std::ifstream(path, std::ios::binary).is_open();
+	recover(path);
+
+	m_fileDescriptor = ::open(path.c_str(), O_WRONLY | O_CREAT | O_CLOEXEC, 0644);
+	if (m_fileDescriptor < 0)
+		throw std::runtime_error("Could not open the journal " + path + ".");
+
+	auto validLength = lseek(m_fileDescriptor, 0, SEEK_END) - static_cast<off_t>(m_truncatedBytes);
+	if (ftruncate(m_fileDescriptor, validLength) != 0 || lseek(m_fileDescriptor, validLength, SEEK_SET) != validLength)
+	{
+		close(m_fileDescriptor);
+		throw std::runtime_error("Could not cut the torn end off the journal " + path + ".");
+	}
+
+	auto written = true;
+	if (validLength == 0)
+	{
+		JournalFileHeader fileHeader = {};
+		std::memcpy(fileHeader.magic, journalFileMagic, sizeof(fileHeader.magic));
+		fileHeader.version = journalFileVersion;
+		written = (write(m_fileDescriptor, &fileHeader, sizeof(fileHeader)) == sizeof(fileHeader));
+		validLength = sizeof(fileHeader);
+	}
+
+	if (!written || fdatasync(m_fileDescriptor) != 0)
+	{
+		close(m_fileDescriptor);
+		throw std::runtime_error("Could not write the journal " + path + ".");
+	}
+
+	// A new file is only there after a power loss once its directory entry is on the disk as well.
+	if (created)
+	{
+		auto slash = path.find_last_of('/');
+		auto directory = (slash == std::string::npos ? std::string(".") : path.substr(0, slash + 1));
+		auto directoryDescriptor = ::open(directory.c_str(), O_RDONLY | O_DIRECTORY | O_CLOEXEC);
+		if (directoryDescriptor >= 0)
+		{
+			fsync(directoryDescriptor);
+			close(directoryDescriptor);
+		}
+	}
+
+	m_fileLength = static_cast<uint64_t>(validLength);
+}
+
+void CaptureJournal::writeBuffer()
+{
+	if (m_buffer.empty())
+		return;
+
+	size_t offset = 0;
+	while (offset < m_buffer.size())
+	{
+		auto written = write(m_fileDescriptor, m_buffer.data() + offset, m_buffer.size() - offset);
+		if (written < 0 && errno == EINTR)
+			continue;
+		if (written <= 0)
+			break;
+
+		offset += static_cast<size_t>(written);
+	}
+
+	auto complete = (offset == m_buffer.size());
+	if (!complete)
+	{
+		// A partial record would hide every record after it from the recovery.
+		auto fileLength = static_cast<off_t>(m_fileLength);
+		if (ftruncate(m_fileDescriptor, fileLength) != 0)
+			fileLength = lseek(m_fileDescriptor, 0, SEEK_END);
+		lseek(m_fileDescriptor, fileLength, SEEK_SET);
+	}
+
+	finishWrite(complete);
+}
+
+void CaptureJournal::sync()
+{
+	// Only the data matters, the size change comes along with it.
+	if (m_unsyncedBytes > 0 && fdatasync(m_fileDescriptor) == 0)
+		m_syncs++;
+	else if (m_unsyncedBytes > 0)
+		syncFailed();
+
+	recordDurable();
+}
+
+CaptureJournal::~CaptureJournal()
+{
+	stop();
+	close(m_fileDescriptor);
+}
+
+#endif
+
+void CaptureJournal::start()
+{
+	if (m_running)
+		return;
+
+	m_running = true;
+	m_stopWriting = false;
+	m_lastSync = std::chrono::steady_clock::now();
+	m_writeTask = std::thread([this]{ run(); });
+}
+
+void CaptureJournal::stop()
+{
+	if (!m_running)
+		return;
+
+	m_stopWriting = true;
+	if (m_writeTask.joinable())
+		m_writeTask.join();
+
+	m_running = false;
+}
+
+void CaptureJournal::push(size_t accessPointId, std::chrono::system_clock::time_point receiveTime, std::chrono::system_clock::time_point deviceTime,
+	const uint8_t* data, size_t length)
+{
+	auto regions = m_queue.writableRegions();
+
+	if (regions.total() == 0)
+	{
+		m_producerStalls++;
+
+		do
+		{
+			std::this_thread::sleep_for(idleWait);
+			regions = m_queue.writableRegions();
+		}
+		while (regions.total() == 0);
+	}
+
+	auto& record = *regions.data[0];
+	record.accessPointId = accessPointId;
+	record.receiveTime = receiveTime;
+	record.deviceTime = deviceTime;
+	record.length = static_cast<uint8_t>(std::min(length, record.data.size()));
+	std::copy(data, data + record.length, record.data.begin());
+
+	m_queue.commitWrite(1);
+}
+
+void CaptureJournal::run()
+{
+	while (!m_stopWriting)
+	{
+		auto encoded = encodeQueued();
+		writeBuffer();
+
+		if (m_durability == Durability::buffered)
+			recordDurable();
+		else if (syncDue())
+			sync();
+
+		if (encoded == 0)
+			std::this_thread::sleep_for(idleWait);
+	}
+
+	encodeQueued();
+	writeBuffer();
+	sync();
+}
+
+size_t CaptureJournal::encodeQueued()
+{
+	size_t encoded = 0;
+
+	while (!m_queue.empty())
+	{
+		auto& record = m_queue.front();
+
+		JournalRecordHeader header = {};
+		header.length = record.length;
+		header.accessPointId = static_cast<uint16_t>(record.accessPointId);
+		header.receiveTimeNs = toCaptureTime(record.receiveTime);
+		header.deviceTimeNs = toCaptureTime(record.deviceTime);
+		header.checksum = recordChecksum(header, record.data.data());
+
+		auto recordStart = m_buffer.size();
+		m_buffer.resize(recordStart + sizeof(header) + record.length);
+		std::memcpy(&m_buffer[recordStart], &header, sizeof(header));
+		std::copy(record.data.begin(), record.data.begin() + record.length, m_buffer.begin() + recordStart + sizeof(header));
+
+		m_bufferedReceiveTimes.push_back(record.receiveTime);
+		m_queue.consume(1);
+		encoded++;
+
+		if (m_durability == Durability::everyPacket)
+		{
+			writeBuffer();
+			sync();
+		}
+	}
+
+	return encoded;
+}
+
+void CaptureJournal::finishWrite(bool complete)
+{
+	if (complete)
+	{
+		m_fileLength += m_buffer.size();
+		m_bytesWritten += m_buffer.size();
+		m_unsyncedBytes += m_buffer.size();
+		m_recordsWritten += m_bufferedReceiveTimes.size();
+		m_unsyncedReceiveTimes.insert(m_unsyncedReceiveTimes.end(), m_bufferedReceiveTimes.begin(), m_bufferedReceiveTimes.end());
+	}
+	else
+	{
+		m_writeErrors++;
+	}
+
+	// Records of a failed write are gone, they never become durable.
+	m_bufferedReceiveTimes.clear();
+	m_buffer.clear();
+}
+
+void CaptureJournal::syncFailed()
+{
+	// Nothing is known about what made it to the disk, none of it counts as durable.
+	m_writeErrors++;
+	m_unsyncedReceiveTimes.clear();
+}
+
+bool CaptureJournal::syncDue() const
+{
+	if (m_unsyncedBytes == 0)
+		return false;
+
+	return m_unsyncedBytes >= m_syncSize || std::chrono::steady_clock::now() - m_lastSync >= m_syncInterval;
+}
+
+void CaptureJournal::recordDurable()
+{
+	m_unsyncedBytes = 0;
+	m_lastSync = std::chrono::steady_clock::now();
+
+	auto durableTime = std::chrono::system_clock::now();
+	for (auto& receiveTime : m_unsyncedReceiveTimes)
+		m_durableLatency.record(durableTime - receiveTime);
+	m_unsyncedReceiveTimes.clear();
+}
+
+bool isJournalFile(const std::string& path)
+{
+	std::ifstream file(path, std::ios::binary);
+	char magic[sizeof(journalFileMagic)] = {};
+	file.read(magic, sizeof(magic));
+
+	return file.gcount() == sizeof(magic) && std::memcmp(magic, journalFileMagic, sizeof(magic)) == 0;
+}
@@ -0,0 +1,183 @@
+#pragma once
+
+#include <array>
+#include <atomic>
+#include <chrono>
+#include <cstdint>
+#include <string>
+#include <thread>
+#include <vector>
+
+#include "mapped_file.h"
+#include "metrics.h"
+#include "ring_buffer.h"
+
+// Write-ahead journal of the captured packets, kept next to the log so a crash or a power loss does not take
+// the packets the log still had buffered with it. Little endian, records follow each other without padding:
+//
+//   JournalFileHeader
+//   JournalRecordHeader + frame, for every packet
+//
+// Every record carries the CRC-32C of everything after the checksum field, a record cut short by the crash
+// or left as garbage by the file system fails it. Whatever follows the first such record is not trusted.
+
+const char journalFileMagic[8] = {'S', 'H', 'M', 'J', 'R', 'N', '0', '1'};
+const uint32_t journalFileVersion = 1;
+
+struct JournalFileHeader
+{
+	char magic[8];
+	uint32_t version;
+	uint32_t reserved;
+};
+
+struct JournalRecordHeader
+{
+	uint32_t checksum;
+	uint16_t length;			// Frame bytes following the header.
+	uint16_t accessPointId;
+	int64_t receiveTimeNs;		// Host receive time, nanoseconds since the epoch.
+	int64_t deviceTimeNs;		// Device time corrected for drift.
+};
+
+static_assert(sizeof(JournalFileHeader) == 16, "Journal file header layout changed.");
+static_assert(sizeof(JournalRecordHeader) == 24, "Journal record header layout changed.");
+
+// Reads the intact records of a journal through a memory mapping, in the order they were written.
+class JournalReader
+{
+public:
+	struct Record
+	{
+		uint16_t accessPointId;
+		std::chrono::system_clock::time_point receiveTime;
+		std::chrono::system_clock::time_point deviceTime;
+		const uint8_t* data;		// Into the mapping.
+		size_t length;
+	};
+
+	// Throws when the file is not a journal. A file shorter than the header has no records.
+	explicit JournalReader(const std::string& path);
+
+	// False at the end of the file or at the first record that is torn.
+	bool next(Record& record);
+
+	// Where the records read so far end, the rest of the file is torn once next() returned false.
+	uint64_t validLength() const { return m_offset; }
+	uint64_t fileLength() const { return m_file.size(); }
+
+private:
+	JournalReader(const JournalReader&);
+	JournalReader& operator=(const JournalReader&);
+
+	MappedFile m_file;
+	uint64_t m_offset;
+};
+
+// Appends the packets to the journal on a thread of its own, like LogWriter does with the text. Records are
+// encoded into a buffer and handed to the operating system on every pass, whether they also go to the disk
+// right away is up to the durability: waiting for the disk is what limits the packet rate, so syncs are
+// grouped, one covers all records written since the one before.
+class CaptureJournal
+{
+public:
+	enum class Durability
+	{
+		// Never synced while capturing. Survives the process dying, a power loss takes what the system had cached.
+		buffered,
+		// Synced once the sync interval has passed or the sync size was written since the last sync, whichever
+		// comes first. A power loss takes at most that much.
+		grouped,
+		// Synced after every record.
+		everyPacket,
+	};
+
+	struct Record
+	{
+		size_t accessPointId;
+		std::chrono::system_clock::time_point receiveTime;
+		std::chrono::system_clock::time_point deviceTime;
+		uint8_t length;
+		std::array<uint8_t, 255> data;
+	};
+
+	// An existing journal is recovered first: the torn tail is cut off and new records go after the intact
+	// ones. Throws when the file can not be opened or is not a journal.
+	CaptureJournal(const std::string& path, Durability durability = Durability::grouped,
+		std::chrono::milliseconds syncInterval = std::chrono::milliseconds(50), size_t syncSize = 1024 * 1024, size_t queueSize = 4096);
+	~CaptureJournal();
+
+	void start();
+	// Writes out and syncs everything queued so far, whatever the durability, and stops the thread.
+	void stop();
+
+	// Single producer only. Waits when the queue is full, nothing is dropped.
+	void push(size_t accessPointId, std::chrono::system_clock::time_point receiveTime, std::chrono::system_clock::time_point deviceTime,
+		const uint8_t* data, size_t length);
+
+	// Intact records found in the file when it was opened, and the bytes after them that were cut off.
+	uint64_t recoveredRecords() const { return m_recoveredRecords; }
+	uint64_t truncatedBytes() const { return m_truncatedBytes; }
+
+	size_t recordsWritten() const { return m_recordsWritten; }
+	size_t bytesWritten() const { return m_bytesWritten; }
+	size_t syncs() const { return m_syncs; }
+	// Writes or syncs that failed. The records of a failed write are lost, the file is cut back to the record before them.
+	// Neither those nor the ones a failed sync was for are counted in the durable latency.
+	size_t writeErrors() const { return m_writeErrors; }
+	size_t producerStalls() const { return m_producerStalls; }
+	// From the receive time of a record to it being synced, or written when the durability is buffered.
+	LatencyHistogram::Snapshot durableLatency() const { return m_durableLatency.snapshot(); }
+
+private:
+	CaptureJournal(const CaptureJournal&);
+	CaptureJournal& operator=(const CaptureJournal&);
+
+	void recover(const std::string& path);
+	void open(const std::string& path);
+	void run();
+	size_t encodeQueued();
+	void writeBuffer();
+	// Counts the buffer in once it was written whole, or drops its records.
+	void finishWrite(bool complete);
+	bool syncDue() const;
+	void sync();
+	void syncFailed();
+	void recordDurable();
+
+	Durability m_durability;
+	std::chrono::milliseconds m_syncInterval;
+	size_t m_syncSize;
+
+#ifdef _WIN32
+	void* m_fileHandle;
+#else
+	int m_fileDescriptor;
+#endif
+
+	RingBuffer<Record> m_queue;
+	std::vector<uint8_t> m_buffer;
+	uint64_t m_fileLength;		// Up to the end of the last record written whole.
+	// Encoded into the buffer but not written yet.
+	std::vector<std::chrono::system_clock::time_point> m_bufferedReceiveTimes;
+	// Written but not synced yet.
+	size_t m_unsyncedBytes;
+	std::vector<std::chrono::system_clock::time_point> m_unsyncedReceiveTimes;
+	std::chrono::steady_clock::time_point m_lastSync;
+
+	std::thread m_writeTask;
+	std::atomic<bool> m_stopWriting;
+	bool m_running;
+
+	uint64_t m_recoveredRecords;
+	uint64_t m_truncatedBytes;
+	std::atomic<size_t> m_recordsWritten;
+	std::atomic<size_t> m_bytesWritten;
+	std::atomic<size_t> m_syncs;
+	std::atomic<size_t> m_writeErrors;
+	std::atomic<size_t> m_producerStalls;
+	LatencyHistogram m_durableLatency;
+};
+
+// True when the file starts like a journal.
+bool isJournalFile(const std::string& path);
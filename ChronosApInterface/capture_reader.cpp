@@ -0,0 +1,117 @@
+#include "capture_reader.h"
+
+#include <cstring>
+#include <stdexcept>
+
+CaptureReader::CaptureReader(const std::string& path) : m_file(path), m_fileHeader(nullptr), m_hasIndex(false)
+{
+	if (m_file.size() < sizeof(CaptureFileHeader))
+		throw std::runtime_error(path + " is too short to be a capture file.");
+
+	m_fileHeader = reinterpret_cast<const CaptureFileHeader*>(m_file.data());
+	if (std::memcmp(m_fileHeader->magic, captureFileMagic, sizeof(captureFileMagic)) != 0 ||
+		m_fileHeader->version < captureFileOldestVersion || m_fileHeader->version > captureFileVersion)
+		throw std::runtime_error(path + " is not a supported capture file.");
+
+	m_hasIndex = readIndex();
+	if (!m_hasIndex)
+		rebuildIndex();
+}
+
+bool CaptureReader::readIndex()
+{
+	if (m_file.size() < sizeof(CaptureFileHeader) + sizeof(CaptureFileTrailer))
+		return false;
+
+	auto trailer = reinterpret_cast<const CaptureFileTrailer*>(m_file.data() + m_file.size() - sizeof(CaptureFileTrailer));
+	if (trailer->magic != captureTrailerMagic)
+		return false;
+
+	auto indexLength = static_cast<uint64_t>(trailer->blockCount) * sizeof(CaptureIndexEntry);
+	if (trailer->indexOffset + indexLength + sizeof(CaptureFileTrailer) != m_file.size())
+		return false;
+
+	auto entries = reinterpret_cast<const CaptureIndexEntry*>(m_file.data() + trailer->indexOffset);
+	m_index.assign(entries, entries + trailer->blockCount);
+
+	return true;
+}
+
+void CaptureReader::rebuildIndex()
+{
+	uint64_t offset = sizeof(CaptureFileHeader);
+
+	while (offset + sizeof(CaptureBlockHeader) <= m_file.size())
+	{
+		auto blockHeader = reinterpret_cast<const CaptureBlockHeader*>(m_file.data() + offset);
+		if (blockHeader->magic != captureBlockMagic || offset + sizeof(CaptureBlockHeader) + blockHeader->dataLength > m_file.size())
+			break;
+
+		CaptureIndexEntry entry = {};
+		entry.firstTimeNs = blockHeader->firstTimeNs;
+		entry.lastTimeNs = blockHeader->lastTimeNs;
+		entry.offset = offset;
+		entry.recordCount = blockHeader->recordCount;
+		m_index.push_back(entry);
+
+		offset += sizeof(CaptureBlockHeader) + blockHeader->dataLength;
+	}
+}
+
+CaptureReader::Cursor CaptureReader::records(int64_t fromNs, int64_t toNs) const
+{
+	return Cursor(*this, fromNs, toNs);
+}
+
+CaptureReader::Cursor::Cursor(const CaptureReader& reader, int64_t fromNs, int64_t toNs) :
+	m_reader(reader),
+	m_fromNs(fromNs),
+	m_toNs(toNs),
+	m_blockIndex(0),
+	m_position(nullptr),
+	m_recordsLeft(0)
+{
+}
+
+bool CaptureReader::Cursor::next(Record& record)
+{
+	auto& index = m_reader.m_index;
+
+	for (;;)
+	{
+		while (m_recordsLeft == 0)
+		{
+			// Blocks entirely outside the range are not even touched.
+			while (m_blockIndex < index.size() && (index[m_blockIndex].lastTimeNs < m_fromNs || index[m_blockIndex].firstTimeNs > m_toNs))
+				m_blockIndex++;
+
+			if (m_blockIndex >= index.size())
+				return false;
+
+			m_position = m_reader.m_file.data() + index[m_blockIndex].offset + sizeof(CaptureBlockHeader);
+			m_recordsLeft = index[m_blockIndex].recordCount;
+			m_blockIndex++;
+		}
+
+		record.header = reinterpret_cast<const CaptureRecordHeader*>(m_position);
+		auto deviceTimeLength = ((record.header->flags & captureRecordDeviceTimeFollows) != 0 ? sizeof(int64_t) : 0);
+		record.payload.data = m_position + sizeof(CaptureRecordHeader) + deviceTimeLength;
+		record.payload.size = record.header->payloadLength;
+
+		m_position += sizeof(CaptureRecordHeader) + deviceTimeLength + capturePaddedLength(record.header->payloadLength);
+		m_recordsLeft--;
+
+		if (record.header->hostTimeNs >= m_fromNs && record.header->hostTimeNs <= m_toNs)
+			return true;
+	}
+}
+
+int64_t CaptureReader::Record::deviceTimeMs() const
+{
+	if ((header->flags & captureRecordDeviceTimeFollows) == 0)
+		return header->hostTimeNs / 1000000 + header->deviceTimeOffsetMs;
+
+	int64_t timeMs;
+	std::memcpy(&timeMs, header + 1, sizeof(timeMs));
+	return timeMs;
+}
@@ -0,0 +1,70 @@
+#pragma once
+
+#include <cstdint>
+#include <limits>
+#include <string>
+#include <vector>
+
+#include "capture_format.h"
+#include "mapped_file.h"
+#include "packet_view.h"
+
+// Reads binary capture files (see capture_format.h) through a memory mapping, records are handed out as
+// views into the mapping without copying. Files without the block index are read as well, the index is
+// then rebuilt by walking the blocks and a partially written last block is left out.
+class CaptureReader
+{
+public:
+	// Points into the mapping, valid for as long as the reader is.
+	struct Record
+	{
+		const CaptureRecordHeader* header;
+		ByteView payload;
+
+		bool isShortFrame() const { return (header->flags & captureRecordShortFrame) != 0; }
+		// Corrected device time in milliseconds since the epoch, meaningless for short frames.
+		int64_t deviceTimeMs() const;
+		// Payload plus the packet header fields it was taken out of.
+		size_t frameLength() const { return (isShortFrame() ? payload.size : payload.size + packetHeaderLength); }
+	};
+
+	// Walks the records of blocks that overlap the time range, only records within the range are returned.
+	class Cursor
+	{
+	public:
+		bool next(Record& record);
+
+	private:
+		friend class CaptureReader;
+		Cursor(const CaptureReader& reader, int64_t fromNs, int64_t toNs);
+
+		const CaptureReader& m_reader;
+		int64_t m_fromNs;
+		int64_t m_toNs;
+		size_t m_blockIndex;
+		const uint8_t* m_position;
+		uint32_t m_recordsLeft;
+	};
+
+	explicit CaptureReader(const std::string& path);
+
+	uint32_t accessPointCount() const { return m_fileHeader->accessPointCount; }
+	int64_t startTimeNs() const { return m_fileHeader->startTimeNs; }
+	size_t blockCount() const { return m_index.size(); }
+	// False when the index had to be rebuilt, the capture was not closed properly.
+	bool hasIndex() const { return m_hasIndex; }
+
+	Cursor records(int64_t fromNs = std::numeric_limits<int64_t>::min(), int64_t toNs = std::numeric_limits<int64_t>::max()) const;
+
+private:
+	CaptureReader(const CaptureReader&);
+	CaptureReader& operator=(const CaptureReader&);
+
+	bool readIndex();
+	void rebuildIndex();
+
+	MappedFile m_file;
+	const CaptureFileHeader* m_fileHeader;
+	std::vector<CaptureIndexEntry> m_index;
+	bool m_hasIndex;
+};
@@ -0,0 +1,276 @@
+#include "capture_session.h"
+
+#include <algorithm>
+#include <exception>
+
+namespace
+{
+	const std::chrono::milliseconds workerIdleWait(1);
+	const std::chrono::milliseconds mergeInterval(10);
+	// Room for packets held back in the reorder window before any allocation is needed.
+	const size_t pendingReserve = 4096;
+}
+
+CaptureSession::CaptureSession(const std::vector<std::string>& portNames, uint32_t baudrate, const RecordCallback& recordCallback,
+	std::chrono::milliseconds reorderWindow, size_t workerCount) :
+	m_stopWorkers(false),
+	m_nextSequence(0),
+	m_stopMerging(false),
+	m_reorderWindow(reorderWindow),
+	m_recordCallback(recordCallback),
+	m_running(false)
+{
+	for (size_t i = 0; i < portNames.size(); i++)
+		m_accessPoints.push_back(std::unique_ptr<SimpliciTi>(new SimpliciTi(portNames[i], packetCallbackFor(i), baudrate)));
+
+	setWorkerCount(workerCount);
+	reservePending();
+}
+
+CaptureSession::CaptureSession(std::vector<std::unique_ptr<SerialTransport>> transports, const RecordCallback& recordCallback,
+	std::chrono::milliseconds reorderWindow, size_t workerCount) :
+	m_stopWorkers(false),
+	m_nextSequence(0),
+	m_stopMerging(false),
+	m_reorderWindow(reorderWindow),
+	m_recordCallback(recordCallback),
+	m_running(false)
+{
+	for (size_t i = 0; i < transports.size(); i++)
+		m_accessPoints.push_back(std::unique_ptr<SimpliciTi>(new SimpliciTi(std::move(transports[i]), packetCallbackFor(i))));
+
+	setWorkerCount(workerCount);
+	reservePending();
+}
+
+void CaptureSession::reservePending()
+{
+	std::vector<PendingPacket> storage;
+	storage.reserve(pendingReserve);
+	m_pending = std::priority_queue<PendingPacket, std::vector<PendingPacket>, ReceivedLater>(ReceivedLater(), std::move(storage));
+
+	m_ready.reserve(pendingReserve);
+}
+
+void CaptureSession::setWorkerCount(size_t workerCount)
+{
+	// Parsing is cheap compared to the reading, half of the cores is plenty.
+	if (workerCount == 0)
+		workerCount = std::max<size_t>(1, std::thread::hardware_concurrency() / 2);
+
+	m_workerCount = std::max<size_t>(1, std::min(workerCount, m_accessPoints.size()));
+}
+
+SimpliciTi::PacketCallback CaptureSession::packetCallbackFor(size_t accessPointId)
+{
+	return [this, accessPointId](const PacketHeader&, ByteView frame, std::chrono::system_clock::time_point receiveTime)
+	{
+		PendingPacket pending;
+		pending.accessPointId = accessPointId;
+		pending.receiveTime = receiveTime;
+		pending.length = static_cast<uint8_t>(frame.size);
+		std::copy(frame.begin(), frame.end(), pending.data.begin());
+
+		std::lock_guard<std::mutex> guard(m_pendingLock);
+
+		pending.sequence = m_nextSequence++;
+		m_pending.push(pending);
+	};
+}
+
+void CaptureSession::start()
+{
+	if (m_running)
+		return;
+
+	// Handshakes run side by side, so the startup takes one round trip of the slowest access point. If any
+	// of them fails then the started ones are stopped as well.
+	std::vector<std::exception_ptr> failures(m_accessPoints.size());
+	std::vector<std::thread> handshakes;
+	for (size_t i = 0; i < m_accessPoints.size(); i++)
+	{
+		handshakes.push_back(std::thread([this, i, &failures]
+		{
+			try
+			{
+				m_accessPoints[i]->startAccessPoint(SimpliciTi::ParsingMode::external);
+			}
+			catch (...)
+			{
+				failures[i] = std::current_exception();
+			}
+		}));
+	}
+
+	for (auto& handshake : handshakes)
+		handshake.join();
+
+	for (auto& failure : failures)
+	{
+		if (!failure)
+			continue;
+
+		for (auto& accessPoint : m_accessPoints)
+			accessPoint->stopAccessPoint();
+
+		std::rethrow_exception(failure);
+	}
+
+	m_running = true;
+	m_stopWorkers = false;
+	m_stopMerging = false;
+
+	for (size_t i = 0; i < m_workerCount; i++)
+		m_workers.push_back(std::thread([this, i]{ runWorker(i); }));
+
+	m_mergeTask = std::thread([this]{ runMerger(); });
+}
+
+void CaptureSession::stop()
+{
+	if (!m_running)
+		return;
+
+	m_running = false;
+
+	m_stopWorkers = true;
+	for (auto& worker : m_workers)
+		worker.join();
+	m_workers.clear();
+
+	// Each of them drains its buffers into the pending queue while stopping.
+	for (auto& accessPoint : m_accessPoints)
+		accessPoint->stopAccessPoint();
+
+	m_stopMerging = true;
+	if (m_mergeTask.joinable())
+		m_mergeTask.join();
+}
+
+void CaptureSession::runWorker(size_t workerIndex)
+{
+	while (!m_stopWorkers)
+	{
+		size_t packetsProcessed = 0;
+
+		for (size_t i = workerIndex; i < m_accessPoints.size(); i += m_workerCount)
+			packetsProcessed += m_accessPoints[i]->processPackets();
+
+		if (packetsProcessed == 0)
+			std::this_thread::sleep_for(workerIdleWait);
+	}
+}
+
+void CaptureSession::runMerger()
+{
+	while (!m_stopMerging)
+	{
+		std::this_thread::sleep_for(mergeInterval);
+		emitPackets(std::chrono::system_clock::now() - m_reorderWindow);
+	}
+
+	// Nothing can arrive anymore, so everything left is in order already.
+	emitPackets(std::chrono::system_clock::time_point::max());
+}
+
+void CaptureSession::emitPackets(std::chrono::system_clock::time_point limit)
+{
+	{
+		std::lock_guard<std::mutex> guard(m_pendingLock);
+
+		while (!m_pending.empty() && m_pending.top().receiveTime <= limit)
+		{
+			m_ready.push_back(m_pending.top());
+			m_pending.pop();
+		}
+	}
+
+	// Callback is run without the lock so the workers are never held up by it.
+	for (auto& pending : m_ready)
+	{
+		ByteView frame = {pending.data.data(), pending.length};
+		auto header = decodePacketHeader(frame);
+		auto deviceTime = pending.receiveTime;
+
+		// Packets are in receive time order here, as the estimator expects them.
+		if (frame.size >= packetHeaderLength)
+			deviceTime = m_clocks[std::make_pair(pending.accessPointId, header.link)].correct(deviceTimeOf(header.timestamp, header.milliseconds), pending.receiveTime);
+
+		CapturedPacket packet = {pending.accessPointId, pending.receiveTime, deviceTime, header, frame};
+
+		auto callbackStart = std::chrono::steady_clock::now();
+		m_recordCallback(packet);
+		m_recordCallbackTime.record(std::chrono::steady_clock::now() - callbackStart);
+	}
+
+	m_ready.clear();
+}
+
+SimpliciTi::Statistics CaptureSession::statistics() const
+{
+	SimpliciTi::Statistics total = {};
+
+	for (auto& accessPoint : m_accessPoints)
+	{
+		auto stats = accessPoint->statistics();
+		total.bytesReceived += stats.bytesReceived;
+		total.bytesDropped += stats.bytesDropped;
+		total.bytesSkipped += stats.bytesSkipped;
+		total.falseHeaders += stats.falseHeaders;
+		total.partialFrames += stats.partialFrames;
+		total.packetsReceived += stats.packetsReceived;
+		total.shortFrames += stats.shortFrames;
+		total.packetQueueStalls += stats.packetQueueStalls;
+		total.packetsLogged += stats.packetsLogged;
+		total.packetQueueDepth += stats.packetQueueDepth;
+		total.commandsSent += stats.commandsSent;
+		total.commandRetries += stats.commandRetries;
+		total.commandsAcknowledged += stats.commandsAcknowledged;
+		total.commandsFailed += stats.commandsFailed;
+		total.commandWrites += stats.commandWrites;
+	}
+
+	return total;
+}
+
+LatencyHistogram::Snapshot CaptureSession::parserCallbackTime() const
+{
+	LatencyHistogram::Snapshot total;
+
+	for (auto& accessPoint : m_accessPoints)
+		total.add(accessPoint->callbackTime());
+
+	return total;
+}
+
+LatencyHistogram::Snapshot CaptureSession::commandRoundTrip() const
+{
+	LatencyHistogram::Snapshot total;
+
+	for (auto& accessPoint : m_accessPoints)
+		total.add(accessPoint->commandRoundTrip());
+
+	return total;
+}
+
+std::future<std::vector<uint8_t>> CaptureSession::queueCommand(size_t accessPointId, const std::vector<uint8_t>& command)
+{
+	return m_accessPoints.at(accessPointId)->queueCommand(command);
+}
+
+std::future<std::vector<uint8_t>> CaptureSession::toggleLed(size_t accessPointId, uint8_t link)
+{
+	return m_accessPoints.at(accessPointId)->toggleLed(link);
+}
+
+size_t CaptureSession::pendingPackets() const
+{
+	std::lock_guard<std::mutex> guard(m_pendingLock);
+
+	return m_pending.size();
+}
+
+CaptureSession::~CaptureSession()
+{
+	stop();
+}
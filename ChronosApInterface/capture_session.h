@@ -0,0 +1,120 @@
+#pragma once
+
+#include <array>
+#include <atomic>
+#include <chrono>
+#include <cstdint>
+#include <functional>
+#include <future>
+#include <map>
+#include <memory>
+#include <mutex>
+#include <queue>
+#include <string>
+#include <thread>
+#include <vector>
+
+#include "clock_drift.h"
+#include "metrics.h"
+#include "serial_transport.h"
+#include "simpliciti.h"
+
+// Captures from several USB RF access points at once. Every port has its own reader thread, parsing of
+// all of them is shared by a small pool of workers and the packets are merged into a single stream
+// ordered by the host receive time.
+class CaptureSession
+{
+public:
+	// Views are valid only during the callback.
+	struct CapturedPacket
+	{
+		size_t accessPointId;	// Index of the port in the list given to the constructor.
+		std::chrono::system_clock::time_point receiveTime;
+		// Device timestamp corrected onto the host clock for the drift of the watch, see ClockDriftEstimator.
+		// Short frames have no timestamp, it is the receive time for them.
+		std::chrono::system_clock::time_point deviceTime;
+		PacketHeader header;
+		ByteView frame;
+	};
+
+	typedef std::function<void(const CapturedPacket&)> RecordCallback;
+
+	// Packets are held back for reorderWindow so the ones from other ports could be sorted in before them.
+	// Zero workerCount picks it by the number of ports and cores.
+	CaptureSession(const std::vector<std::string>& portNames, uint32_t baudrate, const RecordCallback& recordCallback,
+		std::chrono::milliseconds reorderWindow = std::chrono::milliseconds(100), size_t workerCount = 0);
+	// Any other byte sources in place of the serial ports.
+	CaptureSession(std::vector<std::unique_ptr<SerialTransport>> transports, const RecordCallback& recordCallback,
+		std::chrono::milliseconds reorderWindow = std::chrono::milliseconds(100), size_t workerCount = 0);
+
+	void start();
+	void stop();
+
+	size_t accessPointCount() const { return m_accessPoints.size(); }
+	// Commands for one of the access points while capturing, see SimpliciTi::queueCommand.
+	std::future<std::vector<uint8_t>> queueCommand(size_t accessPointId, const std::vector<uint8_t>& command);
+	std::future<std::vector<uint8_t>> toggleLed(size_t accessPointId, uint8_t link);
+	// Sum over all access points.
+	SimpliciTi::Statistics statistics() const;
+	// Time the parsers spent handing packets over to the merger, all access points together.
+	LatencyHistogram::Snapshot parserCallbackTime() const;
+	// From the first write of a command to its acknowledgement, all access points together.
+	LatencyHistogram::Snapshot commandRoundTrip() const;
+	// Time spent in the record callback.
+	LatencyHistogram::Snapshot recordCallbackTime() const { return m_recordCallbackTime.snapshot(); }
+	// Packets held back for ordering, at the moment of the call.
+	size_t pendingPackets() const;
+
+	~CaptureSession();
+
+private:
+	CaptureSession(const CaptureSession&);
+	CaptureSession& operator=(const CaptureSession&);
+
+	// Frame is copied into fixed storage, so holding packets back does not allocate anything.
+	struct PendingPacket
+	{
+		size_t accessPointId;
+		std::chrono::system_clock::time_point receiveTime;
+		uint64_t sequence;		// Keeps the arrival order of packets with equal receive time.
+		uint8_t length;
+		std::array<uint8_t, 255> data;
+	};
+
+	struct ReceivedLater
+	{
+		bool operator()(const PendingPacket& left, const PendingPacket& right) const
+		{
+			if (left.receiveTime != right.receiveTime)
+				return left.receiveTime > right.receiveTime;
+
+			return left.sequence > right.sequence;
+		}
+	};
+
+	SimpliciTi::PacketCallback packetCallbackFor(size_t accessPointId);
+	void setWorkerCount(size_t workerCount);
+	void reservePending();
+	void runWorker(size_t workerIndex);
+	void runMerger();
+	// Hands over packets received before the limit, in receive time order.
+	void emitPackets(std::chrono::system_clock::time_point limit);
+
+	std::vector<std::unique_ptr<SimpliciTi>> m_accessPoints;
+	std::vector<std::thread> m_workers;
+	size_t m_workerCount;
+	std::atomic<bool> m_stopWorkers;
+
+	mutable std::mutex m_pendingLock;
+	std::priority_queue<PendingPacket, std::vector<PendingPacket>, ReceivedLater> m_pending;
+	uint64_t m_nextSequence;
+	std::vector<PendingPacket> m_ready;		// Used only by the merger thread.
+	std::map<std::pair<size_t, uint8_t>, ClockDriftEstimator> m_clocks;	// By access point and link, merger thread only.
+	std::thread m_mergeTask;
+	std::atomic<bool> m_stopMerging;
+	std::chrono::milliseconds m_reorderWindow;
+
+	RecordCallback m_recordCallback;
+	LatencyHistogram m_recordCallbackTime;
+	bool m_running;
+};
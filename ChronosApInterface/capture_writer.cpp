@@ -0,0 +1,140 @@
+#include "capture_writer.h"
+
+#include <algorithm>
+#include <cstring>
+#include <limits>
+#include <stdexcept>
+
+#include "clock_drift.h"
+
+CaptureWriter::CaptureWriter(const std::string& path, uint32_t accessPointCount, std::chrono::system_clock::time_point startTime, size_t blockSize) :
+	m_fileOffset(0),
+	m_blockSize(blockSize),
+	m_recordsWritten(0)
+{
+	m_file.open(path, std::ios::binary | std::ios::trunc);
+	if (!m_file.is_open())
+		throw std::runtime_error("Could not open the capture file " + path + ".");
+
+	CaptureFileHeader fileHeader = {};
+	std::memcpy(fileHeader.magic, captureFileMagic, sizeof(fileHeader.magic));
+	fileHeader.version = captureFileVersion;
+	fileHeader.accessPointCount = accessPointCount;
+	fileHeader.startTimeNs = toCaptureTime(startTime);
+
+	m_file.write(reinterpret_cast<const char*>(&fileHeader), sizeof(fileHeader));
+	m_fileOffset = sizeof(fileHeader);
+
+	// Largest record fits in on top of the block size, so the block never has to grow.
+	m_block.reserve(m_blockSize + sizeof(CaptureRecordHeader) + sizeof(int64_t) + capturePaddedLength(255));
+	m_blockHeader = CaptureBlockHeader();
+}
+
+void CaptureWriter::append(size_t accessPointId, std::chrono::system_clock::time_point receiveTime, std::chrono::system_clock::time_point deviceTime,
+	const PacketHeader& header, ByteView frame)
+{
+	auto shortFrame = frame.size < packetHeaderLength;
+	auto payload = (shortFrame ? frame : header.payload);
+
+	CaptureRecordHeader record = {};
+	record.hostTimeNs = toCaptureTime(receiveTime);
+	record.deviceTimestamp = header.timestamp;
+	record.accessPointId = static_cast<uint16_t>(accessPointId);
+	record.milliseconds = header.milliseconds;
+	record.link = header.link;
+	record.payloadLength = static_cast<uint8_t>(payload.size);
+	record.flags = (shortFrame ? captureRecordShortFrame : 0);
+
+	int64_t deviceTimeMs = 0;
+	size_t deviceTimeLength = 0;
+	if (!shortFrame)
+	{
+		deviceTimeMs = toCaptureTime(deviceTime) / 1000000;
+		auto offsetMs = deviceTimeMs - record.hostTimeNs / 1000000;
+		if (offsetMs >= std::numeric_limits<int32_t>::min() && offsetMs <= std::numeric_limits<int32_t>::max())
+			record.deviceTimeOffsetMs = static_cast<int32_t>(offsetMs);
+		else
+		{
+			record.flags |= captureRecordDeviceTimeFollows;
+			deviceTimeLength = sizeof(deviceTimeMs);
+		}
+	}
+
+	if (m_blockHeader.recordCount == 0)
+	{
+		m_blockHeader.firstTimeNs = record.hostTimeNs;
+		m_blockHeader.lastTimeNs = record.hostTimeNs;
+	}
+
+	m_blockHeader.firstTimeNs = std::min(m_blockHeader.firstTimeNs, record.hostTimeNs);
+	m_blockHeader.lastTimeNs = std::max(m_blockHeader.lastTimeNs, record.hostTimeNs);
+	m_blockHeader.recordCount++;
+
+	auto recordStart = m_block.size();
+	m_block.resize(recordStart + sizeof(record) + deviceTimeLength + capturePaddedLength(payload.size), 0);
+	std::memcpy(&m_block[recordStart], &record, sizeof(record));
+	std::memcpy(&m_block[recordStart + sizeof(record)], &deviceTimeMs, deviceTimeLength);
+	std::copy(payload.begin(), payload.end(), m_block.begin() + recordStart + sizeof(record) + deviceTimeLength);
+
+	m_recordsWritten++;
+
+	if (m_block.size() >= m_blockSize)
+		writeBlock();
+}
+
+void CaptureWriter::writeBlock()
+{
+	if (m_blockHeader.recordCount == 0)
+		return;
+
+	m_blockHeader.magic = captureBlockMagic;
+	m_blockHeader.dataLength = static_cast<uint32_t>(m_block.size());
+
+	CaptureIndexEntry entry = {};
+	entry.firstTimeNs = m_blockHeader.firstTimeNs;
+	entry.lastTimeNs = m_blockHeader.lastTimeNs;
+	entry.offset = m_fileOffset;
+	entry.recordCount = m_blockHeader.recordCount;
+	m_index.push_back(entry);
+
+	m_file.write(reinterpret_cast<const char*>(&m_blockHeader), sizeof(m_blockHeader));
+	m_file.write(reinterpret_cast<const char*>(m_block.data()), m_block.size());
+	m_file.flush();
+	m_fileOffset += sizeof(m_blockHeader) + m_block.size();
+
+	m_block.clear();
+	m_blockHeader = CaptureBlockHeader();
+}
+
+void CaptureWriter::close()
+{
+	if (!m_file.is_open())
+		return;
+
+	writeBlock();
+
+	CaptureFileTrailer trailer = {};
+	trailer.indexOffset = m_fileOffset;
+	trailer.blockCount = static_cast<uint32_t>(m_index.size());
+	trailer.magic = captureTrailerMagic;
+
+	if (!m_index.empty())
+		m_file.write(reinterpret_cast<const char*>(m_index.data()), m_index.size() * sizeof(CaptureIndexEntry));
+	m_file.write(reinterpret_cast<const char*>(&trailer), sizeof(trailer));
+	m_file.close();
+}
+
+CaptureWriter::~CaptureWriter()
+{
+	close();
+}
+
+int64_t toCaptureTime(std::chrono::system_clock::time_point time)
+{
+	return std::chrono::duration_cast<std::chrono::nanoseconds>(time.time_since_epoch()).count();
+}
+
+std::chrono::system_clock::time_point fromCaptureTime(int64_t timeNs)
+{
+	return std::chrono::system_clock::time_point(std::chrono::duration_cast<std::chrono::system_clock::duration>(std::chrono::nanoseconds(timeNs)));
+}
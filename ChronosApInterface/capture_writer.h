@@ -0,0 +1,46 @@
+#pragma once
+
+#include <chrono>
+#include <cstdint>
+#include <fstream>
+#include <string>
+#include <vector>
+
+#include "capture_format.h"
+#include "packet_view.h"
+
+// Writes packets into the binary capture format (see capture_format.h). Records are collected into a
+// block in memory and the block is written out as a whole when it reaches the block size.
+class CaptureWriter
+{
+public:
+	CaptureWriter(const std::string& path, uint32_t accessPointCount, std::chrono::system_clock::time_point startTime,
+		size_t blockSize = 64 * 1024);
+	~CaptureWriter();
+
+	// Device time is the corrected one, it is stored relative to the receive time.
+	void append(size_t accessPointId, std::chrono::system_clock::time_point receiveTime, std::chrono::system_clock::time_point deviceTime,
+		const PacketHeader& header, ByteView frame);
+	// Writes out the last block, the block index and closes the file.
+	void close();
+
+	size_t recordsWritten() const { return m_recordsWritten; }
+
+private:
+	CaptureWriter(const CaptureWriter&);
+	CaptureWriter& operator=(const CaptureWriter&);
+
+	void writeBlock();
+
+	std::ofstream m_file;
+	uint64_t m_fileOffset;
+	size_t m_blockSize;
+
+	std::vector<uint8_t> m_block;
+	CaptureBlockHeader m_blockHeader;
+	std::vector<CaptureIndexEntry> m_index;
+	size_t m_recordsWritten;
+};
+
+int64_t toCaptureTime(std::chrono::system_clock::time_point time);
+std::chrono::system_clock::time_point fromCaptureTime(int64_t timeNs);
@@ -0,0 +1,126 @@
+#include "clock_drift.h"
+
+#include <algorithm>
+#include <cmath>
+
+namespace
+{
+	// Slope is left at zero until the pairs span at least this many seconds of device time.
+	const double minimumSpan = 1.0;
+	// Residual beyond this many times the mean absolute one is an outlier.
+	const double outlierFactor = 6.0;
+	// Outliers in a row that make a step of the device clock.
+	const size_t stepSamples = 3;
+}
+
+ClockDriftEstimator::ClockDriftEstimator(double halfLifeSamples, std::chrono::milliseconds stepThreshold) :
+	m_decay(std::pow(0.5, 1.0 / halfLifeSamples)),
+	m_stepThreshold(stepThreshold.count() / 1000.0),
+	m_started(false),
+	m_originOffset(0),
+	m_weight(0),
+	m_sumX(0),
+	m_sumY(0),
+	m_sumXX(0),
+	m_sumXY(0),
+	m_sumAbsResidual(0),
+	m_slope(0),
+	m_outliers(0),
+	m_firstOutlier(0),
+	m_offset(0)
+{
+}
+
+std::chrono::system_clock::time_point ClockDriftEstimator::correct(std::chrono::system_clock::time_point deviceTime, std::chrono::system_clock::time_point receiveTime)
+{
+	std::chrono::duration<double> offset = receiveTime - deviceTime;
+
+	if (!m_started)
+		reset(deviceTime, offset.count());
+
+	auto x = std::chrono::duration<double>(deviceTime - m_originDevice).count();
+	auto y = offset.count() - m_originOffset;
+
+	if (m_weight > 0)
+	{
+		auto residual = y - fittedAt(x);
+		auto limit = std::max(m_stepThreshold, outlierFactor * m_sumAbsResidual / m_weight);
+
+		if (std::abs(residual) <= limit)
+		{
+			m_outliers = 0;
+			m_sumAbsResidual = m_sumAbsResidual * m_decay + std::abs(residual);
+		}
+		else
+		{
+			if (m_outliers > 0 && std::abs(residual - m_firstOutlier) <= limit / 2)
+			{
+				m_outliers++;
+			}
+			else
+			{
+				m_outliers = 1;
+				m_firstOutlier = residual;
+			}
+
+			if (m_outliers < stepSamples)
+				return correctedAt(deviceTime, x);
+
+			reset(deviceTime, offset.count());
+			x = 0;
+			y = 0;
+		}
+	}
+
+	m_weight = m_weight * m_decay + 1;
+	m_sumX = m_sumX * m_decay + x;
+	m_sumY = m_sumY * m_decay + y;
+	m_sumXX = m_sumXX * m_decay + x * x;
+	m_sumXY = m_sumXY * m_decay + x * y;
+
+	auto meanX = m_sumX / m_weight;
+	auto varianceX = m_sumXX / m_weight - meanX * meanX;
+	if (varianceX > minimumSpan * minimumSpan / 12)
+		m_slope = (m_sumXY / m_weight - meanX * m_sumY / m_weight) / varianceX;
+
+	return correctedAt(deviceTime, x);
+}
+
+double ClockDriftEstimator::driftPpm() const
+{
+	// Offset growing with the device time means the device clock is the slow one.
+	return -m_slope * 1e6;
+}
+
+double ClockDriftEstimator::fittedAt(double x) const
+{
+	return (m_sumY + m_slope * (x * m_weight - m_sumX)) / m_weight;
+}
+
+std::chrono::system_clock::time_point ClockDriftEstimator::correctedAt(std::chrono::system_clock::time_point deviceTime, double x)
+{
+	m_offset = std::chrono::milliseconds(static_cast<int64_t>(std::floor((m_originOffset + fittedAt(x)) * 1000 + 0.5)));
+
+	return std::chrono::time_point_cast<std::chrono::milliseconds>(deviceTime) + m_offset;
+}
+
+void ClockDriftEstimator::reset(std::chrono::system_clock::time_point deviceTime, double offset)
+{
+	m_started = true;
+	m_originDevice = deviceTime;
+	m_originOffset = offset;
+	m_weight = 0;
+	m_sumX = 0;
+	m_sumY = 0;
+	m_sumXX = 0;
+	m_sumXY = 0;
+	m_sumAbsResidual = 0;
+	m_slope = 0;
+	m_outliers = 0;
+}
+
+std::chrono::system_clock::time_point deviceTimeOf(uint32_t timestamp, uint16_t milliseconds)
+{
+	return std::chrono::system_clock::time_point(std::chrono::duration_cast<std::chrono::system_clock::duration>(
+		std::chrono::seconds(timestamp) + std::chrono::milliseconds(milliseconds)));
+}
@@ -0,0 +1,53 @@
+#pragma once
+
+#include <chrono>
+#include <cstdint>
+
+// Maps the timestamps of one watch onto the host clock. The offset between the host receive time and the
+// device time is fitted as a linear function of the device time by least squares, so both the offset and
+// the drift rate of the watch clock are followed. Older pairs fade out with the given half-life.
+//
+// Pairs far off the fit (more than stepThreshold and several times the usual residual) are left out, a late
+// packet would only bend it. When a few of them in a row agree with each other, the device clock was set
+// again and the fit starts over from there.
+class ClockDriftEstimator
+{
+public:
+	explicit ClockDriftEstimator(double halfLifeSamples = 1000.0, std::chrono::milliseconds stepThreshold = std::chrono::milliseconds(20));
+
+	// Adds the pair and returns the device time corrected onto the host clock, in whole milliseconds.
+	std::chrono::system_clock::time_point correct(std::chrono::system_clock::time_point deviceTime, std::chrono::system_clock::time_point receiveTime);
+
+	// Device clock rate against the host, parts per million, positive when the device runs fast.
+	double driftPpm() const;
+	// Offset the last correction added to the device time.
+	std::chrono::milliseconds offset() const { return m_offset; }
+
+private:
+	void reset(std::chrono::system_clock::time_point deviceTime, double offset);
+	// Offset the fit gives at the device time, relative to the origin offset.
+	double fittedAt(double x) const;
+	std::chrono::system_clock::time_point correctedAt(std::chrono::system_clock::time_point deviceTime, double x);
+
+	double m_decay;
+	double m_stepThreshold;
+
+	// Device times are counted from the first pair of the fit and offsets from its offset, in seconds, so
+	// the sums stay small enough for doubles.
+	bool m_started;
+	std::chrono::system_clock::time_point m_originDevice;
+	double m_originOffset;
+	double m_weight;
+	double m_sumX;
+	double m_sumY;
+	double m_sumXX;
+	double m_sumXY;
+	double m_sumAbsResidual;
+	double m_slope;
+	size_t m_outliers;
+	double m_firstOutlier;
+	std::chrono::milliseconds m_offset;
+};
+
+// Device timestamp of a packet header, seconds since the epoch plus milliseconds.
+std::chrono::system_clock::time_point deviceTimeOf(uint32_t timestamp, uint16_t milliseconds);
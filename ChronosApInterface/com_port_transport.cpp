@@ -0,0 +1,70 @@
+#ifdef _WIN32
+
+#include "com_port_transport.h"
+
+#include <array>
+#include <mutex>
+#include <stdexcept>
+
+#include "BM_Driver.h"
+
+namespace
+{
+	// BM_Driver keeps the port state in global arrays, every open port needs its own index there.
+	std::mutex s_portSlotsLock;
+	std::array<bool, MAX_PORTNUM> s_portSlotsUsed = {};
+
+	int reservePortSlot()
+	{
+		std::lock_guard<std::mutex> guard(s_portSlotsLock);
+
+		for (size_t i = 0; i < s_portSlotsUsed.size(); i++)
+		{
+			if (!s_portSlotsUsed[i])
+			{
+				s_portSlotsUsed[i] = true;
+				return static_cast<int>(i);
+			}
+		}
+
+		throw std::runtime_error("Too many COM ports open at the same time.");
+	}
+
+	void releasePortSlot(int portNumber)
+	{
+		std::lock_guard<std::mutex> guard(s_portSlotsLock);
+		s_portSlotsUsed[portNumber] = false;
+	}
+}
+
+ComPortTransport::ComPortTransport(const std::string& comPortName, uint32_t baudrate) : m_portNumber(reservePortSlot())
+{
+	if (!OpenCOM(m_portNumber, const_cast<char*>(comPortName.c_str()), baudrate))
+	{
+		releasePortSlot(m_portNumber);
+		throw std::runtime_error("Invalid handle supplied to the SimpliciTI parser.");
+	}
+}
+
+ComPortTransport::~ComPortTransport()
+{
+	CloseCOM(m_portNumber);
+	releasePortSlot(m_portNumber);
+}
+
+size_t ComPortTransport::read(uint8_t* buffer, size_t length)
+{
+	return ReadCOM(m_portNumber, static_cast<int>(length), buffer);
+}
+
+bool ComPortTransport::write(const uint8_t* data, size_t length)
+{
+	return WriteCOM(m_portNumber, static_cast<int>(length), const_cast<UCHAR*>(data)) != 0;
+}
+
+void ComPortTransport::flush()
+{
+	FlushCOM(m_portNumber);
+}
+
+#endif
@@ -0,0 +1,25 @@
+#pragma once
+
+#include <string>
+
+#include "serial_transport.h"
+
+// COM port of the access point driven by the BM_Driver routines.
+class ComPortTransport : public SerialTransport
+{
+public:
+	ComPortTransport(const std::string& comPortName, uint32_t baudrate = 115200);
+	~ComPortTransport();
+
+	using SerialTransport::read;
+	size_t read(uint8_t* buffer, size_t length);
+	bool write(const uint8_t* data, size_t length);
+	void flush();
+
+private:
+	ComPortTransport(const ComPortTransport&);
+	ComPortTransport& operator=(const ComPortTransport&);
+
+	// BM_Driver slot, 0 to MAX_PORTNUM - 1.
+	int m_portNumber;
+};
@@ -0,0 +1,99 @@
+#include "frame_sync.h"
+
+#include "cpu_features.h"
+
+#ifdef CPU_FEATURES_X86
+#include <immintrin.h>
+#ifdef _MSC_VER
+#include <intrin.h>
+#endif
+#endif
+
+namespace
+{
+	typedef size_t (*PairFinder)(const uint8_t* data, size_t length, uint8_t first, uint8_t second);
+
+	size_t findBytePairScalar(const uint8_t* data, size_t length, uint8_t first, uint8_t second)
+	{
+		for (size_t i = 0; i + 1 < length; i++)
+		{
+			if (data[i] == first && data[i + 1] == second)
+				return i;
+		}
+
+		return length;
+	}
+
+#ifdef CPU_FEATURES_X86
+	unsigned lowestSetBit(unsigned mask)
+	{
+#ifdef _MSC_VER
+		unsigned long index;
+		_BitScanForward(&index, mask);
+		return index;
+#else
+		return static_cast<unsigned>(__builtin_ctz(mask));
+#endif
+	}
+
+	// Every position is compared against the first byte and the position after it against the second one,
+	// both loads are unaligned. Last block is left to the scalar loop as it would read past the data.
+	TARGET_SSE2 size_t findBytePairSse2(const uint8_t* data, size_t length, uint8_t first, uint8_t second)
+	{
+		const __m128i firstBytes = _mm_set1_epi8(static_cast<char>(first));
+		const __m128i secondBytes = _mm_set1_epi8(static_cast<char>(second));
+
+		size_t i = 0;
+		for (; i + 17 <= length; i += 16)
+		{
+			auto current = _mm_loadu_si128(reinterpret_cast<const __m128i*>(data + i));
+			auto next = _mm_loadu_si128(reinterpret_cast<const __m128i*>(data + i + 1));
+			auto matches = _mm_and_si128(_mm_cmpeq_epi8(current, firstBytes), _mm_cmpeq_epi8(next, secondBytes));
+			auto mask = static_cast<unsigned>(_mm_movemask_epi8(matches));
+
+			if (mask != 0)
+				return i + lowestSetBit(mask);
+		}
+
+		return i + findBytePairScalar(data + i, length - i, first, second);
+	}
+
+	TARGET_AVX2 size_t findBytePairAvx2(const uint8_t* data, size_t length, uint8_t first, uint8_t second)
+	{
+		const __m256i firstBytes = _mm256_set1_epi8(static_cast<char>(first));
+		const __m256i secondBytes = _mm256_set1_epi8(static_cast<char>(second));
+
+		size_t i = 0;
+		for (; i + 33 <= length; i += 32)
+		{
+			auto current = _mm256_loadu_si256(reinterpret_cast<const __m256i*>(data + i));
+			auto next = _mm256_loadu_si256(reinterpret_cast<const __m256i*>(data + i + 1));
+			auto matches = _mm256_and_si256(_mm256_cmpeq_epi8(current, firstBytes), _mm256_cmpeq_epi8(next, secondBytes));
+			auto mask = static_cast<unsigned>(_mm256_movemask_epi8(matches));
+
+			if (mask != 0)
+				return i + lowestSetBit(mask);
+		}
+
+		return i + findBytePairScalar(data + i, length - i, first, second);
+	}
+#endif
+
+	PairFinder selectPairFinder()
+	{
+#ifdef CPU_FEATURES_X86
+		if (processorHasAvx2())
+			return findBytePairAvx2;
+		if (processorHasSse2())
+			return findBytePairSse2;
+#endif
+		return findBytePairScalar;
+	}
+
+	const PairFinder s_findBytePair = selectPairFinder();
+}
+
+size_t findBytePair(const uint8_t* data, size_t length, uint8_t first, uint8_t second)
+{
+	return s_findBytePair(data, length, first, second);
+}
@@ -0,0 +1,8 @@
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+
+// Offset of the first place where the first byte is directly followed by the second one, length when there
+// is no such place. Compares 32 or 16 positions at once with AVX2 or SSE2, whichever the processor has.
+size_t findBytePair(const uint8_t* data, size_t length, uint8_t first, uint8_t second);
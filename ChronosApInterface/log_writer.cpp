@@ -0,0 +1,152 @@
+#include "log_writer.h"
+
+#include <algorithm>
+
+namespace
+{
+	const std::chrono::milliseconds idleWait(1);
+}
+
+LogWriter::LogWriter(std::ostream& output, const Formatter& formatter, size_t flushSize, std::chrono::milliseconds flushInterval, size_t queueSize) :
+	m_output(output),
+	m_segmentedOutput(nullptr),
+	m_formatter(formatter),
+	m_flushSize(flushSize),
+	m_flushInterval(flushInterval),
+	m_queue(queueSize),
+	m_stopWriting(false),
+	m_running(false),
+	m_recordsWritten(0),
+	m_flushes(0),
+	m_producerStalls(0)
+{
+	// Some slack on top so the last record before the flush would not make it grow.
+	m_buffer.reserve(m_flushSize + 4096);
+	m_bufferedReceiveTimes.reserve(queueSize);
+}
+
+void LogWriter::start()
+{
+	if (m_running)
+		return;
+
+	m_running = true;
+	m_stopWriting = false;
+	m_lastFlush = std::chrono::steady_clock::now();
+	m_writeTask = std::thread([this]{ run(); });
+}
+
+void LogWriter::stop()
+{
+	if (!m_running)
+		return;
+
+	m_stopWriting = true;
+	if (m_writeTask.joinable())
+		m_writeTask.join();
+
+	m_running = false;
+}
+
+void LogWriter::push(size_t accessPointId, std::chrono::system_clock::time_point receiveTime, std::chrono::system_clock::time_point deviceTime,
+	const uint8_t* data, size_t length)
+{
+	auto regions = m_queue.writableRegions();
+
+	if (regions.total() == 0)
+	{
+		m_producerStalls++;
+
+		do
+		{
+			std::this_thread::sleep_for(idleWait);
+			regions = m_queue.writableRegions();
+		}
+		while (regions.total() == 0);
+	}
+
+	// Filled in place, the queue slot is the only copy of the packet.
+	auto& record = *regions.data[0];
+	record.accessPointId = accessPointId;
+	record.receiveTime = receiveTime;
+	record.deviceTime = deviceTime;
+	record.length = static_cast<uint8_t>(std::min(length, record.data.size()));
+	std::copy(data, data + record.length, record.data.begin());
+
+	m_queue.commitWrite(1);
+}
+
+void LogWriter::run()
+{
+	while (!m_stopWriting)
+	{
+		auto formatted = formatQueued();
+
+		if (!m_bufferedReceiveTimes.empty() && std::chrono::steady_clock::now() - m_lastFlush >= m_flushInterval)
+			flushBuffer();
+
+		if (formatted == 0)
+			std::this_thread::sleep_for(idleWait);
+	}
+
+	formatQueued();
+	flushBuffer();
+}
+
+size_t LogWriter::formatQueued()
+{
+	size_t formatted = 0;
+
+	while (!m_queue.empty())
+	{
+		auto& record = m_queue.front();
+		m_formatter(record, m_buffer);
+		m_bufferedReceiveTimes.push_back(record.receiveTime);
+		m_queue.consume(1);
+		formatted++;
+
+		if (m_buffer.size() >= m_flushSize)
+			flushBuffer();
+	}
+
+	m_recordsWritten += formatted;
+
+	return formatted;
+}
+
+void LogWriter::flushBuffer()
+{
+	m_lastFlush = std::chrono::steady_clock::now();
+
+	// Formatter may have written the records somewhere else and left the buffer empty. When those are committed
+	// is up to whoever it wrote them to, so they are not in the commit latency.
+	if (m_buffer.empty())
+	{
+		m_bufferedReceiveTimes.clear();
+		return;
+	}
+
+	if (m_segmentedOutput != nullptr)
+	{
+		auto receiveTimes = std::minmax_element(m_bufferedReceiveTimes.begin(), m_bufferedReceiveTimes.end());
+		m_segmentedOutput->write(m_buffer.data(), m_buffer.size(), m_bufferedReceiveTimes.size(), *receiveTimes.first, *receiveTimes.second);
+	}
+	else
+	{
+		m_output.write(m_buffer.data(), m_buffer.size());
+		m_output.flush();
+	}
+
+	m_buffer.clear();
+	m_flushes++;
+
+	auto commitTime = std::chrono::system_clock::now();
+	for (auto& receiveTime : m_bufferedReceiveTimes)
+		m_commitLatency.record(commitTime - receiveTime);
+	m_bufferedReceiveTimes.clear();
+}
+
+LogWriter::~LogWriter()
+{
+	stop();
+}
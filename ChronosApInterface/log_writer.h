@@ -0,0 +1,89 @@
+#pragma once
+
+#include <array>
+#include <atomic>
+#include <chrono>
+#include <cstdint>
+#include <functional>
+#include <ostream>
+#include <string>
+#include <thread>
+#include <vector>
+
+#include "metrics.h"
+#include "ring_buffer.h"
+#include "segmented_log.h"
+
+// Writes the log on its own thread. Packets are queued as raw records without any formatting, the
+// logging thread formats them into one reusable buffer and writes it out in batches, either when
+// the buffer has grown past the flush size or when the flush interval has passed.
+class LogWriter
+{
+public:
+	struct Record
+	{
+		size_t accessPointId;
+		std::chrono::system_clock::time_point receiveTime;
+		std::chrono::system_clock::time_point deviceTime;
+		uint8_t length;
+		std::array<uint8_t, 255> data;
+	};
+
+	// Appends the text of a single record to the buffer.
+	typedef std::function<void(const Record& record, std::string& buffer)> Formatter;
+
+	LogWriter(std::ostream& output, const Formatter& formatter, size_t flushSize = 64 * 1024,
+		std::chrono::milliseconds flushInterval = std::chrono::milliseconds(200), size_t queueSize = 4096);
+
+	// Writes into the segments instead of the stream from then on. Before start only.
+	void setSegmentedOutput(SegmentedLog* output) { m_segmentedOutput = output; }
+
+	// Records can be queued before start, they are written once the thread runs.
+	void start();
+	// Writes out everything queued so far and stops the thread.
+	void stop();
+
+	// Single producer only. Waits when the queue is full, the log is never dropped.
+	void push(size_t accessPointId, std::chrono::system_clock::time_point receiveTime, std::chrono::system_clock::time_point deviceTime,
+		const uint8_t* data, size_t length);
+
+	size_t recordsWritten() const { return m_recordsWritten; }
+	size_t flushes() const { return m_flushes; }
+	// How many times the producer had to wait for the logging thread.
+	size_t producerStalls() const { return m_producerStalls; }
+	// Records waiting to be formatted, at the moment of the call.
+	size_t queueDepth() const { return m_queue.size(); }
+	// From the receive time of a record to its text being written out. Only records the formatter put into the
+	// buffer count, it stays empty when they all went elsewhere, as with the binary capture.
+	LatencyHistogram::Snapshot commitLatency() const { return m_commitLatency.snapshot(); }
+
+	~LogWriter();
+
+private:
+	LogWriter(const LogWriter&);
+	LogWriter& operator=(const LogWriter&);
+
+	void run();
+	size_t formatQueued();
+	void flushBuffer();
+
+	std::ostream& m_output;
+	SegmentedLog* m_segmentedOutput;
+	Formatter m_formatter;
+	size_t m_flushSize;
+	std::chrono::milliseconds m_flushInterval;
+
+	RingBuffer<Record> m_queue;
+	std::string m_buffer;
+	std::vector<std::chrono::system_clock::time_point> m_bufferedReceiveTimes;
+	std::chrono::steady_clock::time_point m_lastFlush;
+
+	std::thread m_writeTask;
+	std::atomic<bool> m_stopWriting;
+	bool m_running;
+
+	std::atomic<size_t> m_recordsWritten;
+	std::atomic<size_t> m_flushes;
+	std::atomic<size_t> m_producerStalls;
+	LatencyHistogram m_commitLatency;
+};
@@ -1,26 +1,60 @@
 
+#ifdef _WIN32
 #include <Windows.h>
+#endif
 
+#include <algorithm>
 #include <chrono>
 #include <cstdint>
 #include <ctime>
-#include <exception>
 #include <fstream>
 #include <functional>
-#include <iomanip>
 #include <iostream>
+#include <memory>
 #include <sstream>
+#include <stdexcept>
 #include <string>
 #include <thread>
 #include <vector>
 
-#include "simpliciti.h"
+#include "byte_format.h"
+#include "capture_journal.h"
+#include "capture_reader.h"
+#include "capture_session.h"
+#include "capture_writer.h"
+#include "log_writer.h"
+#include "metrics.h"
+#include "packet_ring.h"
+#include "recording_transport.h"
+#include "replay_transport.h"
+#include "segmented_log.h"
+#include "stream_server.h"
+#include "timestamp_format.h"
 
 namespace
 {
 	std::vector<std::string> parameters;
 	std::ofstream outputFile;
-	DWORD baudrate = 115200;
+	uint32_t baudrate = 115200;
+	// Console stats line rate, zero keeps the console quiet. The JSON snapshot is written regardless.
+	std::chrono::milliseconds statsInterval(1000);
+	ReplayTransport::Timing replayTiming = ReplayTransport::Timing::fastest;
+	// Live packets are also published to other local processes under this name, see packet_ring.h.
+	std::string sharedMemoryName;
+	// Live packets are also streamed to the clients of this Unix socket (Linux only), see stream_server.h.
+	std::string streamSocketPath;
+	StreamServer::SlowClientPolicy slowClientPolicy = StreamServer::SlowClientPolicy::dropFrames;
+	// Live packets are also appended to this write-ahead journal, see capture_journal.h.
+	std::string journalPath;
+	CaptureJournal::Durability journalDurability = CaptureJournal::Durability::grouped;
+	std::chrono::milliseconds journalSyncInterval(50);
+	size_t journalSyncSize = 1024 * 1024;
+	// The text log is split into segments of this size or time span, none of them splits it.
+	uint64_t segmentSize = 0;
+	std::chrono::minutes segmentInterval(0);
+	bool compressSegments = false;
+	// Records are tagged with the access point only when there is more than one.
+	bool tagAccessPoint = false;
 
 	enum class blobFormat
 	{
@@ -30,26 +64,79 @@ namespace
 	};
 
 	blobFormat dataBlobFormat = blobFormat::number;
+	// Packets go into a binary capture file instead of the text log.
+	bool binaryCapture = false;
+
+	// Records are formatted by the log thread, or by the main thread when converting, never both at once.
+	TimestampFormatter hostTimeFormatter("%H:%M:%S");
+	TimestampFormatter deviceTimestampFormatter("%c");
+	TimestampFormatter deviceTimeFormatter("%H:%M:%S");
 }
 
 static void fillParameters(int argc, char* argv[]);
-static std::string bufferToHex(const std::vector<uint8_t>& buffer);
-static void writePacketToFile(const std::vector<uint8_t>& packet);
+static bool parseOption(const std::string& option);
+static bool parseNumber(const std::string& text, uint64_t& value);
+static std::vector<std::string> splitPortList(const std::string& portList);
+static std::string formatStartLine(std::chrono::system_clock::time_point startTime);
+static void formatPacket(size_t accessPointId, std::chrono::system_clock::time_point receiveTime, std::chrono::system_clock::time_point deviceTime,
+	const PacketHeader& header, size_t frameSize, std::string& buffer);
+static void formatRecord(const LogWriter::Record& record, std::string& buffer);
+static std::string formatStatsLine(const MetricsSnapshot& snapshot);
+static int convertCapture(const std::string& capturePath);
+static int convertJournal(const std::string& journalPath);
 
 int main(int argc, char* argv[])
 {
 	if (argc < 2)
 	{
 		std::cout << "Not enough parameters provided." << std::endl;
+		return -1;
 	}
 
 	fillParameters(argc, argv);
 
+	// Offline conversion of a binary capture into the text log, "convert <capture file> [blob format]".
+	auto converting = (parameters.at(0) == "convert");
+	// Capture that also saves the raw serial streams, same parameters as the plain capture.
+	auto recording = (parameters.at(0) == "record");
+	// Capture from raw stream recordings in place of the ports, "replay <files> [blob format] [original|fast]".
+	auto replaying = (parameters.at(0) == "replay");
+	if (converting || recording || replaying)
+		parameters.erase(parameters.begin());
+
+	// Options can go anywhere, the positional parameters are what is left.
+	for (auto parameter = parameters.begin(); parameter != parameters.end();)
+	{
+		if (parameter->compare(0, 2, "--") != 0)
+		{
+			++parameter;
+			continue;
+		}
+
+		if (!parseOption(*parameter))
+		{
+			std::cout << "Unknown option or invalid value " << *parameter << "." << std::endl;
+			return -1;
+		}
+
+		parameter = parameters.erase(parameter);
+	}
+
+	if (parameters.empty())
+	{
+		std::cout << "Not enough parameters provided." << std::endl;
+		return -1;
+	}
+
 	if (parameters.size() > 1)
 	{
 		auto blobFormatParameter = parameters.at(1);
 
-		if (blobFormatParameter == "hex")
+		if (blobFormatParameter == "binary")
+		{
+			binaryCapture = true;
+		}
+		else if (blobFormatParameter == "hex")
 		{
 			dataBlobFormat = blobFormat::hex;
 		}
@@ -63,6 +150,43 @@ int main(int argc, char* argv[])
 		}
 	}
 
+	if (parameters.size() > 2 && replaying)
+	{
+		replayTiming = (parameters.at(2) == "original" ? ReplayTransport::Timing::original : ReplayTransport::Timing::fastest);
+	}
+	else if (parameters.size() > 2)
+	{
+		uint64_t value = baudrate;
+		if (!parseNumber(parameters.at(2), value))
+		{
+			std::cout << "Invalid baudrate " << parameters.at(2) << "." << std::endl;
+			return -1;
+		}
+		baudrate = static_cast<uint32_t>(value);
+	}
+
+	if (parameters.size() > 3)
+	{
+		uint64_t value = statsInterval.count();
+		if (!parseNumber(parameters.at(3), value))
+		{
+			std::cout << "Invalid stats interval " << parameters.at(3) << "." << std::endl;
+			return -1;
+		}
+		statsInterval = std::chrono::milliseconds(value);
+	}
+
+	if (parameters.size() > 4)
+	{
+		std::cout << "Too many parameters, the ones after the stats interval are given as --option=value." << std::endl;
+		return -1;
+	}
+
+	if (converting && isJournalFile(parameters.at(0)))
+		return convertJournal(parameters.at(0));
+	if (converting)
+		return convertCapture(parameters.at(0));
+
 	auto timeNow = std::time(nullptr);
 	auto timeNowTm = std::localtime(&timeNow);
 
@@ -70,43 +194,220 @@ int main(int argc, char* argv[])
 	auto stringLength = std::strftime(const_cast<char*>(timeAsString.data()), timeAsString.capacity(), "%Y %m %d %H_%M_%S", timeNowTm);
 	timeAsString.resize(stringLength);
 	auto fileName = timeAsString + std::string(" AP output.txt");
+	auto segmenting = (segmentSize > 0 || segmentInterval.count() > 0);
 
-	outputFile.open(fileName, std::ios::trunc);
-	if (!outputFile.is_open())
+	if (!binaryCapture && !segmenting)
 	{
-		std::cout << "Could not open the output file. Exiting..." << std::endl;
-		return -1;
+		outputFile.open(fileName, std::ios::trunc);
+		if (!outputFile.is_open())
+		{
+			std::cout << "Could not open the output file. Exiting..." << std::endl;
+			return -1;
+		}
 	}
 	
 	try
 	{
-		std::string comName = "\\\\.\\COM" + parameters.at(0);
-		SimpliciTi simplicitiParser(comName, writePacketToFile);
-		simplicitiParser.startAccessPoint();
+		// Several access points can be given as a comma separated list, for example "3,4,5".
+		std::vector<std::unique_ptr<SerialTransport>> transports;
+		std::vector<ReplayTransport*> replays;
+		for (auto& port : splitPortList(parameters.at(0)))
+		{
+			if (replaying)
+			{
+				replays.push_back(new ReplayTransport(port, replayTiming));
+				transports.push_back(std::unique_ptr<SerialTransport>(replays.back()));
+				continue;
+			}
+
+#ifdef _WIN32
+			auto transport = openSerialTransport("\\\\.\\COM" + port, baudrate);
+#else
+			auto transport = openSerialTransport(port, baudrate);
+#endif
+			if (recording)
+			{
+				auto rawStreamName = timeAsString + " AP " + std::to_string(transports.size()) + " raw.shmraw";
+				transport.reset(new RecordingTransport(std::move(transport), rawStreamName, baudrate));
+			}
+
+			transports.push_back(std::move(transport));
+		}
+
+		auto accessPointCount = transports.size();
+		tagAccessPoint = accessPointCount > 1;
+
+		std::unique_ptr<CaptureWriter> captureWriter;
+		if (binaryCapture)
+			captureWriter.reset(new CaptureWriter(timeAsString + std::string(" AP capture.shmcap"), static_cast<uint32_t>(accessPointCount), std::chrono::system_clock::now()));
 
-		auto timeNow2 = std::time(nullptr);
-		auto timeNowTm2 = std::localtime(&timeNow2);
-		std::string timeAsString2(50, 0);
-		auto stringLength = std::strftime(const_cast<char*>(timeAsString2.data()), timeAsString2.capacity(), "%c", timeNowTm2);
-		timeAsString2.resize(stringLength);
-		outputFile << "Start @ " << timeAsString2 << std::endl;
+		std::unique_ptr<SegmentedLog> segmentedLog;
+		if (!binaryCapture && segmenting)
+			segmentedLog.reset(new SegmentedLog(timeAsString + std::string(" AP output"), segmentSize, segmentInterval, compressSegments));
 
-		int lastCharFromConsole = 0;
-		while (lastCharFromConsole != 'x')
+		LogWriter logWriter(outputFile, [&](const LogWriter::Record& record, std::string& buffer)
 		{
-			std::this_thread::sleep_for(std::chrono::milliseconds(100));
+			if (!captureWriter)
+			{
+				formatRecord(record, buffer);
+				return;
+			}
+
+			ByteView frame = {record.data.data(), record.length};
+			captureWriter->append(record.accessPointId, record.receiveTime, record.deviceTime, decodePacketHeader(frame), frame);
+		});
+		logWriter.setSegmentedOutput(segmentedLog.get());
+
+		std::unique_ptr<PacketRingWriter> packetRing;
+		if (!sharedMemoryName.empty())
+			packetRing.reset(new PacketRingWriter(sharedMemoryName));
+
+		std::unique_ptr<CaptureJournal> journal;
+		if (!journalPath.empty())
+		{
+			journal.reset(new CaptureJournal(journalPath, journalDurability, journalSyncInterval, journalSyncSize));
+			if (journal->recoveredRecords() > 0 || journal->truncatedBytes() > 0)
+				std::cout << "Journal " << journalPath << ": recovered " << journal->recoveredRecords() << " packets, cut off "
+					<< journal->truncatedBytes() << " bytes of a torn end." << std::endl;
+			journal->start();
+		}
 
-			lastCharFromConsole = getc(stdin);
+		std::unique_ptr<StreamServer> streamServer;
+		if (!streamSocketPath.empty())
+		{
+			streamServer.reset(new StreamServer(streamSocketPath, slowClientPolicy));
+			streamServer->start();
 		}
-		// While not entered x keep looping...
 
-		simplicitiParser.stopAccessPoint();
+		CaptureSession captureSession(std::move(transports), [&](const CaptureSession::CapturedPacket& packet)
+		{
+			// Journal first, it is what is left after a crash.
+			if (journal)
+				journal->push(packet.accessPointId, packet.receiveTime, packet.deviceTime, packet.frame.data, packet.frame.size);
+			logWriter.push(packet.accessPointId, packet.receiveTime, packet.deviceTime, packet.frame.data, packet.frame.size);
+			if (packetRing)
+				packetRing->publish(static_cast<uint32_t>(packet.accessPointId), packet.receiveTime, packet.deviceTime, packet.frame.data, packet.frame.size);
+			if (streamServer)
+				streamServer->publish(packet.accessPointId, packet.receiveTime, packet.deviceTime, packet.frame.data, packet.frame.size);
+		});
+		MetricsReporter metricsReporter([&](MetricsSnapshot& snapshot)
+		{
+			auto stats = captureSession.statistics();
+			snapshot.addCounter("bytesReceived", stats.bytesReceived);
+			snapshot.addCounter("bytesDropped", stats.bytesDropped);
+			snapshot.addCounter("bytesSkipped", stats.bytesSkipped);
+			snapshot.addCounter("falseHeaders", stats.falseHeaders);
+			snapshot.addCounter("partialFrames", stats.partialFrames);
+			snapshot.addCounter("packetsReceived", stats.packetsReceived);
+			snapshot.addCounter("shortFrames", stats.shortFrames);
+			snapshot.addCounter("packetQueueStalls", stats.packetQueueStalls);
+			snapshot.addCounter("packetQueueDepth", stats.packetQueueDepth);
+			snapshot.addCounter("commandsSent", stats.commandsSent);
+			snapshot.addCounter("commandRetries", stats.commandRetries);
+			snapshot.addCounter("commandsAcknowledged", stats.commandsAcknowledged);
+			snapshot.addCounter("commandsFailed", stats.commandsFailed);
+			snapshot.addCounter("commandWrites", stats.commandWrites);
+			snapshot.addCounter("pendingPackets", captureSession.pendingPackets());
+			snapshot.addCounter("logQueueDepth", logWriter.queueDepth());
+			snapshot.addCounter("logProducerStalls", logWriter.producerStalls());
+			snapshot.addCounter("recordsWritten", logWriter.recordsWritten());
+			snapshot.addCounter("logFlushes", logWriter.flushes());
+			if (segmentedLog)
+			{
+				snapshot.addCounter("segmentsFinished", segmentedLog->segmentsFinished());
+				snapshot.addCounter("segmentOpenStalls", segmentedLog->openStalls());
+				snapshot.addCounter("segmentPreallocationFailures", segmentedLog->preallocationFailures());
+				snapshot.addCounter("segmentWriteErrors", segmentedLog->writeErrors());
+				snapshot.addCounter("segmentCompressionFailures", segmentedLog->compressionFailures());
+				snapshot.addHistogram("segmentRolloverTime", segmentedLog->rolloverTime());
+			}
+			if (packetRing)
+				snapshot.addCounter("packetsPublished", packetRing->published());
+			if (journal)
+			{
+				snapshot.addCounter("journalRecordsWritten", journal->recordsWritten());
+				snapshot.addCounter("journalBytesWritten", journal->bytesWritten());
+				snapshot.addCounter("journalSyncs", journal->syncs());
+				snapshot.addCounter("journalWriteErrors", journal->writeErrors());
+				snapshot.addCounter("journalProducerStalls", journal->producerStalls());
+				snapshot.addHistogram("journalDurableLatency", journal->durableLatency());
+			}
+			if (streamServer)
+			{
+				snapshot.addCounter("streamClients", streamServer->clientCount());
+				snapshot.addCounter("streamFramesSent", streamServer->framesSent());
+				snapshot.addCounter("streamFramesDropped", streamServer->framesDropped());
+				snapshot.addCounter("streamSlowClientsDisconnected", streamServer->slowClientsDisconnected());
+				snapshot.addCounter("streamQueueOverflows", streamServer->queueOverflows());
+				snapshot.addHistogram("streamSendLatency", streamServer->sendLatency());
+			}
+			snapshot.addHistogram("parserCallbackTime", captureSession.parserCallbackTime());
+			snapshot.addHistogram("recordCallbackTime", captureSession.recordCallbackTime());
+			snapshot.addHistogram("commandRoundTrip", captureSession.commandRoundTrip());
+			if (!binaryCapture)
+				snapshot.addHistogram("commitLatency", logWriter.commitLatency());
+		}, statsInterval.count() > 0 ? formatStatsLine : MetricsReporter::LineFormatter(),
+			statsInterval.count() > 0 ? statsInterval : std::chrono::milliseconds(1000), timeAsString + std::string(" AP metrics.json"));
+
+		captureSession.start();
+
+		if (segmentedLog)
+			segmentedLog->setHeader(formatStartLine(std::chrono::system_clock::now()) + "\n");
+		else if (!binaryCapture)
+			outputFile << formatStartLine(std::chrono::system_clock::now()) << std::endl;
+
+		// Packets received so far are waiting in the queue, they are written after the start line.
+		logWriter.start();
+		metricsReporter.start();
+
+		auto replayStart = std::chrono::steady_clock::now();
+
+		if (replaying)
+		{
+			// Replay ends by itself once all of the recorded data has been handed out.
+			while (std::any_of(replays.begin(), replays.end(), [](const ReplayTransport* replay){ return !replay->drained(); }))
+				std::this_thread::sleep_for(std::chrono::milliseconds(10));
+		}
+		else
+		{
+			int lastCharFromConsole = 0;
+			while (lastCharFromConsole != 'x')
+			{
+				std::this_thread::sleep_for(std::chrono::milliseconds(100));
+
+				lastCharFromConsole = getc(stdin);
+			}
+			// While not entered x keep looping...
+		}
+
+		captureSession.stop();
+		if (journal)
+			journal->stop();
+		logWriter.stop();
+		if (streamServer)
+			streamServer->stop();
+		metricsReporter.stop();
+
+		if (replaying)
+		{
+			std::chrono::duration<double> replayTime = std::chrono::steady_clock::now() - replayStart;
+			auto packets = captureSession.statistics().packetsLogged;
+			std::cout << "Replayed " << packets << " packets in " << replayTime.count() << " s, "
+				<< static_cast<uint64_t>(packets / replayTime.count()) << " packets/s." << std::endl;
+		}
+
+		if (captureWriter)
+			captureWriter->close();
+		if (segmentedLog)
+			segmentedLog->close();
 	}
 	catch (const std::exception& e)
 	{
 		std::cout << "Exception caught while running SimpliciTI parser." << std::endl;
 		std::cout << e.what() << std::endl;
+#ifdef _WIN32
 		std::cout << "GetLastError():" << GetLastError() << std::endl;
+#endif
 	}
 	catch (...)
 	{
@@ -124,78 +425,317 @@ static void fillParameters(int argc, char* argv[])
 		parameters.push_back(std::string(argv[i]));
 }
 
-static std::string bufferToHex(const std::vector<uint8_t>& buffer)
+// "--name=value", see the usage in the README. An empty value keeps the default.
+static bool parseOption(const std::string& option)
 {
-	std::ostringstream stringBuffer;
+	auto separator = option.find('=');
+	auto name = option.substr(2, separator == std::string::npos ? std::string::npos : separator - 2);
+	auto value = (separator == std::string::npos ? std::string() : option.substr(separator + 1));
+	uint64_t number = 0;
+
+	if (name == "shm")
+	{
+		sharedMemoryName = value;
+	}
+	else if (name == "stream")
+	{
+		streamSocketPath = value;
+	}
+	else if (name == "slow-client")
+	{
+		if (value == "disconnect")
+			slowClientPolicy = StreamServer::SlowClientPolicy::disconnect;
+		else if (value.empty() || value == "drop")
+			slowClientPolicy = StreamServer::SlowClientPolicy::dropFrames;
+		else
+			return false;
+	}
+	else if (name == "journal")
+	{
+		journalPath = value;
+	}
+	else if (name == "durability")
+	{
+		if (value == "buffered")
+			journalDurability = CaptureJournal::Durability::buffered;
+		else if (value == "packet")
+			journalDurability = CaptureJournal::Durability::everyPacket;
+		else if (value.empty() || value == "grouped")
+			journalDurability = CaptureJournal::Durability::grouped;
+		else
+			return false;
+	}
+	else if (name == "sync-ms")
+	{
+		number = journalSyncInterval.count();
+		if (!parseNumber(value, number))
+			return false;
+		journalSyncInterval = std::chrono::milliseconds(number);
+	}
+	else if (name == "sync-kb")
+	{
+		number = journalSyncSize / 1024;
+		if (!parseNumber(value, number))
+			return false;
+		journalSyncSize = static_cast<size_t>(number) * 1024;
+	}
+	else if (name == "segment-mb")
+	{
+		number = segmentSize / (1024 * 1024);
+		if (!parseNumber(value, number))
+			return false;
+		segmentSize = number * 1024 * 1024;
+	}
+	else if (name == "segment-minutes")
+	{
+		number = segmentInterval.count();
+		if (!parseNumber(value, number))
+			return false;
+		segmentInterval = std::chrono::minutes(number);
+	}
+	else if (name == "gzip" && value.empty())
+	{
+		compressSegments = true;
+	}
+	else
+	{
+		return false;
+	}
 
-	for (auto& aByte : buffer)
-		stringBuffer << std::hex << std::setw(2) << std::setfill('0') << std::uppercase << static_cast<int>(aByte) << " ";
+	return true;
+}
 
-	return stringBuffer.str();
+// Empty text leaves the value as it is, anything but a plain number is invalid.
+static bool parseNumber(const std::string& text, uint64_t& value)
+{
+	if (text.empty())
+		return true;
+	if (text.find_first_not_of("0123456789") != std::string::npos || text.size() > 18)
+		return false;
+
+	value = std::stoull(text);
+	return true;
 }
 
-static std::string bufferToAscii(const std::vector<uint8_t>& buffer)
+static std::vector<std::string> splitPortList(const std::string& portList)
 {
-	std::ostringstream stringBuffer;
+	std::vector<std::string> ports;
+	std::istringstream portStream(portList);
+	std::string port;
 
-	for (auto& aByte : buffer)
-		stringBuffer << static_cast<char>(aByte) << " ";
+	while (std::getline(portStream, port, ','))
+	{
+		if (!port.empty())
+			ports.push_back(port);
+	}
 
-	return stringBuffer.str();
+	return ports;
 }
 
-static std::string bufferToNumber(const std::vector<uint8_t>& buffer)
+static std::string formatStartLine(std::chrono::system_clock::time_point startTime)
 {
-	std::ostringstream stringBuffer;
+	auto startTimeT = std::chrono::system_clock::to_time_t(startTime);
+	auto startTimeTm = std::localtime(&startTimeT);
+	std::string startTimeAsString(50, 0);
+	auto stringLength = std::strftime(const_cast<char*>(startTimeAsString.data()), startTimeAsString.capacity(), "%c", startTimeTm);
+	startTimeAsString.resize(stringLength);
 
-	for (auto& aByte : buffer)
-		stringBuffer << static_cast<uint32_t>(aByte) << " ";
+	return "Start @ " + startTimeAsString;
+}
 
-	return stringBuffer.str();
+static void formatRecord(const LogWriter::Record& record, std::string& buffer)
+{
+	ByteView packet = {record.data.data(), record.length};
+
+	formatPacket(record.accessPointId, record.receiveTime, record.deviceTime, decodePacketHeader(packet), packet.size, buffer);
 }
 
-static void writePacketToFile(const std::vector<uint8_t>& packet)
+// Device time is printed corrected onto the host clock as well, to the millisecond, right after the raw one.
+static void formatPacket(size_t accessPointId, std::chrono::system_clock::time_point receiveTime, std::chrono::system_clock::time_point deviceTime,
+	const PacketHeader& header, size_t frameSize, std::string& buffer)
 {
-	time_t timestamp = 0;
-	timestamp |= (0x000000FF & packet[1]);
-	timestamp |= ((0x000000FF & packet[2]) << 8);
-	timestamp |= ((0x000000FF & packet[3]) << 16);
-	timestamp |= ((0x000000FF & packet[4]) << 24);
-
-	auto timestampTm = std::localtime(&timestamp);
-	std::string timestampAsString(30, 0);
-	auto timestampLength = std::strftime(const_cast<char*>(timestampAsString.data()), timestampAsString.capacity(), "%c", timestampTm);
-	timestampAsString.resize(timestampLength);
-
-	uint16_t milliseconds = 0;
-	milliseconds |= (0x00FF & packet[5]);
-	milliseconds |= ((0x00FF & packet[6]) << 8);
-
-	std::string formattedBlob;
-	auto packetBlob = std::vector<uint8_t>(packet.begin() + 7, packet.end());
+	if (tagAccessPoint)
+	{
+		buffer += "AP ";
+		appendNumber(buffer, accessPointId);
+		buffer += ", ";
+	}
+
+	hostTimeFormatter.append(buffer, std::chrono::system_clock::to_time_t(receiveTime));
+	buffer += ", ";
+	appendNumber(buffer, frameSize);
+	buffer += " bytes, link ";
+	appendNumber(buffer, header.link);
+	buffer += ", ";
+	deviceTimestampFormatter.append(buffer, header.timestamp);
+	buffer += ';';
+	appendNumber(buffer, header.milliseconds);
+	buffer += ", ";
+
+	auto deviceMilliseconds = std::chrono::duration_cast<std::chrono::milliseconds>(deviceTime.time_since_epoch()).count() % 1000;
+	deviceTimeFormatter.append(buffer, std::chrono::system_clock::to_time_t(deviceTime), static_cast<unsigned>(deviceMilliseconds));
+	buffer += ", ";
+
+	auto& packetBlob = header.payload;
 	switch (dataBlobFormat)
 	{
 	case blobFormat::ascii:
-		formattedBlob = bufferToAscii(packetBlob);
+		appendAscii(buffer, packetBlob.data, packetBlob.size);
 		break;
 	case blobFormat::hex:
-		formattedBlob = bufferToHex(packetBlob);
+		appendHex(buffer, packetBlob.data, packetBlob.size);
 		break;
 	case blobFormat::number:
-		formattedBlob = bufferToNumber(packetBlob);
+		appendDecimal(buffer, packetBlob.data, packetBlob.size);
 		break;
 	default:
-			throw std::exception("No BLOB format specified - programming error.");
+			throw std::runtime_error("No BLOB format specified - programming error.");
 		break;
 	}
 
-	auto timeNow = std::time(nullptr);
-	auto timeNowTm = std::localtime(&timeNow);
+	buffer += '\n';
+}
 
-	std::string timeAsString(30, 0);
-	auto stringLength = std::strftime(const_cast<char*>(timeAsString.data()), timeAsString.capacity(), "%H:%M:%S", timeNowTm);
-	timeAsString.resize(stringLength);
+static std::string formatStatsLine(const MetricsSnapshot& snapshot)
+{
+	std::ostringstream line;
+
+	line << "Packets received: " << snapshot.counter("packetsReceived") << ". In total " << snapshot.counter("bytesReceived") << " bytes."
+		<< " Skipped " << snapshot.counter("bytesSkipped") << ", dropped " << snapshot.counter("bytesDropped") << " bytes.";
+
+	// Binary captures have no text log to commit.
+	auto commitLatency = snapshot.histogram("commitLatency");
+	if (commitLatency.count() > 0)
+		line << " Log latency p99 " << commitLatency.percentile(0.99) / 1000 << " ms.";
+
+	return line.str();
+}
+
+// Writes the text log of a binary capture next to it, same as it would have been written during the capture.
+static int convertCapture(const std::string& capturePath)
+{
+	try
+	{
+		CaptureReader capture(capturePath);
+
+		if (!capture.hasIndex())
+			std::cout << "Capture was not closed properly, reading " << capture.blockCount() << " complete blocks." << std::endl;
+
+		outputFile.open(capturePath + ".txt", std::ios::trunc);
+		if (!outputFile.is_open())
+		{
+			std::cout << "Could not open the output file. Exiting..." << std::endl;
+			return -1;
+		}
+
+		tagAccessPoint = capture.accessPointCount() > 1;
+		outputFile << formatStartLine(fromCaptureTime(capture.startTimeNs())) << std::endl;
 
-	outputFile << timeAsString << ", " << packet.size() << " bytes," << " link " << static_cast<uint32_t>(packet[0]) << ", " << timestampAsString
-		<< ";" << milliseconds << ", " << formattedBlob << std::endl;
-}
\ No newline at end of file
+		std::string buffer;
+		size_t recordCount = 0;
+		CaptureReader::Record record;
+		auto cursor = capture.records();
+
+		while (cursor.next(record))
+		{
+			PacketHeader header = {};
+			header.link = record.header->link;
+			header.payload = record.payload;
+
+			// Short frames carry the raw frame as payload, the log never showed any payload for them.
+			if (record.isShortFrame())
+			{
+				header.payload.data += header.payload.size;
+				header.payload.size = 0;
+			}
+			else
+			{
+				header.timestamp = record.header->deviceTimestamp;
+				header.milliseconds = record.header->milliseconds;
+			}
+
+			auto receiveTime = fromCaptureTime(record.header->hostTimeNs);
+			auto deviceTime = receiveTime;
+			if (!record.isShortFrame())
+				deviceTime = fromCaptureTime(record.deviceTimeMs() * 1000000);
+
+			formatPacket(record.header->accessPointId, receiveTime, deviceTime, header, record.frameLength(), buffer);
+			recordCount++;
+
+			if (buffer.size() >= 64 * 1024)
+			{
+				outputFile << buffer;
+				buffer.clear();
+			}
+		}
+
+		outputFile << buffer;
+		outputFile.close();
+
+		std::cout << "Converted " << recordCount << " packets." << std::endl;
+	}
+	catch (const std::exception& e)
+	{
+		std::cout << "Exception caught while converting the capture." << std::endl;
+		std::cout << e.what() << std::endl;
+		return -1;
+	}
+
+	return 0;
+}
+
+// Writes the text log of the packets in a journal next to it, up to the first torn record.
+static int convertJournal(const std::string& journalPath)
+{
+	try
+	{
+		JournalReader journal(journalPath);
+		JournalReader::Record record;
+
+		// The journal does not say how many access points there were, the records do.
+		JournalReader accessPointScan(journalPath);
+		while (!tagAccessPoint && accessPointScan.next(record))
+			tagAccessPoint = record.accessPointId > 0;
+
+		outputFile.open(journalPath + ".txt", std::ios::trunc);
+		if (!outputFile.is_open())
+		{
+			std::cout << "Could not open the output file. Exiting..." << std::endl;
+			return -1;
+		}
+
+		std::string buffer;
+		size_t recordCount = 0;
+
+		while (journal.next(record))
+		{
+			if (recordCount == 0)
+				outputFile << formatStartLine(record.receiveTime) << std::endl;
+
+			ByteView frame = {record.data, record.length};
+			formatPacket(record.accessPointId, record.receiveTime, record.deviceTime, decodePacketHeader(frame), frame.size, buffer);
+			recordCount++;
+
+			if (buffer.size() >= 64 * 1024)
+			{
+				outputFile << buffer;
+				buffer.clear();
+			}
+		}
+
+		outputFile << buffer;
+		outputFile.close();
+
+		std::cout << "Converted " << recordCount << " packets." << std::endl;
+		if (journal.validLength() < journal.fileLength())
+			std::cout << "The last " << journal.fileLength() - journal.validLength() << " bytes are torn, they were left out." << std::endl;
+	}
+	catch (const std::exception& e)
+	{
+		std::cout << "Exception caught while converting the journal." << std::endl;
+		std::cout << e.what() << std::endl;
+		return -1;
+	}
+
+	return 0;
+}
@@ -0,0 +1,60 @@
+#include "memory_transport.h"
+
+#include <algorithm>
+
+MemoryTransport::MemoryTransport(std::chrono::milliseconds readTimeout) : m_readTimeout(readTimeout), m_readPosition(0)
+{
+}
+
+void MemoryTransport::feed(const uint8_t* data, size_t length)
+{
+	{
+		std::lock_guard<std::mutex> guard(m_lock);
+
+		// Drop what has been read already, so the buffer would not grow forever.
+		m_incoming.erase(m_incoming.begin(), m_incoming.begin() + m_readPosition);
+		m_readPosition = 0;
+		m_incoming.insert(m_incoming.end(), data, data + length);
+	}
+
+	m_dataFed.notify_one();
+}
+
+std::vector<uint8_t> MemoryTransport::takeWritten()
+{
+	std::lock_guard<std::mutex> guard(m_lock);
+
+	std::vector<uint8_t> written;
+	written.swap(m_written);
+
+	return written;
+}
+
+size_t MemoryTransport::read(uint8_t* buffer, size_t length)
+{
+	std::unique_lock<std::mutex> guard(m_lock);
+
+	if (!m_dataFed.wait_for(guard, m_readTimeout, [&]{ return m_readPosition < m_incoming.size(); }))
+		return 0;
+
+	auto readBytes = std::min(length, m_incoming.size() - m_readPosition);
+	std::copy(m_incoming.begin() + m_readPosition, m_incoming.begin() + m_readPosition + readBytes, buffer);
+	m_readPosition += readBytes;
+
+	return readBytes;
+}
+
+bool MemoryTransport::write(const uint8_t* data, size_t length)
+{
+	std::lock_guard<std::mutex> guard(m_lock);
+	m_written.insert(m_written.end(), data, data + length);
+
+	return true;
+}
+
+void MemoryTransport::flush()
+{
+	std::lock_guard<std::mutex> guard(m_lock);
+	m_incoming.clear();
+	m_readPosition = 0;
+}
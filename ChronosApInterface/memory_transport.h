@@ -0,0 +1,34 @@
+#pragma once
+
+#include <chrono>
+#include <condition_variable>
+#include <mutex>
+#include <vector>
+
+#include "serial_transport.h"
+
+// In-memory stand-in for the access point. Whatever is fed in is handed out by read(), written
+// commands are collected and can be fetched for inspection. Useful for running the parsing pipeline
+// without the dongle attached.
+class MemoryTransport : public SerialTransport
+{
+public:
+	// Read blocks up to readTimeout when there is nothing fed, like the COM port does.
+	explicit MemoryTransport(std::chrono::milliseconds readTimeout = std::chrono::milliseconds(20));
+
+	void feed(const uint8_t* data, size_t length);
+	std::vector<uint8_t> takeWritten();
+
+	using SerialTransport::read;
+	size_t read(uint8_t* buffer, size_t length);
+	bool write(const uint8_t* data, size_t length);
+	void flush();
+
+private:
+	std::chrono::milliseconds m_readTimeout;
+	std::mutex m_lock;
+	std::condition_variable m_dataFed;
+	std::vector<uint8_t> m_incoming;
+	size_t m_readPosition;
+	std::vector<uint8_t> m_written;
+};
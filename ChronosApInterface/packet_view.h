@@ -0,0 +1,50 @@
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+
+// Non-owning view of bytes, valid only for as long as the buffer it points into.
+struct ByteView
+{
+	const uint8_t* data;
+	size_t size;
+
+	const uint8_t* begin() const { return data; }
+	const uint8_t* end() const { return data + size; }
+	const uint8_t& operator[](size_t index) const { return data[index]; }
+	bool empty() const { return size == 0; }
+};
+
+// Fields of a packet from the watch as relayed by the access point, payload points into the same frame.
+struct PacketHeader
+{
+	uint8_t link;
+	uint32_t timestamp;		// Seconds since the epoch on the device clock.
+	uint16_t milliseconds;
+	ByteView payload;
+};
+
+// Link, 4 byte timestamp and 2 byte milliseconds before the payload.
+const size_t packetHeaderLength = 7;
+
+// When the frame is too short to hold the header, everything besides the link is left zero and the
+// payload empty, frame size tells these apart from real packets.
+inline PacketHeader decodePacketHeader(ByteView frame)
+{
+	PacketHeader header = {};
+	header.payload.data = frame.data + frame.size;
+
+	if (frame.size > 0)
+		header.link = frame[0];
+
+	if (frame.size < packetHeaderLength)
+		return header;
+
+	header.timestamp = static_cast<uint32_t>(frame[1]) | (static_cast<uint32_t>(frame[2]) << 8) |
+		(static_cast<uint32_t>(frame[3]) << 16) | (static_cast<uint32_t>(frame[4]) << 24);
+	header.milliseconds = static_cast<uint16_t>(frame[5] | (frame[6] << 8));
+	header.payload.data = frame.data + packetHeaderLength;
+	header.payload.size = frame.size - packetHeaderLength;
+
+	return header;
+}
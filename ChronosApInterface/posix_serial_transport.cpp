@@ -0,0 +1,196 @@
+#ifndef _WIN32
+
+#include "posix_serial_transport.h"
+
+#include <cerrno>
+#include <chrono>
+#include <stdexcept>
+#include <thread>
+
+#include <fcntl.h>
+#include <poll.h>
+#include <sys/epoll.h>
+#include <sys/uio.h>
+#include <termios.h>
+#include <unistd.h>
+
+namespace
+{
+	speed_t toSpeed(uint32_t baudrate)
+	{
+		switch (baudrate)
+		{
+		case 9600: return B9600;
+		case 19200: return B19200;
+		case 38400: return B38400;
+		case 57600: return B57600;
+		case 115200: return B115200;
+		case 230400: return B230400;
+		case 460800: return B460800;
+		case 500000: return B500000;
+		case 576000: return B576000;
+		case 921600: return B921600;
+		default:
+			throw std::runtime_error("Unsupported baud rate for the serial port.");
+		}
+	}
+}
+
+PosixSerialTransport::PosixSerialTransport(const std::string& devicePath, uint32_t baudrate, int readTimeoutMs) :
+	m_fileDescriptor(-1),
+	m_epollDescriptor(-1),
+	m_readTimeoutMs(readTimeoutMs),
+	m_disconnected(false)
+{
+	auto speed = toSpeed(baudrate);
+
+	m_fileDescriptor = open(devicePath.c_str(), O_RDWR | O_NOCTTY | O_NONBLOCK | O_CLOEXEC);
+	if (m_fileDescriptor < 0)
+		throw std::runtime_error("Could not open the serial port " + devicePath + ".");
+
+	termios settings;
+	if (tcgetattr(m_fileDescriptor, &settings) != 0)
+	{
+		close(m_fileDescriptor);
+		throw std::runtime_error(devicePath + " is not a serial port.");
+	}
+
+	// 8N1, no flow control and no line processing of any kind, same as the Win32 DCB setup.
+	cfmakeraw(&settings);
+	settings.c_cflag |= CLOCAL | CREAD;
+	settings.c_cflag &= ~(CSTOPB | CRTSCTS);
+	settings.c_iflag &= ~(IXON | IXOFF | IXANY);
+	// Reads never block in the kernel, waiting is done with epoll.
+	settings.c_cc[VMIN] = 0;
+	settings.c_cc[VTIME] = 0;
+	cfsetispeed(&settings, speed);
+	cfsetospeed(&settings, speed);
+
+	if (tcsetattr(m_fileDescriptor, TCSANOW, &settings) != 0)
+	{
+		close(m_fileDescriptor);
+		throw std::runtime_error("Could not configure the serial port " + devicePath + ".");
+	}
+
+	tcflush(m_fileDescriptor, TCIOFLUSH);
+
+	m_epollDescriptor = epoll_create1(EPOLL_CLOEXEC);
+	epoll_event event = {};
+	event.events = EPOLLIN;
+	event.data.fd = m_fileDescriptor;
+	if (m_epollDescriptor < 0 || epoll_ctl(m_epollDescriptor, EPOLL_CTL_ADD, m_fileDescriptor, &event) != 0)
+	{
+		if (m_epollDescriptor >= 0)
+			close(m_epollDescriptor);
+		close(m_fileDescriptor);
+		throw std::runtime_error("Could not set up polling for the serial port " + devicePath + ".");
+	}
+}
+
+PosixSerialTransport::~PosixSerialTransport()
+{
+	tcflush(m_fileDescriptor, TCIOFLUSH);
+	close(m_epollDescriptor);
+	close(m_fileDescriptor);
+}
+
+uint32_t PosixSerialTransport::waitForData()
+{
+	// Every wait would return right away from now on, so the read timeout is waited out here instead.
+	if (m_disconnected)
+	{
+		std::this_thread::sleep_for(std::chrono::milliseconds(m_readTimeoutMs));
+		return 0;
+	}
+
+	epoll_event event;
+	int readyCount;
+
+	do
+	{
+		readyCount = epoll_wait(m_epollDescriptor, &event, 1, m_readTimeoutMs);
+	}
+	while (readyCount < 0 && errno == EINTR);
+
+	return (readyCount > 0 ? event.events : 0);
+}
+
+size_t PosixSerialTransport::read(uint8_t* buffer, size_t length)
+{
+	Buffer single = {buffer, length};
+
+	return read(&single, 1);
+}
+
+size_t PosixSerialTransport::read(const Buffer* buffers, size_t bufferCount)
+{
+	auto events = waitForData();
+
+	// Hang up or error with nothing left to read, the device was unplugged or the other end of the pty closed.
+	if ((events & (EPOLLHUP | EPOLLERR)) != 0 && (events & EPOLLIN) == 0)
+		m_disconnected = true;
+
+	if ((events & EPOLLIN) == 0)
+		return 0;
+
+	iovec vectors[4];
+	int vectorCount = 0;
+	for (size_t i = 0; i < bufferCount && vectorCount < 4; i++)
+	{
+		if (buffers[i].length == 0)
+			continue;
+
+		vectors[vectorCount].iov_base = buffers[i].data;
+		vectors[vectorCount].iov_len = buffers[i].length;
+		vectorCount++;
+	}
+
+	if (vectorCount == 0)
+		return 0;
+
+	ssize_t readBytes;
+	do
+	{
+		readBytes = readv(m_fileDescriptor, vectors, vectorCount);
+	}
+	while (readBytes < 0 && errno == EINTR);
+
+	// A hung up tty reads as end of file or EIO even when epoll reported it readable.
+	if ((readBytes < 0 && errno == EIO) || (readBytes <= 0 && (events & (EPOLLHUP | EPOLLERR)) != 0))
+		m_disconnected = true;
+
+	return (readBytes > 0 ? static_cast<size_t>(readBytes) : 0);
+}
+
+bool PosixSerialTransport::write(const uint8_t* data, size_t length)
+{
+	// Same timeout as the Win32 driver uses.
+	int timeoutMs = static_cast<int>(20 * length + 60);
+	size_t written = 0;
+
+	while (written < length)
+	{
+		auto result = ::write(m_fileDescriptor, data + written, length - written);
+		if (result > 0)
+		{
+			written += result;
+			continue;
+		}
+
+		if (result < 0 && errno != EAGAIN && errno != EINTR)
+			return false;
+
+		pollfd writable = {m_fileDescriptor, POLLOUT, 0};
+		if (poll(&writable, 1, timeoutMs) <= 0)
+			return false;
+	}
+
+	return tcdrain(m_fileDescriptor) == 0;
+}
+
+void PosixSerialTransport::flush()
+{
+	tcflush(m_fileDescriptor, TCIOFLUSH);
+}
+
+#endif
@@ -0,0 +1,36 @@
+#pragma once
+
+#include <atomic>
+#include <string>
+
+#include "serial_transport.h"
+
+// Access point behind a tty device (for example /dev/ttyACM0) on Linux. Port is put into raw mode and
+// used non-blocking, reads wait for data with epoll up to the read timeout and then take everything
+// available with a single readv. A hang up ends the reading for good, later reads just wait out the timeout.
+class PosixSerialTransport : public SerialTransport
+{
+public:
+	// Supported baud rates are the standard ones from 9600 up to 921600.
+	PosixSerialTransport(const std::string& devicePath, uint32_t baudrate = 115200, int readTimeoutMs = 20);
+	~PosixSerialTransport();
+
+	using SerialTransport::read;
+	size_t read(uint8_t* buffer, size_t length);
+	size_t read(const Buffer* buffers, size_t bufferCount);
+	bool write(const uint8_t* data, size_t length);
+	void flush();
+	bool disconnected() const { return m_disconnected; }
+
+private:
+	PosixSerialTransport(const PosixSerialTransport&);
+	PosixSerialTransport& operator=(const PosixSerialTransport&);
+
+	// Events epoll reported for the port, 0 on timeout.
+	uint32_t waitForData();
+
+	int m_fileDescriptor;
+	int m_epollDescriptor;
+	int m_readTimeoutMs;
+	std::atomic<bool> m_disconnected;
+};
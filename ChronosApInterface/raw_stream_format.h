@@ -0,0 +1,39 @@
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+
+#include "capture_format.h"
+
+// Raw serial stream recording, exactly what went over the port with the boundaries of every read and
+// write call. Same conventions as the capture file: little endian, written as in memory, 8 byte aligned.
+//
+//   RawStreamFileHeader
+//   RawStreamChunkHeader + data padded to 8 bytes, for every read that returned data and every write
+//
+// Nothing is written at the end, a recording that was cut short is complete up to its last whole chunk.
+
+const char rawStreamFileMagic[8] = {'S', 'H', 'M', 'R', 'A', 'W', '0', '1'};
+const uint32_t rawStreamFileVersion = 1;
+
+const uint8_t rawStreamRead = 0;	// Bytes from the access point.
+const uint8_t rawStreamWrite = 1;	// Bytes to the access point, a command.
+
+struct RawStreamFileHeader
+{
+	char magic[8];
+	uint32_t version;
+	uint32_t baudrate;
+	int64_t startTimeNs;		// Host time when the recording was started, nanoseconds since the epoch.
+};
+
+struct RawStreamChunkHeader
+{
+	int64_t offsetNs;			// Time since the start of the recording when the call returned.
+	uint32_t length;
+	uint8_t direction;
+	uint8_t reserved[3];
+};
+
+static_assert(sizeof(RawStreamFileHeader) == 24, "Raw stream file header layout changed.");
+static_assert(sizeof(RawStreamChunkHeader) == 16, "Raw stream chunk header layout changed.");
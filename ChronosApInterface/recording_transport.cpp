@@ -0,0 +1,80 @@
+#include "recording_transport.h"
+
+#include <algorithm>
+#include <cstring>
+#include <stdexcept>
+
+#include "capture_writer.h"
+#include "raw_stream_format.h"
+
+RecordingTransport::RecordingTransport(std::unique_ptr<SerialTransport> transport, const std::string& path, uint32_t baudrate) :
+	m_transport(std::move(transport)),
+	m_startTime(std::chrono::steady_clock::now())
+{
+	m_file.open(path, std::ios::binary | std::ios::trunc);
+	if (!m_file.is_open())
+		throw std::runtime_error("Could not open the raw stream file " + path + ".");
+
+	RawStreamFileHeader fileHeader = {};
+	std::memcpy(fileHeader.magic, rawStreamFileMagic, sizeof(fileHeader.magic));
+	fileHeader.version = rawStreamFileVersion;
+	fileHeader.baudrate = baudrate;
+	fileHeader.startTimeNs = toCaptureTime(std::chrono::system_clock::now());
+
+	m_file.write(reinterpret_cast<const char*>(&fileHeader), sizeof(fileHeader));
+}
+
+size_t RecordingTransport::read(uint8_t* buffer, size_t length)
+{
+	Buffer single = {buffer, length};
+
+	return read(&single, 1);
+}
+
+size_t RecordingTransport::read(const Buffer* buffers, size_t bufferCount)
+{
+	auto readBytes = m_transport->read(buffers, bufferCount);
+
+	if (readBytes > 0)
+		appendChunk(rawStreamRead, buffers, bufferCount, readBytes);
+
+	return readBytes;
+}
+
+bool RecordingTransport::write(const uint8_t* data, size_t length)
+{
+	Buffer single = {const_cast<uint8_t*>(data), length};
+	appendChunk(rawStreamWrite, &single, 1, length);
+
+	return m_transport->write(data, length);
+}
+
+void RecordingTransport::flush()
+{
+	m_transport->flush();
+}
+
+void RecordingTransport::appendChunk(uint8_t direction, const Buffer* buffers, size_t bufferCount, size_t length)
+{
+	RawStreamChunkHeader chunk = {};
+	chunk.offsetNs = std::chrono::duration_cast<std::chrono::nanoseconds>(std::chrono::steady_clock::now() - m_startTime).count();
+	chunk.length = static_cast<uint32_t>(length);
+	chunk.direction = direction;
+
+	const char padding[8] = {};
+
+	std::lock_guard<std::mutex> guard(m_fileLock);
+
+	m_file.write(reinterpret_cast<const char*>(&chunk), sizeof(chunk));
+
+	// Scatter reads fill the buffers in order, so the data is the first length bytes over all of them.
+	auto remaining = length;
+	for (size_t i = 0; i < bufferCount && remaining > 0; i++)
+	{
+		auto part = std::min(buffers[i].length, remaining);
+		m_file.write(reinterpret_cast<const char*>(buffers[i].data), part);
+		remaining -= part;
+	}
+
+	m_file.write(padding, capturePaddedLength(length) - length);
+}
@@ -0,0 +1,34 @@
+#pragma once
+
+#include <chrono>
+#include <fstream>
+#include <memory>
+#include <mutex>
+#include <string>
+
+#include "serial_transport.h"
+
+// Passes everything through to another transport and saves the stream into a raw stream file on the way,
+// see raw_stream_format.h. The recording can be played back later with ReplayTransport.
+class RecordingTransport : public SerialTransport
+{
+public:
+	RecordingTransport(std::unique_ptr<SerialTransport> transport, const std::string& path, uint32_t baudrate);
+
+	size_t read(uint8_t* buffer, size_t length);
+	size_t read(const Buffer* buffers, size_t bufferCount);
+	bool write(const uint8_t* data, size_t length);
+	void flush();
+	bool mustBeDrained() const { return m_transport->mustBeDrained(); }
+	bool disconnected() const { return m_transport->disconnected(); }
+
+private:
+	void appendChunk(uint8_t direction, const Buffer* buffers, size_t bufferCount, size_t length);
+
+	std::unique_ptr<SerialTransport> m_transport;
+	std::chrono::steady_clock::time_point m_startTime;
+
+	// Reads and writes come from different threads.
+	std::mutex m_fileLock;
+	std::ofstream m_file;
+};
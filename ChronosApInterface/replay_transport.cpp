@@ -0,0 +1,261 @@
+#include "replay_transport.h"
+
+#include <algorithm>
+#include <cstring>
+#include <stdexcept>
+#include <thread>
+
+#include "raw_stream_format.h"
+
+namespace
+{
+	// The access point answers a command with the command itself, this in place of the command byte.
+	const uint8_t acknowledgementByte = 0x06;
+	// Answers come within milliseconds, they are looked for only this far into the data after the command.
+	const size_t acknowledgementSearchLength = 4096;
+
+	// Commands of a write one by one, by their length bytes, each as its acknowledgement.
+	template <typename Handler>
+	void forEachAcknowledgement(const uint8_t* data, size_t length, Handler handler)
+	{
+		std::vector<uint8_t> acknowledgement;
+		for (size_t offset = 0; offset + 3 <= length && data[offset + 2] >= 3; offset += data[offset + 2])
+		{
+			acknowledgement.assign(data + offset, data + std::min<size_t>(length, offset + data[offset + 2]));
+			acknowledgement[1] = acknowledgementByte;
+			handler(acknowledgement);
+		}
+	}
+}
+
+ReplayTransport::ReplayTransport(const std::string& path, Timing timing, std::chrono::milliseconds readTimeout) :
+	m_file(path),
+	m_baudrate(0),
+	m_timing(timing),
+	m_readTimeout(readTimeout),
+	m_handshakeCommands(0),
+	m_acknowledgementsRemoved(0),
+	m_nextChunk(0),
+	m_positionInChunk(0),
+	m_commandsWritten(0),
+	m_handshakeOffsetNs(0),
+	m_syncOffsetNs(0),
+	m_syncTime(std::chrono::steady_clock::now())
+{
+	if (m_file.size() < sizeof(RawStreamFileHeader))
+		throw std::runtime_error(path + " is not a raw stream recording.");
+
+	auto fileHeader = reinterpret_cast<const RawStreamFileHeader*>(m_file.data());
+	if (std::memcmp(fileHeader->magic, rawStreamFileMagic, sizeof(fileHeader->magic)) != 0 || fileHeader->version != rawStreamFileVersion)
+		throw std::runtime_error(path + " is not a raw stream recording.");
+
+	m_baudrate = fileHeader->baudrate;
+
+	// Writes are kept with the amount of data read before them.
+	std::vector<Chunk> reads;
+	std::vector<Chunk> writes;
+	std::vector<size_t> writePositions;
+	size_t readLength = 0;
+
+	// Last chunk may have been cut short when the recording was not stopped properly, it is left out.
+	size_t offset = sizeof(RawStreamFileHeader);
+	while (offset + sizeof(RawStreamChunkHeader) <= m_file.size())
+	{
+		auto chunkHeader = reinterpret_cast<const RawStreamChunkHeader*>(m_file.data() + offset);
+		auto dataOffset = offset + sizeof(RawStreamChunkHeader);
+		if (dataOffset + chunkHeader->length > m_file.size())
+			break;
+
+		Chunk chunk = {chunkHeader->offsetNs, m_file.data() + dataOffset, chunkHeader->length};
+		if (chunkHeader->direction == rawStreamWrite)
+		{
+			writes.push_back(chunk);
+			writePositions.push_back(readLength);
+		}
+		else if (chunk.length > 0)
+		{
+			reads.push_back(chunk);
+			readLength += chunk.length;
+		}
+
+		offset = dataOffset + capturePaddedLength(chunkHeader->length);
+	}
+
+	splitRecording(reads, writes, writePositions);
+}
+
+void ReplayTransport::splitRecording(const std::vector<Chunk>& reads, const std::vector<Chunk>& writes, const std::vector<size_t>& writePositions)
+{
+	// Positions are counted over all of the read data as one stream.
+	std::vector<size_t> readStarts;
+	size_t readLength = 0;
+	for (auto& read : reads)
+	{
+		readStarts.push_back(readLength);
+		readLength += read.length;
+	}
+
+	auto byteAt = [&](size_t position)
+	{
+		auto chunk = static_cast<size_t>(std::upper_bound(readStarts.begin(), readStarts.end(), position) - readStarts.begin()) - 1;
+		return reads[chunk].data[position - readStarts[chunk]];
+	};
+
+	// Access point answers in order, every search starts behind the acknowledgement found last.
+	std::vector<std::pair<size_t, size_t>> removed;
+	size_t searchFrom = 0;
+	std::vector<uint8_t> window;
+
+	for (size_t i = 0; i < writes.size(); i++)
+	{
+		forEachAcknowledgement(writes[i].data, writes[i].length, [&](const std::vector<uint8_t>& acknowledgement)
+		{
+			auto from = std::max(searchFrom, writePositions[i]);
+			auto to = std::min(readLength, from + acknowledgementSearchLength);
+
+			window.clear();
+			for (auto position = from; position < to; position++)
+				window.push_back(byteAt(position));
+
+			auto found = std::search(window.begin(), window.end(), acknowledgement.begin(), acknowledgement.end());
+			if (found == window.end())
+				return;
+
+			auto start = from + static_cast<size_t>(found - window.begin());
+			removed.push_back(std::make_pair(start, start + acknowledgement.size()));
+			searchFrom = start + acknowledgement.size();
+			m_acknowledgementsRemoved++;
+		});
+	}
+
+	// Commands written before the first byte that is not an acknowledgement are the handshake.
+	size_t firstData = 0;
+	for (auto& range : removed)
+	{
+		if (range.first > firstData)
+			break;
+		firstData = range.second;
+	}
+
+	if (firstData < readLength)
+	{
+		while (m_handshakeCommands < writes.size() && writePositions[m_handshakeCommands] <= firstData)
+			m_handshakeCommands++;
+	}
+
+	if (m_handshakeCommands > 0)
+		m_handshakeOffsetNs = writes[m_handshakeCommands - 1].offsetNs;
+
+	// Every read without the acknowledgements in it, in as many pieces as it takes.
+	size_t range = 0;
+	for (size_t i = 0; i < reads.size(); i++)
+	{
+		auto start = readStarts[i];
+		auto end = start + reads[i].length;
+		auto position = start;
+
+		while (position < end)
+		{
+			while (range < removed.size() && removed[range].second <= position)
+				range++;
+
+			auto keptEnd = (range < removed.size() ? std::min(end, std::max(position, removed[range].first)) : end);
+			if (keptEnd > position)
+			{
+				Chunk chunk = {reads[i].offsetNs, reads[i].data + (position - start), keptEnd - position};
+				m_chunks.push_back(chunk);
+			}
+
+			position = keptEnd;
+			if (range < removed.size() && position >= removed[range].first)
+				position = std::min(end, removed[range].second);
+		}
+	}
+}
+
+size_t ReplayTransport::read(uint8_t* buffer, size_t length)
+{
+	auto deadline = std::chrono::steady_clock::now() + m_readTimeout;
+	std::unique_lock<std::mutex> guard(m_lock);
+
+	// Recorded data waits for the handshake, the answers to commands do not.
+	m_changed.wait_until(guard, deadline, [&]
+	{
+		return !m_acknowledgements.empty() || (m_commandsWritten >= m_handshakeCommands && m_nextChunk < m_chunks.size());
+	});
+
+	if (!m_acknowledgements.empty())
+		return readAcknowledgements(buffer, length);
+
+	if (m_commandsWritten < m_handshakeCommands || m_nextChunk >= m_chunks.size())
+		return 0;
+
+	auto& chunk = m_chunks[m_nextChunk];
+
+	if (m_timing == Timing::original)
+	{
+		auto dueTime = m_syncTime + std::chrono::duration_cast<std::chrono::steady_clock::duration>(std::chrono::nanoseconds(chunk.offsetNs - m_syncOffsetNs));
+		if (m_changed.wait_until(guard, std::min(dueTime, deadline), [&]{ return !m_acknowledgements.empty(); }))
+			return readAcknowledgements(buffer, length);
+
+		if (dueTime > deadline)
+			return 0;
+	}
+
+	auto readBytes = std::min(length, chunk.length - m_positionInChunk);
+	std::copy(chunk.data + m_positionInChunk, chunk.data + m_positionInChunk + readBytes, buffer);
+	m_positionInChunk += readBytes;
+
+	if (m_positionInChunk == chunk.length)
+	{
+		m_nextChunk++;
+		m_positionInChunk = 0;
+	}
+
+	return readBytes;
+}
+
+size_t ReplayTransport::readAcknowledgements(uint8_t* buffer, size_t length)
+{
+	auto readBytes = std::min(length, m_acknowledgements.size());
+	std::copy(m_acknowledgements.begin(), m_acknowledgements.begin() + readBytes, buffer);
+	m_acknowledgements.erase(m_acknowledgements.begin(), m_acknowledgements.begin() + readBytes);
+
+	return readBytes;
+}
+
+bool ReplayTransport::write(const uint8_t* data, size_t length)
+{
+	{
+		std::lock_guard<std::mutex> guard(m_lock);
+
+		forEachAcknowledgement(data, length, [&](const std::vector<uint8_t>& acknowledgement)
+		{
+			m_acknowledgements.insert(m_acknowledgements.end(), acknowledgement.begin(), acknowledgement.end());
+		});
+
+		m_commandsWritten++;
+		if (m_commandsWritten == m_handshakeCommands)
+		{
+			m_syncOffsetNs = m_handshakeOffsetNs;
+			m_syncTime = std::chrono::steady_clock::now();
+		}
+	}
+
+	m_changed.notify_all();
+
+	return true;
+}
+
+void ReplayTransport::flush()
+{
+	std::lock_guard<std::mutex> guard(m_lock);
+	m_acknowledgements.clear();
+}
+
+bool ReplayTransport::drained() const
+{
+	std::lock_guard<std::mutex> guard(m_lock);
+
+	return m_acknowledgements.empty() && m_nextChunk >= m_chunks.size();
+}
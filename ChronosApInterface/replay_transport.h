@@ -0,0 +1,77 @@
+#pragma once
+
+#include <chrono>
+#include <condition_variable>
+#include <mutex>
+#include <string>
+#include <vector>
+
+#include "mapped_file.h"
+#include "serial_transport.h"
+
+// Plays back a raw stream recording of RecordingTransport in place of the access point. Reads return the
+// recorded data with the same boundaries. The recorded commands are not played back, this stands in for the
+// access point instead: every command written now is acknowledged right away the way the firmware does it,
+// and the recorded acknowledgements are cut out of the data. Data is handed out only once as many commands
+// have been written as the recording had before its first data, so the handshake lines up as it did live.
+// Commands recorded later, the periodic timestamp syncs and the stop, are left out with their answers.
+class ReplayTransport : public SerialTransport
+{
+public:
+	enum class Timing
+	{
+		original,		// Every read returns when it did in the recording, relative to the last command.
+		fastest,		// Everything as soon as it is asked for.
+	};
+
+	ReplayTransport(const std::string& path, Timing timing, std::chrono::milliseconds readTimeout = std::chrono::milliseconds(20));
+
+	// Waits for the next recorded read, up to readTimeout, like a port without incoming data would.
+	size_t read(uint8_t* buffer, size_t length);
+	bool write(const uint8_t* data, size_t length);
+	// Drops answers not read yet, the recording starts after the flush anyway.
+	void flush();
+	// Reader is never ahead of the parser here, it can wait for room in the buffers instead of dropping data.
+	bool mustBeDrained() const { return false; }
+
+	uint32_t baudrate() const { return m_baudrate; }
+	// Every recorded read was handed out and every command written was answered.
+	bool drained() const;
+	// Recorded commands whose acknowledgement was found and cut out of the data.
+	size_t acknowledgementsRemoved() const { return m_acknowledgementsRemoved; }
+
+private:
+	// Recorded data without the acknowledgements, a read chunk can be split into several around them.
+	struct Chunk
+	{
+		int64_t offsetNs;
+		const uint8_t* data;
+		size_t length;
+	};
+
+	// Finds the acknowledgements of the recorded commands and keeps everything else of the reads.
+	void splitRecording(const std::vector<Chunk>& reads, const std::vector<Chunk>& writes, const std::vector<size_t>& writePositions);
+	// Hands out answers to the commands, lock held.
+	size_t readAcknowledgements(uint8_t* buffer, size_t length);
+
+	MappedFile m_file;
+	uint32_t m_baudrate;
+	Timing m_timing;
+	std::chrono::milliseconds m_readTimeout;
+	std::vector<Chunk> m_chunks;
+	size_t m_handshakeCommands;
+	size_t m_acknowledgementsRemoved;
+
+	mutable std::mutex m_lock;
+	std::condition_variable m_changed;
+	// Answers to the commands written now, handed out ahead of the recorded data.
+	std::vector<uint8_t> m_acknowledgements;
+	size_t m_nextChunk;
+	size_t m_positionInChunk;
+	size_t m_commandsWritten;
+	// Recorded time of the last handshake command and the moment it was written now, offsets of the reads
+	// are replayed relative to these.
+	int64_t m_handshakeOffsetNs;
+	int64_t m_syncOffsetNs;
+	std::chrono::steady_clock::time_point m_syncTime;
+};
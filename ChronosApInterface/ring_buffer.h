@@ -0,0 +1,176 @@
+#pragma once
+
+#include <algorithm>
+#include <atomic>
+#include <cstddef>
+#include <vector>
+
+// Fixed capacity single producer/single consumer ring buffer. One thread may write into it while another
+// one reads from it, no mutex is needed as long as there is exactly one of each. Capacity is rounded up to
+// the next power of two, read and write positions run freely and are masked on access, so wraparound
+// never needs any data to be moved.
+template <typename T>
+class RingBuffer
+{
+public:
+	// Up to two contiguous parts of the buffer, second one is used only when the region wraps around.
+	template <typename Pointer>
+	struct Regions
+	{
+		Pointer data[2];
+		size_t length[2];
+
+		size_t total() const { return length[0] + length[1]; }
+	};
+
+	explicit RingBuffer(size_t capacity);
+
+	size_t capacity() const { return m_buffer.size(); }
+
+	// Can be called from both sides, the result is exact only for the consumer (size) or
+	// the producer (freeSpace), for the other one it is a snapshot.
+	size_t size() const;
+	size_t freeSpace() const { return capacity() - size(); }
+	bool empty() const { return size() == 0; }
+	// Free running count of the elements ever written (producer) and consumed (consumer), wraps only with size_t.
+	size_t writePosition() const { return m_head.load(std::memory_order_relaxed); }
+	size_t readPosition() const { return m_tail.load(std::memory_order_relaxed); }
+
+	// Producer side.
+	size_t write(const T* data, size_t count);
+	bool push(const T& item);
+	// Free space to be filled in place (for example directly by the COM port read), commitWrite() publishes it.
+	Regions<T*> writableRegions();
+	void commitWrite(size_t count);
+
+	// Consumer side.
+	// Element at the offset from the current read position, offset must be less than size().
+	const T& at(size_t offset) const { return m_buffer[(m_tail.load(std::memory_order_relaxed) + offset) & m_mask]; }
+	T& front() { return m_buffer[m_tail.load(std::memory_order_relaxed) & m_mask]; }
+	Regions<const T*> readableRegions() const;
+	size_t read(T* destination, size_t count);
+	bool pop(T& item);
+	void consume(size_t count);
+	void clear() { consume(size()); }
+
+private:
+	RingBuffer(const RingBuffer&);
+	RingBuffer& operator=(const RingBuffer&);
+
+	static size_t roundUpToPowerOfTwo(size_t value);
+
+	std::vector<T> m_buffer;
+	size_t m_mask;
+
+	// Kept on separate cache lines so producer and consumer do not invalidate each other on every access.
+	char m_padding0[64];
+	std::atomic<size_t> m_head; // Written only by the producer.
+	char m_padding1[64];
+	std::atomic<size_t> m_tail; // Written only by the consumer.
+	char m_padding2[64];
+};
+
+template <typename T>
+RingBuffer<T>::RingBuffer(size_t capacity) : m_buffer(roundUpToPowerOfTwo(capacity)), m_mask(m_buffer.size() - 1), m_head(0), m_tail(0)
+{
+}
+
+template <typename T>
+size_t RingBuffer<T>::roundUpToPowerOfTwo(size_t value)
+{
+	size_t result = 1;
+	while (result < value)
+		result <<= 1;
+
+	return result;
+}
+
+template <typename T>
+size_t RingBuffer<T>::size() const
+{
+	return m_head.load(std::memory_order_acquire) - m_tail.load(std::memory_order_acquire);
+}
+
+template <typename T>
+typename RingBuffer<T>::template Regions<T*> RingBuffer<T>::writableRegions()
+{
+	auto head = m_head.load(std::memory_order_relaxed);
+	auto freeCount = capacity() - (head - m_tail.load(std::memory_order_acquire));
+	auto headIndex = head & m_mask;
+	auto firstLength = std::min(freeCount, capacity() - headIndex);
+
+	Regions<T*> regions = {{&m_buffer[headIndex], m_buffer.data()}, {firstLength, freeCount - firstLength}};
+	return regions;
+}
+
+template <typename T>
+void RingBuffer<T>::commitWrite(size_t count)
+{
+	m_head.store(m_head.load(std::memory_order_relaxed) + count, std::memory_order_release);
+}
+
+template <typename T>
+size_t RingBuffer<T>::write(const T* data, size_t count)
+{
+	auto regions = writableRegions();
+	size_t written = 0;
+
+	for (size_t i = 0; i < 2 && written < count; i++)
+	{
+		auto chunk = std::min(regions.length[i], count - written);
+		std::copy(data + written, data + written + chunk, regions.data[i]);
+		written += chunk;
+	}
+
+	commitWrite(written);
+
+	return written;
+}
+
+template <typename T>
+bool RingBuffer<T>::push(const T& item)
+{
+	return write(&item, 1) == 1;
+}
+
+template <typename T>
+typename RingBuffer<T>::template Regions<const T*> RingBuffer<T>::readableRegions() const
+{
+	auto tail = m_tail.load(std::memory_order_relaxed);
+	auto usedCount = m_head.load(std::memory_order_acquire) - tail;
+	auto tailIndex = tail & m_mask;
+	auto firstLength = std::min(usedCount, capacity() - tailIndex);
+
+	Regions<const T*> regions = {{&m_buffer[tailIndex], m_buffer.data()}, {firstLength, usedCount - firstLength}};
+	return regions;
+}
+
+template <typename T>
+void RingBuffer<T>::consume(size_t count)
+{
+	m_tail.store(m_tail.load(std::memory_order_relaxed) + count, std::memory_order_release);
+}
+
+template <typename T>
+size_t RingBuffer<T>::read(T* destination, size_t count)
+{
+	auto regions = readableRegions();
+	size_t readCount = 0;
+
+	for (size_t i = 0; i < 2 && readCount < count; i++)
+	{
+		auto chunk = std::min(regions.length[i], count - readCount);
+		std::copy(regions.data[i], regions.data[i] + chunk, destination + readCount);
+		readCount += chunk;
+	}
+
+	consume(readCount);
+
+	return readCount;
+}
+
+template <typename T>
+bool RingBuffer<T>::pop(T& item)
+{
+	return read(&item, 1) == 1;
+}
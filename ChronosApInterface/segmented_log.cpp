@@ -0,0 +1,400 @@
+#include "segmented_log.h"
+
+#include <algorithm>
+#include <cstdio>
+#include <limits>
+#include <stdexcept>
+
+#ifdef _WIN32
+#include <Windows.h>
+#else
+#include <cerrno>
+#include <fcntl.h>
+#include <spawn.h>
+#include <sys/wait.h>
+#include <unistd.h>
+#endif
+
+#include "capture_writer.h"
+
+#ifndef _WIN32
+extern char** environ;
+#endif
+
+namespace
+{
+	std::string segmentPath(const std::string& pathPrefix, uint32_t number)
+	{
+		char suffix[16];
+		std::snprintf(suffix, sizeof(suffix), " %04u.txt", number);
+		return pathPrefix + suffix;
+	}
+
+	std::string fileName(const std::string& path)
+	{
+		auto separator = path.find_last_of("/\\");
+		return (separator == std::string::npos ? path : path.substr(separator + 1));
+	}
+
+	// Runs gzip on the file and waits for it. The path goes in as an argument of its own, no shell sees it.
+	bool compressFile(const std::string& path)
+	{
+#ifdef _WIN32
+		std::string commandLine = "gzip -f \"" + path + "\"";
+		STARTUPINFOA startupInfo = {};
+		startupInfo.cb = sizeof(startupInfo);
+		PROCESS_INFORMATION processInfo = {};
+		if (!CreateProcessA(nullptr, &commandLine[0], nullptr, nullptr, FALSE, CREATE_NO_WINDOW, nullptr, nullptr, &startupInfo, &processInfo))
+			return false;
+
+		WaitForSingleObject(processInfo.hProcess, INFINITE);
+		DWORD exitCode = 1;
+		GetExitCodeProcess(processInfo.hProcess, &exitCode);
+		CloseHandle(processInfo.hThread);
+		CloseHandle(processInfo.hProcess);
+
+		return exitCode == 0;
+#else
+		std::string program = "gzip";
+		std::string force = "-f";
+		std::string file = path;
+		char* arguments[] = {&program[0], &force[0], &file[0], nullptr};
+
+		pid_t child;
+		if (posix_spawnp(&child, "gzip", nullptr, nullptr, arguments, environ) != 0)
+			return false;
+
+		int status = 0;
+		while (waitpid(child, &status, 0) < 0)
+		{
+			if (errno != EINTR)
+				return false;
+		}
+
+		return WIFEXITED(status) && WEXITSTATUS(status) == 0;
+#endif
+	}
+}
+
+SegmentedLog::SegmentedLog(const std::string& pathPrefix, uint64_t segmentSize, std::chrono::minutes segmentInterval, bool compress) :
+	m_pathPrefix(pathPrefix),
+	m_segmentSize(segmentSize),
+	m_segmentIntervalNs(std::chrono::duration_cast<std::chrono::nanoseconds>(segmentInterval).count()),
+	m_compress(compress),
+	m_hasCurrent(false),
+	m_nextNumber(1),
+	m_hasNext(false),
+	m_opening(false),
+	m_stopping(false),
+	m_lastSegmentBytes(0),
+	m_segmentsFinished(0),
+	m_openStalls(0),
+	m_preallocationFailures(0),
+	m_writeErrors(0),
+	m_compressionFailures(0)
+{
+	m_manifest.open(m_pathPrefix + " manifest.txt", std::ios::trunc);
+	if (!m_manifest.is_open())
+		throw std::runtime_error("Could not open the manifest " + m_pathPrefix + " manifest.txt.");
+
+	m_current = openSegment(m_nextNumber++, m_segmentSize);
+#ifdef _WIN32
+	if (m_current.fileHandle == INVALID_HANDLE_VALUE)
+#else
+	if (m_current.fileDescriptor < 0)
+#endif
+		throw std::runtime_error("Could not open the log segment " + m_current.path + ".");
+
+	m_hasCurrent = true;
+	m_handOffTask = std::thread([this]{ run(); });
+}
+
+void SegmentedLog::setHeader(const std::string& header)
+{
+	m_header = header;
+
+	if (m_hasCurrent && m_current.bytes == 0)
+		writeSegment(m_current, m_header.data(), m_header.size());
+}
+
+void SegmentedLog::write(const char* data, size_t length, size_t records, std::chrono::system_clock::time_point firstTime,
+	std::chrono::system_clock::time_point lastTime)
+{
+	if (!m_hasCurrent || length == 0)
+		return;
+
+	auto firstTimeNs = toCaptureTime(firstTime);
+	auto lastTimeNs = toCaptureTime(lastTime);
+
+	if (m_current.records > 0 && ((m_segmentSize > 0 && m_current.bytes + length > m_segmentSize) || firstTimeNs >= m_current.endTimeNs))
+		rollOver();
+
+	if (m_current.bytes == 0 && !m_header.empty())
+		writeSegment(m_current, m_header.data(), m_header.size());
+
+	if (!writeSegment(m_current, data, length))
+		return;
+
+	if (m_current.records == 0)
+	{
+		m_current.firstTimeNs = firstTimeNs;
+		m_current.lastTimeNs = lastTimeNs;
+		if (m_segmentIntervalNs > 0)
+			m_current.endTimeNs = (firstTimeNs / m_segmentIntervalNs + 1) * m_segmentIntervalNs;
+	}
+
+	m_current.records += records;
+	m_current.firstTimeNs = std::min(m_current.firstTimeNs, firstTimeNs);
+	m_current.lastTimeNs = std::max(m_current.lastTimeNs, lastTimeNs);
+}
+
+void SegmentedLog::rollOver()
+{
+	auto rolloverStart = std::chrono::steady_clock::now();
+
+	Segment next;
+	auto hasNext = false;
+	uint32_t nextNumber = 0;
+	{
+		std::unique_lock<std::mutex> lock(m_lock);
+		m_finished.push_back(m_current);
+
+		// The background thread already took the next number, the segment after it must not come first.
+		if (!m_hasNext && m_opening)
+		{
+			m_openStalls++;
+			m_nextOpened.wait(lock, [this]{ return !m_opening; });
+		}
+
+		hasNext = m_hasNext;
+		if (m_hasNext)
+			next = m_next;
+		else
+			nextNumber = m_nextNumber++;
+		m_hasNext = false;
+	}
+	m_wake.notify_one();
+
+	if (!hasNext)
+	{
+		m_openStalls++;
+		next = openSegment(nextNumber, m_segmentSize > 0 ? m_segmentSize : m_lastSegmentBytes.load());
+	}
+
+	m_current = next;
+	m_rolloverTime.record(std::chrono::steady_clock::now() - rolloverStart);
+}
+
+void SegmentedLog::run()
+{
+	std::unique_lock<std::mutex> lock(m_lock);
+
+	for (;;)
+	{
+		// The next segment first, the logging thread may be waiting to roll over.
+		if (!m_hasNext && !m_stopping)
+		{
+			auto number = m_nextNumber++;
+			m_opening = true;
+			lock.unlock();
+			auto next = openSegment(number, m_segmentSize > 0 ? m_segmentSize : m_lastSegmentBytes.load());
+			lock.lock();
+
+			m_next = next;
+			m_hasNext = true;
+			m_opening = false;
+			m_nextOpened.notify_one();
+			continue;
+		}
+
+		if (!m_finished.empty())
+		{
+			auto segment = m_finished.front();
+			m_finished.pop_front();
+			lock.unlock();
+			finishSegment(segment);
+			lock.lock();
+			continue;
+		}
+
+		if (m_stopping)
+			break;
+
+		m_wake.wait(lock);
+	}
+}
+
+void SegmentedLog::finishSegment(Segment& segment)
+{
+	closeSegment(segment);
+
+	// Nothing was ever written into the last one.
+	if (segment.bytes == 0)
+	{
+		std::remove(segment.path.c_str());
+		return;
+	}
+
+	m_lastSegmentBytes = segment.bytes;
+
+	auto path = segment.path;
+	if (m_compress)
+	{
+		if (compressFile(path))
+			path += ".gz";
+		else
+			m_compressionFailures++;
+	}
+
+	m_manifest << segment.number << '\t' << fileName(path) << '\t' << segment.firstTimeNs << '\t' << segment.lastTimeNs << '\t'
+		<< segment.records << '\t' << segment.bytes << '\n';
+	m_manifest.flush();
+
+	m_segmentsFinished++;
+}
+
+void SegmentedLog::close()
+{
+	if (!m_hasCurrent)
+		return;
+
+	{
+		std::lock_guard<std::mutex> lock(m_lock);
+		m_finished.push_back(m_current);
+		m_stopping = true;
+	}
+	m_hasCurrent = false;
+	m_wake.notify_one();
+
+	if (m_handOffTask.joinable())
+		m_handOffTask.join();
+
+	// Opened ahead of time and never used.
+	if (m_hasNext)
+	{
+		closeSegment(m_next);
+		std::remove(m_next.path.c_str());
+		m_hasNext = false;
+	}
+
+	m_manifest.close();
+}
+
+SegmentedLog::~SegmentedLog()
+{
+	close();
+}
+
+#ifdef _WIN32
+
+SegmentedLog::Segment SegmentedLog::openSegment(uint32_t number, uint64_t preallocate)
+{
+	Segment segment = {};
+	segment.number = number;
+	segment.path = segmentPath(m_pathPrefix, number);
+	segment.endTimeNs = std::numeric_limits<int64_t>::max();
+
+	segment.fileHandle = CreateFileA(segment.path.c_str(), GENERIC_WRITE, FILE_SHARE_READ, nullptr, CREATE_ALWAYS, FILE_ATTRIBUTE_NORMAL, nullptr);
+	if (segment.fileHandle == INVALID_HANDLE_VALUE || preallocate == 0)
+		return segment;
+
+	FILE_ALLOCATION_INFO allocation;
+	allocation.AllocationSize.QuadPart = static_cast<LONGLONG>(preallocate);
+	if (SetFileInformationByHandle(segment.fileHandle, FileAllocationInfo, &allocation, sizeof(allocation)))
+		segment.preallocated = preallocate;
+	else
+		m_preallocationFailures++;
+
+	return segment;
+}
+
+bool SegmentedLog::writeSegment(Segment& segment, const char* data, size_t length)
+{
+	DWORD written = 0;
+	if (segment.fileHandle == INVALID_HANDLE_VALUE || !WriteFile(segment.fileHandle, data, static_cast<DWORD>(length), &written, nullptr) || written != length)
+	{
+		m_writeErrors++;
+		return false;
+	}
+
+	segment.bytes += length;
+	return true;
+}
+
+void SegmentedLog::closeSegment(Segment& segment)
+{
+	if (segment.fileHandle == INVALID_HANDLE_VALUE)
+		return;
+
+	if (segment.preallocated > segment.bytes)
+	{
+		FILE_ALLOCATION_INFO allocation;
+		allocation.AllocationSize.QuadPart = static_cast<LONGLONG>(segment.bytes);
+		SetFileInformationByHandle(segment.fileHandle, FileAllocationInfo, &allocation, sizeof(allocation));
+	}
+
+	CloseHandle(segment.fileHandle);
+	segment.fileHandle = INVALID_HANDLE_VALUE;
+}
+
+#else
+
+SegmentedLog::Segment SegmentedLog::openSegment(uint32_t number, uint64_t preallocate)
+{
+	Segment segment = {};
+	segment.number = number;
+	segment.path = segmentPath(m_pathPrefix, number);
+	segment.endTimeNs = std::numeric_limits<int64_t>::max();
+
+	segment.fileDescriptor = open(segment.path.c_str(), O_WRONLY | O_CREAT | O_TRUNC | O_CLOEXEC, 0644);
+	if (segment.fileDescriptor < 0 || preallocate == 0)
+		return segment;
+
+	// The size stays at what was written, readers of the segment never see the preallocated part.
+	if (fallocate(segment.fileDescriptor, FALLOC_FL_KEEP_SIZE, 0, static_cast<off_t>(preallocate)) == 0)
+		segment.preallocated = preallocate;
+	else
+		m_preallocationFailures++;
+
+	return segment;
+}
+
+bool SegmentedLog::writeSegment(Segment& segment, const char* data, size_t length)
+{
+	size_t offset = 0;
+	while (segment.fileDescriptor >= 0 && offset < length)
+	{
+		auto written = ::write(segment.fileDescriptor, data + offset, length - offset);
+		if (written < 0 && errno == EINTR)
+			continue;
+		if (written <= 0)
+			break;
+
+		offset += static_cast<size_t>(written);
+	}
+
+	segment.bytes += offset;
+
+	if (offset < length)
+	{
+		m_writeErrors++;
+		return false;
+	}
+
+	return true;
+}
+
+void SegmentedLog::closeSegment(Segment& segment)
+{
+	if (segment.fileDescriptor < 0)
+		return;
+
+	// Space preallocated past the end stays taken until the file is cut, even to the size it already has.
+	if (segment.preallocated > segment.bytes && ftruncate(segment.fileDescriptor, static_cast<off_t>(segment.bytes)) != 0)
+		m_writeErrors++;
+
+	::close(segment.fileDescriptor);
+	segment.fileDescriptor = -1;
+}
+
+#endif
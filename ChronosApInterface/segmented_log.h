@@ -0,0 +1,122 @@
+#pragma once
+
+#include <atomic>
+#include <chrono>
+#include <condition_variable>
+#include <cstdint>
+#include <deque>
+#include <fstream>
+#include <mutex>
+#include <string>
+#include <thread>
+
+#include "metrics.h"
+
+// Text log split into segments, so a long capture can be processed while it is still running and no file
+// grows without end. Segments are "<prefix> 0001.txt", "<prefix> 0002.txt" and so on. A new one is started
+// when the text would make the current one grow past the segment size, or once the records reach the next
+// multiple of the segment interval since the epoch, so an interval of an hour rolls over on the hour. Every
+// segment starts with the header. Segments get their space on the disk when they are opened, all of the
+// segment size at once, or as much as the last one took when they are only rolled by time, so they do not
+// fragment while growing.
+//
+// The logging thread does not open or close files as long as the background thread keeps up with it: that
+// one has the next segment open and preallocated ahead of time, and takes over the finished ones to give
+// back the space they did not use, close them, compress them if asked and add them to the manifest.
+//
+// "<prefix> manifest.txt" gets a line for every finished segment, in order, tab separated: number, file
+// name, receive time of the first and the last record in nanoseconds since the epoch, records and bytes of
+// text. The segment that is being written is not in it yet.
+class SegmentedLog
+{
+public:
+	// Zero segment size or interval leaves that rule out. With compression the finished segments are run
+	// through the gzip of the system, a segment stays as it is when that fails.
+	SegmentedLog(const std::string& pathPrefix, uint64_t segmentSize, std::chrono::minutes segmentInterval, bool compress);
+	// Finishes the last segment and waits for all of them to be handed off.
+	~SegmentedLog();
+
+	// Written at the start of every segment from then on.
+	void setHeader(const std::string& header);
+
+	// Logging thread only. The text is whole records, received from first to last time, it is never split
+	// between two segments.
+	void write(const char* data, size_t length, size_t records, std::chrono::system_clock::time_point firstTime,
+		std::chrono::system_clock::time_point lastTime);
+	// Finishes the last segment and waits for all of them to be handed off.
+	void close();
+
+	size_t segmentsFinished() const { return m_segmentsFinished; }
+	// The logging thread had to open the next segment itself or wait for it, the background thread was not done yet.
+	size_t openStalls() const { return m_openStalls; }
+	// Preallocations, writes and compressions that failed. A failed write loses its records.
+	size_t preallocationFailures() const { return m_preallocationFailures; }
+	size_t writeErrors() const { return m_writeErrors; }
+	size_t compressionFailures() const { return m_compressionFailures; }
+	// Time the logging thread spent rolling over to the next segment.
+	LatencyHistogram::Snapshot rolloverTime() const { return m_rolloverTime.snapshot(); }
+
+private:
+	SegmentedLog(const SegmentedLog&);
+	SegmentedLog& operator=(const SegmentedLog&);
+
+	struct Segment
+	{
+		uint32_t number;
+		std::string path;
+#ifdef _WIN32
+		void* fileHandle;
+#else
+		int fileDescriptor;
+#endif
+		uint64_t preallocated;
+		uint64_t bytes;
+		size_t records;
+		int64_t firstTimeNs;
+		int64_t lastTimeNs;
+		// Records from this time on go into the next segment.
+		int64_t endTimeNs;
+	};
+
+	// Opens and preallocates the segment of the number, without the lock.
+	Segment openSegment(uint32_t number, uint64_t preallocate);
+	bool writeSegment(Segment& segment, const char* data, size_t length);
+	// Gives back the preallocated space past the text and closes the file.
+	void closeSegment(Segment& segment);
+	// Logging thread, the next segment is the current one from then on.
+	void rollOver();
+	void run();
+	void finishSegment(Segment& segment);
+
+	std::string m_pathPrefix;
+	uint64_t m_segmentSize;
+	int64_t m_segmentIntervalNs;
+	bool m_compress;
+	std::string m_header;
+
+	Segment m_current;		// Logging thread only.
+	bool m_hasCurrent;
+
+	std::mutex m_lock;
+	std::condition_variable m_wake;
+	uint32_t m_nextNumber;
+	Segment m_next;
+	bool m_hasNext;
+	// The background thread is opening the next segment outside of the lock, its number is taken.
+	bool m_opening;
+	std::condition_variable m_nextOpened;
+	std::deque<Segment> m_finished;
+	bool m_stopping;
+	// Bytes of the last finished segment, what a segment rolled over by time is preallocated with.
+	std::atomic<uint64_t> m_lastSegmentBytes;
+
+	std::ofstream m_manifest;		// Background thread only.
+	std::thread m_handOffTask;
+
+	std::atomic<size_t> m_segmentsFinished;
+	std::atomic<size_t> m_openStalls;
+	std::atomic<size_t> m_preallocationFailures;
+	std::atomic<size_t> m_writeErrors;
+	std::atomic<size_t> m_compressionFailures;
+	LatencyHistogram m_rolloverTime;
+};
@@ -0,0 +1,35 @@
+#include "serial_transport.h"
+
+#ifdef _WIN32
+#include "com_port_transport.h"
+#else
+#include "posix_serial_transport.h"
+#endif
+
+size_t SerialTransport::read(const Buffer* buffers, size_t bufferCount)
+{
+	size_t readBytes = 0;
+
+	for (size_t i = 0; i < bufferCount; i++)
+	{
+		if (buffers[i].length == 0)
+			continue;
+
+		auto chunk = read(buffers[i].data, buffers[i].length);
+		readBytes += chunk;
+
+		if (chunk < buffers[i].length)
+			break;
+	}
+
+	return readBytes;
+}
+
+std::unique_ptr<SerialTransport> openSerialTransport(const std::string& portName, uint32_t baudrate)
+{
+#ifdef _WIN32
+	return std::unique_ptr<SerialTransport>(new ComPortTransport(portName, baudrate));
+#else
+	return std::unique_ptr<SerialTransport>(new PosixSerialTransport(portName, baudrate));
+#endif
+}
@@ -0,0 +1,39 @@
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+#include <memory>
+#include <string>
+
+// Byte stream towards the USB RF access point. SimpliciTi only talks to the device through this, so
+// the real COM port can be replaced with any other source of bytes.
+class SerialTransport
+{
+public:
+	// Caller owned piece of memory to read into.
+	struct Buffer
+	{
+		uint8_t* data;
+		size_t length;
+	};
+
+	virtual ~SerialTransport() {}
+
+	// Reads up to length bytes, may return less or zero on timeout.
+	virtual size_t read(uint8_t* buffer, size_t length) = 0;
+	// Scatter read, fills the buffers in order. Default one reads them one by one and stops
+	// at the first one that is not filled completely.
+	virtual size_t read(const Buffer* buffers, size_t bufferCount);
+	// Returns true when everything was written.
+	virtual bool write(const uint8_t* data, size_t length) = 0;
+	// Discards everything pending in both directions.
+	virtual void flush() = 0;
+	// Real ports overflow when they are not read in time, so the reader keeps draining them even when there
+	// is no room for the data. Sources that can simply wait, like a replay, return false.
+	virtual bool mustBeDrained() const { return true; }
+	// The device is gone, for example unplugged, and nothing will ever be read from it again.
+	virtual bool disconnected() const { return false; }
+};
+
+// Serial port of the platform, COMx on Windows and a tty device on POSIX systems.
+std::unique_ptr<SerialTransport> openSerialTransport(const std::string& portName, uint32_t baudrate = 115200);
@@ -4,10 +4,11 @@
 #include <array>
 #include <chrono>
 #include <ctime>
-#include <exception>
+#include <iterator>
+#include <stdexcept>
 #include <iostream>
 
-#include "BM_Driver.h"
+#include "frame_sync.h"
 
 #define USB_PACKET_HEADER_LENGTH		0x03
 #define USB_PACKET_START_BYTE			0xFF
@@ -36,133 +37,607 @@
 
 namespace
 {
-	size_t s_bytesReceived = 0;
-	size_t s_packetsReceived = 0;
 	std::vector<uint8_t> startSimpliciTiCommand = {USB_PACKET_START_BYTE, BM_START_SIMPLICITI, 0x03};
 	std::vector<uint8_t> stopSimpliciTiCommand = {USB_PACKET_START_BYTE, BM_STOP_SIMPLICITI, 0x03};
 	std::vector<uint8_t> startSimpliciTiCommandResponse = {USB_PACKET_START_BYTE, HW_NO_ERROR, 0x03};
 	auto stopSimpliciTiCommandResponse = startSimpliciTiCommandResponse;
-	std::vector<uint8_t> usbPacketStartSequence = {USB_PACKET_START_BYTE, HW_NO_ERROR};
+
+	// Access point answers within a few milliseconds, a command without an answer by then is sent again.
+	const std::chrono::milliseconds commandTimeout(100);
+	const size_t commandAttempts = 3;
+	// Watch clocks drift apart from the host over long runs, the capture corrects for it but a fresh sync
+	// keeps the correction small.
+	const std::chrono::minutes timestampSyncInterval(5);
+
+	std::vector<uint8_t> timestampSyncCommand()
+	{
+		auto timeT = std::time(nullptr);
+		timeT += 2; // Just some predictable delay;
+		std::vector<uint8_t> command = {USB_PACKET_START_BYTE,
+										SHM_SYNC_TIMESTAMP, 
+										0x07,
+										static_cast<uint8_t>(timeT & 0xFF),
+										static_cast<uint8_t>((timeT & 0xFF00) >> 8),
+										static_cast<uint8_t>((timeT & 0x00FF0000) >> 16), 
+										static_cast<uint8_t>((timeT & 0xFF000000) >> 24)};
+
+		return command;
+	}
+
+	const size_t dataBufferSize = 16384;
+	// One mark per read, reads are rarely this small. When it does fill up, bytes get the time of a later read.
+	const size_t readMarkQueueSize = 1024;
+	const size_t packetQueueSize = 256;
+	// Upper limit of a single transport read. Win32 driver waits until the whole length has arrived
+	// or the timeout has passed, so it is kept short there. POSIX one takes whatever is available.
+#ifdef _WIN32
+	const size_t readChunkSize = 50;
+#else
+	const size_t readChunkSize = 4096;
+#endif
+	// Idle stages poll their input buffer at this interval.
+	const std::chrono::milliseconds idleWait(1);
+	// A header is taken without the next one behind it only once the stream has been quiet this long, the
+	// packet is then the last one for now. Commands and packets rarely come closer than that to each other.
+	const std::chrono::milliseconds nextHeaderWait(5);
 }
 
-SimpliciTi::SimpliciTi(const std::string& comPortName, const std::function<void(std::vector<uint8_t>)>& fileLogCallback) : m_fileLogCallback(fileLogCallback)
+SimpliciTi::SimpliciTi(const std::string& comPortName, const PacketCallback& fileLogCallback, uint32_t baudrate) :
+	SimpliciTi(openSerialTransport(comPortName, baudrate), fileLogCallback)
 {
-	if (!OpenCOM(0, const_cast<char*>(comPortName.c_str())))
-		throw std::exception("Invalid handle supplied to the SimpliciTI parser.");
+}
 
-	// 1000 bytes for the COM buffer.
-	m_comDataBuffer.reserve(10000);
-	m_comCommandBuffer.reserve(100);
+SimpliciTi::SimpliciTi(std::unique_ptr<SerialTransport> transport, const PacketCallback& fileLogCallback) :
+	m_stopReading(false),
+	m_stopParsing(false),
+	m_stopLogging(false),
+	m_transport(std::move(transport)),
+	m_comDataBuffer(dataBufferSize),
+	m_readMarks(readMarkQueueSize),
+	m_packetQueue(packetQueueSize),
+	m_commandPending(false),
+	m_syncTimestamps(false),
+	m_bytesReceived(0),
+	m_bytesDropped(0),
+	m_bytesSkipped(0),
+	m_falseHeaders(0),
+	m_partialFrames(0),
+	m_packetsReceived(0),
+	m_shortFrames(0),
+	m_packetQueueStalls(0),
+	m_packetsLogged(0),
+	m_commandsSent(0),
+	m_commandRetries(0),
+	m_commandsAcknowledged(0),
+	m_commandsFailed(0),
+	m_commandWrites(0),
+	m_fileLogCallback(fileLogCallback)
+{
 }
 
-void SimpliciTi::startAccessPoint()
+void SimpliciTi::startAccessPoint(ParsingMode mode)
 {
-	FlushCOM(0);
+	if (m_accessPointOn)
+		return;
 
-	auto timeT = std::time(nullptr);
-	timeT += 2; // Just some predictable delay;
-	std::vector<uint8_t> timestampSyncCommand = {USB_PACKET_START_BYTE,
-												SHM_SYNC_TIMESTAMP, 
-												0x07,
-												static_cast<uint8_t>(timeT & 0xFF),
-												static_cast<uint8_t>((timeT & 0xFF00) >> 8),
-												static_cast<uint8_t>((timeT & 0x00FF0000) >> 16), 
-												static_cast<uint8_t>((timeT & 0xFF000000) >> 24)};
+	m_transport->flush();
 
-	writeCommand(timestampSyncCommand);
-	std::this_thread::sleep_for(std::chrono::milliseconds(100));
-	m_comCommandBuffer.resize(0);
-	readData(true, timestampSyncCommand.size());
+	m_parsingMode = mode;
+	m_comDataBuffer.clear();
+	m_readMarks.clear();
+	m_currentPacketSize = 0;
+	m_waitingForNextHeader = false;
 
-	timestampSyncCommand[1] = HW_NO_ERROR;
-	if (m_comCommandBuffer != timestampSyncCommand)
-		std::cout << "Could not set the sync timestamp. Expect bogus timestamps." << std::endl;
+	// Acknowledgements come through the parser, so everything is running before the first command.
+	startThreads();
 
-	writeCommand(startSimpliciTiCommand);
+	auto syncCommand = timestampSyncCommand();
 
-	std::this_thread::sleep_for(std::chrono::milliseconds(100));
+	try
+	{
+		auto response = runCommand(syncCommand);
 
-	m_comCommandBuffer.resize(0);
-	readData(true, startSimpliciTiCommandResponse.size());
+		syncCommand[1] = HW_NO_ERROR;
+		if (response != syncCommand)
+			std::cout << "Could not set the sync timestamp. Expect bogus timestamps." << std::endl;
 
-	if (m_comCommandBuffer != startSimpliciTiCommandResponse)
-		throw std::exception("Starting access point failed. Check the device.");
+		if (runCommand(startSimpliciTiCommand) != startSimpliciTiCommandResponse)
+			throw std::runtime_error("Starting access point failed. Check the device.");
+	}
+	catch (...)
+	{
+		stopThreads();
+		throw;
+	}
 
+	m_nextTimestampSync = std::chrono::steady_clock::now() + timestampSyncInterval;
+	m_syncTimestamps = true;
 	m_accessPointOn = true;
+}
+
+void SimpliciTi::stopAccessPoint()
+{
+	if (m_accessPointOn == false)
+		return;
+
+	m_accessPointOn = false;
+	m_syncTimestamps = false;
+
+	std::cout << std::endl << "Stopping..." << std::endl;
+
+	// Pipeline keeps running until the acknowledgement, so whatever was sent before it is still logged.
+	auto stopped = runCommand(stopSimpliciTiCommand) == stopSimpliciTiCommandResponse;
+
+	stopThreads();
+
+	if (statistics().bytesDropped > 0)
+		std::cout << "Dropped " << statistics().bytesDropped << " bytes, data buffer was full." << std::endl;
+
+	if (statistics().bytesSkipped > 0)
+		std::cout << "Skipped " << statistics().bytesSkipped << " bytes while searching for packet headers, "
+			<< statistics().falseHeaders << " false headers." << std::endl;
+
+	if (!stopped)
+		std::cout << "Stopping the access point did not return any message, please check if the led is still blinking..." << std::endl;
+}
+
+void SimpliciTi::startThreads()
+{
+	m_stopReading = false;
 	m_stopParsing = false;
+	m_stopLogging = false;
+
+	{
+		std::lock_guard<std::mutex> guard(m_commandLock);
+		m_writingCommands = true;
+	}
+	m_commandTask = std::thread([&]{ writeCommands(); });
+
+	m_readTask = std::thread([&]{ readPackets(); });
+
+	if (m_parsingMode == ParsingMode::external)
+		return;
 
-	m_parseTask = std::thread([&]{
-									while (!m_stopParsing)
+	m_parseTask = std::thread([&]{ parsePackets(); });
+	m_logTask = std::thread([&]{
+									while (!m_stopLogging)
 									{
-										//std::this_thread::sleep_for(std::chrono::milliseconds(1));
-										parseAndLogPackets();
-										std::cout << "\rPackets received: " << s_packetsReceived << ". In total " << s_bytesReceived << " bytes.";
+										if (logPackets() == 0)
+											std::this_thread::sleep_for(idleWait);
 									}
+
+									// Whatever got parsed is still logged.
+									logPackets();
 								  });
 }
 
-void SimpliciTi::stopAccessPoint()
+void SimpliciTi::stopThreads()
 {
-	if (m_accessPointOn == false)
-		return;
+	m_stopReading = true;
+	if (m_readTask.joinable())
+		m_readTask.join();
 
 	m_stopParsing = true;
-	m_accessPointOn = false;
-
 	if (m_parseTask.joinable())
 		m_parseTask.join();
 
-	std::cout << std::endl << "Stopping..." << std::endl;
+	m_stopLogging = true;
+	if (m_logTask.joinable())
+		m_logTask.join();
+
+	// Reader is stopped, whatever it managed to read is still logged.
+	if (m_parsingMode == ParsingMode::external)
+		processPackets();
 
-	FlushCOM(0);
+	// Last, acknowledgements are matched up to the end of the parsing.
+	{
+		std::lock_guard<std::mutex> guard(m_commandLock);
+		m_writingCommands = false;
+	}
+	m_commandsQueued.notify_all();
+	if (m_commandTask.joinable())
+		m_commandTask.join();
+}
+
+std::future<std::vector<uint8_t>> SimpliciTi::queueCommand(const std::vector<uint8_t>& command)
+{
+	return queueCommand(command, commandTimeout, commandAttempts);
+}
 
-	// We do no even care of the response anymore...
-	writeCommand(stopSimpliciTiCommand);
+std::future<std::vector<uint8_t>> SimpliciTi::queueCommand(const std::vector<uint8_t>& command, std::chrono::milliseconds timeout, size_t attempts)
+{
+	if (command.size() < USB_PACKET_HEADER_LENGTH || command[USB_PACKET_START_BYTE_INDEX] != USB_PACKET_START_BYTE
+		|| command[USB_PACKET_LENGTH_BYTE_INDEX] != command.size())
+		throw std::runtime_error("Malformed access point command.");
+
+	// Built in a list of its own, it is moved over into the queue under the lock.
+	std::list<QueuedCommand> added(1);
+	auto& queued = added.front();
+	queued.command = command;
+	queued.acknowledgement = command;
+	queued.acknowledgement[USB_PACKET_COMMAND_BYTE_INDEX] = HW_NO_ERROR;
+	queued.timeout = timeout;
+	queued.attemptsLeft = std::max<size_t>(1, attempts);
+	queued.overtaken = false;
+
+	auto response = queued.response.get_future();
 
-	std::this_thread::sleep_for(std::chrono::milliseconds(100));
+	{
+		std::lock_guard<std::mutex> guard(m_commandLock);
 
-	m_comCommandBuffer.resize(0);
-	readData(true, stopSimpliciTiCommandResponse.size());
+		if (!m_writingCommands)
+		{
+			queued.response.set_value(std::vector<uint8_t>());
+			return response;
+		}
 
-	if (m_comCommandBuffer != stopSimpliciTiCommandResponse)
-		std::cout << "Stopping the access point did not return any message, please check if the led is still blinking..." << std::endl;
+		m_queuedCommands.splice(m_queuedCommands.end(), added);
+	}
+
+	m_commandsQueued.notify_one();
+
+	return response;
+}
+
+std::future<std::vector<uint8_t>> SimpliciTi::toggleLed(uint8_t link)
+{
+	std::vector<uint8_t> command = {USB_PACKET_START_BYTE, SHM_TOGGLE_LED, 0x04, link};
+
+	return queueCommand(command);
+}
+
+void SimpliciTi::sendTimestampSync()
+{
+	if (m_syncTimestamps)
+		queueCommand(timestampSyncCommand(), commandTimeout, 1);
+}
+
+std::vector<uint8_t> SimpliciTi::runCommand(const std::vector<uint8_t>& command)
+{
+	auto response = queueCommand(command);
+
+	// Nobody else is parsing in external mode, so it is done here until the response is in.
+	if (m_parsingMode == ParsingMode::external)
+	{
+		while (response.wait_for(idleWait) != std::future_status::ready)
+			processPackets();
+	}
+
+	return response.get();
+}
+
+void SimpliciTi::writeCommands()
+{
+	std::unique_lock<std::mutex> lock(m_commandLock);
+
+	while (m_writingCommands)
+	{
+		auto now = std::chrono::steady_clock::now();
+		expireCommands(now);
+
+		if (!m_queuedCommands.empty())
+		{
+			// Everything queued while the last batch was being written goes out in one write.
+			m_commandBatch.clear();
+			for (auto& queued : m_queuedCommands)
+			{
+				if (queued.firstWrite == std::chrono::steady_clock::time_point())
+				{
+					queued.firstWrite = now;
+					m_commandsSent++;
+				}
+				else
+				{
+					m_commandRetries++;
+				}
+
+				queued.attemptsLeft--;
+				queued.deadline = now + queued.timeout;
+				queued.overtaken = false;
+				m_commandBatch.insert(m_commandBatch.end(), queued.command.begin(), queued.command.end());
+			}
+
+			// In flight before the write, the acknowledgement can be parsed before the write even returns.
+			m_commandsInFlight.splice(m_commandsInFlight.end(), m_queuedCommands);
+			m_commandPending = true;
+
+			// Commands queued meanwhile wait for the next batch. A failed write is not retried right away,
+			// its commands time out and go again just like the ones the access point did not answer.
+			lock.unlock();
+			m_transport->write(m_commandBatch.data(), m_commandBatch.size());
+			lock.lock();
+
+			m_commandWrites++;
+			continue;
+		}
+
+		if (m_commandsInFlight.empty())
+		{
+			m_commandsQueued.wait(lock);
+			continue;
+		}
+
+		auto earliestDeadline = m_commandsInFlight.front().deadline;
+		for (auto& inFlight : m_commandsInFlight)
+			earliestDeadline = std::min(earliestDeadline, inFlight.deadline);
+
+		m_commandsQueued.wait_until(lock, earliestDeadline);
+	}
+
+	// Nothing is parsed anymore, whoever is still waiting gets the answer now.
+	m_queuedCommands.splice(m_queuedCommands.end(), m_commandsInFlight);
+	// Counted before the futures complete, whoever waits on one sees it in the statistics.
+	m_commandsFailed += m_queuedCommands.size();
+	for (auto& queued : m_queuedCommands)
+		queued.response.set_value(std::vector<uint8_t>());
+	m_queuedCommands.clear();
+	m_commandPending = false;
+}
+
+void SimpliciTi::expireCommands(std::chrono::steady_clock::time_point now)
+{
+	for (auto inFlight = m_commandsInFlight.begin(); inFlight != m_commandsInFlight.end();)
+	{
+		auto next = std::next(inFlight);
+
+		if (inFlight->deadline <= now)
+		{
+			if (inFlight->attemptsLeft > 0)
+			{
+				m_queuedCommands.splice(m_queuedCommands.end(), m_commandsInFlight, inFlight);
+			}
+			else
+			{
+				m_commandsFailed++;
+				inFlight->response.set_value(std::vector<uint8_t>());
+				m_commandsInFlight.erase(inFlight);
+			}
+		}
+
+		inFlight = next;
+	}
+
+	m_commandPending = !m_commandsInFlight.empty();
+}
+
+bool SimpliciTi::completeCommand()
+{
+	std::lock_guard<std::mutex> guard(m_commandLock);
+
+	auto packetLength = m_currentPacketSize + USB_PACKET_HEADER_LENGTH;
+	auto match = m_commandsInFlight.end();
+
+	// Only the exact echo of a command, HW_NO_ERROR in place of the command byte and everything else as it was
+	// written. A frame that merely has the length of one is data, in a damaged stretch anything may. Commands in
+	// flight are in the order they were written.
+	for (auto inFlight = m_commandsInFlight.begin(); inFlight != m_commandsInFlight.end(); ++inFlight)
+	{
+		auto& acknowledgement = inFlight->acknowledgement;
+		if (inFlight->overtaken || acknowledgement.size() != packetLength)
+			continue;
+
+		auto exact = true;
+		for (size_t i = 0; i < m_currentPacketSize && exact; i++)
+			exact = (m_comDataBuffer.at(i) == acknowledgement[USB_PACKET_HEADER_LENGTH + i]);
+
+		if (exact)
+		{
+			match = inFlight;
+			break;
+		}
+	}
+
+	if (match == m_commandsInFlight.end())
+		return false;
+
+	// Header itself is consumed already, but it can only be this one.
+	std::vector<uint8_t> response = {USB_PACKET_START_BYTE, HW_NO_ERROR, static_cast<uint8_t>(packetLength)};
+	response.resize(packetLength);
+	m_comDataBuffer.read(response.data() + USB_PACKET_HEADER_LENGTH, m_currentPacketSize);
+
+	// Access point answers in order, so the acknowledgements of the ones before are not coming anymore.
+	auto now = std::chrono::steady_clock::now();
+	auto overtaken = false;
+	for (auto inFlight = m_commandsInFlight.begin(); inFlight != match; ++inFlight)
+	{
+		if (!inFlight->overtaken)
+		{
+			inFlight->overtaken = true;
+			inFlight->deadline = now;
+			overtaken = true;
+		}
+	}
+
+	if (overtaken)
+		m_commandsQueued.notify_one();
+
+	m_commandRoundTrip.record(now - match->firstWrite);
+	m_commandsAcknowledged++;
+	match->response.set_value(response);
+	m_commandsInFlight.erase(match);
+	m_commandPending = !m_commandsInFlight.empty();
+
+	return true;
 }
 
-void SimpliciTi::writeCommand(const std::vector<uint8_t>& command)
+void SimpliciTi::readData(size_t dataLength)
 {
-	if (!WriteCOM(0, command.size(), const_cast<UCHAR*>(command.data())))
+	// Data is read straight into the free space of the ring buffer, both parts of it when it wraps around.
+	auto regions = m_comDataBuffer.writableRegions();
+	SerialTransport::Buffer buffers[2] = {{regions.data[0], std::min(regions.length[0], dataLength)}, {regions.data[1], 0}};
+	buffers[1].length = std::min(regions.length[1], dataLength - buffers[0].length);
+
+	// Parser is behind, but the COM port must be drained anyway or its FIFO will overflow.
+	if (buffers[0].length == 0)
 	{
-		throw std::exception("Failed to send command to the access point.");
+		if (!m_transport->mustBeDrained())
+		{
+			std::this_thread::sleep_for(idleWait);
+			return;
+		}
+
+		std::array<uint8_t, 100> discarded;
+		m_bytesDropped += m_transport->read(discarded.data(), std::min(discarded.size(), dataLength));
+		return;
 	}
+
+	size_t readBytes = m_transport->read(buffers, 2);
+	if (readBytes == 0)
+		return;
+
+	// Mark goes in before the bytes, so the parser never sees bytes without their read time.
+	ReadMark mark = {m_comDataBuffer.writePosition() + readBytes, std::chrono::system_clock::now()};
+	m_readMarks.push(mark);
+	m_comDataBuffer.commitWrite(readBytes);
+
+	m_bytesReceived += readBytes;
 }
 
-void SimpliciTi::readData(bool isCommand, size_t dataLength)
+size_t SimpliciTi::findPacketStart(size_t from) const
 {
-	std::array<uint8_t, 100> buffer;
-	std::vector<uint8_t>& destinationBuffer = (isCommand ? m_comCommandBuffer : m_comDataBuffer);
+	auto regions = m_comDataBuffer.readableRegions();
 
-	// If there is no room for data, then lets read less.
-	auto freeBytes = std::min(destinationBuffer.capacity() - destinationBuffer.size(), buffer.size());
-	size_t bufferSize = std::min(freeBytes, dataLength);
+	if (from < regions.length[0])
+	{
+		auto offset = from + findBytePair(regions.data[0] + from, regions.length[0] - from, USB_PACKET_START_BYTE, HW_NO_ERROR);
+		if (offset < regions.length[0])
+			return offset;
 
-	size_t readBytes = ReadCOM(0, bufferSize, buffer.data());
+		// Sequence can be split between the end of the buffer and its beginning.
+		if (regions.length[1] > 0 && regions.data[0][regions.length[0] - 1] == USB_PACKET_START_BYTE && regions.data[1][0] == HW_NO_ERROR)
+			return regions.length[0] - 1;
 
-	for (size_t i = 0; i < readBytes; i++)
+		from = regions.length[0];
+	}
+
+	auto secondFrom = from - regions.length[0];
+	return from + findBytePair(regions.data[1] + secondFrom, regions.length[1] - secondFrom, USB_PACKET_START_BYTE, HW_NO_ERROR);
+}
+
+size_t SimpliciTi::findValidPacketStart(bool& confirmed)
+{
+	auto bufferSize = m_comDataBuffer.size();
+	confirmed = false;
+
+	for (auto start = findPacketStart(0); start < bufferSize; start = findPacketStart(start + 1))
+	{
+		// Length byte has not arrived yet, nothing to check.
+		if (start + USB_PACKET_LENGTH_BYTE_INDEX >= bufferSize)
+			return start;
+
+		size_t packetLength = m_comDataBuffer.at(start + USB_PACKET_LENGTH_BYTE_INDEX);
+		auto nextStart = start + packetLength;
+
+		auto lengthValid = packetLength >= USB_PACKET_HEADER_LENGTH;
+		auto nextStartValid = (nextStart >= bufferSize || m_comDataBuffer.at(nextStart) == USB_PACKET_START_BYTE)
+			&& (nextStart + 1 >= bufferSize || m_comDataBuffer.at(nextStart + 1) == HW_NO_ERROR);
+
+		// A false header can point far enough ahead to hit a real one by chance, the real packets in between give it away.
+		if (lengthValid && nextStartValid && !spansPacket(start + 1, nextStart))
+		{
+			confirmed = (nextStart + 1 < bufferSize);
+			return start;
+		}
+
+		m_falseHeaders++;
+		if (start == 0 && lengthValid)
+			m_partialFrames++;
+	}
+
+	return bufferSize;
+}
+
+bool SimpliciTi::spansPacket(size_t from, size_t to) const
+{
+	auto bufferSize = m_comDataBuffer.size();
+
+	for (auto start = findPacketStart(from); start < to && start + USB_PACKET_LENGTH_BYTE_INDEX < bufferSize; start = findPacketStart(start + 1))
+	{
+		size_t packetLength = m_comDataBuffer.at(start + USB_PACKET_LENGTH_BYTE_INDEX);
+		auto nextStart = start + packetLength;
+
+		// 0xFF 0x06 in a payload rarely has a length that ends on a header within the same packet.
+		if (packetLength >= USB_PACKET_HEADER_LENGTH && nextStart <= to && nextStart + 1 < bufferSize
+			&& m_comDataBuffer.at(nextStart) == USB_PACKET_START_BYTE && m_comDataBuffer.at(nextStart + 1) == HW_NO_ERROR)
+			return true;
+	}
+
+	return false;
+}
+
+bool SimpliciTi::nextHeaderWaitOver()
+{
+	if (m_stopParsing || m_transport->disconnected())
+		return true;
+
+	auto now = std::chrono::steady_clock::now();
+	auto bufferSize = m_comDataBuffer.size();
+
+	if (!m_waitingForNextHeader || bufferSize != m_headerWaitBufferSize)
 	{
-		destinationBuffer.push_back(buffer[i]);
+		m_waitingForNextHeader = true;
+		m_headerWaitStart = now;
+		m_headerWaitBufferSize = bufferSize;
+		return false;
 	}
 
-	s_bytesReceived += readBytes;
+	return now - m_headerWaitStart >= nextHeaderWait;
 }
 
-// The algorithm here searches for the USB packet header and extracts the length. If there are communication
-// errors, for example the packet data was not received completely then this is not checked. And probably
-// one packet will be corrupt in the log and one or more packets will be discarded. Should have mutex protection
-// here, but since nothing besides m_parseTask uses it, it is safe for now.
-void SimpliciTi::parseAndLogPackets()
+std::chrono::system_clock::time_point SimpliciTi::readTimeOf(size_t position)
 {
-	readData(false, 50);
+	// Marks of the reads that ended before the position are not needed anymore.
+	while (!m_readMarks.empty() && m_readMarks.front().end <= position)
+		m_readMarks.consume(1);
+
+	if (m_readMarks.empty())
+		return std::chrono::system_clock::now();
+
+	return m_readMarks.front().time;
+}
 
+void SimpliciTi::readPackets()
+{
+	while (!m_stopReading)
+	{
+		readData(readChunkSize);
+
+		if (m_transport->disconnected())
+		{
+			std::cout << std::endl << "Access point disconnected, nothing is read from it anymore." << std::endl;
+			break;
+		}
+
+		if (m_syncTimestamps && std::chrono::steady_clock::now() >= m_nextTimestampSync)
+		{
+			sendTimestampSync();
+			m_nextTimestampSync += timestampSyncInterval;
+		}
+	}
+}
+
+void SimpliciTi::parsePackets()
+{
+	while (!m_stopParsing)
+	{
+		auto bufferedBytes = m_comDataBuffer.size();
+		parseAndQueuePackets();
+
+		// Nothing was consumed, wait for the reader.
+		if (m_comDataBuffer.size() == bufferedBytes)
+			std::this_thread::sleep_for(idleWait);
+	}
+
+	parseAndQueuePackets();
+}
+
+// The algorithm here searches for the USB packet header and extracts the length. A header is only trusted
+// when the next one starts right after the packet, or when nothing follows the packet once the stream has
+// gone quiet. So a packet that was not received completely is discarded, unless it happens to be the last
+// one before a pause. Data buffer is only consumed here and packet queue only filled here, so both are safe
+// without a mutex.
+void SimpliciTi::parseAndQueuePackets()
+{
 	while (m_comDataBuffer.size() > 0)
 	{
 		// We do not know the new packet length and we must have atleast the complete header.
@@ -175,26 +650,44 @@ void SimpliciTi::parseAndLogPackets()
 			}
 
 			// Searching for 0xFF, 0x06.
-			auto newPacketBeginning = std::search(m_comDataBuffer.begin(), m_comDataBuffer.end(), usbPacketStartSequence.begin(), usbPacketStartSequence.end());
+			auto confirmed = false;
+			auto newPacketBeginning = findValidPacketStart(confirmed);
 
-			// Complete packet header not found.
-			if (newPacketBeginning + USB_PACKET_LENGTH_BYTE_INDEX >= m_comDataBuffer.end())
+			// Nothing that could be a header, last byte is kept when it could be the first half of one.
+			if (newPacketBeginning >= m_comDataBuffer.size())
 			{
-				std::cout << "Packet start not found, discarding " << m_comDataBuffer.size() << " bytes" << std::endl;
-				m_comDataBuffer.erase(m_comDataBuffer.begin(), m_comDataBuffer.end());
+				auto discarded = m_comDataBuffer.size();
+				if (m_comDataBuffer.at(discarded - 1) == USB_PACKET_START_BYTE)
+					discarded--;
+
+				m_comDataBuffer.consume(discarded);
+				m_bytesSkipped += discarded;
 
 				return;
 			}
 
-			// If this is somehow still zero, then next time new packet will be searched for anyway.
-			m_currentPacketSize = *(newPacketBeginning + USB_PACKET_LENGTH_BYTE_INDEX) - USB_PACKET_HEADER_LENGTH;
+			if (newPacketBeginning > 0)
+			{
+				m_comDataBuffer.consume(newPacketBeginning);
+				m_bytesSkipped += newPacketBeginning;
+			}
+
+			// Header is there, but not all of it yet.
+			if (m_comDataBuffer.size() < USB_PACKET_HEADER_LENGTH)
+				return;
+
+			// Taking the header before the next one confirms it would let a false one swallow the real
+			// packets behind it, so the bytes after the packet are waited for while they keep coming.
+			if (!confirmed && !nextHeaderWaitOver())
+				return;
+
+			m_waitingForNextHeader = false;
 
-			if (((newPacketBeginning + USB_PACKET_HEADER_LENGTH) - m_comDataBuffer.begin()) > USB_PACKET_HEADER_LENGTH)
-				std::cout << "New packet header found, but discarding more bytes (" << (newPacketBeginning + USB_PACKET_HEADER_LENGTH) - m_comDataBuffer.begin()
-				<< ")." << std::endl;
+			// Zero length packet is just a header, next time new packet will be searched for anyway.
+			m_currentPacketSize = m_comDataBuffer.at(USB_PACKET_LENGTH_BYTE_INDEX) - USB_PACKET_HEADER_LENGTH;
 
-			// Erase all the not useful data and the header so later we could just cut the usable data out.
-			m_comDataBuffer.erase(m_comDataBuffer.begin(), newPacketBeginning + USB_PACKET_HEADER_LENGTH);
+			// Consume the header so later we could just cut the usable data out.
+			m_comDataBuffer.consume(USB_PACKET_HEADER_LENGTH);
 		}
 
 		if (m_comDataBuffer.size() < m_currentPacketSize)
@@ -202,20 +695,86 @@ void SimpliciTi::parseAndLogPackets()
 			return;
 		}
 
-		// Lets extract the packet data out.
-		m_fileLogCallback(std::vector<uint8_t>(m_comDataBuffer.begin(), m_comDataBuffer.begin() + m_currentPacketSize));
-		s_packetsReceived++;
+		// Acknowledgement of the command in flight goes to whoever is waiting for it, not to the log.
+		if (m_commandPending && completeCommand())
+		{
+			m_currentPacketSize = 0;
+			continue;
+		}
+
+		if (m_currentPacketSize < packetHeaderLength)
+			m_shortFrames++;
+
+		// Lets extract the packet data out straight into the queue slot.
+		auto queueRegions = m_packetQueue.writableRegions();
+
+		// Logging is behind, the rest stays in the data buffer until there is room. If that fills up as
+		// well then the reader starts dropping bytes.
+		if (queueRegions.total() == 0)
+		{
+			m_packetQueueStalls++;
+			return;
+		}
 
-		m_comDataBuffer.erase(m_comDataBuffer.begin(), m_comDataBuffer.begin() + m_currentPacketSize);
+		auto& record = *queueRegions.data[0];
+		record.receiveTime = readTimeOf(m_comDataBuffer.readPosition() + m_currentPacketSize - 1);
+		record.length = static_cast<uint8_t>(m_currentPacketSize);
+		m_comDataBuffer.read(record.data.data(), m_currentPacketSize);
+		m_packetQueue.commitWrite(1);
 
+		m_packetsReceived++;
 		m_currentPacketSize = 0;
 	}
 }
 
+size_t SimpliciTi::logPackets()
+{
+	size_t packetsLogged = 0;
+
+	while (!m_packetQueue.empty())
+	{
+		auto& record = m_packetQueue.front();
+		ByteView frame = {record.data.data(), record.length};
+		auto callbackStart = std::chrono::steady_clock::now();
+		m_fileLogCallback(decodePacketHeader(frame), frame, record.receiveTime);
+		m_callbackTime.record(std::chrono::steady_clock::now() - callbackStart);
+		m_packetQueue.consume(1);
+
+		packetsLogged++;
+	}
+
+	m_packetsLogged += packetsLogged;
+
+	return packetsLogged;
+}
+
+size_t SimpliciTi::processPackets()
+{
+	size_t packetsLogged = 0;
+	size_t logged;
+
+	do
+	{
+		parseAndQueuePackets();
+		logged = logPackets();
+		packetsLogged += logged;
+	}
+	while (logged > 0);
+
+	return packetsLogged;
+}
+
+SimpliciTi::Statistics SimpliciTi::statistics() const
+{
+	Statistics stats = {m_bytesReceived, m_bytesDropped, m_bytesSkipped, m_falseHeaders, m_partialFrames, m_packetsReceived, m_shortFrames,
+		m_packetQueueStalls, m_packetsLogged, m_packetQueue.size(), m_commandsSent, m_commandRetries, m_commandsAcknowledged,
+		m_commandsFailed, m_commandWrites};
+
+	return stats;
+}
+
 SimpliciTi::~SimpliciTi()
 {
 	stopAccessPoint();
-
-	CloseCOM(0);
 }
 
@@ -1,40 +1,217 @@
 #pragma once
 
-#include <Windows.h>
-
+#include <array>
 #include <atomic>
+#include <chrono>
+#include <condition_variable>
 #include <cstdint>
 #include <functional>
+#include <future>
+#include <list>
+#include <memory>
+#include <mutex>
+#include <string>
 #include <thread>
 #include <vector>
 
+#include "metrics.h"
+#include "packet_view.h"
+#include "ring_buffer.h"
+#include "serial_transport.h"
+
 class SimpliciTi
 {
 public:
-	// COM port handle must be created and set up previously.
-	SimpliciTi(const std::string& comPortName, const std::function<void(std::vector<uint8_t>)>& fileLogCallback);
+	// Counters of the read -> parse -> log pipeline. Dropped ones tell which stage could not keep up.
+	struct Statistics
+	{
+		size_t bytesReceived;
+		size_t bytesDropped;		// Data buffer was full, serial reader had to throw bytes away.
+		size_t bytesSkipped;		// Not part of any packet, thrown away while searching for the next header.
+		size_t falseHeaders;		// 0xFF 0x06 found in the stream, but it was not a packet header.
+		size_t partialFrames;		// Header right after the previous packet, but the packet was cut short.
+		size_t packetsReceived;
+		size_t shortFrames;			// Packets too short to carry the timestamp and payload.
+		size_t packetQueueStalls;	// Packet queue was full, parsing had to wait for the log callback.
+		size_t packetsLogged;
+		size_t packetQueueDepth;	// Packets parsed but not logged yet, at the moment of the call.
+		size_t commandsSent;		// Commands written for the first time.
+		size_t commandRetries;		// Written again after the acknowledgement did not come in time.
+		size_t commandsAcknowledged;
+		size_t commandsFailed;		// No acknowledgement after all attempts.
+		size_t commandWrites;		// Batches of queued commands, each written at once.
+	};
+
+	// Packet (without the USB header), its decoded fields and the host time its last byte was read at. Views point
+	// straight into the receive queue and are valid only during the call, copy whatever is needed later.
+	typedef std::function<void(const PacketHeader& header, ByteView frame, std::chrono::system_clock::time_point receiveTime)> PacketCallback;
+
+	enum class ParsingMode
+	{
+		ownThreads,		// Parsing and logging run on threads of this instance.
+		external,		// Only the reader runs here, caller must call processPackets() regularly.
+	};
 
-	// Start must be called before any other operations are called.
-	void startAccessPoint();
+	// Serial port of the access point, \\.\COMx on Windows and the tty device path elsewhere.
+	SimpliciTi(const std::string& comPortName, const PacketCallback& fileLogCallback, uint32_t baudrate = 115200);
+	// Any other byte source in place of the COM port, for example MemoryTransport.
+	SimpliciTi(std::unique_ptr<SerialTransport> transport, const PacketCallback& fileLogCallback);
+
+	// Start must be called before any other operations are called. Pipeline is running already during the
+	// handshake, each command returns as soon as the parser has seen its acknowledgement. While running, the
+	// device clock is synchronized again every timestampSyncInterval.
+	void startAccessPoint(ParsingMode mode = ParsingMode::ownThreads);
 	void stopAccessPoint();
 
+	// Parses whatever has been read and hands the packets to the callback. Only for ParsingMode::external,
+	// never call it from more than one thread at a time. Returns the number of packets handed over.
+	size_t processPackets();
+
+	// Queues a command for the access point, from any thread and at any time while it is running. Commands are
+	// written by a thread of their own, all of those queued in the meantime in a single write, so the capture is
+	// never held up by them. The acknowledgement is picked out of the incoming packets by the parser, commands
+	// without one after the timeout are written again. The future gets the acknowledgement, or an empty vector
+	// when there was none after all attempts or the access point is not running. The access point answers within
+	// a few milliseconds, by default a command is written up to 3 times with 100 ms for the acknowledgement.
+	// When only the acknowledgement got lost the command is carried out twice, one that must not be repeated
+	// is queued with a single attempt.
+	std::future<std::vector<uint8_t>> queueCommand(const std::vector<uint8_t>& command);
+	std::future<std::vector<uint8_t>> queueCommand(const std::vector<uint8_t>& command, std::chrono::milliseconds timeout, size_t attempts);
+	// SHM_TOGGLE_LED for the watch on the link.
+	std::future<std::vector<uint8_t>> toggleLed(uint8_t link);
+
+	Statistics statistics() const;
+	// Time spent in the packet callback.
+	LatencyHistogram::Snapshot callbackTime() const { return m_callbackTime.snapshot(); }
+	// From the first write of a command to its acknowledgement.
+	LatencyHistogram::Snapshot commandRoundTrip() const { return m_commandRoundTrip.snapshot(); }
+
 	~SimpliciTi();
 
 private:
+	// Payload of a single USB packet, the length byte limits it to 255 - header bytes.
+	struct PacketRecord
+	{
+		std::chrono::system_clock::time_point receiveTime;
+		uint8_t length;
+		std::array<uint8_t, 255> data;
+	};
+
+	// Host time of a serial read and the data buffer write position right after its bytes.
+	struct ReadMark
+	{
+		size_t end;
+		std::chrono::system_clock::time_point time;
+	};
+
+	// The access point echoes every command back with HW_NO_ERROR in place of the command byte, in the order
+	// the commands came in. Acknowledgements are shorter than any data packet, only a short frame with exactly
+	// the same bytes could be mistaken for one. The parser loses one now and then in a corrupted stretch of the
+	// stream, that shows once a command written after it is acknowledged.
+	struct QueuedCommand
+	{
+		std::vector<uint8_t> command;
+		std::vector<uint8_t> acknowledgement;
+		std::promise<std::vector<uint8_t>> response;
+		std::chrono::milliseconds timeout;
+		size_t attemptsLeft;
+		std::chrono::steady_clock::time_point firstWrite;
+		std::chrono::steady_clock::time_point deadline;
+		// A later command was acknowledged first, this one is written again without waiting for the timeout.
+		// It must not take the acknowledgement of an identical command written after it.
+		bool overtaken;
+	};
 
-	void writeCommand(const std::vector<uint8_t>& command);
-	void readData(bool isCommand, size_t dataLength = 100);
+	// Queues the command and waits for its acknowledgement, empty if it never came. In ParsingMode::external
+	// the parser is driven from here while waiting, so only for the handshake before anything else parses.
+	std::vector<uint8_t> runCommand(const std::vector<uint8_t>& command);
+	// Called by the parser with the header of a packet consumed, true if it was the acknowledgement of a
+	// command in flight. The earliest matching one is completed, as the access point answers in order, and
+	// the ones written before it are overtaken.
+	bool completeCommand();
+	// Writes the queued commands in batches and retries or fails the ones whose acknowledgement is late.
+	void writeCommands();
+	// Moves the commands in flight that are past their deadline back to the queue, or fails them.
+	void expireCommands(std::chrono::steady_clock::time_point now);
+	// Periodic sync from the reader thread. Nobody waits for the acknowledgement, a failure is left for the next one.
+	void sendTimestampSync();
+	void startThreads();
+	void stopThreads();
+	void readData(size_t dataLength);
+	// Read time of the byte at the given data buffer position, by the marks of the reads. Parser side only.
+	std::chrono::system_clock::time_point readTimeOf(size_t position);
+	// Offset of the first 0xFF 0x06 sequence at or after the given offset in the data buffer, buffer size if not found.
+	size_t findPacketStart(size_t from) const;
+	// Same, but skips the sequences that can not be a header: the length byte is below the header length, the
+	// next header does not start where the length byte says, or a whole packet lies in between. These are mostly
+	// 0xFF 0x06 inside payloads, picked up when resynchronizing after a corrupt or dropped piece of the stream.
+	// Confirmed is set when the next header is there already, otherwise the start is only the first one that
+	// could still be a header.
+	size_t findValidPacketStart(bool& confirmed);
+	// True once an unconfirmed header has waited long enough, nothing arrived for nextHeaderWait or nothing
+	// will arrive anymore. Starts the wait on the first call and again whenever more bytes came in.
+	bool nextHeaderWaitOver();
+	// Some 0xFF 0x06 between the offsets starts a packet that ends no later than the second offset and is
+	// followed by a header right there.
+	bool spansPacket(size_t from, size_t to) const;
 
-	// Used together in conjuction. Reads the COM port at the background, parses packets
-	// ,fills the buffers and logs.
-	void parseAndLogPackets();
+	// Three stages each on their own thread, connected by the data buffer and the packet queue.
+	// Reader never waits for the other two, when the data buffer is full the bytes are dropped and counted.
+	void readPackets();
+	void parsePackets();
+	void parseAndQueuePackets();
+	size_t logPackets();
+	std::thread m_readTask;
 	std::thread m_parseTask;
-	std::atomic<bool> m_stopParsing = false;
+	std::thread m_logTask;
+	std::thread m_commandTask;
+	// Stages are stopped one after another so the later ones could drain what is left.
+	std::atomic<bool> m_stopReading;
+	std::atomic<bool> m_stopParsing;
+	std::atomic<bool> m_stopLogging;
 	bool m_accessPointOn = false;
+	ParsingMode m_parsingMode = ParsingMode::ownThreads;
+
+	std::unique_ptr<SerialTransport> m_transport;
 
 	size_t m_currentPacketSize = 0;
-	std::vector<uint8_t> m_comDataBuffer;
-	std::vector<uint8_t> m_comCommandBuffer;
+	// Header waiting for the one after it, since when and with how many bytes buffered. Parser side only.
+	bool m_waitingForNextHeader = false;
+	std::chrono::steady_clock::time_point m_headerWaitStart;
+	size_t m_headerWaitBufferSize = 0;
+	RingBuffer<uint8_t> m_comDataBuffer;
+	RingBuffer<ReadMark> m_readMarks;
+	RingBuffer<PacketRecord> m_packetQueue;
+
+	// Commands queued but not written yet, and written ones waiting for their acknowledgement in the order
+	// they were written. Lists, so commands move between them and out without being copied.
+	std::mutex m_commandLock;
+	std::condition_variable m_commandsQueued;
+	std::list<QueuedCommand> m_queuedCommands;
+	std::list<QueuedCommand> m_commandsInFlight;
+	// Some command is in flight, checked by the parser before taking the lock.
+	std::atomic<bool> m_commandPending;
+	bool m_writingCommands = false;
+	std::vector<uint8_t> m_commandBatch;		// Command thread only.
+	std::atomic<bool> m_syncTimestamps;
+	std::chrono::steady_clock::time_point m_nextTimestampSync;
+
+	std::atomic<size_t> m_bytesReceived;
+	std::atomic<size_t> m_bytesDropped;
+	std::atomic<size_t> m_bytesSkipped;
+	std::atomic<size_t> m_falseHeaders;
+	std::atomic<size_t> m_partialFrames;
+	std::atomic<size_t> m_packetsReceived;
+	std::atomic<size_t> m_shortFrames;
+	std::atomic<size_t> m_packetQueueStalls;
+	std::atomic<size_t> m_packetsLogged;
+	std::atomic<size_t> m_commandsSent;
+	std::atomic<size_t> m_commandRetries;
+	std::atomic<size_t> m_commandsAcknowledged;
+	std::atomic<size_t> m_commandsFailed;
+	std::atomic<size_t> m_commandWrites;
+	LatencyHistogram m_callbackTime;
+	LatencyHistogram m_commandRoundTrip;
 
-	std::function<void(std::vector<uint8_t>)> m_fileLogCallback;
-};
\ No newline at end of file
+	PacketCallback m_fileLogCallback;
+};
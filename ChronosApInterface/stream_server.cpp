@@ -0,0 +1,418 @@
+#include "stream_server.h"
+
+#ifndef _WIN32
+
+#include <algorithm>
+#include <cerrno>
+#include <cstring>
+#include <stdexcept>
+
+#include <sys/epoll.h>
+#include <sys/eventfd.h>
+#include <sys/socket.h>
+#include <sys/un.h>
+#include <unistd.h>
+
+namespace
+{
+	const size_t frameHeaderLength = 24;
+	const int maxEvents = 64;
+	// Stop is noticed within this even when the producer does not wake the thread up.
+	const int idleWaitMs = 100;
+	// Sent part of a send buffer is dropped from its front once it is this big.
+	const size_t compactSize = 64 * 1024;
+
+	void putUint32(uint8_t* destination, uint32_t value)
+	{
+		for (int i = 0; i < 4; i++)
+			destination[i] = static_cast<uint8_t>(value >> (8 * i));
+	}
+
+	void putInt64(uint8_t* destination, int64_t value)
+	{
+		for (int i = 0; i < 8; i++)
+			destination[i] = static_cast<uint8_t>(static_cast<uint64_t>(value) >> (8 * i));
+	}
+
+	int64_t toNanoseconds(std::chrono::system_clock::time_point time)
+	{
+		return std::chrono::duration_cast<std::chrono::nanoseconds>(time.time_since_epoch()).count();
+	}
+}
+
+StreamServer::StreamServer(const std::string& socketPath, SlowClientPolicy policy, size_t clientBufferSize, size_t queueSize) :
+	m_socketPath(socketPath),
+	m_policy(policy),
+	m_clientBufferSize(clientBufferSize),
+	m_listenDescriptor(-1),
+	m_epollDescriptor(-1),
+	m_wakeDescriptor(-1),
+	m_queue(queueSize),
+	m_sleeping(false),
+	m_stopServing(false),
+	m_running(false),
+	m_clientCount(0),
+	m_framesSent(0),
+	m_framesDropped(0),
+	m_slowClientsDisconnected(0),
+	m_queueOverflows(0)
+{
+	sockaddr_un address = {};
+	address.sun_family = AF_UNIX;
+	if (socketPath.empty() || socketPath.size() >= sizeof(address.sun_path))
+		throw std::runtime_error("Stream socket path " + socketPath + " is empty or too long.");
+	std::copy(socketPath.begin(), socketPath.end(), address.sun_path);
+
+	// A socket file left behind by an earlier run would make the bind fail.
+	unlink(socketPath.c_str());
+
+	m_listenDescriptor = socket(AF_UNIX, SOCK_STREAM | SOCK_NONBLOCK | SOCK_CLOEXEC, 0);
+	m_epollDescriptor = epoll_create1(EPOLL_CLOEXEC);
+	m_wakeDescriptor = eventfd(0, EFD_NONBLOCK | EFD_CLOEXEC);
+
+	epoll_event listenEvent = {};
+	listenEvent.events = EPOLLIN;
+	listenEvent.data.fd = m_listenDescriptor;
+	epoll_event wakeEvent = {};
+	wakeEvent.events = EPOLLIN;
+	wakeEvent.data.fd = m_wakeDescriptor;
+
+	if (m_listenDescriptor < 0 || m_epollDescriptor < 0 || m_wakeDescriptor < 0
+		|| bind(m_listenDescriptor, reinterpret_cast<const sockaddr*>(&address), sizeof(address)) != 0
+		|| listen(m_listenDescriptor, SOMAXCONN) != 0
+		|| epoll_ctl(m_epollDescriptor, EPOLL_CTL_ADD, m_listenDescriptor, &listenEvent) != 0
+		|| epoll_ctl(m_epollDescriptor, EPOLL_CTL_ADD, m_wakeDescriptor, &wakeEvent) != 0)
+	{
+		for (auto descriptor : {m_listenDescriptor, m_epollDescriptor, m_wakeDescriptor})
+			if (descriptor >= 0)
+				close(descriptor);
+		unlink(socketPath.c_str());
+
+		throw std::runtime_error("Could not listen on the stream socket " + socketPath + ".");
+	}
+}
+
+StreamServer::~StreamServer()
+{
+	stop();
+
+	close(m_listenDescriptor);
+	close(m_epollDescriptor);
+	close(m_wakeDescriptor);
+	unlink(m_socketPath.c_str());
+}
+
+void StreamServer::start()
+{
+	if (m_running)
+		return;
+
+	m_running = true;
+	m_stopServing = false;
+	m_serveTask = std::thread([this]{ run(); });
+}
+
+void StreamServer::stop()
+{
+	if (!m_running)
+		return;
+
+	m_stopServing = true;
+	wake();
+	if (m_serveTask.joinable())
+		m_serveTask.join();
+
+	m_running = false;
+}
+
+void StreamServer::publish(size_t accessPointId, std::chrono::system_clock::time_point receiveTime, std::chrono::system_clock::time_point deviceTime,
+	const uint8_t* data, size_t length)
+{
+	auto regions = m_queue.writableRegions();
+	if (regions.total() == 0)
+	{
+		m_queueOverflows++;
+		return;
+	}
+
+	auto& record = *regions.data[0];
+	record.accessPointId = static_cast<uint32_t>(accessPointId);
+	record.receiveTime = receiveTime;
+	record.deviceTime = deviceTime;
+	record.length = static_cast<uint8_t>(std::min(length, record.data.size()));
+	std::copy(data, data + record.length, record.data.begin());
+
+	m_queue.commitWrite(1);
+
+	// Pairs with the fence in run(): either the server sees the record before it waits, or it is asleep
+	// here and gets woken up. Only the first packet after it fell asleep pays for the system call.
+	std::atomic_thread_fence(std::memory_order_seq_cst);
+	if (m_sleeping.load(std::memory_order_relaxed) && m_sleeping.exchange(false))
+		wake();
+}
+
+void StreamServer::wake()
+{
+	uint64_t one = 1;
+	auto written = write(m_wakeDescriptor, &one, sizeof(one));
+	(void)written;
+}
+
+void StreamServer::run()
+{
+	epoll_event events[maxEvents];
+
+	while (!m_stopServing)
+	{
+		distributeQueued();
+
+		m_sleeping = true;
+		std::atomic_thread_fence(std::memory_order_seq_cst);
+		auto eventCount = epoll_wait(m_epollDescriptor, events, maxEvents, m_queue.empty() ? idleWaitMs : 0);
+		m_sleeping = false;
+
+		for (int i = 0; i < eventCount; i++)
+		{
+			auto descriptor = events[i].data.fd;
+
+			if (descriptor == m_listenDescriptor)
+			{
+				acceptClients();
+				continue;
+			}
+
+			if (descriptor == m_wakeDescriptor)
+			{
+				uint64_t count;
+				auto readBytes = read(m_wakeDescriptor, &count, sizeof(count));
+				(void)readBytes;
+				continue;
+			}
+
+			// Closed earlier in this round.
+			auto client = m_clients.find(descriptor);
+			if (client == m_clients.end())
+				continue;
+
+			auto alive = true;
+			if ((events[i].events & (EPOLLIN | EPOLLHUP | EPOLLERR)) != 0)
+				alive = readFilter(descriptor, client->second);
+			if (alive && (events[i].events & EPOLLOUT) != 0)
+				alive = sendPending(descriptor, client->second);
+
+			if (!alive)
+				closeClient(descriptor);
+		}
+	}
+
+	distributeQueued();
+
+	while (!m_clients.empty())
+		closeClient(m_clients.begin()->first);
+}
+
+void StreamServer::acceptClients()
+{
+	for (;;)
+	{
+		auto descriptor = accept4(m_listenDescriptor, nullptr, nullptr, SOCK_NONBLOCK | SOCK_CLOEXEC);
+		if (descriptor < 0)
+			return;
+
+		epoll_event event = {};
+		event.events = EPOLLIN;
+		event.data.fd = descriptor;
+		if (epoll_ctl(m_epollDescriptor, EPOLL_CTL_ADD, descriptor, &event) != 0)
+		{
+			close(descriptor);
+			continue;
+		}
+
+		auto& client = m_clients[descriptor];
+		client.sentBytes = 0;
+		client.waitingForSocket = false;
+		client.filtered = false;
+		m_clientCount = m_clients.size();
+	}
+}
+
+bool StreamServer::readFilter(int descriptor, Client& client)
+{
+	uint8_t buffer[512];
+
+	for (;;)
+	{
+		auto readBytes = recv(descriptor, buffer, sizeof(buffer), MSG_DONTWAIT);
+		if (readBytes == 0)
+			return false;
+		if (readBytes < 0)
+			return errno == EAGAIN || errno == EWOULDBLOCK || errno == EINTR;
+
+		client.request.insert(client.request.end(), buffer, buffer + readBytes);
+
+		// Only the last whole filter counts, one may arrive in pieces.
+		size_t offset = 0;
+		while (offset < client.request.size() && client.request.size() - offset > client.request[offset])
+		{
+			auto count = client.request[offset];
+			client.links.reset();
+			for (size_t i = 0; i < count; i++)
+				client.links.set(client.request[offset + 1 + i]);
+			client.filtered = (count != 0);
+
+			offset += 1 + count;
+		}
+
+		client.request.erase(client.request.begin(), client.request.begin() + offset);
+	}
+}
+
+void StreamServer::distributeQueued()
+{
+	std::vector<int> slowClients;
+
+	while (!m_queue.empty())
+	{
+		auto& record = m_queue.front();
+
+		for (auto& client : m_clients)
+		{
+			if (!appendFrame(client.second, record) && std::find(slowClients.begin(), slowClients.end(), client.first) == slowClients.end())
+				slowClients.push_back(client.first);
+		}
+
+		m_queue.consume(1);
+	}
+
+	for (auto descriptor : slowClients)
+	{
+		m_slowClientsDisconnected++;
+		closeClient(descriptor);
+	}
+
+	// One send per client for everything queued in this round, clients waiting for their socket get
+	// the rest once it is writable again.
+	std::vector<int> goneClients;
+	for (auto& client : m_clients)
+	{
+		if (!client.second.waitingForSocket && client.second.pending.size() > client.second.sentBytes && !sendPending(client.first, client.second))
+			goneClients.push_back(client.first);
+	}
+
+	for (auto descriptor : goneClients)
+		closeClient(descriptor);
+}
+
+bool StreamServer::appendFrame(Client& client, const Record& record)
+{
+	if (client.filtered && (record.length == 0 || !client.links.test(record.data[0])))
+		return true;
+
+	auto frameLength = frameHeaderLength + record.length;
+	if (client.pending.size() - client.sentBytes + frameLength > m_clientBufferSize)
+	{
+		if (m_policy == SlowClientPolicy::disconnect)
+			return false;
+
+		m_framesDropped++;
+		return true;
+	}
+
+	uint8_t header[frameHeaderLength];
+	putUint32(header, static_cast<uint32_t>(frameLength - 4));
+	putUint32(header + 4, record.accessPointId);
+	putInt64(header + 8, toNanoseconds(record.receiveTime));
+	putInt64(header + 16, toNanoseconds(record.deviceTime));
+
+	client.pending.append(reinterpret_cast<const char*>(header), sizeof(header));
+	client.pending.append(reinterpret_cast<const char*>(record.data.data()), record.length);
+	client.pendingReceiveTimes.push_back(record.receiveTime);
+
+	return true;
+}
+
+bool StreamServer::sendPending(int descriptor, Client& client)
+{
+	while (client.sentBytes < client.pending.size())
+	{
+		auto sentBytes = send(descriptor, client.pending.data() + client.sentBytes, client.pending.size() - client.sentBytes, MSG_DONTWAIT | MSG_NOSIGNAL);
+		if (sentBytes < 0)
+		{
+			if (errno == EINTR)
+				continue;
+			if (errno != EAGAIN && errno != EWOULDBLOCK)
+				return false;
+			break;
+		}
+
+		client.sentBytes += sentBytes;
+	}
+
+	auto drained = (client.sentBytes == client.pending.size());
+	if (drained)
+	{
+		auto sendTime = std::chrono::system_clock::now();
+		for (auto& receiveTime : client.pendingReceiveTimes)
+			m_sendLatency.record(sendTime - receiveTime);
+		m_framesSent += client.pendingReceiveTimes.size();
+
+		client.pending.clear();
+		client.pendingReceiveTimes.clear();
+		client.sentBytes = 0;
+	}
+	else if (client.sentBytes >= compactSize)
+	{
+		client.pending.erase(0, client.sentBytes);
+		client.sentBytes = 0;
+	}
+
+	// Writable events are asked for only while there is something left, a socket is writable nearly always.
+	if (drained == client.waitingForSocket)
+	{
+		epoll_event event = {};
+		event.events = (drained ? EPOLLIN : EPOLLIN | EPOLLOUT);
+		event.data.fd = descriptor;
+		epoll_ctl(m_epollDescriptor, EPOLL_CTL_MOD, descriptor, &event);
+		client.waitingForSocket = !drained;
+	}
+
+	return true;
+}
+
+void StreamServer::closeClient(int descriptor)
+{
+	epoll_ctl(m_epollDescriptor, EPOLL_CTL_DEL, descriptor, nullptr);
+	close(descriptor);
+
+	m_clients.erase(descriptor);
+	m_clientCount = m_clients.size();
+}
+
+#else
+
+#include <stdexcept>
+
+// No Unix domain sockets in this toolset, the shared memory ring is there for local readers on Windows.
+StreamServer::StreamServer(const std::string&, SlowClientPolicy, size_t, size_t queueSize) :
+	m_queue(queueSize)
+{
+	throw std::runtime_error("Streaming to a local socket is only available on Linux.");
+}
+
+StreamServer::~StreamServer()
+{
+}
+
+void StreamServer::start()
+{
+}
+
+void StreamServer::stop()
+{
+}
+
+void StreamServer::publish(size_t, std::chrono::system_clock::time_point, std::chrono::system_clock::time_point, const uint8_t*, size_t)
+{
+}
+
+#endif
@@ -0,0 +1,122 @@
+#pragma once
+
+#include <array>
+#include <atomic>
+#include <bitset>
+#include <chrono>
+#include <cstdint>
+#include <map>
+#include <string>
+#include <thread>
+#include <vector>
+
+#include "metrics.h"
+#include "ring_buffer.h"
+
+// Streams the live packets to local subscribers over a Unix domain socket (Linux only). Clients connect
+// and disconnect whenever they like while capturing.
+//
+// The capture only puts the packet into a queue, it never waits and never touches a socket: if the queue
+// is full the packet is not streamed. Everything else happens on the thread of the server, an epoll loop
+// that copies every packet into the send buffer of each client that wants it and writes the buffers out
+// in batches. Send buffers are bounded, a client that does not keep up loses frames or gets disconnected.
+//
+// Every frame is a little-endian uint32 length of the rest, then uint32 access point, int64 receive time
+// and int64 device time in nanoseconds since the epoch, then the packet as it came from the access point.
+// A client may send a filter at any time: one byte count followed by that many link bytes (the first byte
+// of the packet), only packets of those links are sent to it from then on. A count of zero sends all.
+class StreamServer
+{
+public:
+	enum class SlowClientPolicy
+	{
+		// Frames that do not fit into the send buffer of the client are not sent to it.
+		dropFrames,
+		// The client is disconnected once its send buffer is full.
+		disconnect,
+	};
+
+	// An existing socket file of the path is replaced.
+	StreamServer(const std::string& socketPath, SlowClientPolicy policy = SlowClientPolicy::dropFrames,
+		size_t clientBufferSize = 1024 * 1024, size_t queueSize = 4096);
+	~StreamServer();
+
+	void start();
+	// Sends out what is queued so far, as far as the clients take it without waiting, and closes them all.
+	void stop();
+
+	// Single producer only. Never waits.
+	void publish(size_t accessPointId, std::chrono::system_clock::time_point receiveTime, std::chrono::system_clock::time_point deviceTime,
+		const uint8_t* data, size_t length);
+
+	size_t clientCount() const { return m_clientCount; }
+	size_t framesSent() const { return m_framesSent; }
+	// Frames not sent to a client because its buffer was full, counted per client.
+	size_t framesDropped() const { return m_framesDropped; }
+	size_t slowClientsDisconnected() const { return m_slowClientsDisconnected; }
+	// Packets the server thread was too late for, they reached no client.
+	size_t queueOverflows() const { return m_queueOverflows; }
+	// From the receive time of a packet to its frame being handed to the socket of a client.
+	LatencyHistogram::Snapshot sendLatency() const { return m_sendLatency.snapshot(); }
+
+private:
+	StreamServer(const StreamServer&);
+	StreamServer& operator=(const StreamServer&);
+
+	struct Record
+	{
+		uint32_t accessPointId;
+		std::chrono::system_clock::time_point receiveTime;
+		std::chrono::system_clock::time_point deviceTime;
+		uint8_t length;
+		std::array<uint8_t, 255> data;
+	};
+
+	struct Client
+	{
+		std::string pending;		// Frames not yet taken by the socket, from sentBytes on.
+		size_t sentBytes;
+		bool waitingForSocket;		// Registered for EPOLLOUT.
+		std::bitset<256> links;
+		bool filtered;
+		std::vector<uint8_t> request;		// Partial filter read so far.
+		std::vector<std::chrono::system_clock::time_point> pendingReceiveTimes;
+	};
+
+	void run();
+	void acceptClients();
+	// False when the client is gone.
+	bool readFilter(int descriptor, Client& client);
+	void distributeQueued();
+	// False when the client is to be disconnected for being too slow.
+	bool appendFrame(Client& client, const Record& record);
+	// False when the client is gone.
+	bool sendPending(int descriptor, Client& client);
+	void closeClient(int descriptor);
+	void wake();
+
+	std::string m_socketPath;
+	SlowClientPolicy m_policy;
+	size_t m_clientBufferSize;
+
+	int m_listenDescriptor;
+	int m_epollDescriptor;
+	int m_wakeDescriptor;
+
+	RingBuffer<Record> m_queue;
+	// Set by the server thread before it waits, the producer only wakes it up then.
+	std::atomic<bool> m_sleeping;
+
+	std::map<int, Client> m_clients;		// By socket, server thread only.
+
+	std::thread m_serveTask;
+	std::atomic<bool> m_stopServing;
+	bool m_running;
+
+	std::atomic<size_t> m_clientCount;
+	std::atomic<size_t> m_framesSent;
+	std::atomic<size_t> m_framesDropped;
+	std::atomic<size_t> m_slowClientsDisconnected;
+	std::atomic<size_t> m_queueOverflows;
+	LatencyHistogram m_sendLatency;
+};
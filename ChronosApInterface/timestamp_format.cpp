@@ -0,0 +1,93 @@
+#include "timestamp_format.h"
+
+#include <array>
+
+namespace
+{
+	std::string formatLocalTime(const std::string& format, time_t time)
+	{
+		std::tm timeTm;
+		if (!localTime(time, timeTm))
+			return std::string();
+
+		std::array<char, 64> text;
+		auto length = std::strftime(text.data(), text.size(), format.c_str(), &timeTm);
+
+		return std::string(text.data(), length);
+	}
+}
+
+TimestampFormatter::TimestampFormatter(const std::string& format) :
+	m_format(format),
+	m_validFrom(0),
+	m_validUntil(0),
+	m_secondsOffset(std::string::npos)
+{
+}
+
+void TimestampFormatter::append(std::string& buffer, time_t time)
+{
+	if (time < m_validFrom || time >= m_validUntil)
+		refill(time);
+
+	auto start = buffer.size();
+	buffer += m_text;
+
+	if (m_secondsOffset == std::string::npos)
+		return;
+
+	auto second = static_cast<unsigned>(time - m_validFrom);
+	buffer[start + m_secondsOffset] = static_cast<char>('0' + second / 10);
+	buffer[start + m_secondsOffset + 1] = static_cast<char>('0' + second % 10);
+}
+
+void TimestampFormatter::append(std::string& buffer, time_t time, unsigned milliseconds)
+{
+	append(buffer, time);
+
+	char text[4] = {'.', static_cast<char>('0' + milliseconds / 100), static_cast<char>('0' + milliseconds / 10 % 10), static_cast<char>('0' + milliseconds % 10)};
+	buffer.append(text, sizeof(text));
+}
+
+void TimestampFormatter::refill(time_t time)
+{
+	auto second = time % 60;
+	if (second < 0)
+		second += 60;
+
+	auto minute = time - second;
+	auto first = formatLocalTime(m_format, minute);
+	auto last = formatLocalTime(m_format, minute + 59);
+
+	// Only a "00" in the first one turning into "59" in the last one, anything else changes within the minute.
+	size_t difference = 0;
+	while (difference < first.size() && difference < last.size() && first[difference] == last[difference])
+		difference++;
+
+	auto patchable = first.size() == last.size() && difference + 2 <= first.size()
+		&& first.compare(difference, 2, "00") == 0 && last.compare(difference, 2, "59") == 0
+		&& first.compare(difference + 2, std::string::npos, last, difference + 2, std::string::npos) == 0;
+
+	if (patchable)
+	{
+		m_text = first;
+		m_secondsOffset = difference;
+		m_validFrom = minute;
+		m_validUntil = minute + 60;
+		return;
+	}
+
+	m_text = formatLocalTime(m_format, time);
+	m_secondsOffset = std::string::npos;
+	m_validFrom = time;
+	m_validUntil = time + 1;
+}
+
+bool localTime(time_t time, std::tm& result)
+{
+#ifdef _WIN32
+	return localtime_s(&result, &time) == 0;
+#else
+	return localtime_r(&time, &result) != nullptr;
+#endif
+}
@@ -0,0 +1,35 @@
+#pragma once
+
+#include <ctime>
+#include <string>
+
+// Formats local times with strftime, but converts and formats only once a minute. The text of the minute is
+// kept along with the place of its seconds digits, and only those are written for every call. The place is
+// found by formatting the first and the last second of the minute: when the two differ in anything but a
+// "00" -> "59" pair, the format is cached per second instead.
+//
+// Refills use the reentrant localtime, never the shared buffer of std::localtime. An instance is meant for
+// one thread, give every formatting thread its own.
+class TimestampFormatter
+{
+public:
+	explicit TimestampFormatter(const std::string& format);
+
+	// Appends the local time of the second to the buffer.
+	void append(std::string& buffer, time_t time);
+	// Same followed by a dot and three digits of milliseconds.
+	void append(std::string& buffer, time_t time, unsigned milliseconds);
+
+private:
+	void refill(time_t time);
+
+	std::string m_format;
+	// Cached text is valid from m_validFrom until m_validUntil (exclusive), a minute or a single second.
+	time_t m_validFrom;
+	time_t m_validUntil;
+	std::string m_text;
+	size_t m_secondsOffset;		// Where the two seconds digits are, npos when the text is for a single second.
+};
+
+// Local time of the second, by localtime_r or localtime_s. False if the time can not be represented.
+bool localTime(time_t time, std::tm& result);
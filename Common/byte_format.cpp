@@ -0,0 +1,173 @@
+#include "byte_format.h"
+
+#include "cpu_features.h"
+
+#ifdef CPU_FEATURES_X86
+#include <tmmintrin.h>
+#endif
+
+namespace
+{
+	typedef void (*HexRenderer)(char* output, const uint8_t* data, size_t length);
+
+	// Every byte as "XX ", three characters.
+	struct HexTable
+	{
+		char text[256][3];
+
+		HexTable()
+		{
+			const char digits[] = "0123456789ABCDEF";
+			for (int i = 0; i < 256; i++)
+			{
+				text[i][0] = digits[i >> 4];
+				text[i][1] = digits[i & 0x0F];
+				text[i][2] = ' ';
+			}
+		}
+	};
+
+	// Every byte as decimal digits followed by a space, one to four characters.
+	struct DecimalTable
+	{
+		char text[256][4];
+		uint8_t length[256];
+
+		DecimalTable()
+		{
+			for (int i = 0; i < 256; i++)
+			{
+				size_t position = 0;
+				if (i >= 100)
+					text[i][position++] = static_cast<char>('0' + i / 100);
+				if (i >= 10)
+					text[i][position++] = static_cast<char>('0' + i / 10 % 10);
+				text[i][position++] = static_cast<char>('0' + i % 10);
+				text[i][position++] = ' ';
+				length[i] = static_cast<uint8_t>(position);
+			}
+		}
+	};
+
+	const HexTable s_hexTable;
+	const DecimalTable s_decimalTable;
+
+	void renderHexScalar(char* output, const uint8_t* data, size_t length)
+	{
+		for (size_t i = 0; i < length; i++, output += 3)
+		{
+			auto& text = s_hexTable.text[data[i]];
+			output[0] = text[0];
+			output[1] = text[1];
+			output[2] = text[2];
+		}
+	}
+
+#ifdef CPU_FEATURES_X86
+	// 16 bytes become 48 characters. Nibbles are turned into digits with one table lookup each, then the
+	// high digits, low digits and spaces are shuffled into the three output vectors at every third position.
+	TARGET_SSSE3 void renderHexSsse3(char* output, const uint8_t* data, size_t length)
+	{
+		const __m128i digits = _mm_setr_epi8('0', '1', '2', '3', '4', '5', '6', '7', '8', '9', 'A', 'B', 'C', 'D', 'E', 'F');
+		const __m128i lowNibble = _mm_set1_epi8(0x0F);
+		const char z = static_cast<char>(0x80);
+
+		const __m128i highShuffle[3] = {
+			_mm_setr_epi8(0, z, z, 1, z, z, 2, z, z, 3, z, z, 4, z, z, 5),
+			_mm_setr_epi8(z, z, 6, z, z, 7, z, z, 8, z, z, 9, z, z, 10, z),
+			_mm_setr_epi8(z, 11, z, z, 12, z, z, 13, z, z, 14, z, z, 15, z, z),
+		};
+		const __m128i lowShuffle[3] = {
+			_mm_setr_epi8(z, 0, z, z, 1, z, z, 2, z, z, 3, z, z, 4, z, z),
+			_mm_setr_epi8(5, z, z, 6, z, z, 7, z, z, 8, z, z, 9, z, z, 10),
+			_mm_setr_epi8(z, z, 11, z, z, 12, z, z, 13, z, z, 14, z, z, 15, z),
+		};
+		const __m128i spaces[3] = {
+			_mm_setr_epi8(0, 0, ' ', 0, 0, ' ', 0, 0, ' ', 0, 0, ' ', 0, 0, ' ', 0),
+			_mm_setr_epi8(0, ' ', 0, 0, ' ', 0, 0, ' ', 0, 0, ' ', 0, 0, ' ', 0, 0),
+			_mm_setr_epi8(' ', 0, 0, ' ', 0, 0, ' ', 0, 0, ' ', 0, 0, ' ', 0, 0, ' '),
+		};
+
+		size_t i = 0;
+		for (; i + 16 <= length; i += 16, output += 48)
+		{
+			auto bytes = _mm_loadu_si128(reinterpret_cast<const __m128i*>(data + i));
+			auto high = _mm_shuffle_epi8(digits, _mm_and_si128(_mm_srli_epi16(bytes, 4), lowNibble));
+			auto low = _mm_shuffle_epi8(digits, _mm_and_si128(bytes, lowNibble));
+
+			for (int part = 0; part < 3; part++)
+			{
+				auto text = _mm_or_si128(_mm_or_si128(_mm_shuffle_epi8(high, highShuffle[part]), _mm_shuffle_epi8(low, lowShuffle[part])), spaces[part]);
+				_mm_storeu_si128(reinterpret_cast<__m128i*>(output + part * 16), text);
+			}
+		}
+
+		renderHexScalar(output, data + i, length - i);
+	}
+#endif
+
+	HexRenderer selectHexRenderer()
+	{
+#ifdef CPU_FEATURES_X86
+		if (processorHasSsse3())
+			return renderHexSsse3;
+#endif
+		return renderHexScalar;
+	}
+
+	// Chosen during static initialization, before any thread could be formatting.
+	const HexRenderer s_renderHex = selectHexRenderer();
+}
+
+void appendHex(std::string& buffer, const uint8_t* data, size_t length)
+{
+	if (length == 0)
+		return;
+
+	auto start = buffer.size();
+	buffer.resize(start + length * 3);
+	s_renderHex(&buffer[start], data, length);
+}
+
+void appendQuotedHex(std::string& buffer, const uint8_t* data, size_t length)
+{
+	buffer += '"';
+	appendHex(buffer, data, length);
+	// Closing quote replaces the trailing space, or the opening quote itself when there was no data.
+	buffer.back() = '"';
+}
+
+void appendDecimal(std::string& buffer, const uint8_t* data, size_t length)
+{
+	for (size_t i = 0; i < length; i++)
+		buffer.append(s_decimalTable.text[data[i]], s_decimalTable.length[data[i]]);
+}
+
+void appendNumber(std::string& buffer, uint64_t value)
+{
+	char digits[20];
+	size_t count = 0;
+
+	do
+	{
+		digits[count++] = static_cast<char>('0' + value % 10);
+		value /= 10;
+	}
+	while (value > 0);
+
+	while (count > 0)
+		buffer += digits[--count];
+}
+
+void appendAscii(std::string& buffer, const uint8_t* data, size_t length)
+{
+	auto start = buffer.size();
+	buffer.resize(start + length * 2);
+
+	auto output = &buffer[start];
+	for (size_t i = 0; i < length; i++, output += 2)
+	{
+		output[0] = static_cast<char>(data[i]);
+		output[1] = ' ';
+	}
+}
@@ -0,0 +1,19 @@
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+#include <string>
+
+// Renderers of binary data into text, appending into a buffer owned by the caller so the buffer can be reused
+// from one packet to the next. Every byte is followed by a space, the same way the logs have always shown them.
+
+// "0A FF 12 ", uppercase. Uses the SSSE3 shuffle path when the processor has it, picked once at startup.
+void appendHex(std::string& buffer, const uint8_t* data, size_t length);
+// "\"0A FF 12\"", quoted without the trailing space, as the CSV output of the packet sniffer has it.
+void appendQuotedHex(std::string& buffer, const uint8_t* data, size_t length);
+// "10 255 18 ".
+void appendDecimal(std::string& buffer, const uint8_t* data, size_t length);
+// "1234", the number alone without a space.
+void appendNumber(std::string& buffer, uint64_t value);
+// "a b c ", bytes are copied as they are.
+void appendAscii(std::string& buffer, const uint8_t* data, size_t length);
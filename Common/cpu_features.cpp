@@ -0,0 +1,74 @@
+#include "cpu_features.h"
+
+#if defined(CPU_FEATURES_X86) && defined(_MSC_VER)
+
+#include <immintrin.h>
+#include <intrin.h>
+
+namespace
+{
+	bool cpuidBit(int leaf, int registerIndex, int bit)
+	{
+		int registers[4];
+		__cpuidex(registers, leaf, 0);
+		return (registers[registerIndex] & (1 << bit)) != 0;
+	}
+}
+
+bool processorHasSse2()
+{
+	return cpuidBit(1, 3, 26);
+}
+
+bool processorHasSsse3()
+{
+	return cpuidBit(1, 2, 9);
+}
+
+bool processorHasAvx2()
+{
+	// Operating system has to save the YMM registers as well, otherwise the instructions fault.
+	if (!cpuidBit(1, 2, 27) || (_xgetbv(0) & 0x06) != 0x06)
+		return false;
+
+	return cpuidBit(7, 1, 5);
+}
+
+#elif defined(CPU_FEATURES_X86)
+
+bool processorHasSse2()
+{
+	__builtin_cpu_init();
+	return __builtin_cpu_supports("sse2") != 0;
+}
+
+bool processorHasSsse3()
+{
+	__builtin_cpu_init();
+	return __builtin_cpu_supports("ssse3") != 0;
+}
+
+bool processorHasAvx2()
+{
+	__builtin_cpu_init();
+	return __builtin_cpu_supports("avx2") != 0;
+}
+
+#else
+
+bool processorHasSse2()
+{
+	return false;
+}
+
+bool processorHasSsse3()
+{
+	return false;
+}
+
+bool processorHasAvx2()
+{
+	return false;
+}
+
+#endif
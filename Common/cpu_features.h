@@ -0,0 +1,24 @@
+#pragma once
+
+// Instruction set checks for picking a vectorized code path at runtime. The builds target the plain
+// baseline, so the wider paths are compiled into separately marked functions and chosen once at startup.
+
+#if defined(_M_IX86) || defined(_M_X64) || defined(__i386__) || defined(__x86_64__)
+#define CPU_FEATURES_X86
+#endif
+
+// GCC and Clang compile the intrinsics only into functions marked for the instruction set, MSVC always does.
+#if defined(CPU_FEATURES_X86) && defined(__GNUC__)
+#define TARGET_SSE2 __attribute__((target("sse2")))
+#define TARGET_SSSE3 __attribute__((target("ssse3")))
+#define TARGET_AVX2 __attribute__((target("avx2")))
+#else
+#define TARGET_SSE2
+#define TARGET_SSSE3
+#define TARGET_AVX2
+#endif
+
+// All of these are false on processors other than x86.
+bool processorHasSse2();
+bool processorHasSsse3();
+bool processorHasAvx2();
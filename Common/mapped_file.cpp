@@ -0,0 +1,92 @@
+#include "mapped_file.h"
+
+#include <stdexcept>
+
+#ifdef _WIN32
+#include <Windows.h>
+#else
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#endif
+
+#ifdef _WIN32
+
+MappedFile::MappedFile(const std::string& path) : m_data(nullptr), m_size(0), m_fileHandle(INVALID_HANDLE_VALUE), m_mappingHandle(nullptr)
+{
+	m_fileHandle = CreateFileA(path.c_str(), GENERIC_READ, FILE_SHARE_READ | FILE_SHARE_WRITE, nullptr, OPEN_EXISTING, FILE_FLAG_SEQUENTIAL_SCAN, nullptr);
+	if (m_fileHandle == INVALID_HANDLE_VALUE)
+		throw std::runtime_error("Could not open " + path + ".");
+
+	LARGE_INTEGER fileSize;
+	GetFileSizeEx(m_fileHandle, &fileSize);
+	m_size = static_cast<size_t>(fileSize.QuadPart);
+
+	// Empty files can not be mapped, they are simply left without data.
+	if (m_size == 0)
+		return;
+
+	m_mappingHandle = CreateFileMappingA(m_fileHandle, nullptr, PAGE_READONLY, 0, 0, nullptr);
+	if (m_mappingHandle != nullptr)
+		m_data = static_cast<const uint8_t*>(MapViewOfFile(m_mappingHandle, FILE_MAP_READ, 0, 0, 0));
+
+	if (m_data == nullptr)
+	{
+		if (m_mappingHandle != nullptr)
+			CloseHandle(m_mappingHandle);
+		CloseHandle(m_fileHandle);
+		throw std::runtime_error("Could not map " + path + " into memory.");
+	}
+}
+
+MappedFile::~MappedFile()
+{
+	if (m_data != nullptr)
+		UnmapViewOfFile(m_data);
+	if (m_mappingHandle != nullptr)
+		CloseHandle(m_mappingHandle);
+	CloseHandle(m_fileHandle);
+}
+
+#else
+
+MappedFile::MappedFile(const std::string& path) : m_data(nullptr), m_size(0), m_fileDescriptor(-1)
+{
+	m_fileDescriptor = open(path.c_str(), O_RDONLY | O_CLOEXEC);
+	if (m_fileDescriptor < 0)
+		throw std::runtime_error("Could not open " + path + ".");
+
+	struct stat fileStatus;
+	if (fstat(m_fileDescriptor, &fileStatus) != 0)
+	{
+		close(m_fileDescriptor);
+		throw std::runtime_error("Could not read the size of " + path + ".");
+	}
+
+	m_size = static_cast<size_t>(fileStatus.st_size);
+
+	// Empty files can not be mapped, they are simply left without data.
+	if (m_size == 0)
+		return;
+
+	auto mapping = mmap(nullptr, m_size, PROT_READ, MAP_PRIVATE, m_fileDescriptor, 0);
+	if (mapping == MAP_FAILED)
+	{
+		close(m_fileDescriptor);
+		throw std::runtime_error("Could not map " + path + " into memory.");
+	}
+
+	// Files are read front to back.
+	madvise(mapping, m_size, MADV_SEQUENTIAL);
+	m_data = static_cast<const uint8_t*>(mapping);
+}
+
+MappedFile::~MappedFile()
+{
+	if (m_data != nullptr)
+		munmap(const_cast<uint8_t*>(m_data), m_size);
+	close(m_fileDescriptor);
+}
+
+#endif
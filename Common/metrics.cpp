@@ -0,0 +1,241 @@
+#include "metrics.h"
+
+#include <cstdio>
+#include <fstream>
+#include <iostream>
+#include <sstream>
+
+const size_t LatencyHistogram::subBucketCount;
+const size_t LatencyHistogram::bucketCount;
+
+LatencyHistogram::LatencyHistogram()
+{
+	for (auto& count : m_counts)
+		count.store(0);
+}
+
+size_t LatencyHistogram::bucketIndex(uint64_t microseconds)
+{
+	if (microseconds < subBucketCount)
+		return static_cast<size_t>(microseconds);
+
+	// Position of the highest set bit, at least 4 here.
+	size_t exponent = 4;
+	while ((microseconds >> (exponent + 1)) != 0)
+		exponent++;
+
+	auto subBucket = static_cast<size_t>(microseconds >> (exponent - 4)) - subBucketCount;
+	auto index = subBucketCount + (exponent - 4) * subBucketCount + subBucket;
+
+	return index < bucketCount ? index : bucketCount - 1;
+}
+
+uint64_t LatencyHistogram::bucketUpperBound(size_t index)
+{
+	if (index < subBucketCount)
+		return index;
+
+	auto exponent = (index - subBucketCount) / subBucketCount + 4;
+	auto subBucket = (index - subBucketCount) % subBucketCount;
+	uint64_t lowerBound = static_cast<uint64_t>(subBucketCount + subBucket) << (exponent - 4);
+
+	return lowerBound + (static_cast<uint64_t>(1) << (exponent - 4)) - 1;
+}
+
+void LatencyHistogram::record(std::chrono::nanoseconds value)
+{
+	// Clock adjustments can make the difference negative, it counts as no latency then.
+	auto microseconds = std::chrono::duration_cast<std::chrono::microseconds>(value).count();
+	auto index = bucketIndex(microseconds > 0 ? static_cast<uint64_t>(microseconds) : 0);
+
+	m_counts[index].fetch_add(1, std::memory_order_relaxed);
+}
+
+LatencyHistogram::Snapshot LatencyHistogram::snapshot() const
+{
+	Snapshot snapshot;
+
+	for (size_t i = 0; i < bucketCount; i++)
+		snapshot.m_counts[i] = m_counts[i].load(std::memory_order_relaxed);
+
+	return snapshot;
+}
+
+LatencyHistogram::Snapshot::Snapshot() : m_counts(bucketCount, 0)
+{
+}
+
+uint64_t LatencyHistogram::Snapshot::count() const
+{
+	uint64_t total = 0;
+	for (auto count : m_counts)
+		total += count;
+
+	return total;
+}
+
+uint64_t LatencyHistogram::Snapshot::percentile(double fraction) const
+{
+	auto total = count();
+	if (total == 0)
+		return 0;
+
+	// Rank of the value, at least the first one.
+	auto rank = static_cast<uint64_t>(fraction * static_cast<double>(total) + 0.5);
+	if (rank == 0)
+		rank = 1;
+
+	uint64_t seen = 0;
+	for (size_t i = 0; i < bucketCount; i++)
+	{
+		seen += m_counts[i];
+		if (seen >= rank)
+			return bucketUpperBound(i);
+	}
+
+	return bucketUpperBound(bucketCount - 1);
+}
+
+void LatencyHistogram::Snapshot::add(const Snapshot& other)
+{
+	for (size_t i = 0; i < bucketCount; i++)
+		m_counts[i] += other.m_counts[i];
+}
+
+void MetricsSnapshot::addCounter(const std::string& name, uint64_t value)
+{
+	m_counters.push_back(std::make_pair(name, value));
+}
+
+void MetricsSnapshot::addHistogram(const std::string& name, const LatencyHistogram::Snapshot& histogram)
+{
+	m_histograms.push_back(std::make_pair(name, histogram));
+}
+
+uint64_t MetricsSnapshot::counter(const std::string& name) const
+{
+	for (auto& counter : m_counters)
+	{
+		if (counter.first == name)
+			return counter.second;
+	}
+
+	return 0;
+}
+
+LatencyHistogram::Snapshot MetricsSnapshot::histogram(const std::string& name) const
+{
+	for (auto& histogram : m_histograms)
+	{
+		if (histogram.first == name)
+			return histogram.second;
+	}
+
+	return LatencyHistogram::Snapshot();
+}
+
+std::string MetricsSnapshot::toJson() const
+{
+	std::ostringstream json;
+
+	json << "{\n  \"timestamp\": " << std::chrono::duration_cast<std::chrono::milliseconds>(std::chrono::system_clock::now().time_since_epoch()).count();
+
+	for (auto& counter : m_counters)
+		json << ",\n  \"" << counter.first << "\": " << counter.second;
+
+	for (auto& histogram : m_histograms)
+	{
+		auto& values = histogram.second;
+		json << ",\n  \"" << histogram.first << "\": {\"count\": " << values.count() << ", \"p50Us\": " << values.percentile(0.5)
+			<< ", \"p90Us\": " << values.percentile(0.9) << ", \"p99Us\": " << values.percentile(0.99)
+			<< ", \"p999Us\": " << values.percentile(0.999) << ", \"maxUs\": " << values.max() << "}";
+	}
+
+	json << "\n}\n";
+
+	return json.str();
+}
+
+MetricsReporter::MetricsReporter(const Collector& collector, const LineFormatter& lineFormatter, std::chrono::milliseconds interval,
+	const std::string& jsonPath) :
+	m_collector(collector),
+	m_lineFormatter(lineFormatter),
+	m_interval(interval),
+	m_jsonPath(jsonPath),
+	m_stopReporting(false),
+	m_running(false)
+{
+}
+
+void MetricsReporter::start()
+{
+	if (m_running)
+		return;
+
+	m_running = true;
+	m_stopReporting = false;
+	m_reportTask = std::thread([this]{ run(); });
+}
+
+void MetricsReporter::stop()
+{
+	if (!m_running)
+		return;
+
+	{
+		std::lock_guard<std::mutex> guard(m_stopLock);
+		m_stopReporting = true;
+	}
+	m_stopRequested.notify_all();
+
+	if (m_reportTask.joinable())
+		m_reportTask.join();
+
+	m_running = false;
+
+	report();
+	if (m_lineFormatter)
+		std::cout << std::endl;
+}
+
+void MetricsReporter::run()
+{
+	std::unique_lock<std::mutex> guard(m_stopLock);
+
+	while (!m_stopRequested.wait_for(guard, m_interval, [this]{ return m_stopReporting; }))
+	{
+		guard.unlock();
+		report();
+		guard.lock();
+	}
+}
+
+void MetricsReporter::report()
+{
+	MetricsSnapshot snapshot;
+	m_collector(snapshot);
+
+	if (m_lineFormatter)
+		std::cout << "\r" << m_lineFormatter(snapshot) << std::flush;
+
+	if (m_jsonPath.empty())
+		return;
+
+	// Written next to it and renamed over, so a reader never sees a half written file.
+	auto temporaryPath = m_jsonPath + ".tmp";
+	{
+		std::ofstream jsonFile(temporaryPath, std::ios::trunc);
+		jsonFile << snapshot.toJson();
+	}
+
+#ifdef _WIN32
+	// Rename does not replace an existing file there.
+	std::remove(m_jsonPath.c_str());
+#endif
+	std::rename(temporaryPath.c_str(), m_jsonPath.c_str());
+}
+
+MetricsReporter::~MetricsReporter()
+{
+	stop();
+}
@@ -0,0 +1,114 @@
+#pragma once
+
+#include <array>
+#include <atomic>
+#include <chrono>
+#include <condition_variable>
+#include <cstdint>
+#include <functional>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <utility>
+#include <vector>
+
+// Latency histogram in the HDR style. Every power of two of microseconds is split into 16 linear buckets,
+// so any value is kept with about 6% precision from a microsecond up to hours. Recording is a single relaxed
+// atomic increment, it can be done from any thread on the hot path.
+class LatencyHistogram
+{
+public:
+	static const size_t subBucketCount = 16;
+	static const size_t bucketCount = subBucketCount * 33;
+
+	// Copy of the counts at one moment, for reading the percentiles. Snapshots of several histograms can be added up.
+	class Snapshot
+	{
+	public:
+		Snapshot();
+
+		uint64_t count() const;
+		// Microseconds, upper bound of the bucket the value at the fraction (0...1) of all values falls into.
+		uint64_t percentile(double fraction) const;
+		uint64_t max() const { return percentile(1.0); }
+
+		void add(const Snapshot& other);
+
+	private:
+		friend class LatencyHistogram;
+
+		std::vector<uint64_t> m_counts;
+	};
+
+	LatencyHistogram();
+
+	void record(std::chrono::nanoseconds value);
+	Snapshot snapshot() const;
+
+private:
+	LatencyHistogram(const LatencyHistogram&);
+	LatencyHistogram& operator=(const LatencyHistogram&);
+
+	static size_t bucketIndex(uint64_t microseconds);
+	static uint64_t bucketUpperBound(size_t index);
+
+	std::array<std::atomic<uint64_t>, bucketCount> m_counts;
+};
+
+// Named counters and histograms of one moment, in the order they were added. Filled by the application
+// from whichever components it has, the reporter turns it into the stats line and the JSON snapshot.
+class MetricsSnapshot
+{
+public:
+	void addCounter(const std::string& name, uint64_t value);
+	void addHistogram(const std::string& name, const LatencyHistogram::Snapshot& histogram);
+
+	// Zero or an empty histogram when nothing was added by the name.
+	uint64_t counter(const std::string& name) const;
+	LatencyHistogram::Snapshot histogram(const std::string& name) const;
+
+	// Counters as numbers, histograms as objects of count, percentiles and max in microseconds.
+	std::string toJson() const;
+
+private:
+	std::vector<std::pair<std::string, uint64_t>> m_counters;
+	std::vector<std::pair<std::string, LatencyHistogram::Snapshot>> m_histograms;
+};
+
+// Collects the metrics on its own thread at a fixed interval, prints them as a single console line that
+// overwrites itself and replaces the JSON file with the latest snapshot. Nothing of it runs on the threads
+// that handle the packets, those only update their counters.
+class MetricsReporter
+{
+public:
+	typedef std::function<void(MetricsSnapshot& snapshot)> Collector;
+	typedef std::function<std::string(const MetricsSnapshot& snapshot)> LineFormatter;
+
+	// Empty JSON path writes no file, empty line formatter prints nothing.
+	MetricsReporter(const Collector& collector, const LineFormatter& lineFormatter, std::chrono::milliseconds interval,
+		const std::string& jsonPath);
+
+	void start();
+	// Reports one last time, so the file and the line show the final counts.
+	void stop();
+
+	~MetricsReporter();
+
+private:
+	MetricsReporter(const MetricsReporter&);
+	MetricsReporter& operator=(const MetricsReporter&);
+
+	void run();
+	void report();
+
+	Collector m_collector;
+	LineFormatter m_lineFormatter;
+	std::chrono::milliseconds m_interval;
+	std::string m_jsonPath;
+
+	std::thread m_reportTask;
+	std::mutex m_stopLock;
+	std::condition_variable m_stopRequested;
+	bool m_stopReporting;
+	bool m_running;
+};
@@ -0,0 +1,312 @@
+#include "packet_ring.h"
+
+#include <algorithm>
+#include <atomic>
+#include <cstring>
+#include <stdexcept>
+
+#ifdef _WIN32
+#include <Windows.h>
+#else
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#endif
+
+// Layout of the shared memory, the same for the writer and every reader: the header, then the slots.
+struct PacketRingHeader
+{
+	uint32_t magic;
+	uint32_t version;
+	uint32_t slotCount;
+	uint32_t slotSize;
+	std::atomic<uint32_t> closed;
+	uint8_t padding[44];
+	// Records written so far, on a cache line of its own as it is what the readers keep polling.
+	std::atomic<uint64_t> published;
+	uint8_t publishedPadding[56];
+};
+
+struct PacketRingSlot
+{
+	// 2 * record + 1 while the record is being written, 2 * record + 2 once it is complete.
+	std::atomic<uint64_t> sequence;
+	int64_t receiveTime;		// Nanoseconds since the epoch.
+	int64_t deviceTime;
+	uint32_t accessPointId;
+	uint16_t length;
+	uint8_t data[255];
+	uint8_t padding[35];
+};
+
+namespace
+{
+	const uint32_t ringMagic = 0x52504843;		// "CHPR"
+	const uint32_t ringVersion = 1;
+
+	static_assert(sizeof(PacketRingHeader) == 128, "Readers of other builds depend on the layout of the ring.");
+	static_assert(sizeof(PacketRingSlot) == 320, "Readers of other builds depend on the layout of the ring.");
+
+	const uint32_t maxSlotCount = 1u << 20;
+
+	size_t ringSize(uint32_t slotCount)
+	{
+		uint32_t count = 1;
+		while (count < slotCount && count < maxSlotCount)
+			count <<= 1;
+
+		return sizeof(PacketRingHeader) + sizeof(PacketRingSlot) * count;
+	}
+
+	std::string mappingName(const std::string& name)
+	{
+#ifdef _WIN32
+		return "Local\\" + name;
+#else
+		return "/" + name;
+#endif
+	}
+
+	int64_t toNanoseconds(std::chrono::system_clock::time_point time)
+	{
+		return std::chrono::duration_cast<std::chrono::nanoseconds>(time.time_since_epoch()).count();
+	}
+
+	std::chrono::system_clock::time_point fromNanoseconds(int64_t nanoseconds)
+	{
+		return std::chrono::system_clock::time_point(std::chrono::duration_cast<std::chrono::system_clock::duration>(std::chrono::nanoseconds(nanoseconds)));
+	}
+}
+
+#ifdef _WIN32
+
+// Size zero opens an existing mapping whole.
+PacketRingMapping::PacketRingMapping(const std::string& name, size_t size, bool create) :
+	m_name(mappingName(name)),
+	m_data(nullptr),
+	m_size(size),
+	m_created(create),
+	m_mappingHandle(nullptr)
+{
+	if (create)
+	{
+		auto size64 = static_cast<uint64_t>(size);
+		m_mappingHandle = CreateFileMappingA(INVALID_HANDLE_VALUE, nullptr, PAGE_READWRITE, static_cast<DWORD>(size64 >> 32), static_cast<DWORD>(size64), m_name.c_str());
+		// Mappings live as long as someone has them open, so an existing one is still read by somebody.
+		if (m_mappingHandle != nullptr && GetLastError() == ERROR_ALREADY_EXISTS)
+		{
+			CloseHandle(m_mappingHandle);
+			throw std::runtime_error("Shared memory " + name + " is still open in another process.");
+		}
+	}
+	else
+	{
+		m_mappingHandle = OpenFileMappingA(FILE_MAP_READ, FALSE, m_name.c_str());
+	}
+
+	if (m_mappingHandle == nullptr)
+		throw std::runtime_error("Could not open shared memory " + name + ".");
+
+	m_data = MapViewOfFile(m_mappingHandle, create ? FILE_MAP_WRITE : FILE_MAP_READ, 0, 0, size);
+	if (m_data == nullptr)
+	{
+		CloseHandle(m_mappingHandle);
+		throw std::runtime_error("Could not map shared memory " + name + ".");
+	}
+
+	if (m_size == 0)
+	{
+		MEMORY_BASIC_INFORMATION region;
+		VirtualQuery(m_data, &region, sizeof(region));
+		m_size = region.RegionSize;
+	}
+}
+
+PacketRingMapping::~PacketRingMapping()
+{
+	UnmapViewOfFile(m_data);
+	CloseHandle(m_mappingHandle);
+}
+
+#else
+
+// Size zero opens an existing mapping whole.
+PacketRingMapping::PacketRingMapping(const std::string& name, size_t size, bool create) :
+	m_name(mappingName(name)),
+	m_data(nullptr),
+	m_size(size),
+	m_created(create)
+{
+	int descriptor;
+	if (create)
+	{
+		// A ring of an earlier run that crashed is still there, readers holding it keep their copy.
+		shm_unlink(m_name.c_str());
+		descriptor = shm_open(m_name.c_str(), O_RDWR | O_CREAT | O_EXCL | O_CLOEXEC, 0644);
+		if (descriptor >= 0 && ftruncate(descriptor, static_cast<off_t>(size)) != 0)
+		{
+			close(descriptor);
+			shm_unlink(m_name.c_str());
+			descriptor = -1;
+		}
+	}
+	else
+	{
+		descriptor = shm_open(m_name.c_str(), O_RDONLY | O_CLOEXEC, 0);
+
+		struct stat status;
+		if (descriptor >= 0 && fstat(descriptor, &status) == 0)
+			m_size = static_cast<size_t>(status.st_size);
+	}
+
+	if (descriptor < 0)
+		throw std::runtime_error("Could not open shared memory " + name + ".");
+
+	auto mapping = (m_size == 0 ? MAP_FAILED : mmap(nullptr, m_size, create ? PROT_READ | PROT_WRITE : PROT_READ, MAP_SHARED, descriptor, 0));
+	close(descriptor);
+
+	if (mapping == MAP_FAILED)
+	{
+		if (create)
+			shm_unlink(m_name.c_str());
+		throw std::runtime_error("Could not map shared memory " + name + ".");
+	}
+
+	m_data = mapping;
+}
+
+PacketRingMapping::~PacketRingMapping()
+{
+	munmap(m_data, m_size);
+	if (m_created)
+		shm_unlink(m_name.c_str());
+}
+
+#endif
+
+PacketRingWriter::PacketRingWriter(const std::string& name, uint32_t slotCount) :
+	m_mapping(name, ringSize(slotCount), true),
+	m_header(static_cast<PacketRingHeader*>(m_mapping.data())),
+	m_slots(reinterpret_cast<PacketRingSlot*>(static_cast<uint8_t*>(m_mapping.data()) + sizeof(PacketRingHeader))),
+	m_slotMask(static_cast<uint32_t>((m_mapping.size() - sizeof(PacketRingHeader)) / sizeof(PacketRingSlot) - 1)),
+	m_published(0)
+{
+	// Fresh shared memory is all zeros, so every slot is empty and nothing is published yet.
+	m_header->version = ringVersion;
+	m_header->slotCount = m_slotMask + 1;
+	m_header->slotSize = sizeof(PacketRingSlot);
+
+	// Readers check the magic first, the rest has to be in place by then.
+	std::atomic_thread_fence(std::memory_order_release);
+	m_header->magic = ringMagic;
+}
+
+PacketRingWriter::~PacketRingWriter()
+{
+	m_header->closed.store(1, std::memory_order_release);
+}
+
+void PacketRingWriter::publish(uint32_t accessPointId, std::chrono::system_clock::time_point receiveTime, std::chrono::system_clock::time_point deviceTime,
+	const uint8_t* data, size_t length)
+{
+	auto& slot = m_slots[m_published & m_slotMask];
+	length = std::min(length, sizeof(slot.data));
+
+	// The odd number goes out before any of the record changes, a reader in the middle of it notices.
+	slot.sequence.store(2 * m_published + 1, std::memory_order_relaxed);
+	std::atomic_thread_fence(std::memory_order_release);
+
+	slot.receiveTime = toNanoseconds(receiveTime);
+	slot.deviceTime = toNanoseconds(deviceTime);
+	slot.accessPointId = accessPointId;
+	slot.length = static_cast<uint16_t>(length);
+	std::memcpy(slot.data, data, length);
+
+	slot.sequence.store(2 * m_published + 2, std::memory_order_release);
+	m_published++;
+	m_header->published.store(m_published, std::memory_order_release);
+}
+
+uint64_t PacketRingWriter::published() const
+{
+	return m_header->published.load(std::memory_order_relaxed);
+}
+
+PacketRingReader::PacketRingReader(const std::string& name) :
+	m_mapping(name, 0, false),
+	m_header(static_cast<const PacketRingHeader*>(m_mapping.data())),
+	m_slots(reinterpret_cast<const PacketRingSlot*>(static_cast<const uint8_t*>(m_mapping.data()) + sizeof(PacketRingHeader))),
+	m_slotMask(0),
+	m_next(0),
+	m_currentSlot(nullptr),
+	m_currentSequence(0),
+	m_lost(0)
+{
+	if (m_mapping.size() < sizeof(PacketRingHeader) || m_header->magic != ringMagic)
+		throw std::runtime_error("Shared memory " + name + " is not a packet ring, or its writer is still starting.");
+
+	std::atomic_thread_fence(std::memory_order_acquire);
+	auto slotCount = m_header->slotCount;
+	if (m_header->version != ringVersion || m_header->slotSize != sizeof(PacketRingSlot) || slotCount == 0 || (slotCount & (slotCount - 1)) != 0
+		|| m_mapping.size() < sizeof(PacketRingHeader) + sizeof(PacketRingSlot) * slotCount)
+		throw std::runtime_error("Packet ring " + name + " is of another version.");
+
+	m_slotMask = slotCount - 1;
+	m_next = m_header->published.load(std::memory_order_acquire);
+}
+
+bool PacketRingReader::next(Record& record)
+{
+	for (;;)
+	{
+		auto published = m_header->published.load(std::memory_order_acquire);
+		if (m_next >= published)
+			return false;
+
+		// More than a ring behind, the ones in between are overwritten already.
+		uint64_t slotCount = m_slotMask + 1;
+		if (published - m_next > slotCount)
+		{
+			m_lost += published - slotCount - m_next;
+			m_next = published - slotCount;
+		}
+
+		auto& slot = m_slots[m_next & m_slotMask];
+		if (slot.sequence.load(std::memory_order_acquire) != 2 * m_next + 2)
+		{
+			// Written over since it was published.
+			m_lost++;
+			m_next++;
+			continue;
+		}
+
+		record.sequence = m_next;
+		record.accessPointId = slot.accessPointId;
+		record.receiveTime = fromNanoseconds(slot.receiveTime);
+		record.deviceTime = fromNanoseconds(slot.deviceTime);
+		record.data = slot.data;
+		record.length = std::min<size_t>(slot.length, sizeof(slot.data));
+
+		m_currentSlot = &slot;
+		m_currentSequence = m_next;
+		m_next++;
+
+		return true;
+	}
+}
+
+bool PacketRingReader::stillValid() const
+{
+	if (m_currentSlot == nullptr)
+		return false;
+
+	// Everything read from the slot before this, stays before the check.
+	std::atomic_thread_fence(std::memory_order_acquire);
+	return m_currentSlot->sequence.load(std::memory_order_relaxed) == 2 * m_currentSequence + 2;
+}
+
+bool PacketRingReader::closed() const
+{
+	return m_header->closed.load(std::memory_order_acquire) != 0;
+}
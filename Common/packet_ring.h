@@ -0,0 +1,113 @@
+#pragma once
+
+#include <chrono>
+#include <cstddef>
+#include <cstdint>
+#include <string>
+
+struct PacketRingHeader;
+struct PacketRingSlot;
+
+// Live packets of the access point tool for other processes on the same machine, in a ring of fixed size
+// slots in shared memory. There is a single writer. Readers map the ring read-only and keep their own
+// position in it, so any number of them can come and go without the writer knowing or ever waiting for
+// them. A reader that falls more than the whole ring behind loses the oldest records and is told so.
+//
+// Every slot carries the number of the record in it, odd while it is being written. A reader takes the
+// number before looking at the record and checks it again after, the way a seqlock works: records are read
+// in place, without copies, and a record the writer got to in the meantime shows up as such.
+//
+// The name is a plain word, it is made into "/<name>" for POSIX shared memory and "Local\<name>" on Windows.
+
+// Shared memory of the ring, created by the writer and opened read-only by the readers.
+class PacketRingMapping
+{
+public:
+	PacketRingMapping(const std::string& name, size_t size, bool create);
+	~PacketRingMapping();
+
+	void* data() const { return m_data; }
+	size_t size() const { return m_size; }
+
+private:
+	PacketRingMapping(const PacketRingMapping&);
+	PacketRingMapping& operator=(const PacketRingMapping&);
+
+	std::string m_name;
+	void* m_data;
+	size_t m_size;
+	bool m_created;
+#ifdef _WIN32
+	void* m_mappingHandle;
+#endif
+};
+
+class PacketRingWriter
+{
+public:
+	// Slot count is rounded up to a power of two, 2^20 at most. A ring left behind under the same name by a writer that did
+	// not exit cleanly is replaced, readers still attached to it stay with the old one and have to attach again.
+	explicit PacketRingWriter(const std::string& name, uint32_t slotCount = 4096);
+	// Marks the ring closed for the readers and removes the name.
+	~PacketRingWriter();
+
+	// Frames longer than a slot holds are cut, frames are never longer than 255 bytes.
+	void publish(uint32_t accessPointId, std::chrono::system_clock::time_point receiveTime, std::chrono::system_clock::time_point deviceTime,
+		const uint8_t* data, size_t length);
+
+	// Safe to call from other threads than the one publishing.
+	uint64_t published() const;
+
+private:
+	PacketRingWriter(const PacketRingWriter&);
+	PacketRingWriter& operator=(const PacketRingWriter&);
+
+	PacketRingMapping m_mapping;
+	PacketRingHeader* m_header;
+	PacketRingSlot* m_slots;
+	uint32_t m_slotMask;
+	uint64_t m_published;
+};
+
+class PacketRingReader
+{
+public:
+	// Points into the ring, it is only good as long as stillValid() says so.
+	struct Record
+	{
+		uint64_t sequence;		// Number of the record since the writer started.
+		uint32_t accessPointId;
+		std::chrono::system_clock::time_point receiveTime;
+		std::chrono::system_clock::time_point deviceTime;
+		const uint8_t* data;
+		size_t length;
+	};
+
+	// Attaches to the ring of a running writer and starts with the records published after that. Throws
+	// std::runtime_error when there is no ring under the name or it is not one.
+	explicit PacketRingReader(const std::string& name);
+
+	// Next record, false when there is nothing new yet. Never waits.
+	bool next(Record& record);
+	// True when the writer has not touched the record from the last next() so far. Whatever was read from
+	// the record before the call is good only if it returns true, otherwise the record is to be dropped.
+	bool stillValid() const;
+
+	// Records the writer overwrote before this reader got to them.
+	uint64_t lost() const { return m_lost; }
+	// The writer is gone. Reading goes on to the last record it wrote, a new writer makes a new ring.
+	bool closed() const;
+
+private:
+	PacketRingReader(const PacketRingReader&);
+	PacketRingReader& operator=(const PacketRingReader&);
+
+	PacketRingMapping m_mapping;
+	const PacketRingHeader* m_header;
+	const PacketRingSlot* m_slots;
+	uint32_t m_slotMask;
+	uint64_t m_next;
+	const PacketRingSlot* m_currentSlot;
+	uint64_t m_currentSequence;
+	uint64_t m_lost;
+};
@@ -0,0 +1,108 @@
+#include "file_follow.h"
+
+#include <thread>
+
+#ifdef _WIN32
+#include <Windows.h>
+#else
+#include <unistd.h>
+#endif
+
+#ifdef __linux__
+#include <poll.h>
+#include <sys/inotify.h>
+#endif
+
+#ifdef _WIN32
+FileWatcher::FileWatcher(const std::string& path)
+{
+	auto separator = path.find_last_of("\\/");
+	auto directory = (separator == std::string::npos ? std::string(".") : path.substr(0, separator + 1));
+
+	m_changeHandle = FindFirstChangeNotificationA(directory.c_str(), FALSE, FILE_NOTIFY_CHANGE_SIZE | FILE_NOTIFY_CHANGE_LAST_WRITE);
+}
+
+FileWatcher::~FileWatcher()
+{
+	if (m_changeHandle != INVALID_HANDLE_VALUE)
+		FindCloseChangeNotification(m_changeHandle);
+}
+
+bool FileWatcher::wait(std::chrono::milliseconds timeout)
+{
+	if (m_changeHandle == INVALID_HANDLE_VALUE)
+	{
+		std::this_thread::sleep_for(timeout);
+		return false;
+	}
+
+	if (WaitForSingleObject(m_changeHandle, static_cast<DWORD>(timeout.count())) != WAIT_OBJECT_0)
+		return false;
+
+	FindNextChangeNotification(m_changeHandle);
+	return true;
+}
+
+bool truncateFile(const std::string& path, uint64_t size)
+{
+	auto file = CreateFileA(path.c_str(), GENERIC_WRITE, FILE_SHARE_READ, nullptr, OPEN_EXISTING, FILE_ATTRIBUTE_NORMAL, nullptr);
+	if (file == INVALID_HANDLE_VALUE)
+		return false;
+
+	LARGE_INTEGER position;
+	position.QuadPart = static_cast<LONGLONG>(size);
+	auto truncated = SetFilePointerEx(file, position, nullptr, FILE_BEGIN) && SetEndOfFile(file);
+	CloseHandle(file);
+
+	return truncated != FALSE;
+}
+#else
+FileWatcher::FileWatcher(const std::string& path) :
+	m_inotifyDescriptor(-1)
+{
+#ifdef __linux__
+	m_inotifyDescriptor = inotify_init1(IN_NONBLOCK | IN_CLOEXEC);
+	if (m_inotifyDescriptor >= 0 && inotify_add_watch(m_inotifyDescriptor, path.c_str(), IN_MODIFY | IN_CLOSE_WRITE) < 0)
+	{
+		close(m_inotifyDescriptor);
+		m_inotifyDescriptor = -1;
+	}
+#else
+	(void)path;
+#endif
+}
+
+FileWatcher::~FileWatcher()
+{
+	if (m_inotifyDescriptor >= 0)
+		close(m_inotifyDescriptor);
+}
+
+bool FileWatcher::wait(std::chrono::milliseconds timeout)
+{
+#ifdef __linux__
+	if (m_inotifyDescriptor >= 0)
+	{
+		pollfd descriptor = {m_inotifyDescriptor, POLLIN, 0};
+		if (poll(&descriptor, 1, static_cast<int>(timeout.count())) <= 0)
+			return false;
+
+		// Events themselves do not matter, only that there were some. Several writes come as one wakeup.
+		char events[4096];
+		while (read(m_inotifyDescriptor, events, sizeof(events)) > 0)
+		{
+		}
+
+		return true;
+	}
+#endif
+
+	std::this_thread::sleep_for(timeout);
+	return false;
+}
+
+bool truncateFile(const std::string& path, uint64_t size)
+{
+	return truncate(path.c_str(), static_cast<off_t>(size)) == 0;
+}
+#endif
@@ -0,0 +1,32 @@
+#pragma once
+
+#include <chrono>
+#include <cstdint>
+#include <string>
+
+// Wakes up when a file that is still being written may have grown. inotify on Linux, a change notification
+// of the containing directory on Windows. Notifications can be late or missing (network shares, Windows
+// updating the size lazily), so every wait also ends at the timeout and the caller checks the size anyway.
+// Elsewhere it only waits for the timeout.
+class FileWatcher
+{
+public:
+	explicit FileWatcher(const std::string& path);
+	~FileWatcher();
+
+	// True when a change was reported, false when the timeout passed without one.
+	bool wait(std::chrono::milliseconds timeout);
+
+private:
+	FileWatcher(const FileWatcher&);
+	FileWatcher& operator=(const FileWatcher&);
+
+#ifdef _WIN32
+	void* m_changeHandle;
+#else
+	int m_inotifyDescriptor;
+#endif
+};
+
+// Cuts the file to the given size. False if it could not be done.
+bool truncateFile(const std::string& path, uint64_t size);
@@ -1,36 +1,60 @@
 
 #include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <condition_variable>
+#include <csignal>
 #include <cstdint>
+#include <cstdio>
 #include <fstream>
-#include <iomanip>
+#include <functional>
 #include <iostream>
-#include <sstream>
+#include <memory>
+#include <mutex>
 #include <string>
+#include <thread>
 #include <vector>
 
+#include "file_follow.h"
+#include "mapped_file.h"
+#include "metrics.h"
+#include "psd_arrow_writer.h"
+#include "psd_csv.h"
+#include "psd_record.h"
+#include "psd_validation.h"
 
 namespace
 {
-	const size_t psdPacketSize = 271;
+	const size_t psdPacketSize = PsdRecord::size;
+	// Records formatted by one worker at a time, around 4 MB of the input file.
+	const size_t recordsPerBatch = 16384;
+	// Longest wait for a change notification before the file size is checked anyway.
+	const std::chrono::milliseconds followPollInterval(1000);
+	const char* csvHeader = "packetNr,destination,source,port,transactionID,packet,RSSI,LQI,FCS";
 	std::vector<std::string> parameters;
+	// Set by Ctrl+C, follow mode finishes the batch at hand and reports.
+	volatile std::sig_atomic_t stopFollowing = 0;
 
-	struct packetData
+	// Everything before psdOffset has been converted into the first csvSize bytes of the CSV.
+	struct Checkpoint
 	{
-		std::string destinationAddress;
-		std::string sourceAddress;
-		uint8_t port;
-		uint8_t transactionId;
-		std::string dataHex;
-		int8_t rssi;
-		uint8_t lqi;
-		bool fcsOk;
+		uint64_t psdOffset;
+		uint64_t csvSize;
 	};
 }
 
 static void fillParameters(int argc, char* argv[]);
-static struct packetData parsePsd(const std::vector<uint8_t>& packetBinary);
-
-int main(char argc, char* argv[])
+static int followRecords(const std::string& inputPath, const std::string& outputPath);
+static bool readCheckpoint(const std::string& path, Checkpoint& checkpoint);
+static void writeCheckpoint(const std::string& path, const Checkpoint& checkpoint);
+static bool fileSize(const std::string& path, uint64_t& size);
+static void convertBatches(size_t batchCount, const std::function<void(size_t, std::string&)>& formatBatch, const std::function<void(size_t, std::string&)>& writeBatch,
+	std::ofstream& outputFile);
+static int validateRecords(const MappedFile& inputFile, const std::string& outputPath, const std::string& reportPath);
+static void validateScannedRecords(PsdScanner& scanner, CaptureStatistics& statistics, std::string& output);
+static int writeArrow(const MappedFile& inputFile, size_t packetsExpected, const std::string& outputPath);
+
+int main(int argc, char* argv[])
 {
 	if (argc < 2)
 	{
@@ -39,109 +63,366 @@ int main(char argc, char* argv[])
 
 	fillParameters(argc, argv);
 
-	std::ifstream inputFile;
-	inputFile.open(parameters.at(0), std::ios::binary);
-	if (inputFile.good() == false)
+	std::string outputFileName = parameters.at(0);
+	outputFileName.replace(outputFileName.end() - 3, outputFileName.end(), "csv");
+
+	// "follow" keeps converting what the sniffer appends to a capture it is still writing.
+	if (parameters.size() > 1 && parameters.at(1) == "follow")
+		return followRecords(parameters.at(0), outputFileName);
+
+	std::unique_ptr<MappedFile> inputFile;
+	try
+	{
+		inputFile.reset(new MappedFile(parameters.at(0)));
+	}
+	catch (const std::runtime_error&)
 	{
 		std::cerr << "Input file does not exist. Exiting." << std::endl;
 		return -1;
 	}
 
-	inputFile.seekg(0, std::ifstream::end);
-	size_t packetsExpected = static_cast<size_t>(inputFile.tellg() / psdPacketSize);
-	size_t byteError = static_cast<size_t>(inputFile.tellg() % psdPacketSize);
-	inputFile.seekg(0);
+	size_t packetsExpected = inputFile->size() / psdPacketSize;
+	size_t byteError = inputFile->size() % psdPacketSize;
 	std::cout << "Expecting " << packetsExpected << " packets from the file." << std::endl;
 	std::cout << "File offset byte count: " << byteError << "." << std::endl;
 
-	std::string outputFileName = parameters.at(0);
-	outputFileName.replace(outputFileName.end() - 3, outputFileName.end(), "csv");
+	// "arrow" writes the same columns as an Arrow IPC stream instead of the CSV.
+	if (parameters.size() > 1 && parameters.at(1) == "arrow")
+	{
+		auto arrowFileName = parameters.at(0);
+		arrowFileName.replace(arrowFileName.end() - 3, arrowFileName.end(), "arrows");
+
+		return writeArrow(*inputFile, packetsExpected, arrowFileName);
+	}
+
+	// "validate" checks every record and reports on the whole capture while converting it.
+	if (parameters.size() > 1 && parameters.at(1) == "validate")
+		return validateRecords(*inputFile, outputFileName, outputFileName.substr(0, outputFileName.size() - 3) + "report.txt");
+
 	std::ofstream outputFile;
 	outputFile.open(outputFileName);
 
-	outputFile << "packetNr,destination,source,port,transactionID,packet,RSSI,LQI,FCS" << std::endl;
+	outputFile << csvHeader << std::endl;
 
-	uint32_t packetCount = 1;
+	convertBatches((packetsExpected + recordsPerBatch - 1) / recordsPerBatch, [&](size_t batch, std::string& output)
+	{
+		auto firstRecord = batch * recordsPerBatch;
+		auto recordCount = std::min(recordsPerBatch, packetsExpected - firstRecord);
+		formatCsvRecords(inputFile->data() + firstRecord * psdPacketSize, firstRecord + 1, recordCount, output);
+	}, [&](size_t batch, std::string&)
+	{
+		std::cout << "\r" << std::min((batch + 1) * recordsPerBatch, packetsExpected) << " packets parsed.";
+	}, outputFile);
+
+	outputFile.close();
+
+	return 0;
+}
+
+static void fillParameters(int argc, char* argv[])
+{
+	for (uint32_t i = 1; i < (uint32_t)argc; i++)
+		parameters.push_back(std::string(argv[i]));
+}
+
+// The workers format batches of the file independently. Batches are written out strictly in file order,
+// writeBatch gets each right before and can still change it. A worker may run ahead of the writer only by
+// a couple of batches so the memory use does not depend on the file size.
+static void convertBatches(size_t batchCount, const std::function<void(size_t, std::string&)>& formatBatch, const std::function<void(size_t, std::string&)>& writeBatch,
+	std::ofstream& outputFile)
+{
+	const size_t workerCount = std::max(1u, std::thread::hardware_concurrency());
+	const size_t slotCount = workerCount * 2;
 
-	do
+	std::vector<std::string> formattedBatches(slotCount);
+	std::vector<bool> batchReady(slotCount, false);
+	std::mutex batchLock;
+	std::condition_variable batchChanged;
+	std::atomic<size_t> nextBatch(0);
+	size_t batchesWritten = 0;
+
+	auto formatBatches = [&]
 	{
-		std::vector<uint8_t> packetSnifferPacket(271);
+		for (auto batch = nextBatch++; batch < batchCount; batch = nextBatch++)
+		{
+			auto slot = batch % slotCount;
+
+			{
+				std::unique_lock<std::mutex> guard(batchLock);
+				batchChanged.wait(guard, [&]{ return batch < batchesWritten + slotCount; });
+			}
+
+			formatBatch(batch, formattedBatches[slot]);
+
+			std::lock_guard<std::mutex> guard(batchLock);
+			batchReady[slot] = true;
+			batchChanged.notify_all();
+		}
+	};
 
-		inputFile.read(reinterpret_cast<char*>(packetSnifferPacket.data()), static_cast<std::streamsize>(packetSnifferPacket.size()));
+	std::vector<std::thread> workers;
+	for (size_t i = 0; i < workerCount; i++)
+		workers.push_back(std::thread(formatBatches));
+
+	for (size_t batch = 0; batch < batchCount; batch++)
+	{
+		auto slot = batch % slotCount;
 
-		if (inputFile.gcount() != psdPacketSize)
 		{
-			break;
+			std::unique_lock<std::mutex> guard(batchLock);
+			batchChanged.wait(guard, [&]{ return batchReady[slot]; });
 		}
 
-		auto parsedData = parsePsd(packetSnifferPacket);
+		// Text mode stream, so the line endings are the same as they were with std::endl.
+		writeBatch(batch, formattedBatches[slot]);
+		outputFile << formattedBatches[slot];
 
-		std::cout << "\r" << packetCount << " packets parsed.";
+		std::lock_guard<std::mutex> guard(batchLock);
+		formattedBatches[slot].clear();
+		batchReady[slot] = false;
+		batchesWritten++;
+		batchChanged.notify_all();
+	}
 
-		outputFile << packetCount << "," << parsedData.destinationAddress << "," << parsedData.sourceAddress << "," << static_cast<uint32_t>(parsedData.port) << "," 
-			<< static_cast<uint32_t>(parsedData.transactionId) << "," << parsedData.dataHex << "," << static_cast<int32_t>(parsedData.rssi) 
-			<< "," << static_cast<uint32_t>(parsedData.lqi) << "," << (parsedData.fcsOk ? "OK" : "ERROR") << std::endl;
+	for (auto& worker : workers)
+		worker.join();
+}
 
-		packetCount++;
+// Batches are byte ranges of the file here, every worker finds the records in its own range. The CSV has
+// the record numbers of the sniffer and the status of every record in an extra column, records that were
+// cut short are left out. The counts of the batches are merged in file order as they are written.
+static int validateRecords(const MappedFile& inputFile, const std::string& outputPath, const std::string& reportPath)
+{
+	const size_t batchSize = recordsPerBatch * psdPacketSize;
+	const size_t batchCount = (inputFile.size() + batchSize - 1) / batchSize;
+
+	std::ofstream outputFile(outputPath, std::ios::trunc);
+	if (!outputFile.is_open())
+	{
+		std::cerr << "Could not open the output file. Exiting." << std::endl;
+		return -1;
 	}
-	while (inputFile.eof() == false && inputFile.good() == true);
 
-	inputFile.close();
-	outputFile.close();
+	outputFile << csvHeader << ",status" << std::endl;
+
+	std::vector<CaptureStatistics> batchStatistics(batchCount);
+	CaptureStatistics statistics;
+
+	convertBatches(batchCount, [&](size_t batch, std::string& output)
+	{
+		auto begin = batch * batchSize;
+		PsdScanner scanner(inputFile.data(), inputFile.size(), begin, std::min(begin + batchSize, inputFile.size()), batchStatistics[batch]);
+		validateScannedRecords(scanner, batchStatistics[batch], output);
+	}, [&](size_t batch, std::string& output)
+	{
+		auto& nextStatistics = batchStatistics[batch];
+
+		// Without records the batch says nothing about where the records continue, the next one has
+		// to show that. The last one still does, by reaching the end of the file.
+		if (!nextStatistics.hasRecords() && batch + 1 < batchCount)
+			return;
+
+		if (nextStatistics.firstOffset() > statistics.nextOffset())
+		{
+			CaptureStatistics betweenStatistics;
+			std::string lines;
+			PsdScanner scanner(inputFile.data(), inputFile.size(), statistics.nextOffset(), nextStatistics.firstOffset(), statistics, betweenStatistics);
+			validateScannedRecords(scanner, betweenStatistics, lines);
+
+			statistics.merge(betweenStatistics);
+			output.insert(0, lines);
+		}
+
+		statistics.merge(nextStatistics);
+		nextStatistics = CaptureStatistics();
+		std::cout << "\r" << (statistics.count(RecordStatus::valid) + statistics.count(RecordStatus::fcsError) + statistics.count(RecordStatus::badLength)
+			+ statistics.count(RecordStatus::truncated)) << " packets parsed.";
+	}, outputFile);
+
+	auto report = statistics.report();
+	std::cout << std::endl << std::endl << report;
+
+	std::ofstream reportFile(reportPath, std::ios::trunc);
+	reportFile << report;
 
 	return 0;
 }
 
-static void fillParameters(int argc, char* argv[])
+static void validateScannedRecords(PsdScanner& scanner, CaptureStatistics& statistics, std::string& output)
 {
-	for (uint32_t i = 1; i < (uint32_t)argc; i++)
-		parameters.push_back(std::string(argv[i]));
+	while (auto data = scanner.next())
+	{
+		PsdRecord record(data);
+		auto status = classifyRecord(record);
+		statistics.add(record, status);
+
+		formatCsvRecord(record, record.sequenceNumber(), output);
+		output += ',';
+		output += recordStatusName(status);
+		output += '\n';
+	}
 }
 
-static std::string bufferToHex(const std::vector<uint8_t>& buffer)
+// Decoding is cheap next to formatting text, so the records go through on this thread in file order.
+static int writeArrow(const MappedFile& inputFile, size_t packetsExpected, const std::string& outputPath)
 {
-	std::ostringstream stringBuffer;
+	try
+	{
+		PsdArrowWriter writer(outputPath);
 
-	stringBuffer << "\"";
+		for (size_t i = 0; i < packetsExpected; i++)
+		{
+			writer.append(static_cast<uint32_t>(i + 1), PsdRecord(inputFile.data() + i * psdPacketSize));
 
-	for (auto& aByte : buffer)
-		stringBuffer << std::hex << std::setw(2) << std::setfill('0') << std::uppercase << static_cast<int>(aByte) << " ";
+			if ((i + 1) % recordsPerBatch == 0)
+				std::cout << "\r" << (i + 1) << " packets parsed.";
+		}
 
-	auto asString = stringBuffer.str();
-	asString.replace(asString.end() - 1, asString.end(), "\"");
+		writer.close();
+	}
+	catch (const std::runtime_error& error)
+	{
+		std::cerr << error.what() << " Exiting." << std::endl;
+		return -1;
+	}
 
-	return asString;
+	std::cout << "\r" << packetsExpected << " packets parsed." << std::endl;
+
+	return 0;
 }
 
-static struct packetData parsePsd(const std::vector<uint8_t>& packetBinary)
+// Converts the records as the sniffer appends them, until Ctrl+C. Only whole records are taken, the rest
+// waits for the next append. Progress is kept in a checkpoint next to the CSV and a restart continues from
+// it: the CSV is cut back to the checkpoint first, so lines written after it are neither lost nor doubled.
+static int followRecords(const std::string& inputPath, const std::string& outputPath)
 {
-	struct packetData packet = {};
+	std::ifstream inputFile(inputPath, std::ios::binary);
+	if (!inputFile.is_open())
+	{
+		std::cerr << "Input file does not exist. Exiting." << std::endl;
+		return -1;
+	}
 
-	size_t dataLength = packetBinary.at(15);
-	packet.destinationAddress = bufferToHex(std::vector<uint8_t>(packetBinary.begin() + 16, packetBinary.begin() + 20));
-	packet.sourceAddress = bufferToHex(std::vector<uint8_t>(packetBinary.begin() + 20, packetBinary.begin() + 24));
-	packet.port = packetBinary.at(24);
-	packet.transactionId = packetBinary.at(26);
-	packet.dataHex = "EMPTY";
+	auto checkpointPath = outputPath + ".checkpoint";
+	Checkpoint checkpoint = {0, 0};
+	uint64_t outputSize = 0;
+	std::ofstream outputFile;
 
-	size_t applicationDataLength = dataLength - 11;
-	if (applicationDataLength > 0 && applicationDataLength <= 50)
+	if (readCheckpoint(checkpointPath, checkpoint) && fileSize(outputPath, outputSize) && outputSize >= checkpoint.csvSize
+		&& truncateFile(outputPath, checkpoint.csvSize))
 	{
-		packet.dataHex = bufferToHex(std::vector<uint8_t>(packetBinary.begin() + 27, packetBinary.begin() + (27 + (dataLength - 11))));
+		outputFile.open(outputPath, std::ios::app);
+		std::cout << "Resuming from packet " << (checkpoint.psdOffset / psdPacketSize + 1) << "." << std::endl;
 	}
-	
-	// When there are erroneous packets logged.
-	if (applicationDataLength > 50)
+	else
+	{
+		outputFile.open(outputPath, std::ios::trunc);
+		outputFile << csvHeader << std::endl;
+		checkpoint.psdOffset = 0;
+		checkpoint.csvSize = static_cast<uint64_t>(outputFile.tellp());
+	}
+
+	if (!outputFile.is_open())
 	{
-		packet.fcsOk = false;
-		return packet;
+		std::cerr << "Could not open the output file. Exiting." << std::endl;
+		return -1;
 	}
 
-	int8_t rawRssi = static_cast<int8_t>(packetBinary.at(27 + applicationDataLength));
-	int16_t calculatedRssi = (rawRssi >= 128 ? ((rawRssi - 256) / 2 - 72) : (rawRssi / 2 - 72));
-	packet.rssi = (calculatedRssi < -128 ? -128 : calculatedRssi); //std::max(-128, calculatedRssi);
-	packet.fcsOk = ((packetBinary.at(27 + applicationDataLength + 1) & 0x80) > 0 ? true : false);
-	packet.lqi = packetBinary.at(27 + applicationDataLength + 1) & 0x7F;
+	std::signal(SIGINT, [](int){ stopFollowing = 1; });
+	std::cout << "Following " << inputPath << ", Ctrl+C to stop." << std::endl;
+
+	FileWatcher watcher(inputPath);
+	// From noticing the append to its lines being in the CSV. The notification itself comes right with the
+	// write, only when it is missed the time since the append is longer by up to the poll interval.
+	LatencyHistogram latency;
+	std::vector<uint8_t> records(recordsPerBatch * psdPacketSize);
+	std::string lines;
+	size_t packetsConverted = 0;
+
+	while (!stopFollowing)
+	{
+		watcher.wait(followPollInterval);
+		auto changeTime = std::chrono::steady_clock::now();
 
-	return packet;
-}
\ No newline at end of file
+		inputFile.clear();
+		inputFile.seekg(0, std::ios::end);
+		auto inputSize = static_cast<uint64_t>(inputFile.tellg());
+
+		if (inputSize < checkpoint.psdOffset)
+		{
+			std::cerr << std::endl << "Input file got shorter than what was converted already, it is not the same capture. Exiting." << std::endl;
+			return -1;
+		}
+
+		auto newRecords = static_cast<size_t>((inputSize - checkpoint.psdOffset) / psdPacketSize);
+		if (newRecords == 0)
+			continue;
+
+		inputFile.seekg(static_cast<std::streamoff>(checkpoint.psdOffset));
+
+		// Batch by batch, catching up on a long capture holds the lines of one batch at a time. The checkpoint
+		// follows each batch once its lines are flushed to the system, not synced to the disk: after a power loss
+		// the CSV may be shorter than the checkpoint says, and the restart then converts from the start again.
+		while (newRecords > 0 && !stopFollowing)
+		{
+			auto recordCount = std::min(newRecords, recordsPerBatch);
+			inputFile.read(reinterpret_cast<char*>(records.data()), recordCount * psdPacketSize);
+
+			lines.clear();
+			formatCsvRecords(records.data(), static_cast<size_t>(checkpoint.psdOffset / psdPacketSize) + 1, recordCount, lines);
+			outputFile << lines;
+			outputFile.flush();
+
+			checkpoint.psdOffset += recordCount * psdPacketSize;
+			checkpoint.csvSize = static_cast<uint64_t>(outputFile.tellp());
+			writeCheckpoint(checkpointPath, checkpoint);
+
+			packetsConverted += recordCount;
+			newRecords -= recordCount;
+		}
+
+		latency.record(std::chrono::steady_clock::now() - changeTime);
+		auto snapshot = latency.snapshot();
+		std::cout << "\r" << (checkpoint.psdOffset / psdPacketSize) << " packets parsed. Latency p50 " << snapshot.percentile(0.5) / 1000.0
+			<< " ms, p99 " << snapshot.percentile(0.99) / 1000.0 << " ms.";
+	}
+
+	auto snapshot = latency.snapshot();
+	std::cout << std::endl << "Converted " << packetsConverted << " packets in " << snapshot.count() << " batches. Append to CSV latency p50 "
+		<< snapshot.percentile(0.5) / 1000.0 << " ms, p99 " << snapshot.percentile(0.99) / 1000.0 << " ms, max " << snapshot.max() / 1000.0 << " ms." << std::endl;
+
+	return 0;
+}
+
+static bool readCheckpoint(const std::string& path, Checkpoint& checkpoint)
+{
+	std::ifstream checkpointFile(path);
+
+	return static_cast<bool>(checkpointFile >> checkpoint.psdOffset >> checkpoint.csvSize);
+}
+
+// Written next to it and renamed over, so a crash never leaves a half written checkpoint.
+static void writeCheckpoint(const std::string& path, const Checkpoint& checkpoint)
+{
+	auto temporaryPath = path + ".tmp";
+	{
+		std::ofstream checkpointFile(temporaryPath, std::ios::trunc);
+		checkpointFile << checkpoint.psdOffset << " " << checkpoint.csvSize << std::endl;
+	}
+
+#ifdef _WIN32
+	// Rename does not replace an existing file there.
+	std::remove(path.c_str());
+#endif
+	std::rename(temporaryPath.c_str(), path.c_str());
+}
+
+static bool fileSize(const std::string& path, uint64_t& size)
+{
+	std::ifstream file(path, std::ios::binary | std::ios::ate);
+	if (!file.is_open())
+		return false;
+
+	size = static_cast<uint64_t>(file.tellg());
+	return true;
+}
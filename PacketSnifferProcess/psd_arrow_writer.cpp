@@ -0,0 +1,479 @@
+#include "psd_arrow_writer.h"
+
+#include <algorithm>
+#include <cstring>
+#include <stdexcept>
+
+namespace
+{
+	// Enumerations of the Arrow metadata, from Schema.fbs and Message.fbs of the format.
+	const int16_t metadataVersionV5 = 4;
+	const uint8_t messageHeaderSchema = 1;
+	const uint8_t messageHeaderDictionaryBatch = 2;
+	const uint8_t messageHeaderRecordBatch = 3;
+	const uint8_t typeInt = 2;
+	const uint8_t typeBinary = 4;
+	const uint8_t typeBool = 6;
+
+	const uint32_t continuationMarker = 0xFFFFFFFF;
+	const int64_t destinationDictionaryId = 0;
+	const int64_t sourceDictionaryId = 1;
+
+	// FieldNode and Buffer structs of RecordBatch.
+	struct ArrowStruct
+	{
+		int64_t first;
+		int64_t second;
+	};
+
+	// Just enough of a flatbuffers builder for the Arrow metadata. It is written front to back: the root
+	// offset, then every table right after its vtable and the children after their parents, so all of the
+	// offsets point forward. Offsets to children are left as placeholders and filled in once they are written.
+	class FlatBuffer
+	{
+	public:
+		// Fields of a table, given before the table is written. Children are referenced by offsets, the
+		// positions of those are handed back by write() in the order they were declared.
+		class Table
+		{
+		public:
+			template <typename T>
+			Table& scalar(uint16_t id, T value)
+			{
+				Field field = {id, sizeof(T), 0, false};
+				std::memcpy(&field.value, &value, sizeof(T));
+				m_fields.push_back(field);
+				return *this;
+			}
+
+			Table& child(uint16_t id)
+			{
+				Field field = {id, 4, 0, true};
+				m_fields.push_back(field);
+				return *this;
+			}
+
+		private:
+			friend class FlatBuffer;
+
+			struct Field
+			{
+				uint16_t id;
+				size_t size;
+				uint64_t value;
+				bool isChild;
+			};
+
+			std::vector<Field> m_fields;
+		};
+
+		// Starts with the placeholder of the root offset, the first table written is the root.
+		FlatBuffer() : m_data(4, 0) {}
+
+		std::vector<size_t> write(const Table& table, size_t referencedFrom)
+		{
+			// Widest fields first, so they are aligned without padding in between. The table itself starts
+			// 4 bytes before an 8 byte boundary, so its soffset comes first and the 8 byte fields follow it.
+			auto fields = table.m_fields;
+			std::stable_sort(fields.begin(), fields.end(), [](const Table::Field& left, const Table::Field& right){ return left.size > right.size; });
+
+			std::vector<size_t> fieldOffsets(fields.size());
+			size_t tableSize = 4;
+			uint16_t maxId = 0;
+			for (size_t i = 0; i < fields.size(); i++)
+			{
+				while ((4 + tableSize) % fields[i].size != 0)
+					tableSize++;
+
+				fieldOffsets[i] = tableSize;
+				tableSize += fields[i].size;
+				maxId = std::max(maxId, static_cast<uint16_t>(fields[i].id + 1));
+			}
+
+			std::vector<uint16_t> vtable(2 + maxId, 0);
+			vtable[0] = static_cast<uint16_t>(vtable.size() * 2);
+			vtable[1] = static_cast<uint16_t>(tableSize);
+			for (size_t i = 0; i < fields.size(); i++)
+				vtable[2 + fields[i].id] = static_cast<uint16_t>(fieldOffsets[i]);
+
+			align(2, 0);
+			auto vtablePosition = m_data.size();
+			append(vtable.data(), vtable.size() * 2);
+
+			align(8, 4);
+			auto tablePosition = m_data.size();
+			patch(referencedFrom, tablePosition);
+			m_data.resize(tablePosition + tableSize, 0);
+
+			auto vtableOffset = static_cast<int32_t>(tablePosition - vtablePosition);
+			std::memcpy(&m_data[tablePosition], &vtableOffset, 4);
+
+			// Children in declaration order, not in the sorted one.
+			std::vector<size_t> children;
+			for (auto& declared : table.m_fields)
+			{
+				for (size_t i = 0; i < fields.size(); i++)
+				{
+					if (fields[i].id != declared.id)
+						continue;
+
+					if (declared.isChild)
+						children.push_back(tablePosition + fieldOffsets[i]);
+					else
+						std::memcpy(&m_data[tablePosition + fieldOffsets[i]], &fields[i].value, fields[i].size);
+				}
+			}
+
+			return children;
+		}
+
+		void writeString(size_t referencedFrom, const std::string& text)
+		{
+			align(4, 0);
+			patch(referencedFrom, m_data.size());
+
+			auto length = static_cast<uint32_t>(text.size());
+			append(&length, 4);
+			append(text.c_str(), text.size() + 1);
+		}
+
+		void writeStructs(size_t referencedFrom, const std::vector<ArrowStruct>& structs)
+		{
+			align(8, 4);
+			patch(referencedFrom, m_data.size());
+
+			auto count = static_cast<uint32_t>(structs.size());
+			append(&count, 4);
+			append(structs.data(), structs.size() * sizeof(ArrowStruct));
+		}
+
+		// Vector of offsets to tables, returns the places of the offsets.
+		std::vector<size_t> writeTableVector(size_t referencedFrom, size_t count)
+		{
+			align(4, 0);
+			patch(referencedFrom, m_data.size());
+
+			auto length = static_cast<uint32_t>(count);
+			append(&length, 4);
+
+			std::vector<size_t> elements;
+			for (size_t i = 0; i < count; i++)
+			{
+				elements.push_back(m_data.size());
+				m_data.resize(m_data.size() + 4, 0);
+			}
+
+			return elements;
+		}
+
+		const std::vector<uint8_t>& data() const { return m_data; }
+
+	private:
+		// Pads until the position plus extra is a multiple of the alignment.
+		void align(size_t alignment, size_t extra)
+		{
+			while ((m_data.size() + extra) % alignment != 0)
+				m_data.push_back(0);
+		}
+
+		void append(const void* data, size_t length)
+		{
+			auto bytes = static_cast<const uint8_t*>(data);
+			m_data.insert(m_data.end(), bytes, bytes + length);
+		}
+
+		void patch(size_t referencedFrom, size_t target)
+		{
+			auto offset = static_cast<uint32_t>(target - referencedFrom);
+			std::memcpy(&m_data[referencedFrom], &offset, 4);
+		}
+
+		std::vector<uint8_t> m_data;
+	};
+
+	// Buffers of a record batch one after another, each starting at an 8 byte boundary.
+	class MessageBody
+	{
+	public:
+		void addBuffer(const void* data, size_t length)
+		{
+			ArrowStruct buffer = {static_cast<int64_t>(m_data.size()), static_cast<int64_t>(length)};
+			m_buffers.push_back(buffer);
+
+			auto bytes = static_cast<const uint8_t*>(data);
+			m_data.insert(m_data.end(), bytes, bytes + length);
+			m_data.resize((m_data.size() + 7) & ~static_cast<size_t>(7), 0);
+		}
+
+		// No nulls anywhere, so every column has an empty validity buffer in front of its data.
+		template <typename T>
+		void addColumn(const std::vector<T>& values, size_t rowCount)
+		{
+			ArrowStruct node = {static_cast<int64_t>(rowCount), 0};
+			m_nodes.push_back(node);
+
+			addBuffer(nullptr, 0);
+			addBuffer(values.data(), values.size() * sizeof(T));
+		}
+
+		void addBinaryColumn(const std::vector<int32_t>& offsets, const std::vector<uint8_t>& data, size_t rowCount)
+		{
+			ArrowStruct node = {static_cast<int64_t>(rowCount), 0};
+			m_nodes.push_back(node);
+
+			addBuffer(nullptr, 0);
+			addBuffer(offsets.data(), offsets.size() * sizeof(int32_t));
+			addBuffer(data.data(), data.size());
+		}
+
+		const std::vector<uint8_t>& data() const { return m_data; }
+		const std::vector<ArrowStruct>& nodes() const { return m_nodes; }
+		const std::vector<ArrowStruct>& buffers() const { return m_buffers; }
+
+	private:
+		std::vector<uint8_t> m_data;
+		std::vector<ArrowStruct> m_nodes;
+		std::vector<ArrowStruct> m_buffers;
+	};
+
+	// Message table with its header of the given type, returns where the header goes.
+	size_t writeMessageTable(FlatBuffer& metadata, uint8_t headerType, size_t bodyLength)
+	{
+		FlatBuffer::Table message;
+		message.scalar<int16_t>(0, metadataVersionV5).scalar<uint8_t>(1, headerType).child(2).scalar<int64_t>(3, static_cast<int64_t>(bodyLength));
+
+		return metadata.write(message, 0)[0];
+	}
+
+	void writeRecordBatchTable(FlatBuffer& metadata, size_t referencedFrom, size_t rowCount, const MessageBody& body)
+	{
+		FlatBuffer::Table recordBatch;
+		recordBatch.scalar<int64_t>(0, static_cast<int64_t>(rowCount)).child(1).child(2);
+
+		auto children = metadata.write(recordBatch, referencedFrom);
+		metadata.writeStructs(children[0], body.nodes());
+		metadata.writeStructs(children[1], body.buffers());
+	}
+
+	void writeIntTable(FlatBuffer& metadata, size_t referencedFrom, int32_t bitWidth, bool isSigned)
+	{
+		FlatBuffer::Table intType;
+		intType.scalar<int32_t>(0, bitWidth).scalar<uint8_t>(1, isSigned ? 1 : 0);
+
+		metadata.write(intType, referencedFrom);
+	}
+
+	struct ColumnType
+	{
+		const char* name;
+		uint8_t type;
+		int32_t bitWidth;
+		bool isSigned;
+		int64_t dictionaryId;		// Negative when the column is not dictionary-encoded.
+	};
+
+	// In the order of the CSV columns.
+	const ColumnType columns[] =
+	{
+		{"packetNr", typeInt, 32, false, -1},
+		{"destination", typeInt, 32, false, destinationDictionaryId},
+		{"source", typeInt, 32, false, sourceDictionaryId},
+		{"port", typeInt, 8, false, -1},
+		{"transactionID", typeInt, 8, false, -1},
+		{"packet", typeBinary, 0, false, -1},
+		{"RSSI", typeInt, 8, true, -1},
+		{"LQI", typeInt, 8, false, -1},
+		{"FCS", typeBool, 0, false, -1},
+	};
+}
+
+PsdArrowWriter::PsdArrowWriter(const std::string& path, size_t rowGroupSize) :
+	m_rowGroupSize(rowGroupSize),
+	m_closed(false),
+	m_rowCount(0)
+{
+	m_file.open(path, std::ios::binary | std::ios::trunc);
+	if (!m_file.is_open())
+		throw std::runtime_error("Could not open the output file " + path + ".");
+
+	m_destinations.valuesWritten = 0;
+	m_sources.valuesWritten = 0;
+
+	m_packetNumbers.reserve(m_rowGroupSize);
+	m_destinationIndices.reserve(m_rowGroupSize);
+	m_sourceIndices.reserve(m_rowGroupSize);
+	m_ports.reserve(m_rowGroupSize);
+	m_transactionIds.reserve(m_rowGroupSize);
+	m_payloadOffsets.reserve(m_rowGroupSize + 1);
+	m_payloadOffsets.push_back(0);
+	m_rssis.reserve(m_rowGroupSize);
+	m_lqis.reserve(m_rowGroupSize);
+	m_fcsBits.reserve(m_rowGroupSize / 8 + 1);
+
+	writeSchema();
+}
+
+PsdArrowWriter::~PsdArrowWriter()
+{
+	close();
+}
+
+void PsdArrowWriter::append(uint32_t packetNumber, const PsdRecord& record)
+{
+	auto payload = record.payload();
+
+	m_packetNumbers.push_back(packetNumber);
+	m_destinationIndices.push_back(encode(m_destinations, record.destination()));
+	m_sourceIndices.push_back(encode(m_sources, record.source()));
+	m_ports.push_back(record.port());
+	m_transactionIds.push_back(record.transactionId());
+	m_payloads.insert(m_payloads.end(), payload.data, payload.data + payload.length);
+	m_payloadOffsets.push_back(static_cast<int32_t>(m_payloads.size()));
+	m_rssis.push_back(record.rssi());
+	m_lqis.push_back(record.lqi());
+
+	if (m_rowCount % 8 == 0)
+		m_fcsBits.push_back(0);
+	if (record.fcsOk())
+		m_fcsBits.back() |= static_cast<uint8_t>(1 << (m_rowCount % 8));
+
+	m_rowCount++;
+
+	if (m_rowCount == m_rowGroupSize)
+		writeBatch();
+}
+
+void PsdArrowWriter::close()
+{
+	if (m_closed)
+		return;
+
+	m_closed = true;
+	writeBatch();
+
+	uint32_t endOfStream[2] = {continuationMarker, 0};
+	m_file.write(reinterpret_cast<const char*>(endOfStream), sizeof(endOfStream));
+	m_file.close();
+}
+
+int32_t PsdArrowWriter::encode(Dictionary& dictionary, uint32_t value)
+{
+	auto inserted = dictionary.indices.insert(std::make_pair(value, static_cast<int32_t>(dictionary.values.size())));
+	if (inserted.second)
+		dictionary.values.push_back(value);
+
+	return inserted.first->second;
+}
+
+void PsdArrowWriter::writeSchema()
+{
+	FlatBuffer metadata;
+	auto header = writeMessageTable(metadata, messageHeaderSchema, 0);
+
+	FlatBuffer::Table schema;
+	schema.scalar<int16_t>(0, 0).child(1);
+	auto fields = metadata.writeTableVector(metadata.write(schema, header)[0], sizeof(columns) / sizeof(columns[0]));
+
+	for (size_t i = 0; i < fields.size(); i++)
+	{
+		auto& column = columns[i];
+
+		FlatBuffer::Table field;
+		field.child(0).scalar<uint8_t>(1, 0).scalar<uint8_t>(2, column.type).child(3).child(5);
+		if (column.dictionaryId >= 0)
+			field.child(4);
+
+		auto children = metadata.write(field, fields[i]);
+		metadata.writeString(children[0], column.name);
+
+		if (column.type == typeInt)
+			writeIntTable(metadata, children[1], column.bitWidth, column.isSigned);
+		else
+			metadata.write(FlatBuffer::Table(), children[1]);
+
+		// No nested columns, but the vector has to be there.
+		metadata.writeTableVector(children[2], 0);
+
+		if (column.dictionaryId >= 0)
+		{
+			FlatBuffer::Table encoding;
+			encoding.scalar<int64_t>(0, column.dictionaryId).child(1).scalar<uint8_t>(2, 0);
+			writeIntTable(metadata, metadata.write(encoding, children[3])[0], 32, true);
+		}
+	}
+
+	writeMessage(metadata.data(), std::vector<uint8_t>());
+}
+
+void PsdArrowWriter::writeDictionary(int64_t id, Dictionary& dictionary)
+{
+	if (dictionary.valuesWritten == dictionary.values.size())
+		return;
+
+	// Only the addresses that are new since the last batch, anything after the first one is a delta.
+	std::vector<uint32_t> newValues(dictionary.values.begin() + dictionary.valuesWritten, dictionary.values.end());
+	MessageBody body;
+	body.addColumn(newValues, newValues.size());
+
+	FlatBuffer metadata;
+	auto header = writeMessageTable(metadata, messageHeaderDictionaryBatch, body.data().size());
+
+	FlatBuffer::Table dictionaryBatch;
+	dictionaryBatch.scalar<int64_t>(0, id).child(1).scalar<uint8_t>(2, dictionary.valuesWritten > 0 ? 1 : 0);
+	writeRecordBatchTable(metadata, metadata.write(dictionaryBatch, header)[0], newValues.size(), body);
+
+	writeMessage(metadata.data(), body.data());
+
+	dictionary.valuesWritten = dictionary.values.size();
+}
+
+void PsdArrowWriter::writeBatch()
+{
+	if (m_rowCount == 0)
+		return;
+
+	writeDictionary(destinationDictionaryId, m_destinations);
+	writeDictionary(sourceDictionaryId, m_sources);
+
+	MessageBody body;
+	body.addColumn(m_packetNumbers, m_rowCount);
+	body.addColumn(m_destinationIndices, m_rowCount);
+	body.addColumn(m_sourceIndices, m_rowCount);
+	body.addColumn(m_ports, m_rowCount);
+	body.addColumn(m_transactionIds, m_rowCount);
+	body.addBinaryColumn(m_payloadOffsets, m_payloads, m_rowCount);
+	body.addColumn(m_rssis, m_rowCount);
+	body.addColumn(m_lqis, m_rowCount);
+	body.addColumn(m_fcsBits, m_rowCount);
+
+	FlatBuffer metadata;
+	auto header = writeMessageTable(metadata, messageHeaderRecordBatch, body.data().size());
+	writeRecordBatchTable(metadata, header, m_rowCount, body);
+
+	writeMessage(metadata.data(), body.data());
+
+	m_rowCount = 0;
+	m_packetNumbers.clear();
+	m_destinationIndices.clear();
+	m_sourceIndices.clear();
+	m_ports.clear();
+	m_transactionIds.clear();
+	m_payloadOffsets.resize(1);
+	m_payloads.clear();
+	m_rssis.clear();
+	m_lqis.clear();
+	m_fcsBits.clear();
+}
+
+// Encapsulated message: continuation marker, metadata length, the flatbuffer padded to 8 bytes, then the body.
+void PsdArrowWriter::writeMessage(const std::vector<uint8_t>& metadata, const std::vector<uint8_t>& body)
+{
+	const char padding[8] = {};
+	auto paddedLength = (metadata.size() + 7) & ~static_cast<size_t>(7);
+
+	uint32_t prefix[2] = {continuationMarker, static_cast<uint32_t>(paddedLength)};
+	m_file.write(reinterpret_cast<const char*>(prefix), sizeof(prefix));
+	m_file.write(reinterpret_cast<const char*>(metadata.data()), metadata.size());
+	m_file.write(padding, paddedLength - metadata.size());
+	m_file.write(reinterpret_cast<const char*>(body.data()), body.size());
+}
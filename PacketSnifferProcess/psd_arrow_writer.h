@@ -0,0 +1,66 @@
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+#include <fstream>
+#include <string>
+#include <unordered_map>
+#include <vector>
+
+#include "psd_record.h"
+
+// Writes the records as an Arrow IPC stream (https://arrow.apache.org/docs/format/Columnar.html), readable by
+// pyarrow.ipc.open_stream and everything built on it. Columns have the names of the CSV header. Addresses
+// are uint32 columns dictionary-encoded with int32 indices, payload is a binary column and the rest are
+// plain typed columns, FCS a bit packed boolean.
+//
+// Rows are collected into a record batch of rowGroupSize rows at a time, so memory does not depend on the
+// input size. Addresses first seen in a batch are sent right before it as a delta to the dictionaries.
+class PsdArrowWriter
+{
+public:
+	explicit PsdArrowWriter(const std::string& path, size_t rowGroupSize = 65536);
+	~PsdArrowWriter();
+
+	void append(uint32_t packetNumber, const PsdRecord& record);
+	// Writes the last batch and the end of stream marker.
+	void close();
+
+private:
+	PsdArrowWriter(const PsdArrowWriter&);
+	PsdArrowWriter& operator=(const PsdArrowWriter&);
+
+	struct Dictionary
+	{
+		std::unordered_map<uint32_t, int32_t> indices;
+		std::vector<uint32_t> values;
+		size_t valuesWritten;
+	};
+
+	static int32_t encode(Dictionary& dictionary, uint32_t value);
+
+	void writeSchema();
+	void writeDictionary(int64_t id, Dictionary& dictionary);
+	void writeBatch();
+	void writeMessage(const std::vector<uint8_t>& metadata, const std::vector<uint8_t>& body);
+
+	std::ofstream m_file;
+	size_t m_rowGroupSize;
+	bool m_closed;
+
+	Dictionary m_destinations;
+	Dictionary m_sources;
+
+	// Columns of the batch being collected.
+	size_t m_rowCount;
+	std::vector<uint32_t> m_packetNumbers;
+	std::vector<int32_t> m_destinationIndices;
+	std::vector<int32_t> m_sourceIndices;
+	std::vector<uint8_t> m_ports;
+	std::vector<uint8_t> m_transactionIds;
+	std::vector<int32_t> m_payloadOffsets;
+	std::vector<uint8_t> m_payloads;
+	std::vector<int8_t> m_rssis;
+	std::vector<uint8_t> m_lqis;
+	std::vector<uint8_t> m_fcsBits;
+};
@@ -0,0 +1,41 @@
+#include "psd_csv.h"
+
+#include "byte_format.h"
+
+void formatCsvRecords(const uint8_t* records, size_t firstPacketNumber, size_t recordCount, std::string& output)
+{
+	for (size_t i = 0; i < recordCount; i++)
+	{
+		formatCsvRecord(PsdRecord(records + i * PsdRecord::size), firstPacketNumber + i, output);
+		output += '\n';
+	}
+}
+
+void formatCsvRecord(const PsdRecord& record, uint64_t packetNumber, std::string& output)
+{
+	appendNumber(output, packetNumber);
+	output += ',';
+	appendQuotedHex(output, record.destinationBytes(), PsdRecord::addressLength);
+	output += ',';
+	appendQuotedHex(output, record.sourceBytes(), PsdRecord::addressLength);
+	output += ',';
+	appendNumber(output, record.port());
+	output += ',';
+	appendNumber(output, record.transactionId());
+	output += ',';
+
+	auto payload = record.payload();
+	if (payload.length > 0)
+		appendQuotedHex(output, payload.data, payload.length);
+	else
+		output += "EMPTY";
+
+	output += ',';
+	auto rssi = record.rssi();
+	if (rssi < 0)
+		output += '-';
+	appendNumber(output, static_cast<uint64_t>(rssi < 0 ? -rssi : rssi));
+	output += ',';
+	appendNumber(output, record.lqi());
+	output += (record.fcsOk() ? ",OK" : ",ERROR");
+}
@@ -0,0 +1,14 @@
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+#include <string>
+
+#include "psd_record.h"
+
+// Appends the CSV lines of recordCount consecutive records to the output, numbered from firstPacketNumber.
+// Everything goes straight into it, so once the buffer has grown to the size of a batch there are no
+// allocations left.
+void formatCsvRecords(const uint8_t* records, size_t firstPacketNumber, size_t recordCount, std::string& output);
+// One CSV line without the line end.
+void formatCsvRecord(const PsdRecord& record, uint64_t packetNumber, std::string& output);
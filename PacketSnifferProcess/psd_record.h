@@ -0,0 +1,103 @@
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+
+// Bytes somewhere in a record, not owned.
+struct ByteSpan
+{
+	const uint8_t* data;
+	size_t length;
+};
+
+// One record of a SmartRF packet sniffer capture, decoded in place. It is only a pointer into the capture,
+// the fields are read at fixed offsets when asked for, so nothing is copied or allocated per record.
+class PsdRecord
+{
+public:
+	enum Layout
+	{
+		size = 271,
+		informationOffset = 0,
+		sequenceNumberOffset = 1,
+		packetLengthOffset = 13,
+		lengthOffset = 15,
+		destinationOffset = 16,
+		sourceOffset = 20,
+		portOffset = 24,
+		transactionIdOffset = 26,
+		payloadOffset = 27,
+		addressLength = 4,
+		// The length byte counts the SimpliciTI header in front of the payload.
+		headerLength = 11,
+		maxPayloadLength = 50,
+		// Bits of the information byte: the packet length counts the two status bytes after the frame, and
+		// the sniffer did not get the whole frame.
+		lengthIncludesFcsFlag = 0x01,
+		incompleteFlag = 0x04
+	};
+
+	explicit PsdRecord(const uint8_t* data) : m_data(data) {}
+
+	// Number the sniffer gave the record, one more for every record it captured.
+	uint32_t sequenceNumber() const
+	{
+		auto bytes = m_data + sequenceNumberOffset;
+		return bytes[0] | (static_cast<uint32_t>(bytes[1]) << 8) | (static_cast<uint32_t>(bytes[2]) << 16) | (static_cast<uint32_t>(bytes[3]) << 24);
+	}
+
+	bool incomplete() const { return (m_data[informationOffset] & incompleteFlag) != 0; }
+
+	// The length the sniffer wrote for the packet agrees with the length byte of the frame in it.
+	bool consistentLength() const
+	{
+		auto packetLength = m_data[packetLengthOffset] | (m_data[packetLengthOffset + 1] << 8);
+		auto statusLength = ((m_data[informationOffset] & lengthIncludesFcsFlag) != 0 ? 2 : 0);
+
+		return packetLength == 1 + m_data[lengthOffset] + statusLength;
+	}
+
+	const uint8_t* destinationBytes() const { return m_data + destinationOffset; }
+	const uint8_t* sourceBytes() const { return m_data + sourceOffset; }
+	// Address bytes in file order, the first one most significant.
+	uint32_t destination() const { return bigEndian(destinationBytes()); }
+	uint32_t source() const { return bigEndian(sourceBytes()); }
+
+	uint8_t port() const { return m_data[portOffset]; }
+	uint8_t transactionId() const { return m_data[transactionIdOffset]; }
+
+	// Without RSSI and FCS, there is nothing sensible after the payload when the length is out of range.
+	bool hasStatus() const { return payloadLengthField() <= maxPayloadLength; }
+
+	// Empty when there is no payload and when the length is out of range.
+	ByteSpan payload() const
+	{
+		auto length = payloadLengthField();
+		ByteSpan span = {m_data + payloadOffset, (length <= maxPayloadLength ? length : 0)};
+		return span;
+	}
+
+	// The RSSI and FCS/LQI bytes follow the payload, all three are zero or false without hasStatus().
+	int8_t rssi() const
+	{
+		if (!hasStatus())
+			return 0;
+
+		auto rssi = static_cast<int8_t>(m_data[payloadOffset + payloadLengthField()]) / 2 - 72;
+		return static_cast<int8_t>(rssi < -128 ? -128 : rssi);
+	}
+
+	uint8_t lqi() const { return (hasStatus() ? m_data[payloadOffset + payloadLengthField() + 1] & 0x7F : 0); }
+	bool fcsOk() const { return hasStatus() && (m_data[payloadOffset + payloadLengthField() + 1] & 0x80) != 0; }
+
+private:
+	// Wraps around for lengths shorter than the header, which then count as out of range.
+	size_t payloadLengthField() const { return static_cast<size_t>(m_data[lengthOffset]) - headerLength; }
+
+	static uint32_t bigEndian(const uint8_t* bytes)
+	{
+		return (static_cast<uint32_t>(bytes[0]) << 24) | (static_cast<uint32_t>(bytes[1]) << 16) | (static_cast<uint32_t>(bytes[2]) << 8) | bytes[3];
+	}
+
+	const uint8_t* m_data;
+};
@@ -0,0 +1,408 @@
+#include "psd_validation.h"
+
+#include <algorithm>
+#include <cstring>
+#include <iomanip>
+#include <sstream>
+#include <vector>
+
+#include "byte_format.h"
+
+namespace
+{
+	const size_t recordSize = PsdRecord::size;
+	const char* statusNames[] = {"valid", "fcsError", "badLength", "truncated"};
+	const int rssiBucketWidth = 8;
+	const int lqiBucketWidth = 16;
+	const size_t histogramBarWidth = 40;
+	// Most records the sniffer may miss between two it wrote, for the numbers to still count as in sequence.
+	const uint32_t maxSequenceJump = 256;
+
+	std::string formatAddress(uint32_t address)
+	{
+		uint8_t bytes[4] = {static_cast<uint8_t>(address >> 24), static_cast<uint8_t>(address >> 16), static_cast<uint8_t>(address >> 8), static_cast<uint8_t>(address)};
+		std::string text;
+		appendQuotedHex(text, bytes, sizeof(bytes));
+
+		return text;
+	}
+
+	// Counts grouped into buckets of the given width, one line with a bar for every non-empty bucket.
+	void writeHistogram(std::ostream& report, const uint64_t* counts, int size, int firstValue, int bucketWidth)
+	{
+		std::vector<uint64_t> buckets((size + bucketWidth - 1) / bucketWidth, 0);
+		for (int i = 0; i < size; i++)
+			buckets[i / bucketWidth] += counts[i];
+
+		auto largest = *std::max_element(buckets.begin(), buckets.end());
+		for (size_t i = 0; i < buckets.size(); i++)
+		{
+			if (buckets[i] == 0)
+				continue;
+
+			auto low = firstValue + static_cast<int>(i) * bucketWidth;
+			auto bar = static_cast<size_t>((buckets[i] * histogramBarWidth + largest - 1) / largest);
+			report << std::setw(6) << low << ".." << std::setw(4) << std::left << (low + bucketWidth - 1) << std::right
+				<< std::setw(10) << buckets[i] << " " << std::string(bar, '#') << "\n";
+		}
+	}
+}
+
+const char* recordStatusName(RecordStatus status)
+{
+	return statusNames[static_cast<size_t>(status)];
+}
+
+RecordStatus classifyRecord(const PsdRecord& record)
+{
+	if (record.incomplete())
+		return RecordStatus::truncated;
+	if (!record.hasStatus())
+		return RecordStatus::badLength;
+	if (!record.fcsOk())
+		return RecordStatus::fcsError;
+
+	return RecordStatus::valid;
+}
+
+CaptureStatistics::CaptureStatistics() :
+	m_bytesSkipped(0),
+	m_partialRecords(0),
+	m_realignments(0),
+	m_missingRecords(0),
+	m_skipping(false),
+	m_firstOffset(0),
+	m_nextOffset(0),
+	m_hasRecords(false),
+	m_firstSequenceNumber(0),
+	m_lastSequenceNumber(0)
+{
+	std::memset(m_statusCounts, 0, sizeof(m_statusCounts));
+	std::memset(m_rssiCounts, 0, sizeof(m_rssiCounts));
+	std::memset(m_lqiCounts, 0, sizeof(m_lqiCounts));
+}
+
+void CaptureStatistics::add(const PsdRecord& record, RecordStatus status)
+{
+	if (m_skipping)
+	{
+		m_partialRecords++;
+		m_realignments++;
+		m_skipping = false;
+	}
+
+	auto sequenceNumber = record.sequenceNumber();
+	// A bigger jump than the scanner takes for a gap is a numbering that started over, nothing is missing there.
+	if (!m_hasRecords)
+		m_firstSequenceNumber = sequenceNumber;
+	else if (PsdScanner::inSequence(m_lastSequenceNumber, sequenceNumber))
+		m_missingRecords += sequenceNumber - m_lastSequenceNumber - 1;
+
+	m_hasRecords = true;
+	m_lastSequenceNumber = sequenceNumber;
+	m_statusCounts[static_cast<size_t>(status)]++;
+
+	// Addresses of the records without a sensible length are noise, they would only flood the source table.
+	if (status != RecordStatus::valid && status != RecordStatus::fcsError)
+		return;
+
+	m_rssiCounts[record.rssi() + 128]++;
+	m_lqiCounts[record.lqi()]++;
+
+	SourceStatistics unseen = {0, 0, 0, 0, -1, -1};
+	auto& source = m_sources.insert(std::make_pair(record.source(), unseen)).first->second;
+
+	if (status == RecordStatus::fcsError)
+	{
+		source.failed++;
+		return;
+	}
+
+	source.good++;
+	addTransaction(source, record.transactionId());
+}
+
+void CaptureStatistics::addSkipped(size_t bytes)
+{
+	m_bytesSkipped += bytes;
+	m_skipping = true;
+}
+
+void CaptureStatistics::setExtent(size_t firstOffset, size_t nextOffset)
+{
+	m_firstOffset = firstOffset;
+	m_nextOffset = nextOffset;
+}
+
+void CaptureStatistics::merge(const CaptureStatistics& next)
+{
+	if (next.m_firstOffset > m_nextOffset)
+		addSkipped(next.m_firstOffset - m_nextOffset);
+	if (next.m_hasRecords && m_skipping)
+	{
+		m_partialRecords++;
+		m_realignments++;
+		m_skipping = false;
+	}
+
+	if (next.m_hasRecords)
+	{
+		if (!m_hasRecords)
+			m_firstSequenceNumber = next.m_firstSequenceNumber;
+		else if (PsdScanner::inSequence(m_lastSequenceNumber, next.m_firstSequenceNumber))
+			m_missingRecords += next.m_firstSequenceNumber - m_lastSequenceNumber - 1;
+
+		m_hasRecords = true;
+		m_lastSequenceNumber = next.m_lastSequenceNumber;
+		m_skipping = next.m_skipping;
+	}
+	else
+	{
+		m_skipping = m_skipping || next.m_skipping;
+	}
+
+	for (size_t i = 0; i < 4; i++)
+		m_statusCounts[i] += next.m_statusCounts[i];
+	m_bytesSkipped += next.m_bytesSkipped;
+	m_partialRecords += next.m_partialRecords;
+	m_realignments += next.m_realignments;
+	m_missingRecords += next.m_missingRecords;
+	m_nextOffset = std::max(m_nextOffset, next.m_nextOffset);
+
+	for (auto& nextSource : next.m_sources)
+	{
+		auto inserted = m_sources.insert(nextSource);
+		if (inserted.second)
+			continue;
+
+		auto& source = inserted.first->second;
+		auto& added = nextSource.second;
+
+		// The gap between the last packet of the source here and its first one in the next part.
+		if (added.firstTransactionId >= 0)
+			addTransaction(source, static_cast<uint8_t>(added.firstTransactionId));
+
+		source.good += added.good;
+		source.failed += added.failed;
+		source.lost += added.lost;
+		source.repeated += added.repeated;
+		if (added.lastTransactionId >= 0)
+			source.lastTransactionId = added.lastTransactionId;
+	}
+
+	for (size_t i = 0; i < 256; i++)
+		m_rssiCounts[i] += next.m_rssiCounts[i];
+	for (size_t i = 0; i < 128; i++)
+		m_lqiCounts[i] += next.m_lqiCounts[i];
+}
+
+std::string CaptureStatistics::report() const
+{
+	// A skip that runs to the end of the file is a partial record as well, just without a realignment.
+	auto partialRecords = m_partialRecords + (m_skipping ? 1 : 0);
+	uint64_t records = 0;
+	for (size_t i = 0; i < 4; i++)
+		records += m_statusCounts[i];
+
+	std::ostringstream report;
+	report << "Records: " << records << ", valid " << count(RecordStatus::valid) << ", FCS error " << count(RecordStatus::fcsError)
+		<< ", bad length " << count(RecordStatus::badLength) << ", marked incomplete " << count(RecordStatus::truncated) << ".\n";
+	report << "Partial records: " << partialRecords << ", " << m_bytesSkipped << " bytes skipped, realigned " << m_realignments << " times.\n";
+	report << "Record numbers missing from the sequence: " << m_missingRecords << ".\n\n";
+
+	report << "Source" << std::string(10, ' ') << std::setw(10) << "good" << std::setw(10) << "FCS error" << std::setw(10) << "lost" << std::setw(10) << "repeated" << std::setw(8) << "loss %" << "\n";
+
+	uint64_t failedOnlyPackets = 0;
+	size_t failedOnlySources = 0;
+	for (auto& entry : m_sources)
+	{
+		auto& source = entry.second;
+
+		// Corrupted addresses show up only in packets that failed the FCS, they are summed up instead.
+		if (source.good == 0)
+		{
+			failedOnlyPackets += source.failed;
+			failedOnlySources++;
+			continue;
+		}
+
+		auto loss = 100.0 * source.lost / (source.good + source.lost);
+		report << formatAddress(entry.first) << std::string(3, ' ') << std::setw(10) << source.good << std::setw(10) << source.failed
+			<< std::setw(10) << source.lost << std::setw(10) << source.repeated << std::setw(8) << std::fixed << std::setprecision(2) << loss << "\n";
+	}
+
+	if (failedOnlySources > 0)
+		report << failedOnlySources << " more addresses only in packets with an FCS error, " << failedOnlyPackets << " packets.\n";
+
+	report << "\nRSSI, dBm\n";
+	writeHistogram(report, m_rssiCounts, 256, -128, rssiBucketWidth);
+	report << "\nLQI\n";
+	writeHistogram(report, m_lqiCounts, 128, 0, lqiBucketWidth);
+
+	return report.str();
+}
+
+// Same transaction ID again is a retransmission, otherwise everything in between was lost.
+void CaptureStatistics::addTransaction(SourceStatistics& source, uint8_t transactionId)
+{
+	if (source.firstTransactionId < 0)
+		source.firstTransactionId = transactionId;
+	else if (transactionId == source.lastTransactionId)
+		source.repeated++;
+	else
+		source.lost += static_cast<uint8_t>(transactionId - source.lastTransactionId - 1);
+
+	source.lastTransactionId = transactionId;
+}
+
+PsdScanner::PsdScanner(const uint8_t* capture, size_t captureSize, size_t begin, size_t end, CaptureStatistics& statistics) :
+	m_capture(capture),
+	m_captureSize(captureSize),
+	m_end(end),
+	m_statistics(statistics),
+	m_started(false),
+	m_lastSequenceNumber(0)
+{
+	m_firstOffset = findAlignment(begin, end);
+	m_offset = m_firstOffset;
+}
+
+PsdScanner::PsdScanner(const uint8_t* capture, size_t captureSize, size_t begin, size_t end, const CaptureStatistics& previous, CaptureStatistics& statistics) :
+	m_capture(capture),
+	m_captureSize(captureSize),
+	m_end(end),
+	m_statistics(statistics),
+	m_firstOffset(begin),
+	m_offset(begin),
+	m_started(previous.hasRecords()),
+	m_lastSequenceNumber(previous.lastSequenceNumber())
+{
+}
+
+const uint8_t* PsdScanner::next()
+{
+	while (m_offset < m_end)
+	{
+		if (m_offset + recordSize > m_captureSize)
+		{
+			m_statistics.addSkipped(m_captureSize - m_offset);
+			m_offset = m_captureSize;
+			break;
+		}
+
+		// A record that continues the sequence is whole, unless the one after it is out of line and a record that
+		// continues the sequence as well starts inside it: then its end was lost. The first record and one out of
+		// sequence have to start a pair or a run, otherwise bytes were lost or inserted in front of them.
+		auto sequenceNumber = sequenceNumberAt(m_offset);
+		auto aligned = m_offset;
+		if (m_started && inSequence(m_lastSequenceNumber, sequenceNumber))
+		{
+			auto inside = (followedInSequence(m_offset) ? m_offset + recordSize : findContinuation(m_offset + 1, m_offset + recordSize));
+			aligned = (inside == m_offset + recordSize ? m_offset : inside);
+		}
+		else if (!startsPair(m_offset) && !startsRun(m_offset))
+		{
+			aligned = findAlignment(m_offset + 1, m_end);
+		}
+
+		if (aligned == m_offset)
+		{
+			auto record = m_capture + m_offset;
+			m_started = true;
+			m_lastSequenceNumber = sequenceNumber;
+			m_offset += recordSize;
+
+			return record;
+		}
+
+		// When the next record is in the next part, it counts the skip up to it.
+		if (aligned >= m_end && m_end < m_captureSize)
+			break;
+
+		m_statistics.addSkipped(aligned - m_offset);
+		m_offset = aligned;
+	}
+
+	m_statistics.setExtent(m_firstOffset, m_offset);
+	return nullptr;
+}
+
+bool PsdScanner::startsPair(size_t offset) const
+{
+	// A capture shorter than two records has its one record at the start.
+	if (offset + 2 * recordSize > m_captureSize)
+		return offset == 0 && m_captureSize >= recordSize;
+
+	// The numbers and timestamps go up slowly, so at offsets a few bytes into a record they still look
+	// like a sequence. The length fields are what tells a record start apart.
+	return inSequence(sequenceNumberAt(offset), sequenceNumberAt(offset + recordSize)) && PsdRecord(m_capture + offset).consistentLength();
+}
+
+bool PsdScanner::startsRun(size_t offset) const
+{
+	if (offset + 3 * recordSize > m_captureSize)
+		return false;
+
+	// A byte in front of the record start the numbers still go up by around 256, the length fields of one of
+	// the three have to agree. It need not be the first, a record the sniffer marked incomplete does not have
+	// them right.
+	if (!inSequence(sequenceNumberAt(offset), sequenceNumberAt(offset + recordSize))
+		|| !inSequence(sequenceNumberAt(offset + recordSize), sequenceNumberAt(offset + 2 * recordSize)))
+		return false;
+
+	return PsdRecord(m_capture + offset).consistentLength() || PsdRecord(m_capture + offset + recordSize).consistentLength()
+		|| PsdRecord(m_capture + offset + 2 * recordSize).consistentLength();
+}
+
+bool PsdScanner::followedInSequence(size_t offset) const
+{
+	if (offset + 2 * recordSize > m_captureSize)
+		return true;
+
+	return inSequence(sequenceNumberAt(offset), sequenceNumberAt(offset + recordSize));
+}
+
+bool PsdScanner::continuesSequence(size_t offset) const
+{
+	if (offset + recordSize > m_captureSize || !inSequence(m_lastSequenceNumber, sequenceNumberAt(offset)))
+		return false;
+
+	return PsdRecord(m_capture + offset).consistentLength() || followedInSequence(offset);
+}
+
+bool PsdScanner::inSequence(uint32_t sequenceNumber, uint32_t nextSequenceNumber)
+{
+	auto jump = nextSequenceNumber - sequenceNumber;
+	return jump >= 1 && jump <= maxSequenceJump;
+}
+
+size_t PsdScanner::findContinuation(size_t from, size_t limit) const
+{
+	for (auto offset = from; offset < limit; offset++)
+	{
+		if (continuesSequence(offset))
+			return offset;
+	}
+
+	return limit;
+}
+
+// A record going on from the last one is by far the likelier find after damage, a weak pair a few bytes into
+// a record before it must not win. Pairs and runs are looked for only when the sequence does not go on.
+size_t PsdScanner::findAlignment(size_t from, size_t limit) const
+{
+	if (m_started)
+	{
+		auto continuation = findContinuation(from, limit);
+		if (continuation < limit)
+			return continuation;
+	}
+
+	for (auto offset = from; offset < limit; offset++)
+	{
+		if (startsPair(offset) || startsRun(offset))
+			return offset;
+	}
+
+	return limit;
+}
@@ -0,0 +1,133 @@
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+#include <map>
+#include <string>
+
+#include "psd_record.h"
+
+enum class RecordStatus
+{
+	valid,
+	fcsError,
+	// The length byte is shorter than the header or the payload longer than a record can hold.
+	badLength,
+	// Marked incomplete by the sniffer, or a partial record cut short by an offset error or the end of the file.
+	truncated,
+};
+
+const char* recordStatusName(RecordStatus status);
+RecordStatus classifyRecord(const PsdRecord& record);
+
+// Counts of one part of a capture, the parts are merged in file order into the counts of the whole file.
+// Transaction IDs are counted per source: every SimpliciTI sender increments its own, so a jump of more
+// than one between two good packets of a source means the ones in between were not captured.
+class CaptureStatistics
+{
+public:
+	CaptureStatistics();
+
+	void add(const PsdRecord& record, RecordStatus status);
+	// Bytes that were skipped to find the next whole record. Skips up to the next record count as one
+	// partial record, and as a realignment once a record follows.
+	void addSkipped(size_t bytes);
+	// Where the records of this part start and where the one after its last record would be.
+	void setExtent(size_t firstOffset, size_t nextOffset);
+
+	// Adds the part that directly follows this one in the file.
+	void merge(const CaptureStatistics& next);
+
+	uint64_t count(RecordStatus status) const { return m_statusCounts[static_cast<size_t>(status)]; }
+	bool hasRecords() const { return m_hasRecords; }
+	uint32_t lastSequenceNumber() const { return m_lastSequenceNumber; }
+	size_t firstOffset() const { return m_firstOffset; }
+	size_t nextOffset() const { return m_nextOffset; }
+	std::string report() const;
+
+private:
+	struct SourceStatistics
+	{
+		uint64_t good;
+		uint64_t failed;
+		uint64_t lost;
+		uint64_t repeated;
+		int firstTransactionId;		// Negative until a good packet of the source is seen.
+		int lastTransactionId;
+	};
+
+	void addTransaction(SourceStatistics& source, uint8_t transactionId);
+
+	uint64_t m_statusCounts[4];
+	uint64_t m_bytesSkipped;
+	uint64_t m_partialRecords;
+	uint64_t m_realignments;
+	uint64_t m_missingRecords;
+	// The part ends in skipped bytes, the partial record is counted when the next record turns up.
+	bool m_skipping;
+
+	size_t m_firstOffset;
+	size_t m_nextOffset;
+	bool m_hasRecords;
+	uint32_t m_firstSequenceNumber;
+	uint32_t m_lastSequenceNumber;
+
+	std::map<uint32_t, SourceStatistics> m_sources;
+	uint64_t m_rssiCounts[256];		// Indexed by the RSSI plus 128.
+	uint64_t m_lqiCounts[128];
+};
+
+// Walks the records that start in [begin, end) of a capture. Records normally follow each other every
+// PsdRecord::size bytes with consecutive sequence numbers. A record starts a pair when its length fields
+// agree and the number of the record after it is a little higher, the sniffer may have missed a few. It
+// starts a run when the numbers of the two after it go on as well and the length fields of one of the
+// three agree. A record that continues the sequence is taken as it is. Where the sequence breaks and the
+// record in place starts no pair or run, bytes were lost or inserted: the scanner skips to the first
+// record that continues the sequence, or failing that to the first pair or run.
+// A capture ends with one whole record that continues the sequence, or is nothing but one record.
+//
+// A part scanned on its own starts at the first pair or run in it, the scan of the whole file may have
+// started a record before that already. Where a part does not start right where the one before it stopped,
+// the bytes in between are scanned again continuing from the part before, which gives what a scan of the
+// whole file would have.
+class PsdScanner
+{
+public:
+	// Starts at the first pair in the part.
+	PsdScanner(const uint8_t* capture, size_t captureSize, size_t begin, size_t end, CaptureStatistics& statistics);
+	// Continues at begin right after everything that is in the previous statistics.
+	PsdScanner(const uint8_t* capture, size_t captureSize, size_t begin, size_t end, const CaptureStatistics& previous, CaptureStatistics& statistics);
+
+	// Next record of the part, null when there are no more. The statistics get the extent of the part then.
+	const uint8_t* next();
+
+	// The second number is a little higher than the first.
+	static bool inSequence(uint32_t sequenceNumber, uint32_t nextSequenceNumber);
+
+private:
+	PsdScanner(const PsdScanner&);
+	PsdScanner& operator=(const PsdScanner&);
+
+	bool startsPair(size_t offset) const;
+	bool startsRun(size_t offset) const;
+	// The record after it is in sequence, or there is none.
+	bool followedInSequence(size_t offset) const;
+	// A record that goes on from the last one, with agreeing length fields or followed in sequence.
+	bool continuesSequence(size_t offset) const;
+	// First offset of a record continuing the last one, or the limit if there is none before it.
+	size_t findContinuation(size_t from, size_t limit) const;
+	// First offset of a record continuing the last one, or else the first one that starts a pair or a run, or
+	// the limit if there is none before it.
+	size_t findAlignment(size_t from, size_t limit) const;
+	uint32_t sequenceNumberAt(size_t offset) const { return PsdRecord(m_capture + offset).sequenceNumber(); }
+
+	const uint8_t* m_capture;
+	size_t m_captureSize;
+	size_t m_end;
+	CaptureStatistics& m_statistics;
+
+	size_t m_firstOffset;
+	size_t m_offset;
+	bool m_started;
+	uint32_t m_lastSequenceNumber;
+};
@@ -0,0 +1,82 @@
+#include <chrono>
+#include <cstdio>
+#include <cstdlib>
+#include <string>
+#include <thread>
+
+#include "child_process.h"
+#include "test.h"
+
+// The AP tool against the access point simulator with 2% of the packets faulty, both as separate processes over a
+// pseudo terminal the way they are run: 20 watches at 200 packets/s each for a few seconds. A fault may take the
+// packet next to it along, every other packet has to be logged.
+//
+//   ap_simulator_test [seconds, 3 by default]
+
+namespace
+{
+	// Absolute, the AP tool runs in a directory of its own.
+	std::string toolDirectory(const char* program)
+	{
+		auto resolved = realpath(program, nullptr);
+		std::string path(resolved != nullptr ? resolved : program);
+		std::free(resolved);
+
+		auto slash = path.rfind('/');
+		return (slash == std::string::npos ? std::string(".") : path.substr(0, slash));
+	}
+
+	// Number after the last occurrence of the label.
+	unsigned long long lastNumberAfter(const std::string& text, const std::string& label)
+	{
+		auto position = text.rfind(label);
+		return (position == std::string::npos ? 0 : std::strtoull(text.c_str() + position + label.size(), nullptr, 10));
+	}
+}
+
+int main(int argc, char* argv[])
+{
+	int seconds = (argc > 1 ? std::atoi(argv[1]) : 3);
+	auto tools = toolDirectory(argv[0]);
+	std::string directory = "/tmp/ap_simulator_test";
+	std::system(("rm -rf " + directory + " && mkdir -p " + directory).c_str());
+
+	ChildProcess simulator({tools + "/apsim", "20", "200", "20", "20"});
+	auto banner = simulator.readLine();
+	auto pathStart = banner.find("/dev/");
+	CHECK(pathStart != std::string::npos);
+	if (pathStart == std::string::npos)
+		return test::result();
+	auto devicePath = banner.substr(pathStart, banner.find(',', pathStart) - pathStart);
+
+	ChildProcess accessPoint({tools + "/ap", devicePath}, directory);
+	std::this_thread::sleep_for(std::chrono::seconds(seconds));
+	accessPoint.write("x\n");
+	auto apOutput = accessPoint.finish();
+
+	simulator.write("x\n");
+	auto simulatorOutput = simulator.finish();
+
+	auto sent = lastNumberAfter(simulatorOutput, "Sent ");
+	auto thrownAway = lastNumberAfter(simulatorOutput, "bytes. ");
+	auto droppedByteFaults = lastNumberAfter(simulatorOutput, "Faults: ");
+	auto garbageFaults = lastNumberAfter(simulatorOutput, "with dropped bytes, ");
+	auto received = lastNumberAfter(apOutput, "Packets received: ");
+
+	std::printf("%s%sSent %llu, received %llu, %llu with dropped bytes, %llu after garbage\n", apOutput.c_str(), simulatorOutput.c_str(),
+		sent, received, droppedByteFaults, garbageFaults);
+
+	CHECK_EQUAL(0, accessPoint.exitStatus());
+	CHECK(sent > 0);
+	CHECK(apOutput.find("Starting access point failed") == std::string::npos);
+	CHECK(apOutput.find("did not return any message") == std::string::npos);
+	// The tool keeps up, nothing is thrown away on either side.
+	CHECK_EQUAL(0ull, thrownAway);
+	CHECK(apOutput.find("Dropped") == std::string::npos);
+	CHECK(received <= sent);
+	CHECK(received + 2 * (droppedByteFaults + garbageFaults) >= sent);
+
+	std::system(("rm -rf " + directory).c_str());
+
+	return test::result();
+}
@@ -0,0 +1,126 @@
+#include <chrono>
+#include <cstdint>
+#include <cstdio>
+#include <iomanip>
+#include <sstream>
+#include <string>
+#include <vector>
+
+#include "byte_format.h"
+#include "cpu_features.h"
+#include "test.h"
+
+// Renderer throughput in GB/s of input bytes, against the stream formatting both tools had before and a plain
+// loop over the lookup table, for payloads of a packet and for long buffers. appendHex is the path picked at
+// startup, SSSE3 where the processor has it.
+//
+//   byte_format_bench [megabytes of input per measurement, 64 by default]
+
+namespace
+{
+	std::string streamHex(const uint8_t* data, size_t length)
+	{
+		std::ostringstream stringBuffer;
+
+		for (size_t i = 0; i < length; i++)
+			stringBuffer << std::hex << std::setw(2) << std::setfill('0') << std::uppercase << static_cast<int>(data[i]) << " ";
+
+		return stringBuffer.str();
+	}
+
+	std::string streamDecimal(const uint8_t* data, size_t length)
+	{
+		std::ostringstream stringBuffer;
+
+		for (size_t i = 0; i < length; i++)
+			stringBuffer << static_cast<uint32_t>(data[i]) << " ";
+
+		return stringBuffer.str();
+	}
+
+	void appendHexTable(std::string& buffer, const uint8_t* data, size_t length)
+	{
+		static const char digits[] = "0123456789ABCDEF";
+
+		auto start = buffer.size();
+		buffer.resize(start + length * 3);
+
+		auto output = &buffer[start];
+		for (size_t i = 0; i < length; i++, output += 3)
+		{
+			output[0] = digits[data[i] >> 4];
+			output[1] = digits[data[i] & 0x0F];
+			output[2] = ' ';
+		}
+	}
+
+	// Formats the input in pieces of the given length, the buffer is reused as the tools reuse theirs.
+	template <typename Render>
+	double measure(const std::vector<uint8_t>& input, size_t pieceLength, Render render)
+	{
+		std::string buffer;
+		size_t checksum = 0;
+
+		auto start = std::chrono::steady_clock::now();
+		for (size_t offset = 0; offset + pieceLength <= input.size(); offset += pieceLength)
+		{
+			buffer.clear();
+			render(buffer, &input[offset], pieceLength);
+			checksum += buffer.size();
+		}
+		auto seconds = test::secondsSince(start);
+
+		if (checksum == 0)
+			std::printf("Nothing was formatted.\n");
+
+		return input.size() / seconds / 1e9;
+	}
+}
+
+int main(int argc, char* argv[])
+{
+	size_t inputSize = (argc > 1 ? std::stoul(argv[1]) : 64) * 1024 * 1024;
+
+	std::vector<uint8_t> input(inputSize);
+	uint32_t random = 1;
+	for (auto& byte : input)
+	{
+		random = random * 1664525 + 1013904223;
+		byte = static_cast<uint8_t>(random >> 24);
+	}
+
+	// The streams are slow enough that a sixteenth of the input tells as much.
+	std::vector<uint8_t> streamInput(input.begin(), input.begin() + input.size() / 16);
+
+	std::printf("%zu MB of input, SSSE3 %s\n", inputSize / (1024 * 1024), processorHasSsse3() ? "available" : "not available");
+	std::printf("%-20s %16s %16s\n", "GB/s of input", "20 byte pieces", "4096 byte pieces");
+
+	size_t pieces[] = {20, 4096};
+	double results[2];
+
+	for (int i = 0; i < 2; i++)
+		results[i] = measure(streamInput, pieces[i], [](std::string& buffer, const uint8_t* data, size_t length) { buffer += streamHex(data, length); });
+	std::printf("%-20s %16.3f %16.3f\n", "hex, streams", results[0], results[1]);
+
+	for (int i = 0; i < 2; i++)
+		results[i] = measure(input, pieces[i], appendHexTable);
+	std::printf("%-20s %16.3f %16.3f\n", "hex, digit loop", results[0], results[1]);
+
+	for (int i = 0; i < 2; i++)
+		results[i] = measure(input, pieces[i], appendHex);
+	std::printf("%-20s %16.3f %16.3f\n", "appendHex", results[0], results[1]);
+
+	for (int i = 0; i < 2; i++)
+		results[i] = measure(streamInput, pieces[i], [](std::string& buffer, const uint8_t* data, size_t length) { buffer += streamDecimal(data, length); });
+	std::printf("%-20s %16.3f %16.3f\n", "decimal, streams", results[0], results[1]);
+
+	for (int i = 0; i < 2; i++)
+		results[i] = measure(input, pieces[i], appendDecimal);
+	std::printf("%-20s %16.3f %16.3f\n", "appendDecimal", results[0], results[1]);
+
+	for (int i = 0; i < 2; i++)
+		results[i] = measure(input, pieces[i], appendAscii);
+	std::printf("%-20s %16.3f %16.3f\n", "appendAscii", results[0], results[1]);
+
+	return 0;
+}
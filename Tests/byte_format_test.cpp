@@ -0,0 +1,208 @@
+#include <algorithm>
+#include <cstdint>
+#include <fstream>
+#include <iomanip>
+#include <sstream>
+#include <string>
+#include <vector>
+
+#include "byte_format.h"
+#include "test.h"
+
+// The renderers against the stream formatting both tools had before them. golden/byte_format.txt holds the output
+// of that formatting for a fixed set of inputs: all byte values at the lengths the vector path takes whole, in
+// pieces short enough for the scalar path alone, and every length around the 16 byte blocks. Random buffers are
+// compared against the stream formatting itself on top.
+//
+//   byte_format_test [--write-golden]    rewrites the fixture from the stream formatting
+
+namespace
+{
+	std::string streamHex(const std::vector<uint8_t>& buffer)
+	{
+		std::ostringstream stringBuffer;
+
+		for (auto& aByte : buffer)
+			stringBuffer << std::hex << std::setw(2) << std::setfill('0') << std::uppercase << static_cast<int>(aByte) << " ";
+
+		return stringBuffer.str();
+	}
+
+	std::string streamQuotedHex(const std::vector<uint8_t>& buffer)
+	{
+		auto asString = "\"" + streamHex(buffer);
+		asString.replace(asString.end() - 1, asString.end(), "\"");
+
+		return asString;
+	}
+
+	std::string streamDecimal(const std::vector<uint8_t>& buffer)
+	{
+		std::ostringstream stringBuffer;
+
+		for (auto& aByte : buffer)
+			stringBuffer << static_cast<uint32_t>(aByte) << " ";
+
+		return stringBuffer.str();
+	}
+
+	std::string streamAscii(const std::vector<uint8_t>& buffer)
+	{
+		std::ostringstream stringBuffer;
+
+		for (auto& aByte : buffer)
+			stringBuffer << static_cast<char>(aByte) << " ";
+
+		return stringBuffer.str();
+	}
+
+	std::string streamNumber(uint64_t value)
+	{
+		std::ostringstream stringBuffer;
+		stringBuffer << value;
+
+		return stringBuffer.str();
+	}
+
+	std::string rendererHex(const std::vector<uint8_t>& buffer)
+	{
+		std::string text;
+		appendHex(text, buffer.data(), buffer.size());
+		return text;
+	}
+
+	std::string rendererQuotedHex(const std::vector<uint8_t>& buffer)
+	{
+		std::string text;
+		appendQuotedHex(text, buffer.data(), buffer.size());
+		return text;
+	}
+
+	std::string rendererDecimal(const std::vector<uint8_t>& buffer)
+	{
+		std::string text;
+		appendDecimal(text, buffer.data(), buffer.size());
+		return text;
+	}
+
+	std::string rendererAscii(const std::vector<uint8_t>& buffer)
+	{
+		std::string text;
+		appendAscii(text, buffer.data(), buffer.size());
+		return text;
+	}
+
+	std::string rendererNumber(uint64_t value)
+	{
+		std::string text;
+		appendNumber(text, value);
+		return text;
+	}
+
+	std::vector<std::vector<uint8_t>> goldenInputs()
+	{
+		std::vector<std::vector<uint8_t>> inputs;
+
+		std::vector<uint8_t> allBytes;
+		for (int i = 0; i < 256; i++)
+			allBytes.push_back(static_cast<uint8_t>(i));
+		inputs.push_back(allBytes);
+
+		for (size_t i = 0; i < allBytes.size(); i += 15)
+			inputs.push_back(std::vector<uint8_t>(allBytes.begin() + i, allBytes.begin() + std::min<size_t>(i + 15, allBytes.size())));
+
+		for (size_t length = 0; length <= 50; length++)
+		{
+			std::vector<uint8_t> input;
+			for (size_t i = 0; i < length; i++)
+				input.push_back(static_cast<uint8_t>(i * 37 + length * 11));
+			inputs.push_back(input);
+		}
+
+		return inputs;
+	}
+
+	const uint64_t goldenNumbers[] = {0, 9, 10, 99, 100, 255, 65535, 4294967295u, 18446744073709551615u};
+
+	template <typename Bytes, typename Number>
+	std::string formatGolden(Bytes hex, Bytes quotedHex, Bytes decimal, Bytes ascii, Number number)
+	{
+		std::string text;
+		for (auto& input : goldenInputs())
+			text += hex(input) + "\n" + quotedHex(input) + "\n" + decimal(input) + "\n" + ascii(input) + "\n";
+
+		for (auto value : goldenNumbers)
+			text += number(value) + "\n";
+
+		return text;
+	}
+
+	std::string goldenPath(const char* program)
+	{
+		std::string path(program);
+		auto slash = path.rfind('/');
+		return (slash == std::string::npos ? std::string(".") : path.substr(0, slash)) + "/../golden/byte_format.txt";
+	}
+
+	void testGolden(const std::string& path)
+	{
+		std::ifstream file(path, std::ios::binary);
+		CHECK(file.is_open());
+
+		std::ostringstream golden;
+		golden << file.rdbuf();
+
+		auto text = formatGolden(rendererHex, rendererQuotedHex, rendererDecimal, rendererAscii, rendererNumber);
+		CHECK(!golden.str().empty());
+		CHECK(text == golden.str());
+	}
+
+	void testRandomBuffers()
+	{
+		uint32_t random = 1;
+		for (int round = 0; round < 20000; round++)
+		{
+			random = random * 1664525 + 1013904223;
+			std::vector<uint8_t> input(random >> 24);
+			for (auto& byte : input)
+			{
+				random = random * 1664525 + 1013904223;
+				byte = static_cast<uint8_t>(random >> 16);
+			}
+
+			CHECK(rendererHex(input) == streamHex(input));
+			CHECK(rendererQuotedHex(input) == streamQuotedHex(input));
+			CHECK(rendererDecimal(input) == streamDecimal(input));
+			CHECK(rendererAscii(input) == streamAscii(input));
+		}
+	}
+
+	// Renderers append, whatever is in the buffer stays.
+	void testAppends()
+	{
+		const uint8_t data[] = {0x00, 0x7F, 0xFF};
+		std::string text = "x";
+		appendHex(text, data, sizeof(data));
+		appendQuotedHex(text, data, 0);
+		appendDecimal(text, data, sizeof(data));
+		appendNumber(text, 42);
+
+		CHECK(text == "x00 7F FF \"0 127 255 42");
+	}
+}
+
+int main(int argc, char* argv[])
+{
+	if (argc > 1 && std::string(argv[1]) == "--write-golden")
+	{
+		std::ofstream file(goldenPath(argv[0]), std::ios::binary | std::ios::trunc);
+		file << formatGolden(streamHex, streamQuotedHex, streamDecimal, streamAscii, streamNumber);
+		return 0;
+	}
+
+	testGolden(goldenPath(argv[0]));
+	testRandomBuffers();
+	testAppends();
+
+	return test::result();
+}
@@ -0,0 +1,135 @@
+#include <chrono>
+#include <cstdint>
+#include <cstdio>
+#include <fstream>
+#include <string>
+#include <vector>
+
+#include "capture_reader.h"
+#include "capture_writer.h"
+#include "test.h"
+
+// Binary capture round trip: the corrected device time read back is the one written, to the millisecond the text
+// log shows, also when it is days or decades away from the host time.
+
+namespace
+{
+	const std::string capturePath = "/tmp/capture_format_test.shmcap";
+
+	struct Packet
+	{
+		std::chrono::system_clock::time_point receiveTime;
+		std::chrono::system_clock::time_point deviceTime;
+		std::vector<uint8_t> frame;
+	};
+
+	int64_t toMilliseconds(std::chrono::system_clock::time_point time)
+	{
+		return std::chrono::duration_cast<std::chrono::milliseconds>(time.time_since_epoch()).count();
+	}
+
+	std::vector<Packet> makePackets()
+	{
+		auto receiveTime = std::chrono::system_clock::time_point(std::chrono::seconds(1790000000)) + std::chrono::microseconds(123456);
+		std::vector<std::chrono::system_clock::duration> offsets = {
+			std::chrono::milliseconds(0),
+			std::chrono::milliseconds(1500),
+			std::chrono::milliseconds(-250),
+			std::chrono::hours(24 * 24),			// Still fits the 32 bit offset.
+			std::chrono::hours(24 * 30),
+			-std::chrono::hours(24 * 40),
+			-receiveTime.time_since_epoch()			// Watch clock never set.
+		};
+
+		std::vector<Packet> packets;
+		for (size_t i = 0; i < offsets.size() * 3; i++)
+		{
+			Packet packet;
+			packet.receiveTime = receiveTime + std::chrono::milliseconds(10 * i);
+			packet.deviceTime = packet.receiveTime + offsets[i % offsets.size()];
+			packet.frame = {static_cast<uint8_t>(1 + i % 4), 0x10, 0x20, 0x30, 0x40, static_cast<uint8_t>(i), 0};
+			for (size_t j = 0; j < i; j++)
+				packet.frame.push_back(static_cast<uint8_t>(i * 7 + j));
+
+			packets.push_back(packet);
+		}
+
+		return packets;
+	}
+
+	void writeCapture(const std::vector<Packet>& packets, size_t blockSize)
+	{
+		CaptureWriter writer(capturePath, 2, packets.front().receiveTime, blockSize);
+		for (size_t i = 0; i < packets.size(); i++)
+		{
+			ByteView frame = {packets[i].frame.data(), packets[i].frame.size()};
+			writer.append(i % 2, packets[i].receiveTime, packets[i].deviceTime, decodePacketHeader(frame), frame);
+		}
+		writer.close();
+	}
+
+	void testDeviceTimeRoundTrip(size_t blockSize)
+	{
+		auto packets = makePackets();
+		writeCapture(packets, blockSize);
+
+		CaptureReader reader(capturePath);
+		auto cursor = reader.records();
+		CaptureReader::Record record;
+		size_t count = 0;
+
+		while (cursor.next(record))
+		{
+			if (count >= packets.size())
+				break;
+
+			auto& packet = packets[count];
+			CHECK_EQUAL(toMilliseconds(packet.deviceTime), record.deviceTimeMs());
+			CHECK_EQUAL(packet.frame.size(), record.frameLength());
+			CHECK_EQUAL(count % 2, record.header->accessPointId);
+			CHECK(std::vector<uint8_t>(record.payload.begin(), record.payload.end()) ==
+				std::vector<uint8_t>(packet.frame.begin() + packetHeaderLength, packet.frame.end()));
+			count++;
+		}
+
+		CHECK_EQUAL(packets.size(), count);
+		std::remove(capturePath.c_str());
+	}
+
+	// Records of version 1 files are laid out as those without the device time following, they still read.
+	void testVersion1IsRead()
+	{
+		auto packets = makePackets();
+		packets.resize(3);
+		writeCapture(packets, 64 * 1024);
+
+		{
+			std::fstream file(capturePath, std::ios::in | std::ios::out | std::ios::binary);
+			uint32_t version = 1;
+			file.seekp(sizeof(captureFileMagic));
+			file.write(reinterpret_cast<const char*>(&version), sizeof(version));
+		}
+
+		CaptureReader reader(capturePath);
+		auto cursor = reader.records();
+		CaptureReader::Record record;
+		size_t count = 0;
+		while (cursor.next(record) && count < packets.size())
+		{
+			CHECK_EQUAL(toMilliseconds(packets[count].deviceTime), record.deviceTimeMs());
+			count++;
+		}
+
+		CHECK_EQUAL(packets.size(), count);
+		std::remove(capturePath.c_str());
+	}
+}
+
+int main()
+{
+	testDeviceTimeRoundTrip(64 * 1024);
+	testDeviceTimeRoundTrip(64);
+	testVersion1IsRead();
+
+	return test::result();
+}
@@ -0,0 +1,74 @@
+#include <algorithm>
+#include <chrono>
+#include <cstdint>
+#include <cstdio>
+#include <string>
+#include <thread>
+#include <vector>
+
+#include "capture_journal.h"
+#include "test.h"
+
+// Packets/s the journal takes at each durability, pushed as fast as the producer can, and how long a packet takes
+// from its receive time until it is durable. Every sync waits for the disk, so the numbers depend on what the
+// directory is on: a tmpfs syncs for free.
+//
+//   capture_journal_bench [packets, 200000 by default] [directory, /var/tmp by default]
+
+namespace
+{
+	struct Setting
+	{
+		const char* name;
+		CaptureJournal::Durability durability;
+		size_t packetCount;
+	};
+
+	void run(const Setting& setting, const std::string& path)
+	{
+		std::remove(path.c_str());
+
+		std::vector<uint8_t> frame(32, 0x5A);
+		CaptureJournal journal(path, setting.durability);
+		journal.start();
+
+		auto start = std::chrono::steady_clock::now();
+		for (size_t i = 0; i < setting.packetCount; i++)
+		{
+			frame[0] = static_cast<uint8_t>(i);
+			auto now = std::chrono::system_clock::now();
+			journal.push(1, now, now, frame.data(), frame.size());
+		}
+		journal.stop();
+		auto seconds = test::secondsSince(start);
+
+		auto latency = journal.durableLatency();
+		std::printf("%-10s %10zu %12.0f %8zu %10zu %12llu %12llu %8zu\n", setting.name, setting.packetCount, setting.packetCount / seconds,
+			journal.syncs(), journal.producerStalls(), static_cast<unsigned long long>(latency.percentile(0.5)),
+			static_cast<unsigned long long>(latency.percentile(0.99)), journal.writeErrors());
+
+		std::remove(path.c_str());
+	}
+}
+
+int main(int argc, char* argv[])
+{
+	size_t packetCount = (argc > 1 ? std::stoul(argv[1]) : 200000);
+	std::string directory = (argc > 2 ? argv[2] : "/var/tmp");
+	auto path = directory + "/capture_journal_bench.journal";
+
+	std::printf("32 byte frames into %s, %u hardware threads\n", directory.c_str(), std::thread::hardware_concurrency());
+	std::printf("%-10s %10s %12s %8s %10s %12s %12s %8s\n", "durability", "packets", "packets/s", "syncs", "stalls", "p50 us", "p99 us", "errors");
+
+	// A sync per packet takes a disk round trip each, it gets fewer packets.
+	Setting settings[] = {
+		{"buffered", CaptureJournal::Durability::buffered, packetCount},
+		{"grouped", CaptureJournal::Durability::grouped, packetCount},
+		{"packet", CaptureJournal::Durability::everyPacket, std::max<size_t>(1, packetCount / 100)},
+	};
+
+	for (auto& setting : settings)
+		run(setting, path);
+
+	return 0;
+}
@@ -0,0 +1,205 @@
+#include <chrono>
+#include <csignal>
+#include <cstdint>
+#include <cstdio>
+#include <fstream>
+#include <string>
+#include <thread>
+#include <vector>
+
+#include <sys/resource.h>
+#include <unistd.h>
+
+#include "capture_journal.h"
+#include "test.h"
+
+// Write-ahead journal: what is pushed reads back, a torn tail is cut off on the next open and new records go
+// right after the intact ones, and the records of a failed write are neither readable nor counted as durable.
+
+namespace
+{
+	const std::string path = "/tmp/capture_journal_test.journal";
+	const std::chrono::system_clock::time_point baseTime = std::chrono::system_clock::time_point(std::chrono::seconds(1700000000));
+
+	std::vector<uint8_t> frame(uint32_t sequence)
+	{
+		std::vector<uint8_t> data(7 + sequence % 50, static_cast<uint8_t>(sequence * 7));
+		for (size_t i = 0; i < 4; i++)
+			data[i] = static_cast<uint8_t>(sequence >> (8 * i));
+		return data;
+	}
+
+	void pushRecords(CaptureJournal& journal, uint32_t first, uint32_t count)
+	{
+		for (auto sequence = first; sequence < first + count; sequence++)
+		{
+			auto data = frame(sequence);
+			auto time = baseTime + std::chrono::milliseconds(sequence);
+			journal.push(sequence % 3, time, time - std::chrono::seconds(1), data.data(), data.size());
+		}
+	}
+
+	// Sequence numbers of the records read, -1 for one that is not what was pushed.
+	std::vector<int64_t> readSequences()
+	{
+		std::vector<int64_t> sequences;
+		JournalReader reader(path);
+		JournalReader::Record record;
+		while (reader.next(record))
+		{
+			uint32_t sequence = record.data[0] | (record.data[1] << 8) | (record.data[2] << 16) | (static_cast<uint32_t>(record.data[3]) << 24);
+			auto expected = frame(sequence);
+			auto intact = (record.length == expected.size() && std::equal(expected.begin(), expected.end(), record.data)
+				&& record.accessPointId == sequence % 3 && record.receiveTime == baseTime + std::chrono::milliseconds(sequence)
+				&& record.deviceTime == record.receiveTime - std::chrono::seconds(1));
+			sequences.push_back(intact ? sequence : -1);
+		}
+
+		return sequences;
+	}
+
+	bool inOrder(const std::vector<int64_t>& sequences, size_t count)
+	{
+		if (sequences.size() != count)
+			return false;
+		for (size_t i = 0; i < count; i++)
+		{
+			if (sequences[i] != static_cast<int64_t>(i))
+				return false;
+		}
+		return true;
+	}
+
+	uint64_t fileSize()
+	{
+		std::ifstream file(path, std::ios::binary | std::ios::ate);
+		return static_cast<uint64_t>(file.tellg());
+	}
+
+	// Journal of the first count records, and where each record ends in it.
+	std::vector<uint64_t> writeJournal(uint32_t count)
+	{
+		std::remove(path.c_str());
+		{
+			CaptureJournal journal(path, CaptureJournal::Durability::grouped);
+			journal.start();
+			pushRecords(journal, 0, count);
+			journal.stop();
+		}
+
+		std::vector<uint64_t> ends;
+		uint64_t end = sizeof(JournalFileHeader);
+		for (uint32_t i = 0; i < count; i++)
+		{
+			end += sizeof(JournalRecordHeader) + frame(i).size();
+			ends.push_back(end);
+		}
+
+		return ends;
+	}
+
+	void testReadBack()
+	{
+		auto ends = writeJournal(1000);
+		CHECK_EQUAL(ends.back(), fileSize());
+		CHECK(inOrder(readSequences(), 1000));
+	}
+
+	// Crash in the middle of a record at various places, or garbage after the last one: the next open finds
+	// the intact ones, cuts the rest and carries on right after them.
+	void testTornTail()
+	{
+		const uint32_t count = 100;
+		uint64_t cuts[] = {1, sizeof(JournalRecordHeader) / 2, sizeof(JournalRecordHeader), sizeof(JournalRecordHeader) + 3};
+
+		for (auto cut : cuts)
+		{
+			auto ends = writeJournal(count);
+			auto lastStart = ends[count - 2];
+			CHECK(truncate(path.c_str(), static_cast<off_t>(lastStart + cut)) == 0);
+
+			CaptureJournal journal(path);
+			CHECK_EQUAL(static_cast<uint64_t>(count - 1), journal.recoveredRecords());
+			CHECK_EQUAL(cut, journal.truncatedBytes());
+
+			journal.start();
+			pushRecords(journal, count - 1, 10);
+			journal.stop();
+
+			CHECK(inOrder(readSequences(), count + 9));
+		}
+
+		// Zeros from a file system that extended the file but never got to write the data.
+		{
+			auto ends = writeJournal(count);
+			std::ofstream(path, std::ios::binary | std::ios::app) << std::string(4096, '\0');
+
+			CaptureJournal journal(path);
+			CHECK_EQUAL(static_cast<uint64_t>(count), journal.recoveredRecords());
+			CHECK_EQUAL(4096u, journal.truncatedBytes());
+			CHECK_EQUAL(ends.back(), fileSize());
+		}
+
+		// A damaged record in the middle hides everything after it.
+		{
+			auto ends = writeJournal(count);
+			std::fstream file(path, std::ios::binary | std::ios::in | std::ios::out);
+			file.seekp(static_cast<std::streamoff>(ends[49] + sizeof(JournalRecordHeader)));
+			file.put('\x55');
+			file.close();
+
+			CaptureJournal journal(path);
+			CHECK_EQUAL(50u, journal.recoveredRecords());
+			CHECK_EQUAL(ends.back() - ends[49], journal.truncatedBytes());
+		}
+	}
+
+	// The file size limit makes the writes fail part of the way through a buffer.
+	void testFailedWriteNotDurable()
+	{
+		writeJournal(0);
+
+		CaptureJournal journal(path, CaptureJournal::Durability::grouped, std::chrono::milliseconds(1));
+		rlimit original;
+		getrlimit(RLIMIT_FSIZE, &original);
+		rlimit limited = original;
+		limited.rlim_cur = 20000;
+		std::signal(SIGXFSZ, SIG_IGN);
+		setrlimit(RLIMIT_FSIZE, &limited);
+
+		// In small pieces, so some writes go through before the limit.
+		journal.start();
+		for (uint32_t first = 0; first < 5000; first += 50)
+		{
+			pushRecords(journal, first, 50);
+			std::this_thread::sleep_for(std::chrono::milliseconds(2));
+		}
+		journal.stop();
+
+		setrlimit(RLIMIT_FSIZE, &original);
+		std::signal(SIGXFSZ, SIG_DFL);
+
+		auto sequences = readSequences();
+		std::printf("Size limited journal: %zu records readable, %zu written, %llu counted durable, %zu write errors\n", sequences.size(),
+			journal.recordsWritten(), static_cast<unsigned long long>(journal.durableLatency().count()), journal.writeErrors());
+
+		CHECK(journal.writeErrors() > 0);
+		CHECK(sequences.size() > 0);
+		CHECK(sequences.size() < 5000);
+		CHECK_EQUAL(sequences.size(), journal.recordsWritten());
+		CHECK_EQUAL(static_cast<uint64_t>(sequences.size()), journal.durableLatency().count());
+		for (auto sequence : sequences)
+			CHECK(sequence >= 0);
+	}
+}
+
+int main()
+{
+	testReadBack();
+	testTornTail();
+	testFailedWriteNotDurable();
+
+	std::remove(path.c_str());
+
+	return test::result();
+}
@@ -0,0 +1,158 @@
+#include <algorithm>
+#include <chrono>
+#include <cstdint>
+#include <cstdio>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <vector>
+
+#include "capture_session.h"
+#include "pty_access_point.h"
+#include "test.h"
+
+// Three access points on pseudo terminals through one capture session, opened by their paths like real ports.
+// Each streams its own packets at the same time as the others, with the number of the access point and a running
+// number in the payload. Every packet has to come out once, tagged with the access point it came from, in the
+// order of its port, and the merged stream has to be in receive time order.
+//
+//   capture_session_test [packets per access point, 3000 by default]
+
+namespace
+{
+	const size_t accessPointCount = 3;
+
+	struct Received
+	{
+		size_t accessPointId;
+		uint8_t link;
+		uint32_t number;
+		std::chrono::system_clock::time_point receiveTime;
+	};
+
+	// Device time is the host time, the way a freshly synced watch sends it.
+	std::vector<uint8_t> packetOf(size_t accessPoint, uint32_t number)
+	{
+		auto packet = PtyAccessPoint::dataPacket(static_cast<uint8_t>(1 + accessPoint), static_cast<uint32_t>(accessPoint << 24) | number);
+		auto now = std::chrono::system_clock::now().time_since_epoch();
+		auto seconds = static_cast<uint32_t>(std::chrono::duration_cast<std::chrono::seconds>(now).count());
+		auto milliseconds = static_cast<uint16_t>(std::chrono::duration_cast<std::chrono::milliseconds>(now).count() % 1000);
+
+		for (size_t i = 0; i < 4; i++)
+			packet[4 + i] = static_cast<uint8_t>(seconds >> (8 * i));
+		packet[8] = static_cast<uint8_t>(milliseconds);
+		packet[9] = static_cast<uint8_t>(milliseconds >> 8);
+
+		return packet;
+	}
+
+	// A few packets at a time every millisecond, so the ports keep overlapping.
+	void stream(PtyAccessPoint& accessPoint, size_t index, size_t packetCount)
+	{
+		for (size_t first = 0; first < packetCount; first += 4)
+		{
+			std::vector<uint8_t> bytes;
+			for (auto number = first; number < std::min(packetCount, first + 4); number++)
+			{
+				auto packet = packetOf(index, static_cast<uint32_t>(number));
+				bytes.insert(bytes.end(), packet.begin(), packet.end());
+			}
+
+			accessPoint.write(bytes);
+			std::this_thread::sleep_for(std::chrono::milliseconds(1));
+		}
+	}
+}
+
+int main(int argc, char* argv[])
+{
+	size_t packetCount = (argc > 1 ? std::stoul(argv[1]) : 3000);
+
+	std::vector<std::unique_ptr<PtyAccessPoint>> accessPoints;
+	std::vector<std::string> paths;
+	for (size_t i = 0; i < accessPointCount; i++)
+	{
+		accessPoints.push_back(std::unique_ptr<PtyAccessPoint>(new PtyAccessPoint()));
+		paths.push_back(accessPoints.back()->path());
+	}
+
+	std::mutex receivedLock;
+	std::vector<Received> received;
+	received.reserve(accessPointCount * packetCount);
+
+	CaptureSession session(paths, 115200, [&](const CaptureSession::CapturedPacket& packet)
+	{
+		auto& payload = packet.header.payload;
+		Received entry = {packet.accessPointId, packet.header.link, 0, packet.receiveTime};
+		for (size_t i = 0; i < 4 && i < payload.size; i++)
+			entry.number |= static_cast<uint32_t>(payload.data[i]) << (8 * i);
+
+		std::lock_guard<std::mutex> guard(receivedLock);
+		received.push_back(entry);
+	});
+	session.start();
+
+	std::vector<std::thread> streams;
+	for (size_t i = 0; i < accessPointCount; i++)
+		streams.push_back(std::thread([&, i]{ stream(*accessPoints[i], i, packetCount); }));
+	for (auto& streamTask : streams)
+		streamTask.join();
+
+	auto start = std::chrono::steady_clock::now();
+	while (test::secondsSince(start) < 10)
+	{
+		{
+			std::lock_guard<std::mutex> guard(receivedLock);
+			if (received.size() >= accessPointCount * packetCount)
+				break;
+		}
+
+		std::this_thread::sleep_for(std::chrono::milliseconds(10));
+	}
+	session.stop();
+
+	auto statistics = session.statistics();
+	std::vector<size_t> nextNumber(accessPointCount, 0);
+	size_t mistagged = 0;
+	size_t outOfOrder = 0;
+	size_t backInTime = 0;
+	size_t switches = 0;
+
+	for (size_t i = 0; i < received.size(); i++)
+	{
+		auto& entry = received[i];
+		auto source = static_cast<size_t>(entry.number >> 24);
+
+		if (source != entry.accessPointId || entry.link != 1 + entry.accessPointId || entry.accessPointId >= accessPointCount)
+		{
+			mistagged++;
+			continue;
+		}
+
+		if ((entry.number & 0xFFFFFF) != nextNumber[source])
+			outOfOrder++;
+		nextNumber[source] = (entry.number & 0xFFFFFF) + 1;
+
+		if (i > 0 && entry.receiveTime < received[i - 1].receiveTime)
+			backInTime++;
+		if (i > 0 && entry.accessPointId != received[i - 1].accessPointId)
+			switches++;
+	}
+
+	std::printf("%zu access points, %zu packets each: %zu received, %zu mistagged, %zu out of port order, %zu back in time, "
+		"%zu switches between ports, %zu bytes skipped\n", accessPointCount, packetCount, received.size(), mistagged, outOfOrder,
+		backInTime, switches, statistics.bytesSkipped);
+
+	CHECK_EQUAL(accessPointCount * packetCount, received.size());
+	CHECK_EQUAL(accessPointCount * packetCount, statistics.packetsReceived);
+	CHECK_EQUAL(0u, statistics.bytesSkipped);
+	CHECK_EQUAL(0u, mistagged);
+	CHECK_EQUAL(0u, outOfOrder);
+	CHECK_EQUAL(0u, backInTime);
+	for (size_t i = 0; i < accessPointCount; i++)
+		CHECK_EQUAL(packetCount, nextNumber[i]);
+	// The ports really were merged, not one after the other.
+	CHECK(switches > packetCount / 4);
+
+	return test::result();
+}
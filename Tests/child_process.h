@@ -0,0 +1,148 @@
+#pragma once
+
+#include <chrono>
+#include <stdexcept>
+#include <string>
+#include <vector>
+
+#include <poll.h>
+#include <signal.h>
+#include <sys/wait.h>
+#include <unistd.h>
+
+// One of the tools as a process of its own, the way it is run: console input through a pipe, console output
+// (with errors) read back line by line.
+class ChildProcess
+{
+public:
+	ChildProcess(const std::vector<std::string>& arguments, const std::string& directory = std::string()) : m_read(0), m_exitStatus(-1)
+	{
+		int input[2];
+		int output[2];
+		if (pipe(input) != 0 || pipe(output) != 0)
+			throw std::runtime_error("Could not create the pipes.");
+
+		m_pid = fork();
+		if (m_pid < 0)
+			throw std::runtime_error("Could not start " + arguments.at(0) + ".");
+
+		if (m_pid == 0)
+		{
+			dup2(input[0], STDIN_FILENO);
+			dup2(output[1], STDOUT_FILENO);
+			dup2(output[1], STDERR_FILENO);
+			close(input[0]);
+			close(input[1]);
+			close(output[0]);
+			close(output[1]);
+
+			if (!directory.empty() && chdir(directory.c_str()) != 0)
+				_exit(127);
+
+			std::vector<char*> argv;
+			for (auto& argument : arguments)
+				argv.push_back(const_cast<char*>(argument.c_str()));
+			argv.push_back(nullptr);
+
+			execv(argv[0], argv.data());
+			_exit(127);
+		}
+
+		close(input[0]);
+		close(output[1]);
+		m_input = input[1];
+		m_output = output[0];
+	}
+
+	~ChildProcess()
+	{
+		if (m_exitStatus < 0)
+		{
+			kill(m_pid, SIGKILL);
+			wait();
+		}
+	}
+
+	// Next line of output without the line end, empty when none came before the timeout or the process ended.
+	std::string readLine(std::chrono::milliseconds timeout = std::chrono::milliseconds(5000))
+	{
+		auto deadline = std::chrono::steady_clock::now() + timeout;
+		std::string::size_type end;
+		while ((end = m_text.find('\n', m_read)) == std::string::npos)
+		{
+			auto remaining = std::chrono::duration_cast<std::chrono::milliseconds>(deadline - std::chrono::steady_clock::now()).count();
+			if (remaining <= 0 || !readSome(static_cast<int>(remaining)))
+				return std::string();
+		}
+
+		auto line = m_text.substr(m_read, end - m_read);
+		m_read = end + 1;
+		return line;
+	}
+
+	void write(const std::string& text)
+	{
+		if (::write(m_input, text.data(), text.size()) != static_cast<ssize_t>(text.size()))
+			throw std::runtime_error("Could not write to the process.");
+	}
+
+	// Ctrl+C.
+	void interrupt()
+	{
+		kill(m_pid, SIGINT);
+	}
+
+	// Closes the console input, waits for the end and returns all output not read as lines yet.
+	std::string finish()
+	{
+		close(m_input);
+		m_input = -1;
+		while (readSome(-1))
+		{
+		}
+
+		wait();
+		auto rest = m_text.substr(m_read);
+		m_read = m_text.size();
+		return rest;
+	}
+
+	int exitStatus() const { return m_exitStatus; }
+
+private:
+	ChildProcess(const ChildProcess&);
+	ChildProcess& operator=(const ChildProcess&);
+
+	bool readSome(int timeoutMs)
+	{
+		pollfd descriptor = {m_output, POLLIN, 0};
+		if (poll(&descriptor, 1, timeoutMs) <= 0)
+			return false;
+
+		char buffer[4096];
+		auto count = read(m_output, buffer, sizeof(buffer));
+		if (count <= 0)
+			return false;
+
+		m_text.append(buffer, static_cast<size_t>(count));
+		return true;
+	}
+
+	void wait()
+	{
+		int status = 0;
+		waitpid(m_pid, &status, 0);
+		m_exitStatus = (WIFEXITED(status) ? WEXITSTATUS(status) : 128);
+		close(m_output);
+		if (m_input >= 0)
+			close(m_input);
+		m_input = -1;
+	}
+
+	pid_t m_pid;
+	int m_input;
+	int m_output;
+	std::string m_text;
+	std::string::size_type m_read;
+	int m_exitStatus;
+};
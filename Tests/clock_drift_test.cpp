@@ -0,0 +1,151 @@
+#include <algorithm>
+#include <chrono>
+#include <cmath>
+#include <cstdint>
+#include <cstdio>
+
+#include "clock_drift.h"
+#include "test.h"
+
+// The estimator on synthetic pairs: a watch clock running 50 ppm fast with millisecond timestamps, a packet every
+// 100 ms and up to 3 ms of receive latency. The drift has to be found, a single late packet must not move the fit,
+// and a watch clock set again has to start a new fit within a few packets. Corrected times are compared with the
+// true host time the packet was sent at.
+
+namespace
+{
+	typedef std::chrono::system_clock::time_point TimePoint;
+
+	const double driftPpm = 50.0;
+	const std::chrono::milliseconds packetInterval(100);
+	// Off the true host time after the fit settled: the receive latency and a millisecond of rounding.
+	const double toleranceMs = 5.0;
+
+	class Watch
+	{
+	public:
+		Watch() : m_hostStart(std::chrono::seconds(1700000000)), m_deviceStart(std::chrono::seconds(1700000000) - std::chrono::seconds(3)), m_random(1),
+			m_sent(0) {}
+
+		// Host time the next packet is sent at, and the device time the watch stamps it with.
+		void next(TimePoint& hostTime, TimePoint& deviceTime)
+		{
+			auto elapsed = packetInterval * m_sent++;
+			hostTime = m_hostStart + elapsed;
+
+			auto deviceElapsed = std::chrono::duration<double>(elapsed).count() * (1 + driftPpm / 1e6);
+			deviceTime = m_deviceStart + std::chrono::milliseconds(static_cast<int64_t>(std::floor(deviceElapsed * 1000)));
+		}
+
+		TimePoint received(TimePoint hostTime)
+		{
+			m_random = m_random * 1664525 + 1013904223;
+			return hostTime + std::chrono::microseconds((m_random >> 8) % 3000);
+		}
+
+		// Setting the watch clock again.
+		void step(std::chrono::milliseconds change) { m_deviceStart += change; }
+
+	private:
+		TimePoint m_hostStart;
+		TimePoint m_deviceStart;
+		uint32_t m_random;
+		int64_t m_sent;
+	};
+
+	double errorMs(TimePoint corrected, TimePoint hostTime)
+	{
+		return std::chrono::duration<double, std::milli>(corrected - hostTime).count();
+	}
+
+	// Largest error over the packets, counting only those after the first settleCount.
+	double feed(ClockDriftEstimator& estimator, Watch& watch, size_t packetCount, size_t settleCount)
+	{
+		double largestError = 0;
+		for (size_t i = 0; i < packetCount; i++)
+		{
+			TimePoint hostTime;
+			TimePoint deviceTime;
+			watch.next(hostTime, deviceTime);
+
+			auto corrected = estimator.correct(deviceTime, watch.received(hostTime));
+			if (i >= settleCount)
+				largestError = std::max(largestError, std::abs(errorMs(corrected, hostTime)));
+		}
+
+		return largestError;
+	}
+
+	void testDriftIsFound()
+	{
+		ClockDriftEstimator estimator;
+		Watch watch;
+
+		// Ten minutes, the drift adds up to 30 ms over them.
+		auto largestError = feed(estimator, watch, 6000, 100);
+
+		std::printf("Drift %.1f ppm estimated as %.1f ppm, largest error %.2f ms\n", driftPpm, estimator.driftPpm(), largestError);
+		CHECK(std::abs(estimator.driftPpm() - driftPpm) < 5);
+		CHECK(largestError < toleranceMs);
+	}
+
+	void testOutlierIsLeftOut()
+	{
+		ClockDriftEstimator estimator;
+		Watch watch;
+		feed(estimator, watch, 3000, 0);
+
+		auto driftBefore = estimator.driftPpm();
+		auto offsetBefore = estimator.offset();
+
+		// Held up for half a second somewhere on the way.
+		TimePoint hostTime;
+		TimePoint deviceTime;
+		watch.next(hostTime, deviceTime);
+		auto corrected = estimator.correct(deviceTime, hostTime + std::chrono::milliseconds(500));
+
+		std::printf("Late packet corrected %.2f ms off, offset moved %lld ms\n", errorMs(corrected, hostTime),
+			static_cast<long long>((estimator.offset() - offsetBefore).count()));
+		CHECK(std::abs(errorMs(corrected, hostTime)) < toleranceMs);
+		CHECK(std::abs((estimator.offset() - offsetBefore).count()) <= 1);
+		CHECK_EQUAL(driftBefore, estimator.driftPpm());
+
+		CHECK(feed(estimator, watch, 100, 0) < toleranceMs);
+	}
+
+	void testStepStartsOver()
+	{
+		ClockDriftEstimator estimator;
+		Watch watch;
+		feed(estimator, watch, 3000, 0);
+		CHECK(std::abs(estimator.driftPpm() - driftPpm) < 10);
+		auto offsetBefore = estimator.offset();
+
+		watch.step(std::chrono::seconds(2));
+
+		// The first two after the step are taken for late packets, the third one starts the new fit.
+		TimePoint hostTime;
+		TimePoint deviceTime;
+		for (int i = 0; i < 3; i++)
+		{
+			watch.next(hostTime, deviceTime);
+			estimator.correct(deviceTime, watch.received(hostTime));
+		}
+		CHECK_EQUAL(0.0, estimator.driftPpm());
+		CHECK(std::abs((estimator.offset() - offsetBefore + std::chrono::seconds(2)).count()) <= 5);
+
+		auto largestError = feed(estimator, watch, 6000, 0);
+		std::printf("After a 2 s step: largest error %.2f ms, drift estimated as %.1f ppm\n", largestError, estimator.driftPpm());
+		CHECK(largestError < toleranceMs);
+		CHECK(std::abs(estimator.driftPpm() - driftPpm) < 5);
+	}
+}
+
+int main()
+{
+	testDriftIsFound();
+	testOutlierIsLeftOut();
+	testStepStartsOver();
+
+	return test::result();
+}
@@ -0,0 +1,123 @@
+#include <algorithm>
+#include <chrono>
+#include <cstdint>
+#include <cstdio>
+#include <future>
+#include <memory>
+#include <thread>
+#include <vector>
+
+#include "posix_serial_transport.h"
+#include "pty_access_point.h"
+#include "simpliciti.h"
+#include "test.h"
+
+// Queued commands over a pseudo terminal, through the command writer and back through the parser: the round trip
+// while packets stream in, and that only the exact echo of a command completes it, never a frame that merely has
+// the same length.
+
+namespace
+{
+	struct Capture
+	{
+		explicit Capture(PtyAccessPoint& accessPoint) : packets(0),
+			simpliciTi(std::unique_ptr<SerialTransport>(new PosixSerialTransport(accessPoint.path(), 115200, 20)),
+				[this](const PacketHeader&, ByteView, std::chrono::system_clock::time_point)
+				{
+					packets++;
+				})
+		{
+			simpliciTi.startAccessPoint();
+		}
+
+		std::atomic<size_t> packets;
+		SimpliciTi simpliciTi;
+	};
+
+	std::vector<uint8_t> echo(std::vector<uint8_t> command)
+	{
+		command[1] = 0x06;
+		return command;
+	}
+
+	void testRoundTrip()
+	{
+		const size_t commandCount = 200;
+		PtyAccessPoint accessPoint;
+		Capture capture(accessPoint);
+
+		// Packets keep coming in between the acknowledgements.
+		std::atomic<bool> streaming(true);
+		std::thread stream([&]
+		{
+			for (uint32_t i = 0; streaming; i++)
+			{
+				accessPoint.write(PtyAccessPoint::dataPacket(1, i));
+				std::this_thread::sleep_for(std::chrono::microseconds(500));
+			}
+		});
+
+		std::vector<double> roundTrips;
+		size_t wrongAnswers = 0;
+		for (size_t i = 0; i < commandCount; i++)
+		{
+			auto link = static_cast<uint8_t>(1 + i % 4);
+			auto start = std::chrono::steady_clock::now();
+			auto response = capture.simpliciTi.toggleLed(link).get();
+			roundTrips.push_back(test::secondsSince(start) * 1e6);
+
+			if (response != echo({0xFF, 0x55, 0x04, link}))
+				wrongAnswers++;
+		}
+
+		streaming = false;
+		stream.join();
+		capture.simpliciTi.stopAccessPoint();
+
+		std::sort(roundTrips.begin(), roundTrips.end());
+		std::printf("%zu commands over the pty with packets streaming: round trip p50 %.0f us, p99 %.0f us, %zu packets in between\n",
+			commandCount, roundTrips[commandCount / 2], roundTrips[commandCount * 99 / 100], capture.packets.load());
+
+		CHECK_EQUAL(0u, wrongAnswers);
+		CHECK_EQUAL(0u, capture.simpliciTi.statistics().commandsFailed);
+		CHECK_EQUAL(0u, capture.simpliciTi.statistics().commandRetries);
+	}
+
+	void testOnlyExactEchoCompletes()
+	{
+		PtyAccessPoint accessPoint;
+		Capture capture(accessPoint);
+		accessPoint.setAcknowledge(false);
+
+		// Same length as the echo, different link byte.
+		std::vector<uint8_t> command = {0xFF, 0x55, 0x04, 1};
+		auto response = capture.simpliciTi.queueCommand(command, std::chrono::milliseconds(100), 1);
+		while (accessPoint.commandsReceived() < 3)
+			std::this_thread::sleep_for(std::chrono::milliseconds(1));
+		accessPoint.write(std::vector<uint8_t>{0xFF, 0x06, 0x04, 2});
+		CHECK(response.get().empty());
+		CHECK_EQUAL(1u, capture.simpliciTi.statistics().commandsFailed);
+
+		// The exact one still counts after a frame of the same length went by.
+		response = capture.simpliciTi.queueCommand(command, std::chrono::milliseconds(500), 1);
+		while (accessPoint.commandsReceived() < 4)
+			std::this_thread::sleep_for(std::chrono::milliseconds(1));
+		accessPoint.write(std::vector<uint8_t>{0xFF, 0x06, 0x04, 3});
+		accessPoint.write(echo(command));
+		CHECK(response.get() == echo(command));
+		CHECK_EQUAL(1u, capture.simpliciTi.statistics().commandsFailed);
+		// Sync and start of the handshake, and this one.
+		CHECK_EQUAL(3u, capture.simpliciTi.statistics().commandsAcknowledged);
+
+		accessPoint.setAcknowledge(true);
+		capture.simpliciTi.stopAccessPoint();
+	}
+}
+
+int main()
+{
+	testRoundTrip();
+	testOnlyExactEchoCompletes();
+
+	return test::result();
+}
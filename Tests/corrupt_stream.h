@@ -0,0 +1,228 @@
+#pragma once
+
+#include <algorithm>
+#include <chrono>
+#include <condition_variable>
+#include <cstdint>
+#include <mutex>
+#include <vector>
+
+#include "serial_transport.h"
+
+// Access point stream with the kinds of damage a serial line does to it: bytes dropped or inserted, packets cut
+// short, their length byte hit, and garbage between packets that may hold something looking like a header. The
+// payloads are random besides the sequence number in front, so they have their share of 0xFF 0x06 as well.
+struct CorruptStream
+{
+	std::vector<uint8_t> bytes;
+	// Frames as they were sent, without the USB header, as the packet callback gets them.
+	std::vector<std::vector<uint8_t>> frames;
+	// Intact and directly followed by an intact header, or by nothing. These have to come through.
+	std::vector<bool> mustArrive;
+	size_t damaged;
+};
+
+inline uint32_t nextRandom(uint32_t& random)
+{
+	random = random * 1664525 + 1013904223;
+	return random >> 8;
+}
+
+inline CorruptStream makeCorruptStream(size_t packetCount, unsigned damagePercent, uint32_t seed)
+{
+	CorruptStream stream;
+	stream.damaged = 0;
+	uint32_t random = seed;
+
+	std::vector<bool> intact(packetCount, true);
+	std::vector<bool> headerIntact(packetCount, true);
+	std::vector<bool> garbageBefore(packetCount, false);
+
+	for (size_t i = 0; i < packetCount; i++)
+	{
+		std::vector<uint8_t> frame = {static_cast<uint8_t>(1 + i % 4), 0x10, 0x20, 0x30, 0x40, static_cast<uint8_t>(i % 1000), 0};
+		auto payloadLength = 4 + nextRandom(random) % 37;
+		for (size_t j = 0; j < payloadLength; j++)
+			frame.push_back(j < 4 ? static_cast<uint8_t>(i >> (8 * j)) : static_cast<uint8_t>(nextRandom(random)));
+		stream.frames.push_back(frame);
+
+		std::vector<uint8_t> packet = {0xFF, 0x06, static_cast<uint8_t>(3 + frame.size())};
+		packet.insert(packet.end(), frame.begin(), frame.end());
+
+		if (nextRandom(random) % 100 < damagePercent)
+		{
+			stream.damaged++;
+			auto position = nextRandom(random) % packet.size();
+
+			switch (nextRandom(random) % 5)
+			{
+			case 0:
+				packet.erase(packet.begin() + position);
+				intact[i] = false;
+				headerIntact[i] = (position >= 2);
+				break;
+			case 1:
+				packet.insert(packet.begin() + position, static_cast<uint8_t>(nextRandom(random)));
+				intact[i] = false;
+				headerIntact[i] = (position >= 2);
+				break;
+			case 2:
+				packet.resize(std::max<size_t>(position, 1));
+				intact[i] = false;
+				headerIntact[i] = (packet.size() >= 2);
+				break;
+			case 3:
+			{
+				// Length byte points somewhere else, but never exactly at a header, that could not be told apart.
+				auto length = static_cast<uint8_t>(nextRandom(random));
+				if (length == packet[2])
+					length++;
+				packet[2] = length;
+				intact[i] = false;
+				break;
+			}
+			default:
+			{
+				// The fake header never points at the real one either.
+				std::vector<uint8_t> garbage(1 + nextRandom(random) % 16);
+				for (auto& byte : garbage)
+					byte = static_cast<uint8_t>(nextRandom(random));
+
+				auto fakeStart = nextRandom(random) % garbage.size();
+				uint8_t fake[] = {0xFF, 0x06, static_cast<uint8_t>(nextRandom(random))};
+				if (fake[2] == garbage.size() - fakeStart)
+					fake[2]++;
+				for (size_t j = 0; j < 3 && fakeStart + j < garbage.size(); j++)
+					garbage[fakeStart + j] = fake[j];
+
+				stream.bytes.insert(stream.bytes.end(), garbage.begin(), garbage.end());
+				garbageBefore[i] = true;
+				break;
+			}
+			}
+		}
+
+		stream.bytes.insert(stream.bytes.end(), packet.begin(), packet.end());
+	}
+
+	for (size_t i = 0; i < packetCount; i++)
+		stream.mustArrive.push_back(intact[i] && (i + 1 == packetCount || (headerIntact[i + 1] && !garbageBefore[i + 1])));
+
+	return stream;
+}
+
+// What came through of a CorruptStream.
+struct ResyncResult
+{
+	size_t intactDelivered;
+	size_t corruptDelivered;	// Frames that were not sent like that.
+	size_t mustArriveLost;
+};
+
+class ResyncCounter
+{
+public:
+	explicit ResyncCounter(const CorruptStream& stream) : m_stream(stream), m_delivered(stream.frames.size(), false), m_corrupt(0) {}
+
+	void frame(const uint8_t* data, size_t length)
+	{
+		if (length >= 7 + 4)
+		{
+			size_t sequence = data[7] | (data[8] << 8) | (data[9] << 16) | (static_cast<size_t>(data[10]) << 24);
+			if (sequence < m_stream.frames.size() && std::equal(data, data + length, m_stream.frames[sequence].begin())
+				&& length == m_stream.frames[sequence].size())
+			{
+				m_delivered[sequence] = true;
+				return;
+			}
+		}
+
+		m_corrupt++;
+	}
+
+	ResyncResult result() const
+	{
+		ResyncResult result = {0, m_corrupt, 0};
+		for (size_t i = 0; i < m_delivered.size(); i++)
+		{
+			result.intactDelivered += (m_delivered[i] ? 1 : 0);
+			result.mustArriveLost += (m_stream.mustArrive[i] && !m_delivered[i] ? 1 : 0);
+		}
+
+		return result;
+	}
+
+private:
+	const CorruptStream& m_stream;
+	std::vector<bool> m_delivered;
+	size_t m_corrupt;
+};
+
+// Hands out the bytes only as far as they were released. Commands are acknowledged right away, ahead of
+// the stream, the way the access point does it.
+class ScriptedTransport : public SerialTransport
+{
+public:
+	explicit ScriptedTransport(const std::vector<uint8_t>& bytes) : m_bytes(bytes), m_released(0), m_read(0) {}
+
+	void release(size_t count)
+	{
+		std::lock_guard<std::mutex> guard(m_lock);
+		m_released = std::min(m_bytes.size(), m_released + count);
+		m_changed.notify_all();
+	}
+
+	size_t released()
+	{
+		std::lock_guard<std::mutex> guard(m_lock);
+		return m_released;
+	}
+
+	using SerialTransport::read;
+	size_t read(uint8_t* buffer, size_t length)
+	{
+		std::unique_lock<std::mutex> lock(m_lock);
+		m_changed.wait_for(lock, std::chrono::milliseconds(1), [&]{ return !m_acknowledgements.empty() || m_read < m_released; });
+
+		if (!m_acknowledgements.empty())
+		{
+			auto count = std::min(length, m_acknowledgements.size());
+			std::copy(m_acknowledgements.begin(), m_acknowledgements.begin() + count, buffer);
+			m_acknowledgements.erase(m_acknowledgements.begin(), m_acknowledgements.begin() + count);
+			return count;
+		}
+
+		auto count = std::min(length, m_released - m_read);
+		std::copy(m_bytes.begin() + m_read, m_bytes.begin() + m_read + count, buffer);
+		m_read += count;
+
+		return count;
+	}
+
+	bool write(const uint8_t* data, size_t length)
+	{
+		std::lock_guard<std::mutex> guard(m_lock);
+
+		// Commands of a batch one by one, each echoed with HW_NO_ERROR.
+		for (size_t offset = 0; offset + 3 <= length && data[offset + 2] >= 3; offset += data[offset + 2])
+		{
+			auto start = m_acknowledgements.size();
+			m_acknowledgements.insert(m_acknowledgements.end(), data + offset, data + std::min(length, offset + data[offset + 2]));
+			m_acknowledgements[start + 1] = 0x06;
+		}
+
+		m_changed.notify_all();
+		return true;
+	}
+
+	void flush() {}
+	bool mustBeDrained() const { return false; }
+
+private:
+	const std::vector<uint8_t>& m_bytes;
+	std::mutex m_lock;
+	std::condition_variable m_changed;
+	std::vector<uint8_t> m_acknowledgements;
+	size_t m_released;
+	size_t m_read;
+};
@@ -0,0 +1,208 @@
+#include <chrono>
+#include <cstdint>
+#include <cstdio>
+#include <ctime>
+#include <fstream>
+#include <iomanip>
+#include <sstream>
+#include <string>
+#include <vector>
+
+#include <sys/resource.h>
+
+#include "byte_format.h"
+#include "log_writer.h"
+#include "packet_view.h"
+#include "test.h"
+#include "timestamp_format.h"
+
+// Text log throughput: the old path, every packet formatted with streams and strftime and written with std::endl
+// on the thread that delivers it, against LogWriter formatting on its own thread and writing in batches. Both
+// write the same lines, number format, into a file. CPU is that of the whole process, all threads together.
+//
+//   log_writer_bench [packets, 1000000 by default] [output directory, /tmp by default]
+
+namespace
+{
+	double cpuSeconds()
+	{
+		rusage usage;
+		getrusage(RUSAGE_SELF, &usage);
+		return usage.ru_utime.tv_sec + usage.ru_stime.tv_sec + (usage.ru_utime.tv_usec + usage.ru_stime.tv_usec) / 1e6;
+	}
+
+	std::vector<uint8_t> makePacket(uint32_t sequence)
+	{
+		auto timestamp = static_cast<uint32_t>(1500000000 + sequence / 200);
+		std::vector<uint8_t> packet = {1, static_cast<uint8_t>(timestamp), static_cast<uint8_t>(timestamp >> 8),
+			static_cast<uint8_t>(timestamp >> 16), static_cast<uint8_t>(timestamp >> 24), static_cast<uint8_t>(sequence % 1000), 0};
+		for (int i = 0; i < 20; i++)
+			packet.push_back(static_cast<uint8_t>(sequence * 31 + i));
+
+		return packet;
+	}
+
+	// writePacketToFile as it was before LogWriter.
+	void writePacketToFile(std::ofstream& outputFile, const std::vector<uint8_t>& packet, std::chrono::system_clock::time_point receiveTime)
+	{
+		time_t timestamp = 0;
+		timestamp |= (0x000000FF & packet[1]);
+		timestamp |= ((0x000000FF & packet[2]) << 8);
+		timestamp |= ((0x000000FF & packet[3]) << 16);
+		timestamp |= ((0x000000FF & packet[4]) << 24);
+
+		auto timestampTm = std::localtime(&timestamp);
+		std::string timestampAsString(30, 0);
+		auto timestampLength = std::strftime(const_cast<char*>(timestampAsString.data()), timestampAsString.capacity(), "%c", timestampTm);
+		timestampAsString.resize(timestampLength);
+
+		uint16_t milliseconds = 0;
+		milliseconds |= (0x00FF & packet[5]);
+		milliseconds |= ((0x00FF & packet[6]) << 8);
+
+		auto packetBlob = std::vector<uint8_t>(packet.begin() + 7, packet.end());
+		std::ostringstream stringBuffer;
+		for (auto& aByte : packetBlob)
+			stringBuffer << static_cast<uint32_t>(aByte) << " ";
+		auto formattedBlob = stringBuffer.str();
+
+		auto timeNow = std::chrono::system_clock::to_time_t(receiveTime);
+		auto timeNowTm = std::localtime(&timeNow);
+
+		std::string timeAsString(30, 0);
+		auto stringLength = std::strftime(const_cast<char*>(timeAsString.data()), timeAsString.capacity(), "%H:%M:%S", timeNowTm);
+		timeAsString.resize(stringLength);
+
+		outputFile << timeAsString << ", " << packet.size() << " bytes," << " link " << static_cast<uint32_t>(packet[0]) << ", " << timestampAsString
+			<< ";" << milliseconds << ", " << formattedBlob << std::endl;
+	}
+
+	// The same line as formatPacket in main.cpp writes it, without the corrected device time the old path did not have.
+	class LineFormatter
+	{
+	public:
+		LineFormatter() : m_hostTimeFormatter("%H:%M:%S"), m_deviceTimestampFormatter("%c") {}
+
+		void operator()(const LogWriter::Record& record, std::string& buffer)
+		{
+			ByteView frame = {record.data.data(), record.length};
+			auto header = decodePacketHeader(frame);
+
+			m_hostTimeFormatter.append(buffer, std::chrono::system_clock::to_time_t(record.receiveTime));
+			buffer += ", ";
+			appendNumber(buffer, frame.size);
+			buffer += " bytes, link ";
+			appendNumber(buffer, header.link);
+			buffer += ", ";
+			m_deviceTimestampFormatter.append(buffer, header.timestamp);
+			buffer += ';';
+			appendNumber(buffer, header.milliseconds);
+			buffer += ", ";
+			appendDecimal(buffer, header.payload.data, header.payload.size);
+			buffer += '\n';
+		}
+
+	private:
+		TimestampFormatter m_hostTimeFormatter;
+		TimestampFormatter m_deviceTimestampFormatter;
+	};
+
+	struct Result
+	{
+		double seconds;
+		double cpuSeconds;
+		double producerSeconds;		// Time the delivering thread spent on the packets.
+		long fileSize;
+	};
+
+	long fileSize(const std::string& path)
+	{
+		std::ifstream file(path, std::ios::binary | std::ios::ate);
+		return static_cast<long>(file.tellg());
+	}
+
+	Result runOldPath(const std::vector<std::vector<uint8_t>>& packets, size_t packetCount, const std::string& path,
+		std::chrono::system_clock::time_point receiveTime)
+	{
+		std::ofstream outputFile(path, std::ios::trunc);
+
+		auto start = std::chrono::steady_clock::now();
+		auto cpuStart = cpuSeconds();
+		for (size_t i = 0; i < packetCount; i++)
+			writePacketToFile(outputFile, packets[i % packets.size()], receiveTime);
+		outputFile.close();
+
+		Result result = {test::secondsSince(start), cpuSeconds() - cpuStart, 0, fileSize(path)};
+		result.producerSeconds = result.seconds;
+
+		return result;
+	}
+
+	Result runLogWriter(const std::vector<std::vector<uint8_t>>& packets, size_t packetCount, const std::string& path,
+		std::chrono::system_clock::time_point receiveTime)
+	{
+		std::ofstream outputFile(path, std::ios::trunc);
+		LineFormatter formatter;
+		LogWriter logWriter(outputFile, std::ref(formatter));
+
+		auto start = std::chrono::steady_clock::now();
+		auto cpuStart = cpuSeconds();
+		logWriter.start();
+		for (size_t i = 0; i < packetCount; i++)
+		{
+			auto& packet = packets[i % packets.size()];
+			logWriter.push(0, receiveTime, receiveTime, packet.data(), packet.size());
+		}
+		auto producerSeconds = test::secondsSince(start);
+		logWriter.stop();
+		outputFile.close();
+
+		Result result = {test::secondsSince(start), cpuSeconds() - cpuStart, producerSeconds, fileSize(path)};
+
+		return result;
+	}
+
+	void print(const char* name, const Result& result, size_t packetCount)
+	{
+		std::printf("%-10s %12.0f %14.2f %16.2f %10.1f\n", name, packetCount / result.seconds, result.cpuSeconds / packetCount * 1e6,
+			result.producerSeconds / packetCount * 1e6, result.fileSize / 1e6);
+	}
+}
+
+int main(int argc, char* argv[])
+{
+	size_t packetCount = (argc > 1 ? std::stoul(argv[1]) : 1000000);
+	std::string directory = (argc > 2 ? argv[2] : "/tmp");
+
+	std::vector<std::vector<uint8_t>> packets;
+	for (uint32_t i = 0; i < 4096; i++)
+		packets.push_back(makePacket(i));
+
+	// Same receive time for all, so both logs must come out the same.
+	auto receiveTime = std::chrono::system_clock::now();
+	auto oldResult = runOldPath(packets, packetCount, directory + "/log_writer_bench_old.txt", receiveTime);
+	auto newResult = runLogWriter(packets, packetCount, directory + "/log_writer_bench_new.txt", receiveTime);
+
+	std::printf("%zu packets of %zu bytes\n", packetCount, packets[0].size());
+	std::printf("%-10s %12s %14s %16s %10s\n", "path", "packets/s", "CPU us/packet", "caller us/packet", "MB");
+	print("endl", oldResult, packetCount);
+	print("LogWriter", newResult, packetCount);
+
+	std::ifstream oldFile(directory + "/log_writer_bench_old.txt", std::ios::binary);
+	std::ifstream newFile(directory + "/log_writer_bench_new.txt", std::ios::binary);
+	std::ostringstream oldText;
+	std::ostringstream newText;
+	oldText << oldFile.rdbuf();
+	newText << newFile.rdbuf();
+
+	std::remove((directory + "/log_writer_bench_old.txt").c_str());
+	std::remove((directory + "/log_writer_bench_new.txt").c_str());
+
+	if (oldText.str() != newText.str())
+	{
+		std::printf("The logs differ.\n");
+		return 1;
+	}
+
+	return 0;
+}
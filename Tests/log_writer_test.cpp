@@ -0,0 +1,69 @@
+#include <chrono>
+#include <cstdint>
+#include <sstream>
+#include <string>
+
+#include "byte_format.h"
+#include "log_writer.h"
+#include "test.h"
+
+namespace
+{
+	void pushRecords(LogWriter& logWriter, size_t count)
+	{
+		for (size_t i = 0; i < count; i++)
+		{
+			uint8_t packet[] = {1, 2, 3, static_cast<uint8_t>(i)};
+			auto now = std::chrono::system_clock::now();
+			logWriter.push(0, now, now, packet, sizeof(packet));
+		}
+	}
+
+	void testTextIsWrittenInOrder()
+	{
+		std::ostringstream output;
+		LogWriter logWriter(output, [](const LogWriter::Record& record, std::string& buffer)
+		{
+			appendDecimal(buffer, record.data.data(), record.length);
+			buffer += '\n';
+		}, 64);
+
+		pushRecords(logWriter, 100);
+		logWriter.start();
+		logWriter.stop();
+
+		std::string expected;
+		for (int i = 0; i < 100; i++)
+			expected += "1 2 3 " + std::to_string(i) + " \n";
+
+		CHECK(output.str() == expected);
+		CHECK_EQUAL(100u, logWriter.recordsWritten());
+		CHECK(logWriter.flushes() > 1);
+		CHECK_EQUAL(100u, logWriter.commitLatency().count());
+	}
+
+	// Binary capture writes the records itself, nothing is committed here and no latency is recorded for them.
+	void testNoCommitLatencyWithoutText()
+	{
+		std::ostringstream output;
+		size_t formatted = 0;
+		LogWriter logWriter(output, [&](const LogWriter::Record&, std::string&) { formatted++; });
+
+		logWriter.start();
+		pushRecords(logWriter, 100);
+		logWriter.stop();
+
+		CHECK_EQUAL(100u, formatted);
+		CHECK(output.str().empty());
+		CHECK_EQUAL(0u, logWriter.flushes());
+		CHECK_EQUAL(0u, logWriter.commitLatency().count());
+	}
+}
+
+int main()
+{
+	testTextIsWrittenInOrder();
+	testNoCommitLatencyWithoutText();
+
+	return test::result();
+}
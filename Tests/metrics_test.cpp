@@ -0,0 +1,240 @@
+#include <cctype>
+#include <chrono>
+#include <cstdint>
+#include <cstdio>
+#include <fstream>
+#include <map>
+#include <sstream>
+#include <string>
+
+#include "metrics.h"
+#include "test.h"
+
+// The latency histogram and the JSON snapshot. A single value read back as the maximum gives the upper bound of the
+// bucket it went into: exact below 16 µs, 16 buckets for every power of two above, everything past the last one
+// clamped into it. Percentiles are checked on a known spread of values, the JSON the reporter writes is parsed back.
+
+namespace
+{
+	const std::string jsonPath = "/tmp/metrics_test.json";
+
+	uint64_t bucketOf(uint64_t microseconds)
+	{
+		LatencyHistogram histogram;
+		histogram.record(std::chrono::microseconds(microseconds));
+		return histogram.snapshot().max();
+	}
+
+	// Just enough JSON for the snapshot: objects, plain strings as names and unsigned numbers. The values come out
+	// by their path, "histogram.p50Us" for a number in an object.
+	class JsonReader
+	{
+	public:
+		explicit JsonReader(const std::string& text) : m_text(text), m_position(0) {}
+
+		bool parse(std::map<std::string, uint64_t>& values)
+		{
+			if (!parseObject("", values))
+				return false;
+
+			skipSpace();
+			return m_position == m_text.size();
+		}
+
+	private:
+		void skipSpace()
+		{
+			while (m_position < m_text.size() && std::isspace(static_cast<unsigned char>(m_text[m_position])))
+				m_position++;
+		}
+
+		bool take(char expected)
+		{
+			skipSpace();
+			if (m_position >= m_text.size() || m_text[m_position] != expected)
+				return false;
+
+			m_position++;
+			return true;
+		}
+
+		bool parseName(std::string& name)
+		{
+			if (!take('"'))
+				return false;
+
+			auto end = m_text.find('"', m_position);
+			if (end == std::string::npos)
+				return false;
+
+			name = m_text.substr(m_position, end - m_position);
+			m_position = end + 1;
+			return true;
+		}
+
+		bool parseNumber(uint64_t& value)
+		{
+			skipSpace();
+			auto start = m_position;
+			value = 0;
+			while (m_position < m_text.size() && std::isdigit(static_cast<unsigned char>(m_text[m_position])))
+				value = value * 10 + static_cast<uint64_t>(m_text[m_position++] - '0');
+
+			return m_position > start;
+		}
+
+		bool parseObject(const std::string& path, std::map<std::string, uint64_t>& values)
+		{
+			if (!take('{'))
+				return false;
+			if (take('}'))
+				return true;
+
+			do
+			{
+				std::string name;
+				if (!parseName(name) || !take(':'))
+					return false;
+
+				auto valuePath = path.empty() ? name : path + "." + name;
+				if (values.count(valuePath) != 0)
+					return false;
+
+				skipSpace();
+				if (m_position < m_text.size() && m_text[m_position] == '{')
+				{
+					if (!parseObject(valuePath, values))
+						return false;
+				}
+				else if (!parseNumber(values[valuePath]))
+					return false;
+			} while (take(','));
+
+			return take('}');
+		}
+
+		const std::string& m_text;
+		size_t m_position;
+	};
+
+	void testBucketBounds()
+	{
+		CHECK_EQUAL(0u, bucketOf(0));
+		CHECK_EQUAL(1u, bucketOf(1));
+		CHECK_EQUAL(15u, bucketOf(15));
+		// From 16 on the powers of two are split into 16, a bucket of one value up to 31.
+		CHECK_EQUAL(16u, bucketOf(16));
+		CHECK_EQUAL(31u, bucketOf(31));
+		// Then two values to a bucket.
+		CHECK_EQUAL(33u, bucketOf(32));
+		CHECK_EQUAL(33u, bucketOf(33));
+		CHECK_EQUAL(35u, bucketOf(34));
+		CHECK_EQUAL(1023u, bucketOf(1000));
+		CHECK_EQUAL(1087u, bucketOf(1024));
+
+		// The last bucket ends a microsecond before 2^36, about 19 hours, and takes anything longer.
+		const uint64_t top = (static_cast<uint64_t>(1) << 36) - 1;
+		CHECK_EQUAL(top, bucketOf(top));
+		CHECK_EQUAL(top, bucketOf(top + 1));
+		CHECK_EQUAL(top, bucketOf(static_cast<uint64_t>(1) << 40));
+
+		// Below a microsecond and negative differences both count as no latency.
+		LatencyHistogram histogram;
+		histogram.record(std::chrono::nanoseconds(999));
+		histogram.record(std::chrono::milliseconds(-5));
+		CHECK_EQUAL(2u, histogram.snapshot().count());
+		CHECK_EQUAL(0u, histogram.snapshot().max());
+	}
+
+	void testPercentiles()
+	{
+		CHECK_EQUAL(0u, LatencyHistogram::Snapshot().percentile(0.5));
+
+		// 1 to 1000 µs once each.
+		LatencyHistogram histogram;
+		for (int i = 1; i <= 1000; i++)
+			histogram.record(std::chrono::microseconds(i));
+
+		auto snapshot = histogram.snapshot();
+		CHECK_EQUAL(1000u, snapshot.count());
+		CHECK_EQUAL(1u, snapshot.percentile(0.0));
+		// Value 500 is in the bucket from 496 to 511, 990 in the one from 960 to 991.
+		CHECK_EQUAL(511u, snapshot.percentile(0.5));
+		CHECK_EQUAL(991u, snapshot.percentile(0.99));
+		CHECK_EQUAL(1023u, snapshot.max());
+
+		// Mostly fast, one in a hundred slow: the p99 is the last fast one, just past it the slow ones.
+		LatencyHistogram mixed;
+		for (int i = 0; i < 990; i++)
+			mixed.record(std::chrono::microseconds(10));
+		for (int i = 0; i < 10; i++)
+			mixed.record(std::chrono::milliseconds(20));
+
+		auto mixedSnapshot = mixed.snapshot();
+		CHECK_EQUAL(10u, mixedSnapshot.percentile(0.5));
+		CHECK_EQUAL(10u, mixedSnapshot.percentile(0.99));
+		CHECK_EQUAL(20479u, mixedSnapshot.percentile(0.999));
+		CHECK_EQUAL(20479u, mixedSnapshot.max());
+
+		// Added up, the counts are what both had.
+		snapshot.add(mixedSnapshot);
+		CHECK_EQUAL(2000u, snapshot.count());
+		CHECK_EQUAL(20479u, snapshot.max());
+	}
+
+	void testJsonSnapshot()
+	{
+		LatencyHistogram histogram;
+		for (int i = 1; i <= 1000; i++)
+			histogram.record(std::chrono::microseconds(i));
+
+		std::remove(jsonPath.c_str());
+		{
+			MetricsReporter reporter([&](MetricsSnapshot& snapshot)
+			{
+				snapshot.addCounter("packetsReceived", 123456);
+				snapshot.addCounter("bytesSkipped", 0);
+				snapshot.addHistogram("latency", histogram.snapshot());
+				snapshot.addHistogram("empty", LatencyHistogram::Snapshot());
+			}, MetricsReporter::LineFormatter(), std::chrono::milliseconds(1000), jsonPath);
+
+			reporter.start();
+			reporter.stop();
+		}
+
+		std::ifstream file(jsonPath);
+		std::ostringstream text;
+		text << file.rdbuf();
+
+		std::map<std::string, uint64_t> values;
+		CHECK(JsonReader(text.str()).parse(values));
+
+		std::printf("JSON snapshot of %zu values:\n%s", values.size(), text.str().c_str());
+		CHECK_EQUAL(15u, values.size());
+		CHECK(values["timestamp"] > 1600000000000u);
+		CHECK_EQUAL(123456u, values["packetsReceived"]);
+		CHECK_EQUAL(1u, values.count("bytesSkipped"));
+		CHECK_EQUAL(0u, values["bytesSkipped"]);
+		CHECK_EQUAL(1000u, values["latency.count"]);
+		CHECK_EQUAL(511u, values["latency.p50Us"]);
+		CHECK_EQUAL(927u, values["latency.p90Us"]);
+		CHECK_EQUAL(991u, values["latency.p99Us"]);
+		CHECK_EQUAL(1023u, values["latency.p999Us"]);
+		CHECK_EQUAL(1023u, values["latency.maxUs"]);
+		CHECK_EQUAL(0u, values["empty.count"]);
+		CHECK_EQUAL(0u, values["empty.maxUs"]);
+
+		// Not left behind by the rename.
+		CHECK(!std::ifstream(jsonPath + ".tmp"));
+		std::remove(jsonPath.c_str());
+	}
+}
+
+int main()
+{
+	testBucketBounds();
+	testPercentiles();
+	testJsonSnapshot();
+
+	return test::result();
+}
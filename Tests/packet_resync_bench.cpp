@@ -0,0 +1,74 @@
+#include <algorithm>
+#include <chrono>
+#include <cstdint>
+#include <cstdio>
+#include <memory>
+#include <string>
+#include <thread>
+
+#include "corrupt_stream.h"
+#include "simpliciti.h"
+#include "test.h"
+
+// Parser throughput while resynchronizing, read -> parse -> log on their own threads with the whole stream
+// available at once, for more and more damage. Every false header costs a search through the packet it claims
+// and through the one after, the rate shows what that adds up to.
+//
+//   packet_resync_bench [packets, 500000 by default]
+
+namespace
+{
+	void run(size_t packetCount, unsigned damagePercent)
+	{
+		auto stream = makeCorruptStream(packetCount, damagePercent, 7);
+		size_t mustArrive = std::count(stream.mustArrive.begin(), stream.mustArrive.end(), true);
+
+		auto transport = new ScriptedTransport(stream.bytes);
+		ResyncCounter counter(stream);
+		SimpliciTi simpliciTi(std::unique_ptr<SerialTransport>(transport), [&](const PacketHeader&, ByteView frame, std::chrono::system_clock::time_point)
+		{
+			counter.frame(frame.data, frame.size);
+		});
+		simpliciTi.startAccessPoint();
+
+		auto handshakeBytes = simpliciTi.statistics().bytesReceived;
+		auto start = std::chrono::steady_clock::now();
+		transport->release(stream.bytes.size());
+
+		// Done once everything is read and nothing more has been logged for a while, the last packet is taken
+		// after the stream has been quiet for a bit.
+		auto lastChange = std::chrono::steady_clock::now();
+		size_t logged = 0;
+		while (simpliciTi.statistics().bytesReceived < handshakeBytes + stream.bytes.size() || test::secondsSince(lastChange) < 0.05)
+		{
+			std::this_thread::sleep_for(std::chrono::milliseconds(1));
+			if (simpliciTi.statistics().packetsLogged != logged)
+			{
+				logged = simpliciTi.statistics().packetsLogged;
+				lastChange = std::chrono::steady_clock::now();
+			}
+		}
+		auto seconds = std::chrono::duration<double>(lastChange - start).count();
+		auto statistics = simpliciTi.statistics();
+		auto result = counter.result();
+
+		std::printf("%7u%% %10.1f %12.0f %12zu %10zu %10zu %10zu %10zu\n", damagePercent, stream.bytes.size() / seconds / 1e6, packetCount / seconds,
+			result.intactDelivered, mustArrive, result.mustArriveLost, result.corruptDelivered, statistics.falseHeaders);
+
+		simpliciTi.stopAccessPoint();
+	}
+}
+
+int main(int argc, char* argv[])
+{
+	size_t packetCount = (argc > 1 ? std::stoul(argv[1]) : 500000);
+
+	std::printf("%zu packets\n", packetCount);
+	std::printf("%8s %10s %12s %12s %10s %10s %10s %10s\n", "damaged", "MB/s", "packets/s", "intact", "must", "lost", "damaged in", "false hdr");
+
+	unsigned damage[] = {0, 1, 5, 10, 30};
+	for (auto percent : damage)
+		run(packetCount, percent);
+
+	return 0;
+}
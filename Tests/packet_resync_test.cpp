@@ -0,0 +1,149 @@
+#include <algorithm>
+#include <chrono>
+#include <cstdint>
+#include <cstdio>
+#include <memory>
+#include <thread>
+#include <vector>
+
+#include "corrupt_stream.h"
+#include "simpliciti.h"
+#include "test.h"
+
+// Resynchronization of the parser on damaged streams. The bytes are handed over in random pieces of 1 to 64 and
+// parsed after each, so headers keep ending up right at the end of what is buffered. Whatever is intact and
+// followed by an intact header has to come through, and next to nothing that was damaged may.
+
+namespace
+{
+	struct Parser
+	{
+		explicit Parser(const CorruptStream& stream) : transport(new ScriptedTransport(stream.bytes)), counter(stream),
+			simpliciTi(std::unique_ptr<SerialTransport>(transport), [&](const PacketHeader&, ByteView frame, std::chrono::system_clock::time_point)
+			{
+				counter.frame(frame.data, frame.size);
+			})
+		{
+			simpliciTi.startAccessPoint(SimpliciTi::ParsingMode::external);
+			handshakeBytes = simpliciTi.statistics().bytesReceived;
+		}
+
+		// Waits until the reader has everything released so far, so each piece is parsed on its own.
+		void feed(size_t count)
+		{
+			transport->release(count);
+			auto expected = handshakeBytes + transport->released();
+			while (simpliciTi.statistics().bytesReceived < expected)
+				std::this_thread::yield();
+
+			simpliciTi.processPackets();
+		}
+
+		ScriptedTransport* transport;
+		ResyncCounter counter;
+		SimpliciTi simpliciTi;
+		size_t handshakeBytes;
+	};
+
+	void feedInPieces(Parser& parser, size_t length, uint32_t seed)
+	{
+		uint32_t random = seed;
+		for (size_t fed = 0; fed < length;)
+		{
+			auto piece = std::min<size_t>(length - fed, 1 + nextRandom(random) % 64);
+			parser.feed(piece);
+			fed += piece;
+		}
+	}
+
+	void testDamagedStream(unsigned damagePercent)
+	{
+		const size_t packetCount = 20000;
+		auto stream = makeCorruptStream(packetCount, damagePercent, 7);
+		size_t mustArrive = std::count(stream.mustArrive.begin(), stream.mustArrive.end(), true);
+
+		ResyncResult result;
+		SimpliciTi::Statistics statistics;
+		{
+			Parser parser(stream);
+			feedInPieces(parser, stream.bytes.size(), 11);
+			parser.simpliciTi.stopAccessPoint();
+
+			result = parser.counter.result();
+			statistics = parser.simpliciTi.statistics();
+		}
+
+		std::printf("%u%% damaged: %zu of %zu packets damaged, %zu intact ones delivered, %zu had to be, %zu of those lost, "
+			"%zu damaged delivered, %zu false headers\n", damagePercent, stream.damaged, packetCount, result.intactDelivered, mustArrive,
+			result.mustArriveLost, result.corruptDelivered, statistics.falseHeaders);
+
+		// A damaged packet whose length happens to end right on a header-like pair in the garbage behind it looks
+		// just like an intact one, the few of those are all that may come through.
+		CHECK_EQUAL(0u, result.mustArriveLost);
+		CHECK(result.corruptDelivered * 100 <= stream.damaged);
+		if (damagePercent == 0)
+		{
+			CHECK_EQUAL(packetCount, result.intactDelivered);
+			CHECK_EQUAL(0u, statistics.bytesSkipped);
+		}
+	}
+
+	// A header at the end of the buffer is taken once the stream stays quiet, not held back forever.
+	void testLastPacketBeforePause()
+	{
+		auto stream = makeCorruptStream(1, 0, 1);
+		Parser parser(stream);
+
+		parser.feed(stream.bytes.size());
+		CHECK_EQUAL(0u, parser.counter.result().intactDelivered);
+
+		auto start = std::chrono::steady_clock::now();
+		while (parser.counter.result().intactDelivered == 0 && test::secondsSince(start) < 1)
+		{
+			std::this_thread::sleep_for(std::chrono::milliseconds(1));
+			parser.simpliciTi.processPackets();
+		}
+
+		auto seconds = test::secondsSince(start);
+		std::printf("Last packet before a pause delivered after %.1f ms\n", seconds * 1000);
+		CHECK_EQUAL(1u, parser.counter.result().intactDelivered);
+		CHECK(seconds < 0.1);
+	}
+
+	// A cut short packet at the end of the buffer looks fine until the next one comes in.
+	void testCutPacketAtEndOfBuffer()
+	{
+		auto stream = makeCorruptStream(2, 0, 3);
+		auto firstLength = stream.frames[0].size() + 3;
+		auto cutLength = firstLength - 4;
+
+		std::vector<uint8_t> bytes(stream.bytes.begin(), stream.bytes.begin() + cutLength);
+		bytes.insert(bytes.end(), stream.bytes.begin() + firstLength, stream.bytes.end());
+		stream.bytes = bytes;
+		stream.mustArrive[0] = false;
+
+		Parser parser(stream);
+		// The cut packet and the header of the next one, with a pause that is shorter than the wait.
+		parser.feed(cutLength + 2);
+		std::this_thread::sleep_for(std::chrono::milliseconds(2));
+		parser.simpliciTi.processPackets();
+		parser.feed(stream.bytes.size());
+		parser.simpliciTi.stopAccessPoint();
+
+		auto result = parser.counter.result();
+		CHECK_EQUAL(0u, result.corruptDelivered);
+		CHECK_EQUAL(0u, result.mustArriveLost);
+		CHECK_EQUAL(1u, result.intactDelivered);
+	}
+}
+
+int main()
+{
+	testDamagedStream(0);
+	testDamagedStream(5);
+	testDamagedStream(30);
+	testLastPacketBeforePause();
+	testCutPacketAtEndOfBuffer();
+
+	return test::result();
+}
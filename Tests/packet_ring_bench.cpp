@@ -0,0 +1,164 @@
+#include <algorithm>
+#include <chrono>
+#include <cstdint>
+#include <cstdio>
+#include <string>
+#include <thread>
+#include <vector>
+
+#include <sys/wait.h>
+#include <unistd.h>
+
+#include "packet_ring.h"
+#include "test.h"
+
+// Publish to consume latency of the shared memory ring with several readers, each a process of its own like the
+// dashboards that attach to a capture. The writer publishes at a steady rate with the publish time as receive
+// time, every reader polls the ring and yields when it is empty and reports the time from publish to next() and
+// how many records it lost.
+//
+//   packet_ring_bench [records, 200000 by default] [records/s, 20000 by default]
+
+namespace
+{
+	struct ReaderResult
+	{
+		double p50Us;
+		double p99Us;
+		double maxUs;
+		uint64_t received;
+		uint64_t lost;
+	};
+
+	double percentile(std::vector<double>& sorted, double fraction)
+	{
+		return (sorted.empty() ? 0 : sorted[static_cast<size_t>(fraction * (sorted.size() - 1))]);
+	}
+
+	// Runs in the reader process, tells the parent when it is attached and writes its result at the end.
+	void readRecords(const std::string& name, size_t recordCount, int readyPipe, int resultPipe)
+	{
+		PacketRingReader reader(name);
+		char ready = 1;
+		if (write(readyPipe, &ready, 1) != 1)
+			return;
+
+		std::vector<double> latencies;
+		latencies.reserve(recordCount);
+		ReaderResult result = {};
+
+		PacketRingReader::Record record;
+		while (result.received + reader.lost() < recordCount)
+		{
+			if (!reader.next(record))
+			{
+				if (reader.closed())
+					break;
+				std::this_thread::yield();
+				continue;
+			}
+
+			auto now = std::chrono::system_clock::now();
+			if (!reader.stillValid())
+				continue;
+
+			latencies.push_back(std::chrono::duration<double, std::micro>(now - record.receiveTime).count());
+			result.received++;
+		}
+
+		std::sort(latencies.begin(), latencies.end());
+		result.p50Us = percentile(latencies, 0.5);
+		result.p99Us = percentile(latencies, 0.99);
+		result.maxUs = percentile(latencies, 1.0);
+		result.lost = reader.lost();
+		if (write(resultPipe, &result, sizeof(result)) != sizeof(result))
+			return;
+	}
+
+	void run(size_t readerCount, size_t recordCount, double rate)
+	{
+		auto name = "packet_ring_bench_" + std::to_string(getpid());
+		PacketRingWriter writer(name, 4096);
+
+		int readyPipe[2];
+		int resultPipe[2];
+		if (pipe(readyPipe) != 0 || pipe(resultPipe) != 0)
+			return;
+
+		std::vector<pid_t> readers;
+		for (size_t i = 0; i < readerCount; i++)
+		{
+			auto pid = fork();
+			if (pid == 0)
+			{
+				readRecords(name, recordCount, readyPipe[1], resultPipe[1]);
+				_exit(0);
+			}
+			readers.push_back(pid);
+		}
+
+		for (size_t i = 0; i < readerCount; i++)
+		{
+			char ready;
+			if (read(readyPipe[0], &ready, 1) != 1)
+				return;
+		}
+
+		uint8_t frame[32] = {1};
+		auto start = std::chrono::steady_clock::now();
+		for (size_t i = 0; i < recordCount; i++)
+		{
+			auto due = start + std::chrono::duration_cast<std::chrono::steady_clock::duration>(std::chrono::duration<double>(i / rate));
+			while (std::chrono::steady_clock::now() < due)
+				std::this_thread::yield();
+
+			frame[7] = static_cast<uint8_t>(i);
+			auto now = std::chrono::system_clock::now();
+			writer.publish(1, now, now, frame, sizeof(frame));
+		}
+
+		std::vector<ReaderResult> results(readerCount);
+		for (auto& result : results)
+		{
+			if (read(resultPipe[0], &result, sizeof(result)) != sizeof(result))
+				result = ReaderResult();
+		}
+
+		for (auto pid : readers)
+			waitpid(pid, nullptr, 0);
+
+		close(readyPipe[0]);
+		close(readyPipe[1]);
+		close(resultPipe[0]);
+		close(resultPipe[1]);
+
+		ReaderResult worst = {};
+		for (auto& result : results)
+		{
+			worst.p50Us = std::max(worst.p50Us, result.p50Us);
+			worst.p99Us = std::max(worst.p99Us, result.p99Us);
+			worst.maxUs = std::max(worst.maxUs, result.maxUs);
+			worst.lost += result.lost;
+			worst.received += result.received;
+		}
+
+		std::printf("%8zu %12.0f %10.1f %10.1f %12.1f %12llu %10llu\n", readerCount, recordCount / test::secondsSince(start), worst.p50Us,
+			worst.p99Us, worst.maxUs, static_cast<unsigned long long>(worst.received), static_cast<unsigned long long>(worst.lost));
+	}
+}
+
+int main(int argc, char* argv[])
+{
+	size_t recordCount = (argc > 1 ? std::stoul(argv[1]) : 200000);
+	double rate = (argc > 2 ? std::stod(argv[2]) : 20000);
+
+	std::printf("%zu records at %.0f/s, 4096 slots, %u hardware threads; latencies of the slowest reader, records of all\n", recordCount, rate,
+		std::thread::hardware_concurrency());
+	std::printf("%8s %12s %10s %10s %12s %12s %10s\n", "readers", "records/s", "p50 us", "p99 us", "max us", "received", "lost");
+
+	size_t readerCounts[] = {1, 2, 4, 8};
+	for (auto readers : readerCounts)
+		run(readers, recordCount, rate);
+
+	return 0;
+}
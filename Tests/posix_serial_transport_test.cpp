@@ -0,0 +1,140 @@
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <cstdio>
+#include <memory>
+#include <thread>
+#include <vector>
+
+#include <sys/resource.h>
+
+#include "posix_serial_transport.h"
+#include "pty_access_point.h"
+#include "simpliciti.h"
+#include "test.h"
+
+// Termios transport over a pseudo terminal: latency from a packet written on the master to the packet callback,
+// through the whole read -> parse -> log pipeline, and what happens when the other end hangs up.
+
+namespace
+{
+	double cpuSeconds()
+	{
+		rusage usage;
+		getrusage(RUSAGE_SELF, &usage);
+		return usage.ru_utime.tv_sec + usage.ru_stime.tv_sec + (usage.ru_utime.tv_usec + usage.ru_stime.tv_usec) / 1e6;
+	}
+
+	double percentile(std::vector<double> values, double fraction)
+	{
+		std::sort(values.begin(), values.end());
+		return values[static_cast<size_t>(fraction * (values.size() - 1))];
+	}
+
+	void testLatency()
+	{
+		const size_t packetCount = 2000;
+		PtyAccessPoint accessPoint;
+
+		std::vector<std::chrono::steady_clock::time_point> written(packetCount);
+		std::vector<std::chrono::steady_clock::time_point> received(packetCount);
+		std::atomic<size_t> receivedCount(0);
+
+		SimpliciTi simpliciTi(std::unique_ptr<SerialTransport>(new PosixSerialTransport(accessPoint.path(), 115200, 20)),
+			[&](const PacketHeader& header, ByteView, std::chrono::system_clock::time_point)
+			{
+				uint32_t sequence = header.payload[0] | (header.payload[1] << 8) | (header.payload[2] << 16) | (header.payload[3] << 24);
+				if (sequence < packetCount)
+				{
+					received[sequence] = std::chrono::steady_clock::now();
+					receivedCount++;
+				}
+			});
+
+		simpliciTi.startAccessPoint();
+
+		for (uint32_t i = 0; i < packetCount; i++)
+		{
+			auto packet = PtyAccessPoint::dataPacket(1, i);
+			written[i] = std::chrono::steady_clock::now();
+			accessPoint.write(packet);
+			std::this_thread::sleep_for(std::chrono::microseconds(500));
+		}
+
+		auto deadline = std::chrono::steady_clock::now() + std::chrono::seconds(5);
+		while (receivedCount < packetCount && std::chrono::steady_clock::now() < deadline)
+			std::this_thread::sleep_for(std::chrono::milliseconds(1));
+
+		simpliciTi.stopAccessPoint();
+
+		CHECK_EQUAL(packetCount, receivedCount.load());
+		if (receivedCount != packetCount)
+			return;
+
+		std::vector<double> latencies;
+		for (size_t i = 0; i < packetCount; i++)
+			latencies.push_back(std::chrono::duration<double, std::micro>(received[i] - written[i]).count());
+
+		std::printf("Write to callback over the pty, %zu packets: p50 %.0f us, p90 %.0f us, p99 %.0f us, max %.0f us\n", packetCount,
+			percentile(latencies, 0.5), percentile(latencies, 0.9), percentile(latencies, 0.99), percentile(latencies, 1.0));
+
+		// Bounded by the idle waits of the parser and the logger, not by the 20 ms read timeout.
+		CHECK(percentile(latencies, 0.5) < 10000);
+	}
+
+	void testHangUpStopsReading()
+	{
+		PtyAccessPoint accessPoint;
+		PosixSerialTransport transport(accessPoint.path(), 115200, 20);
+
+		uint8_t buffer[64];
+		CHECK_EQUAL(0u, transport.read(buffer, sizeof(buffer)));
+		CHECK(!transport.disconnected());
+
+		accessPoint.closeMaster();
+		transport.read(buffer, sizeof(buffer));
+		CHECK(transport.disconnected());
+
+		// Reads still take the timeout, a reader calling them in a loop does not spin.
+		auto start = std::chrono::steady_clock::now();
+		auto cpuStart = cpuSeconds();
+		for (int i = 0; i < 10; i++)
+			CHECK_EQUAL(0u, transport.read(buffer, sizeof(buffer)));
+
+		CHECK(test::secondsSince(start) >= 0.18);
+		CHECK(cpuSeconds() - cpuStart < 0.05);
+	}
+
+	void testHangUpWhileCapturing()
+	{
+		PtyAccessPoint accessPoint;
+		std::atomic<size_t> receivedCount(0);
+
+		SimpliciTi simpliciTi(std::unique_ptr<SerialTransport>(new PosixSerialTransport(accessPoint.path(), 115200, 20)),
+			[&](const PacketHeader&, ByteView, std::chrono::system_clock::time_point) { receivedCount++; });
+
+		simpliciTi.startAccessPoint();
+		accessPoint.write(PtyAccessPoint::dataPacket(1, 0));
+		accessPoint.closeMaster();
+		std::this_thread::sleep_for(std::chrono::milliseconds(100));
+
+		// Parser and logger poll at 1 ms, a reader spinning on the hang up would take a whole core.
+		auto cpuStart = cpuSeconds();
+		std::this_thread::sleep_for(std::chrono::milliseconds(500));
+		auto cpuUsed = cpuSeconds() - cpuStart;
+		std::printf("CPU after the hang up: %.0f ms in 500 ms\n", cpuUsed * 1000);
+		CHECK(cpuUsed < 0.25);
+
+		simpliciTi.stopAccessPoint();
+		CHECK_EQUAL(1u, receivedCount.load());
+	}
+}
+
+int main()
+{
+	testLatency();
+	testHangUpStopsReading();
+	testHangUpWhileCapturing();
+
+	return test::result();
+}
@@ -0,0 +1,65 @@
+#include <chrono>
+#include <cstdint>
+#include <cstdio>
+#include <cstdlib>
+#include <string>
+#include <thread>
+
+#include "psd_capture.h"
+#include "test.h"
+
+// File size and conversion time of the Arrow output of the psd tool against its CSV, both runs of the tool as a
+// separate process on the same generated capture. Addresses come from a handful of watches like in a real
+// capture, that is what the dictionaries are for.
+//
+//   psd_arrow_bench [capture size in MB, 512 by default] [directory, /tmp by default] [watches, 20 by default]
+
+namespace
+{
+	// Seconds the tool took, negative when it failed.
+	double convert(const std::string& tool, const std::string& capturePath, const std::string& mode)
+	{
+		auto start = std::chrono::steady_clock::now();
+		auto command = tool + " \"" + capturePath + "\" " + mode + " > /dev/null";
+		auto status = std::system(command.c_str());
+
+		return (status == 0 ? test::secondsSince(start) : -1);
+	}
+}
+
+int main(int argc, char* argv[])
+{
+	uint64_t captureSize = (argc > 1 ? std::stoull(argv[1]) : 512) * 1024 * 1024;
+	std::string directory = (argc > 2 ? argv[2] : "/tmp");
+	uint32_t watchCount = static_cast<uint32_t>(argc > 3 ? std::stoul(argv[3]) : 20);
+
+	auto capturePath = directory + "/psd_arrow_bench.psd";
+	auto csvPath = directory + "/psd_arrow_bench.csv";
+	auto arrowPath = directory + "/psd_arrow_bench.arrows";
+	auto tool = toolDirectory(argv[0]) + "/psd";
+
+	auto recordCount = writePsdCapture(capturePath, captureSize, watchCount);
+	std::printf("%zu records from %u watches, %.0f MB, %u hardware threads\n", recordCount, watchCount, fileSize(capturePath) / 1e6,
+		std::thread::hardware_concurrency());
+
+	auto csvSeconds = convert(tool, capturePath, "");
+	auto arrowSeconds = convert(tool, capturePath, "arrow");
+
+	std::printf("%-8s %10s %12s %10s %14s\n", "output", "seconds", "records/s", "MB out", "bytes/record");
+	std::printf("%-8s %10.2f %12.0f %10.1f %14.1f\n", "CSV", csvSeconds, recordCount / csvSeconds, fileSize(csvPath) / 1e6,
+		static_cast<double>(fileSize(csvPath)) / recordCount);
+	std::printf("%-8s %10.2f %12.0f %10.1f %14.1f\n", "Arrow", arrowSeconds, recordCount / arrowSeconds, fileSize(arrowPath) / 1e6,
+		static_cast<double>(fileSize(arrowPath)) / recordCount);
+
+	std::remove(capturePath.c_str());
+	std::remove(csvPath.c_str());
+	std::remove(arrowPath.c_str());
+
+	if (csvSeconds < 0 || arrowSeconds < 0)
+	{
+		std::printf("The psd tool failed.\n");
+		return 1;
+	}
+
+	return 0;
+}
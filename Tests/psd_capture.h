@@ -0,0 +1,78 @@
+#pragma once
+
+#include <algorithm>
+#include <cstdint>
+#include <fstream>
+#include <string>
+#include <vector>
+
+#include "psd_record.h"
+
+// Generated packet sniffer captures for the converter benchmarks. Mostly regular packets, now and then one
+// without payload, one with a length byte below the header and one with a length out of range, as sniffers
+// write them. With a device count the addresses come from that many devices, otherwise they are random.
+inline void makePsdRecord(uint32_t sequence, uint32_t& random, uint8_t* record, uint32_t deviceCount = 0)
+{
+	for (size_t i = 0; i < PsdRecord::size; i++)
+	{
+		random = random * 1664525 + 1013904223;
+		record[i] = static_cast<uint8_t>(random >> 24);
+	}
+
+	uint8_t length = static_cast<uint8_t>(PsdRecord::headerLength + sequence % (PsdRecord::maxPayloadLength + 1));
+	if (sequence % 97 == 0)
+		length = 3;
+	else if (sequence % 101 == 0)
+		length = 200;
+
+	record[PsdRecord::informationOffset] = static_cast<uint8_t>(sequence % 5 == 0 ? PsdRecord::incompleteFlag : PsdRecord::lengthIncludesFcsFlag);
+	for (size_t i = 0; i < 4; i++)
+		record[PsdRecord::sequenceNumberOffset + i] = static_cast<uint8_t>(sequence >> (8 * i));
+	record[PsdRecord::packetLengthOffset] = static_cast<uint8_t>(1 + length + 2);
+	record[PsdRecord::packetLengthOffset + 1] = 0;
+	record[PsdRecord::lengthOffset] = length;
+
+	if (deviceCount > 0)
+	{
+		uint32_t source = 0x79560000 + sequence % deviceCount;
+		uint32_t destination = (sequence % 3 == 0 ? 0xFFFFFFFF : 0x12345678);
+		for (size_t i = 0; i < 4; i++)
+		{
+			record[PsdRecord::sourceOffset + i] = static_cast<uint8_t>(source >> (8 * i));
+			record[PsdRecord::destinationOffset + i] = static_cast<uint8_t>(destination >> (8 * i));
+		}
+	}
+}
+
+// Returns the number of records written.
+inline size_t writePsdCapture(const std::string& path, uint64_t size, uint32_t deviceCount = 0)
+{
+	std::ofstream file(path, std::ios::binary | std::ios::trunc);
+	std::vector<uint8_t> chunk(16384 * PsdRecord::size);
+	uint32_t random = 12345;
+	size_t recordCount = static_cast<size_t>(size / PsdRecord::size);
+
+	for (size_t first = 0; first < recordCount; first += 16384)
+	{
+		auto count = std::min<size_t>(16384, recordCount - first);
+		for (size_t i = 0; i < count; i++)
+			makePsdRecord(static_cast<uint32_t>(first + i), random, &chunk[i * PsdRecord::size], deviceCount);
+
+		file.write(reinterpret_cast<const char*>(chunk.data()), count * PsdRecord::size);
+	}
+
+	return recordCount;
+}
+
+inline uint64_t fileSize(const std::string& path)
+{
+	std::ifstream file(path, std::ios::binary | std::ios::ate);
+	return (file.is_open() ? static_cast<uint64_t>(file.tellg()) : 0);
+}
+
+inline std::string toolDirectory(const char* program)
+{
+	std::string path(program);
+	auto slash = path.rfind('/');
+	return (slash == std::string::npos ? std::string(".") : path.substr(0, slash));
+}
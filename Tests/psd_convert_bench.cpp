@@ -0,0 +1,145 @@
+#include <algorithm>
+#include <chrono>
+#include <cstdint>
+#include <cstdio>
+#include <cstdlib>
+#include <fstream>
+#include <iomanip>
+#include <iostream>
+#include <sstream>
+#include <string>
+#include <thread>
+#include <vector>
+
+#include "psd_capture.h"
+#include "psd_record.h"
+#include "test.h"
+
+// PSD to CSV throughput of the psd tool on a generated capture of a few GB, as a separate process the way it is
+// run. The converter as it was before the memory map, record by record through an ifstream and streams, runs on
+// the first records only, it would take minutes for the whole file; its CSV must be the start of the new one.
+//
+//   psd_convert_bench [capture size in MB, 2048 by default] [directory, /tmp by default] [records for the old converter, 200000 by default]
+
+namespace
+{
+	const size_t psdPacketSize = PsdRecord::size;
+
+	// The converter before the memory map, minus the progress line for every record.
+	std::string bufferToHex(const std::vector<uint8_t>& buffer)
+	{
+		std::ostringstream stringBuffer;
+
+		stringBuffer << "\"";
+
+		for (auto& aByte : buffer)
+			stringBuffer << std::hex << std::setw(2) << std::setfill('0') << std::uppercase << static_cast<int>(aByte) << " ";
+
+		auto asString = stringBuffer.str();
+		asString.replace(asString.end() - 1, asString.end(), "\"");
+
+		return asString;
+	}
+
+	void writeOldLine(std::ofstream& outputFile, uint32_t packetCount, const std::vector<uint8_t>& packetBinary)
+	{
+		size_t dataLength = packetBinary.at(15);
+		auto destinationAddress = bufferToHex(std::vector<uint8_t>(packetBinary.begin() + 16, packetBinary.begin() + 20));
+		auto sourceAddress = bufferToHex(std::vector<uint8_t>(packetBinary.begin() + 20, packetBinary.begin() + 24));
+		std::string dataHex = "EMPTY";
+		int8_t rssi = 0;
+		uint8_t lqi = 0;
+		bool fcsOk = false;
+
+		size_t applicationDataLength = dataLength - 11;
+		if (applicationDataLength > 0 && applicationDataLength <= 50)
+			dataHex = bufferToHex(std::vector<uint8_t>(packetBinary.begin() + 27, packetBinary.begin() + (27 + (dataLength - 11))));
+
+		if (applicationDataLength <= 50)
+		{
+			int8_t rawRssi = static_cast<int8_t>(packetBinary.at(27 + applicationDataLength));
+			int16_t calculatedRssi = static_cast<int16_t>(rawRssi / 2 - 72);
+			rssi = static_cast<int8_t>(calculatedRssi < -128 ? -128 : calculatedRssi);
+			fcsOk = (packetBinary.at(27 + applicationDataLength + 1) & 0x80) > 0;
+			lqi = packetBinary.at(27 + applicationDataLength + 1) & 0x7F;
+		}
+
+		outputFile << packetCount << "," << destinationAddress << "," << sourceAddress << "," << static_cast<uint32_t>(packetBinary.at(24)) << ","
+			<< static_cast<uint32_t>(packetBinary.at(26)) << "," << dataHex << "," << static_cast<int32_t>(rssi)
+			<< "," << static_cast<uint32_t>(lqi) << "," << (fcsOk ? "OK" : "ERROR") << std::endl;
+	}
+
+	void convertOld(const std::string& inputPath, const std::string& outputPath, size_t recordCount)
+	{
+		std::ifstream inputFile(inputPath, std::ios::binary);
+		std::ofstream outputFile(outputPath);
+		outputFile << "packetNr,destination,source,port,transactionID,packet,RSSI,LQI,FCS" << std::endl;
+
+		for (uint32_t packetCount = 1; packetCount <= recordCount; packetCount++)
+		{
+			std::vector<uint8_t> packetSnifferPacket(271);
+			inputFile.read(reinterpret_cast<char*>(packetSnifferPacket.data()), static_cast<std::streamsize>(packetSnifferPacket.size()));
+			if (inputFile.gcount() != psdPacketSize)
+				break;
+
+			writeOldLine(outputFile, packetCount, packetSnifferPacket);
+		}
+	}
+
+	std::string readStart(const std::string& path, size_t length)
+	{
+		std::ifstream file(path, std::ios::binary);
+		std::string text(length, 0);
+		file.read(&text[0], static_cast<std::streamsize>(length));
+		text.resize(static_cast<size_t>(file.gcount()));
+
+		return text;
+	}
+}
+
+int main(int argc, char* argv[])
+{
+	uint64_t captureSize = (argc > 1 ? std::stoull(argv[1]) : 2048) * 1024 * 1024;
+	std::string directory = (argc > 2 ? argv[2] : "/tmp");
+	size_t oldRecords = (argc > 3 ? std::stoul(argv[3]) : 200000);
+
+	auto capturePath = directory + "/psd_convert_bench.psd";
+	auto csvPath = directory + "/psd_convert_bench.csv";
+	auto oldCsvPath = directory + "/psd_convert_bench_old.csv";
+
+	auto start = std::chrono::steady_clock::now();
+	auto recordCount = writePsdCapture(capturePath, captureSize);
+	std::printf("%zu records, %.0f MB generated in %.1f s, %u hardware threads\n", recordCount, recordCount * psdPacketSize / 1e6,
+		test::secondsSince(start), std::thread::hardware_concurrency());
+
+	start = std::chrono::steady_clock::now();
+	auto command = toolDirectory(argv[0]) + "/psd \"" + capturePath + "\" > /dev/null";
+	auto status = std::system(command.c_str());
+	auto newSeconds = test::secondsSince(start);
+
+	oldRecords = std::min(oldRecords, recordCount);
+	start = std::chrono::steady_clock::now();
+	convertOld(capturePath, oldCsvPath, oldRecords);
+	auto oldSeconds = test::secondsSince(start);
+
+	auto oldCsvSize = fileSize(oldCsvPath);
+	auto identical = (status == 0 && readStart(csvPath, static_cast<size_t>(oldCsvSize)) == readStart(oldCsvPath, static_cast<size_t>(oldCsvSize)));
+
+	std::printf("%-16s %10s %12s %10s %10s\n", "converter", "records", "records/s", "MB/s in", "MB out");
+	std::printf("%-16s %10zu %12.0f %10.1f %10.1f\n", "mapped, batches", recordCount, recordCount / newSeconds,
+		recordCount * psdPacketSize / newSeconds / 1e6, fileSize(csvPath) / 1e6);
+	std::printf("%-16s %10zu %12.0f %10.1f %10.1f\n", "ifstream, endl", oldRecords, oldRecords / oldSeconds,
+		oldRecords * psdPacketSize / oldSeconds / 1e6, oldCsvSize / 1e6);
+
+	std::remove(capturePath.c_str());
+	std::remove(csvPath.c_str());
+	std::remove(oldCsvPath.c_str());
+
+	if (!identical)
+	{
+		std::printf("The CSV differs from the old converter.\n");
+		return 1;
+	}
+
+	return 0;
+}
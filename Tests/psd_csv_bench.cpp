@@ -0,0 +1,201 @@
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <cstdint>
+#include <cstdio>
+#include <cstdlib>
+#include <iomanip>
+#include <new>
+#include <sstream>
+#include <string>
+#include <vector>
+
+#include "psd_capture.h"
+#include "psd_csv.h"
+#include "psd_record.h"
+#include "test.h"
+
+// CSV formatting of PSD records on one thread: parsePsd with its strings, vector copies and stream formatting the
+// way the converter had it, against formatCsvRecords writing straight into the batch buffer. Both format the same
+// records in memory, no file in between, and must give the same text. Allocations per record are counted on top.
+//
+//   psd_csv_bench [records, 1000000 by default]
+
+namespace
+{
+	std::atomic<bool> countingAllocations(false);
+	std::atomic<size_t> allocationCount(0);
+}
+
+void* operator new(size_t size)
+{
+	if (countingAllocations)
+		allocationCount++;
+
+	if (auto memory = std::malloc(size == 0 ? 1 : size))
+		return memory;
+
+	throw std::bad_alloc();
+}
+
+void* operator new[](size_t size)
+{
+	return operator new(size);
+}
+
+// Not inlined, GCC takes the free in there for a mismatch with the operator new it has not inlined.
+__attribute__((noinline)) void operator delete(void* memory) noexcept
+{
+	std::free(memory);
+}
+
+void operator delete[](void* memory) noexcept
+{
+	std::free(memory);
+}
+
+void operator delete(void* memory, size_t) noexcept
+{
+	std::free(memory);
+}
+
+void operator delete[](void* memory, size_t) noexcept
+{
+	std::free(memory);
+}
+
+namespace
+{
+	// The decoder before the record view.
+	struct packetData
+	{
+		std::string destinationAddress;
+		std::string sourceAddress;
+		uint8_t port;
+		uint8_t transactionId;
+		std::string dataHex;
+		int8_t rssi;
+		uint8_t lqi;
+		bool fcsOk;
+	};
+
+	std::string bufferToHex(const std::vector<uint8_t>& buffer)
+	{
+		std::ostringstream stringBuffer;
+
+		stringBuffer << "\"";
+
+		for (auto& aByte : buffer)
+			stringBuffer << std::hex << std::setw(2) << std::setfill('0') << std::uppercase << static_cast<int>(aByte) << " ";
+
+		auto asString = stringBuffer.str();
+		asString.replace(asString.end() - 1, asString.end(), "\"");
+
+		return asString;
+	}
+
+	packetData parsePsd(const std::vector<uint8_t>& packetBinary)
+	{
+		packetData packet = {};
+
+		size_t dataLength = packetBinary.at(15);
+		packet.destinationAddress = bufferToHex(std::vector<uint8_t>(packetBinary.begin() + 16, packetBinary.begin() + 20));
+		packet.sourceAddress = bufferToHex(std::vector<uint8_t>(packetBinary.begin() + 20, packetBinary.begin() + 24));
+		packet.port = packetBinary.at(24);
+		packet.transactionId = packetBinary.at(26);
+		packet.dataHex = "EMPTY";
+
+		size_t applicationDataLength = dataLength - 11;
+		if (applicationDataLength > 0 && applicationDataLength <= 50)
+			packet.dataHex = bufferToHex(std::vector<uint8_t>(packetBinary.begin() + 27, packetBinary.begin() + (27 + (dataLength - 11))));
+
+		if (applicationDataLength > 50)
+		{
+			packet.fcsOk = false;
+			return packet;
+		}
+
+		int8_t rawRssi = static_cast<int8_t>(packetBinary.at(27 + applicationDataLength));
+		int16_t calculatedRssi = static_cast<int16_t>(rawRssi / 2 - 72);
+		packet.rssi = static_cast<int8_t>(calculatedRssi < -128 ? -128 : calculatedRssi);
+		packet.fcsOk = (packetBinary.at(27 + applicationDataLength + 1) & 0x80) > 0;
+		packet.lqi = packetBinary.at(27 + applicationDataLength + 1) & 0x7F;
+
+		return packet;
+	}
+
+	// Lines as the old converter wrote them, into a stream in place of the file.
+	void formatOld(const std::vector<uint8_t>& records, size_t recordCount, std::ostringstream& output)
+	{
+		for (uint32_t i = 0; i < recordCount; i++)
+		{
+			std::vector<uint8_t> packetSnifferPacket(records.begin() + i * PsdRecord::size, records.begin() + (i + 1) * PsdRecord::size);
+			auto parsedData = parsePsd(packetSnifferPacket);
+
+			output << i + 1 << "," << parsedData.destinationAddress << "," << parsedData.sourceAddress << "," << static_cast<uint32_t>(parsedData.port) << ","
+				<< static_cast<uint32_t>(parsedData.transactionId) << "," << parsedData.dataHex << "," << static_cast<int32_t>(parsedData.rssi)
+				<< "," << static_cast<uint32_t>(parsedData.lqi) << "," << (parsedData.fcsOk ? "OK" : "ERROR") << "\n";
+		}
+	}
+
+	// One batch at a time into a buffer that is reused, the way the converter workers do it.
+	void formatNew(const std::vector<uint8_t>& records, size_t recordCount, std::string& output, std::string& batch)
+	{
+		const size_t recordsPerBatch = 16384;
+		for (size_t first = 0; first < recordCount; first += recordsPerBatch)
+		{
+			batch.clear();
+			formatCsvRecords(records.data() + first * PsdRecord::size, first + 1, std::min(recordsPerBatch, recordCount - first), batch);
+			output += batch;
+		}
+	}
+}
+
+int main(int argc, char* argv[])
+{
+	size_t recordCount = (argc > 1 ? std::stoul(argv[1]) : 1000000);
+
+	std::vector<uint8_t> records(recordCount * PsdRecord::size);
+	uint32_t random = 12345;
+	for (size_t i = 0; i < recordCount; i++)
+		makePsdRecord(static_cast<uint32_t>(i), random, &records[i * PsdRecord::size]);
+
+	std::ostringstream oldOutput;
+	allocationCount = 0;
+	countingAllocations = true;
+	auto start = std::chrono::steady_clock::now();
+	formatOld(records, recordCount, oldOutput);
+	auto oldSeconds = test::secondsSince(start);
+	countingAllocations = false;
+	auto oldAllocations = allocationCount.load();
+
+	// Buffers sized by a first round, as they are after the first batches of a conversion.
+	std::string newOutput;
+	std::string batch;
+	formatNew(records, std::min<size_t>(recordCount, 16384), newOutput, batch);
+	newOutput.clear();
+	newOutput.reserve(oldOutput.str().size());
+
+	allocationCount = 0;
+	countingAllocations = true;
+	start = std::chrono::steady_clock::now();
+	formatNew(records, recordCount, newOutput, batch);
+	auto newSeconds = test::secondsSince(start);
+	countingAllocations = false;
+	auto newAllocations = allocationCount.load();
+
+	std::printf("%zu records\n", recordCount);
+	std::printf("%-22s %12s %12s %14s\n", "decoder", "records/s", "MB/s out", "allocs/record");
+	std::printf("%-22s %12.0f %12.1f %14.2f\n", "parsePsd, streams", recordCount / oldSeconds, oldOutput.str().size() / oldSeconds / 1e6,
+		static_cast<double>(oldAllocations) / recordCount);
+	std::printf("%-22s %12.0f %12.1f %14.2f\n", "PsdRecord, in place", recordCount / newSeconds, newOutput.size() / newSeconds / 1e6,
+		static_cast<double>(newAllocations) / recordCount);
+
+	if (newOutput != oldOutput.str())
+	{
+		std::printf("The CSV differs from parsePsd.\n");
+		return 1;
+	}
+
+	return 0;
+}
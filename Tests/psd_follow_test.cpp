@@ -0,0 +1,192 @@
+#include <chrono>
+#include <cstdint>
+#include <cstdio>
+#include <fstream>
+#include <sstream>
+#include <string>
+#include <thread>
+#include <vector>
+
+#include "child_process.h"
+#include "psd_capture.h"
+#include "psd_csv.h"
+#include "psd_record.h"
+#include "test.h"
+
+// The converter following a capture that is still being written, as a process of its own stopped with Ctrl+C. The
+// CSV has to be the plain conversion of every whole record, whatever the appends looked like: a first one of a few
+// batches, records in pieces, a restart from the checkpoint with lines in the CSV the checkpoint does not have yet.
+// A capture that gets shorter than what was converted is not the same capture any more, the converter gives up.
+
+namespace
+{
+	const size_t recordSize = PsdRecord::size;
+	const std::string capturePath = "/tmp/psd_follow_test.psd";
+	const std::string csvPath = "/tmp/psd_follow_test.csv";
+	const std::string checkpointPath = csvPath + ".checkpoint";
+	const char* csvHeader = "packetNr,destination,source,port,transactionID,packet,RSSI,LQI,FCS\n";
+
+	std::vector<uint8_t> makeRecords(size_t recordCount)
+	{
+		std::vector<uint8_t> records(recordCount * recordSize);
+		uint32_t random = 12345;
+		for (size_t i = 0; i < recordCount; i++)
+			makePsdRecord(static_cast<uint32_t>(i), random, &records[i * recordSize], 20);
+
+		return records;
+	}
+
+	void append(const std::vector<uint8_t>& records, size_t begin, size_t end)
+	{
+		std::ofstream file(capturePath, std::ios::binary | std::ios::app);
+		file.write(reinterpret_cast<const char*>(records.data() + begin), static_cast<std::streamsize>(end - begin));
+	}
+
+	std::string plainCsv(const std::vector<uint8_t>& records, size_t recordCount)
+	{
+		std::string text = csvHeader;
+		formatCsvRecords(records.data(), 1, recordCount, text);
+		return text;
+	}
+
+	std::string readText(const std::string& path)
+	{
+		std::ifstream file(path, std::ios::binary);
+		std::ostringstream text;
+		text << file.rdbuf();
+		return text.str();
+	}
+
+	// Until the CSV has the size it should have, it is never expected to grow past it.
+	bool waitForCsv(const std::string& expected)
+	{
+		auto start = std::chrono::steady_clock::now();
+		while (test::secondsSince(start) < 20)
+		{
+			if (fileSize(csvPath) >= expected.size())
+				return readText(csvPath) == expected;
+
+			std::this_thread::sleep_for(std::chrono::milliseconds(10));
+		}
+
+		return false;
+	}
+
+	std::vector<std::string> arguments(const std::string& tool)
+	{
+		std::vector<std::string> arguments;
+		arguments.push_back(tool);
+		arguments.push_back(capturePath);
+		arguments.push_back("follow");
+		return arguments;
+	}
+
+	bool contains(const std::string& text, const std::string& part)
+	{
+		return text.find(part) != std::string::npos;
+	}
+
+	void checkCheckpoint(size_t recordCount, const std::string& csv)
+	{
+		uint64_t psdOffset = 0;
+		uint64_t csvSize = 0;
+		std::ifstream checkpoint(checkpointPath);
+		CHECK(static_cast<bool>(checkpoint >> psdOffset >> csvSize));
+		CHECK_EQUAL(recordCount * recordSize, psdOffset);
+		CHECK_EQUAL(csv.size(), csvSize);
+	}
+
+	void removeFiles()
+	{
+		std::remove(capturePath.c_str());
+		std::remove(csvPath.c_str());
+		std::remove(checkpointPath.c_str());
+	}
+
+	// A few batches there already, then single records in two pieces each.
+	void testFollowAndResume(const std::string& tool, const std::vector<uint8_t>& records)
+	{
+		const size_t firstCount = 16384 * 3 + 100;
+		const size_t followCount = firstCount + 20;
+		const size_t resumeCount = followCount + 1000;
+		removeFiles();
+		append(records, 0, firstCount * recordSize);
+
+		{
+			ChildProcess converter(arguments(tool));
+			CHECK(contains(converter.readLine(), "Following"));
+			CHECK(waitForCsv(plainCsv(records, firstCount)));
+
+			for (auto record = firstCount; record < followCount; record++)
+			{
+				append(records, record * recordSize, record * recordSize + 100);
+				std::this_thread::sleep_for(std::chrono::milliseconds(5));
+				append(records, record * recordSize + 100, (record + 1) * recordSize);
+			}
+			// Half a record at the end waits for the rest.
+			append(records, followCount * recordSize, followCount * recordSize + 50);
+			CHECK(waitForCsv(plainCsv(records, followCount)));
+
+			converter.interrupt();
+			auto output = converter.finish();
+			CHECK_EQUAL(0, converter.exitStatus());
+			CHECK(contains(output, "Converted " + std::to_string(followCount) + " packets"));
+		}
+		checkCheckpoint(followCount, plainCsv(records, followCount));
+
+		// Lines that made it into the CSV before a crash, but not into the checkpoint, are cut off on the restart.
+		{
+			std::ofstream csv(csvPath, std::ios::binary | std::ios::app);
+			csv << "lines after the checkpoint\n";
+		}
+		append(records, followCount * recordSize + 50, resumeCount * recordSize);
+
+		{
+			ChildProcess converter(arguments(tool));
+			CHECK(contains(converter.readLine(), "Resuming from packet " + std::to_string(followCount + 1) + "."));
+			CHECK(waitForCsv(plainCsv(records, resumeCount)));
+
+			converter.interrupt();
+			converter.finish();
+			CHECK_EQUAL(0, converter.exitStatus());
+		}
+		checkCheckpoint(resumeCount, plainCsv(records, resumeCount));
+
+		std::printf("Followed %zu records, resumed for %zu more\n", followCount, resumeCount - followCount);
+		removeFiles();
+	}
+
+	void testInputShrinks(const std::string& tool, const std::vector<uint8_t>& records)
+	{
+		removeFiles();
+		append(records, 0, 1000 * recordSize);
+
+		ChildProcess converter(arguments(tool));
+		CHECK(contains(converter.readLine(), "Following"));
+		CHECK(waitForCsv(plainCsv(records, 1000)));
+
+		// Another capture written over it.
+		{
+			std::ofstream file(capturePath, std::ios::binary | std::ios::trunc);
+			file.write(reinterpret_cast<const char*>(records.data()), 10 * recordSize);
+		}
+
+		auto output = converter.finish();
+		CHECK_EQUAL(255, converter.exitStatus());
+		CHECK(contains(output, "Input file got shorter than what was converted already"));
+		CHECK(readText(csvPath) == plainCsv(records, 1000));
+
+		removeFiles();
+	}
+}
+
+int main(int, char* argv[])
+{
+	auto tool = toolDirectory(argv[0]) + "/psd";
+	auto records = makeRecords(16384 * 3 + 2000);
+
+	testFollowAndResume(tool, records);
+	testInputShrinks(tool, records);
+
+	return test::result();
+}
@@ -0,0 +1,236 @@
+#include <cstdint>
+#include <cstdio>
+#include <cstdlib>
+#include <fstream>
+#include <sstream>
+#include <string>
+#include <vector>
+
+#include "psd_capture.h"
+#include "psd_csv.h"
+#include "psd_record.h"
+#include "psd_validation.h"
+#include "test.h"
+
+// The converter in validate mode on generated captures, clean and damaged, run as the tool with its batches. The
+// generator numbers the records from 0 and marks every fifth incomplete without the FCS flag, so those never have
+// consistent length fields. Every record that is left whole has to come out exactly as the plain conversion writes
+// it, in order, and nothing else may: the damaged ones are left out, and the report has to count them.
+
+namespace
+{
+	const size_t recordSize = PsdRecord::size;
+	// Records in a batch of the converter.
+	const size_t batchRecords = 16384;
+
+	struct Capture
+	{
+		std::vector<uint8_t> bytes;
+		// Records that have to come out, by their sequence number.
+		std::vector<uint32_t> expected;
+	};
+
+	std::vector<uint8_t> makeRecords(size_t recordCount, uint32_t deviceCount)
+	{
+		std::vector<uint8_t> records(recordCount * recordSize);
+		uint32_t random = 12345;
+		for (size_t i = 0; i < recordCount; i++)
+			makePsdRecord(static_cast<uint32_t>(i), random, &records[i * recordSize], deviceCount);
+
+		return records;
+	}
+
+	Capture cleanCapture(const std::vector<uint8_t>& records)
+	{
+		Capture capture;
+		capture.bytes = records;
+		for (size_t i = 0; i < records.size() / recordSize; i++)
+			capture.expected.push_back(static_cast<uint32_t>(i));
+
+		return capture;
+	}
+
+	void forget(Capture& capture, uint32_t sequenceNumber)
+	{
+		for (auto expected = capture.expected.begin(); expected != capture.expected.end(); ++expected)
+		{
+			if (*expected == sequenceNumber)
+			{
+				capture.expected.erase(expected);
+				return;
+			}
+		}
+	}
+
+	// The plain conversion of the records as they were generated, numbered from 0 like the sniffer did, with the
+	// status validate adds.
+	std::vector<std::string> plainLines(const std::vector<uint8_t>& records, const std::vector<uint32_t>& sequenceNumbers)
+	{
+		std::vector<std::string> lines;
+		for (auto sequenceNumber : sequenceNumbers)
+		{
+			std::string line;
+			PsdRecord record(&records[sequenceNumber * recordSize]);
+			formatCsvRecords(&records[sequenceNumber * recordSize], sequenceNumber, 1, line);
+			line.pop_back();
+			lines.push_back(line + "," + recordStatusName(classifyRecord(record)));
+		}
+
+		return lines;
+	}
+
+	std::vector<std::string> readLines(const std::string& path)
+	{
+		std::vector<std::string> lines;
+		std::ifstream file(path);
+		std::string line;
+		while (std::getline(file, line))
+			lines.push_back(line);
+
+		return lines;
+	}
+
+	std::string readText(const std::string& path)
+	{
+		std::ifstream file(path);
+		std::ostringstream text;
+		text << file.rdbuf();
+		return text.str();
+	}
+
+	// Runs the tool on the capture, compares the CSV row for row and returns the report.
+	std::string validate(const char* name, const std::string& tool, const std::vector<uint8_t>& records, const Capture& capture)
+	{
+		const std::string base = "/tmp/psd_validation_test";
+		{
+			std::ofstream file(base + ".psd", std::ios::binary | std::ios::trunc);
+			file.write(reinterpret_cast<const char*>(capture.bytes.data()), static_cast<std::streamsize>(capture.bytes.size()));
+		}
+
+		auto status = std::system((tool + " " + base + ".psd validate > /dev/null").c_str());
+		CHECK_EQUAL(0, status);
+
+		auto lines = readLines(base + ".csv");
+		auto expected = plainLines(records, capture.expected);
+		auto report = readText(base + ".report.txt");
+
+		std::printf("%s: %zu rows, %zu expected\n", name, lines.empty() ? 0 : lines.size() - 1, expected.size());
+		CHECK(!lines.empty());
+		CHECK_EQUAL(expected.size() + 1, lines.size());
+
+		size_t mismatches = 0;
+		for (size_t i = 0; i < expected.size() && i + 1 < lines.size(); i++)
+		{
+			if (lines[i + 1] != expected[i] && mismatches++ < 3)
+				std::printf("  row %zu: \"%s\", expected \"%s\"\n", i + 1, lines[i + 1].c_str(), expected[i].c_str());
+		}
+		CHECK_EQUAL(0u, mismatches);
+
+		std::remove((base + ".psd").c_str());
+		std::remove((base + ".csv").c_str());
+		std::remove((base + ".report.txt").c_str());
+
+		return report;
+	}
+
+	bool contains(const std::string& text, const std::string& part)
+	{
+		return text.find(part) != std::string::npos;
+	}
+
+	// Two and a half batches, the records at the batch boundaries are found by the batches on both sides of them.
+	void testClean(const std::string& tool, uint32_t deviceCount)
+	{
+		auto records = makeRecords(batchRecords * 5 / 2, deviceCount);
+		auto report = validate(deviceCount > 0 ? "clean" : "clean, random addresses", tool, records, cleanCapture(records));
+
+		CHECK(contains(report, "Partial records: 0, 0 bytes skipped, realigned 0 times."));
+		CHECK(contains(report, "Record numbers missing from the sequence: 0."));
+	}
+
+	// Between two records, once less than a record and once more.
+	void testInsertedBytes(const std::string& tool)
+	{
+		auto records = makeRecords(batchRecords * 5 / 2, 20);
+		auto capture = cleanCapture(records);
+
+		uint32_t random = 99;
+		std::vector<uint8_t> garbage(recordSize + 29);
+		for (auto& byte : garbage)
+		{
+			random = random * 1664525 + 1013904223;
+			byte = static_cast<uint8_t>(random >> 24);
+		}
+
+		capture.bytes.insert(capture.bytes.begin() + 30001 * recordSize, garbage.begin(), garbage.end());
+		capture.bytes.insert(capture.bytes.begin() + 1001 * recordSize, garbage.begin(), garbage.begin() + 37);
+
+		auto report = validate("inserted bytes", tool, records, capture);
+		CHECK(contains(report, "Partial records: 2, " + std::to_string(garbage.size() + 37) + " bytes skipped, realigned 2 times."));
+		CHECK(contains(report, "Record numbers missing from the sequence: 0."));
+	}
+
+	// Out of the middle of a record, that one is cut short and left out.
+	void testDeletedBytes(const std::string& tool)
+	{
+		auto records = makeRecords(batchRecords * 5 / 2, 20);
+		auto capture = cleanCapture(records);
+
+		capture.bytes.erase(capture.bytes.begin() + 2000 * recordSize + 100, capture.bytes.begin() + 2000 * recordSize + 150);
+		forget(capture, 2000);
+		// An incomplete one.
+		capture.bytes.erase(capture.bytes.begin() + 3000 * recordSize + 10, capture.bytes.begin() + 3000 * recordSize + 11);
+		forget(capture, 3000);
+
+		auto report = validate("deleted bytes", tool, records, capture);
+		CHECK(contains(report, "Partial records: 2, " + std::to_string(2 * recordSize - 51) + " bytes skipped, realigned 2 times."));
+		CHECK(contains(report, "Record numbers missing from the sequence: 2."));
+	}
+
+	void testTruncatedTail(const std::string& tool)
+	{
+		auto records = makeRecords(batchRecords * 5 / 2, 20);
+		auto capture = cleanCapture(records);
+
+		capture.bytes.resize(capture.bytes.size() - recordSize + 100);
+		forget(capture, static_cast<uint32_t>(records.size() / recordSize - 1));
+
+		auto report = validate("truncated tail", tool, records, capture);
+		CHECK(contains(report, "Partial records: 1, 100 bytes skipped, realigned 0 times."));
+		CHECK(contains(report, "Record numbers missing from the sequence: 0."));
+	}
+
+	// Records the sniffer missed right across the first batch boundary, and bytes lost from the record in front of
+	// the second one, so that batch starts inside a record.
+	void testGapAtBatchBoundary(const std::string& tool)
+	{
+		auto records = makeRecords(batchRecords * 5 / 2, 20);
+		auto capture = cleanCapture(records);
+
+		capture.bytes.erase(capture.bytes.begin() + (batchRecords - 5) * recordSize, capture.bytes.begin() + (batchRecords + 5) * recordSize);
+		for (uint32_t i = batchRecords - 5; i < batchRecords + 5; i++)
+			forget(capture, i);
+
+		auto secondBoundary = 2 * batchRecords * recordSize;
+		capture.bytes.erase(capture.bytes.begin() + secondBoundary - 100, capture.bytes.begin() + secondBoundary - 40);
+		forget(capture, static_cast<uint32_t>(2 * batchRecords - 1 + 10));
+
+		auto report = validate("gap at batch boundary", tool, records, capture);
+		CHECK(contains(report, "Partial records: 1, " + std::to_string(recordSize - 60) + " bytes skipped, realigned 1 times."));
+		CHECK(contains(report, "Record numbers missing from the sequence: 11."));
+	}
+}
+
+int main(int, char* argv[])
+{
+	auto tool = toolDirectory(argv[0]) + "/psd";
+
+	testClean(tool, 20);
+	testClean(tool, 0);
+	testInsertedBytes(tool);
+	testDeletedBytes(tool);
+	testTruncatedTail(tool);
+	testGapAtBatchBoundary(tool);
+
+	return test::result();
+}
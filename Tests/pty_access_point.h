@@ -0,0 +1,158 @@
+#pragma once
+
+#include <atomic>
+#include <cerrno>
+#include <cstdint>
+#include <mutex>
+#include <stdexcept>
+#include <string>
+#include <thread>
+#include <vector>
+
+#include <poll.h>
+#include <pty.h>
+#include <termios.h>
+#include <unistd.h>
+
+// Access point on a pseudo terminal, inside the test process so the test controls exactly what is written
+// and when. Every command is acknowledged the way the firmware does it, the command sent back with 0x06 in
+// place of the command byte. The slave path is opened by the code under test like a real tty.
+class PtyAccessPoint
+{
+public:
+	PtyAccessPoint() : m_master(-1), m_slave(-1), m_stop(false), m_acknowledge(true), m_commandsReceived(0)
+	{
+		char name[128];
+		if (openpty(&m_master, &m_slave, name, nullptr, nullptr) != 0)
+			throw std::runtime_error("Could not open a pseudo terminal.");
+
+		m_slavePath = name;
+
+		termios settings;
+		tcgetattr(m_slave, &settings);
+		cfmakeraw(&settings);
+		tcsetattr(m_slave, TCSANOW, &settings);
+
+		m_commandTask = std::thread([this]{ answerCommands(); });
+	}
+
+	~PtyAccessPoint()
+	{
+		closeMaster();
+		close(m_slave);
+	}
+
+	const std::string& path() const { return m_slavePath; }
+
+	void write(const uint8_t* data, size_t length)
+	{
+		std::lock_guard<std::mutex> guard(m_writeLock);
+
+		size_t written = 0;
+		while (m_master >= 0 && written < length)
+		{
+			auto result = ::write(m_master, data + written, length - written);
+			if (result > 0)
+			{
+				written += static_cast<size_t>(result);
+				continue;
+			}
+
+			if (result < 0 && errno != EAGAIN && errno != EINTR)
+				return;
+
+			pollfd writable = {m_master, POLLOUT, 0};
+			poll(&writable, 1, 10);
+		}
+	}
+
+	void write(const std::vector<uint8_t>& data) { write(data.data(), data.size()); }
+
+	// Hangs up, the slave side sees EPOLLHUP from now on.
+	void closeMaster()
+	{
+		m_stop = true;
+		if (m_commandTask.joinable())
+			m_commandTask.join();
+
+		std::lock_guard<std::mutex> guard(m_writeLock);
+		if (m_master >= 0)
+			close(m_master);
+		m_master = -1;
+	}
+
+	void setAcknowledge(bool acknowledge) { m_acknowledge = acknowledge; }
+	size_t commandsReceived() const { return m_commandsReceived; }
+
+	// Commands as they came, whole ones only.
+	std::vector<std::vector<uint8_t>> commands()
+	{
+		std::lock_guard<std::mutex> guard(m_commandLock);
+		return m_commands;
+	}
+
+	static std::vector<uint8_t> dataPacket(uint8_t link, uint32_t sequence, size_t payloadLength = 8)
+	{
+		std::vector<uint8_t> packet = {0xFF, 0x06, static_cast<uint8_t>(3 + 7 + payloadLength), link, 0, 0, 0, 0, 0, 0};
+		for (size_t i = 0; i < payloadLength; i++)
+			packet.push_back(i < 4 ? static_cast<uint8_t>(sequence >> (8 * i)) : static_cast<uint8_t>(i));
+
+		return packet;
+	}
+
+private:
+	PtyAccessPoint(const PtyAccessPoint&);
+	PtyAccessPoint& operator=(const PtyAccessPoint&);
+
+	void answerCommands()
+	{
+		std::vector<uint8_t> pending;
+		uint8_t buffer[256];
+
+		while (!m_stop)
+		{
+			pollfd readable = {m_master, POLLIN, 0};
+			if (poll(&readable, 1, 5) <= 0 || (readable.revents & POLLIN) == 0)
+				continue;
+
+			auto count = ::read(m_master, buffer, sizeof(buffer));
+			if (count <= 0)
+				continue;
+
+			pending.insert(pending.end(), buffer, buffer + count);
+
+			while (pending.size() >= 3 && pending[2] >= 3 && pending.size() >= pending[2])
+			{
+				std::vector<uint8_t> command(pending.begin(), pending.begin() + pending[2]);
+				pending.erase(pending.begin(), pending.begin() + pending[2]);
+
+				{
+					std::lock_guard<std::mutex> guard(m_commandLock);
+					m_commands.push_back(command);
+				}
+				m_commandsReceived++;
+
+				if (!m_acknowledge)
+					continue;
+
+				command[1] = 0x06;
+				write(command);
+			}
+
+			// Not a command at all, start over.
+			if (pending.size() >= 3 && pending[2] < 3)
+				pending.clear();
+		}
+	}
+
+	int m_master;
+	int m_slave;
+	std::string m_slavePath;
+	std::mutex m_writeLock;
+	std::thread m_commandTask;
+	std::atomic<bool> m_stop;
+	std::atomic<bool> m_acknowledge;
+	std::atomic<size_t> m_commandsReceived;
+	std::mutex m_commandLock;
+	std::vector<std::vector<uint8_t>> m_commands;
+};
@@ -0,0 +1,42 @@
+#pragma once
+
+#include <algorithm>
+#include <cstdint>
+#include <fstream>
+#include <string>
+#include <vector>
+
+#include "raw_stream_format.h"
+
+// Writes a raw stream recording the way RecordingTransport does, for a ReplayTransport to play back.
+class RawRecording
+{
+public:
+	RawRecording(const std::string& path, uint32_t baudrate) : m_file(path, std::ios::binary | std::ios::trunc)
+	{
+		RawStreamFileHeader header = {};
+		std::copy(rawStreamFileMagic, rawStreamFileMagic + sizeof(rawStreamFileMagic), header.magic);
+		header.version = rawStreamFileVersion;
+		header.baudrate = baudrate;
+		m_file.write(reinterpret_cast<const char*>(&header), sizeof(header));
+	}
+
+	void read(int64_t offsetNs, const std::vector<uint8_t>& data) { chunk(offsetNs, rawStreamRead, data); }
+	void write(int64_t offsetNs, const std::vector<uint8_t>& data) { chunk(offsetNs, rawStreamWrite, data); }
+
+private:
+	void chunk(int64_t offsetNs, uint8_t direction, const std::vector<uint8_t>& data)
+	{
+		RawStreamChunkHeader header = {};
+		header.offsetNs = offsetNs;
+		header.length = static_cast<uint32_t>(data.size());
+		header.direction = direction;
+		m_file.write(reinterpret_cast<const char*>(&header), sizeof(header));
+		m_file.write(reinterpret_cast<const char*>(data.data()), static_cast<std::streamsize>(data.size()));
+
+		const char padding[8] = {};
+		m_file.write(padding, static_cast<std::streamsize>(capturePaddedLength(data.size()) - data.size()));
+	}
+
+	std::ofstream m_file;
+};
@@ -0,0 +1,140 @@
+#include <cstdint>
+#include <cstdio>
+#include <cstdlib>
+#include <string>
+#include <vector>
+
+#include "pty_access_point.h"
+#include "raw_recording.h"
+#include "test.h"
+
+// The AP tool replaying a recording that is longer than the timestamp sync interval, so it has the periodic syncs
+// and their answers in the middle of the data and the stop at the end. Every packet has to come through, and
+// neither the syncs nor the stop of the replay itself may go unanswered.
+//
+//   replay_test [packets, 350000 by default]
+
+namespace
+{
+	const int64_t second = 1000000000;
+	const int64_t recordingLength = 12 * 60 * second;
+	const int64_t syncInterval = 5 * 60 * second;
+	const size_t packetsPerRead = 40;
+
+	std::vector<uint8_t> syncCommand(int64_t offsetNs)
+	{
+		auto time = static_cast<uint32_t>(1700000000 + offsetNs / second);
+		return std::vector<uint8_t>{0xFF, 0x51, 0x07, static_cast<uint8_t>(time), static_cast<uint8_t>(time >> 8),
+			static_cast<uint8_t>(time >> 16), static_cast<uint8_t>(time >> 24)};
+	}
+
+	std::vector<uint8_t> acknowledgement(std::vector<uint8_t> command)
+	{
+		command[1] = 0x06;
+		return command;
+	}
+
+	size_t writeRecording(const std::string& path, size_t packetCount)
+	{
+		RawRecording recording(path, 115200);
+		const std::vector<uint8_t> start = {0xFF, 0x07, 0x03};
+		const std::vector<uint8_t> stop = {0xFF, 0x09, 0x03};
+
+		recording.write(1000000, syncCommand(0));
+		recording.read(3000000, acknowledgement(syncCommand(0)));
+		recording.write(4000000, start);
+		recording.read(6000000, acknowledgement(start));
+
+		size_t syncs = 0;
+		int64_t nextSync = syncInterval;
+		std::vector<uint8_t> read;
+		for (size_t first = 0; first < packetCount; first += packetsPerRead)
+		{
+			auto offset = 10000000 + static_cast<int64_t>(first * (recordingLength / packetCount));
+
+			// The sync goes out between two reads, its answer comes between two packets of the next one.
+			std::vector<uint8_t> pendingAcknowledgement;
+			if (offset >= nextSync)
+			{
+				recording.write(offset - 1000000, syncCommand(offset));
+				pendingAcknowledgement = acknowledgement(syncCommand(offset));
+				nextSync += syncInterval;
+				syncs++;
+			}
+
+			read.clear();
+			for (size_t i = first; i < std::min(packetCount, first + packetsPerRead); i++)
+			{
+				auto packet = PtyAccessPoint::dataPacket(static_cast<uint8_t>(1 + i % 4), static_cast<uint32_t>(i));
+				read.insert(read.end(), packet.begin(), packet.end());
+				if (i == first + packetsPerRead / 2)
+					read.insert(read.end(), pendingAcknowledgement.begin(), pendingAcknowledgement.end());
+			}
+			recording.read(offset, read);
+		}
+
+		recording.write(recordingLength + 20000000, stop);
+		recording.read(recordingLength + 22000000, acknowledgement(stop));
+
+		return syncs;
+	}
+
+	// Absolute, the tool runs in the directory of the recording.
+	std::string toolDirectory(const char* program)
+	{
+		auto resolved = realpath(program, nullptr);
+		std::string path(resolved != nullptr ? resolved : program);
+		std::free(resolved);
+
+		auto slash = path.rfind('/');
+		return (slash == std::string::npos ? std::string(".") : path.substr(0, slash));
+	}
+
+	std::string run(const std::string& command)
+	{
+		std::string output;
+		auto pipe = popen(command.c_str(), "r");
+		if (pipe == nullptr)
+			return output;
+
+		char buffer[4096];
+		size_t count;
+		while ((count = std::fread(buffer, 1, sizeof(buffer), pipe)) > 0)
+			output.append(buffer, count);
+		pclose(pipe);
+
+		return output;
+	}
+
+	bool contains(const std::string& text, const std::string& part)
+	{
+		return text.find(part) != std::string::npos;
+	}
+}
+
+int main(int argc, char* argv[])
+{
+	size_t packetCount = (argc > 1 ? std::stoul(argv[1]) : 350000);
+	std::string directory = "/tmp/replay_test";
+	auto recordingPath = directory + "/recording.shmraw";
+	auto tool = toolDirectory(argv[0]) + "/ap";
+
+	run("rm -rf " + directory + " && mkdir -p " + directory);
+	auto syncs = writeRecording(recordingPath, packetCount);
+
+	// Binary capture, the tool would otherwise write the whole log in text.
+	auto output = run("cd " + directory + " && " + tool + " replay recording.shmraw binary < /dev/null 2>&1");
+	std::printf("%zu packets over %lld minutes with %zu syncs in between:\n%s", packetCount,
+		static_cast<long long>(recordingLength / (60 * second)), syncs, output.c_str());
+
+	CHECK(syncs >= 2);
+	// Exactly these, an acknowledgement taken for data would be counted as a packet.
+	CHECK(contains(output, "Replayed " + std::to_string(packetCount) + " packets in"));
+	CHECK(!contains(output, "Could not set the sync timestamp"));
+	CHECK(!contains(output, "did not return any message"));
+	CHECK(!contains(output, "while searching for packet headers"));
+
+	run("rm -rf " + directory);
+
+	return test::result();
+}
@@ -0,0 +1,117 @@
+#include <chrono>
+#include <cstdint>
+#include <cstdio>
+#include <string>
+#include <vector>
+
+#include "raw_recording.h"
+#include "replay_transport.h"
+#include "test.h"
+
+// Playback of a recording that has commands in the middle of the data: the recorded answers are cut out,
+// the commands written now are answered instead, and the data after an unanswered command still comes.
+
+namespace
+{
+	const std::vector<uint8_t> start = {0xFF, 0x07, 0x03};
+	const std::vector<uint8_t> startAcknowledgement = {0xFF, 0x06, 0x03};
+	const std::vector<uint8_t> sync = {0xFF, 0x51, 0x07, 1, 2, 3, 4};
+	const std::vector<uint8_t> syncAcknowledgement = {0xFF, 0x06, 0x07, 1, 2, 3, 4};
+	const std::vector<uint8_t> unanswered = {0xFF, 0x55, 0x04, 1};
+	const std::vector<uint8_t> stop = {0xFF, 0x09, 0x03};
+
+	std::vector<uint8_t> packet(uint8_t sequence)
+	{
+		return std::vector<uint8_t>{0xFF, 0x06, 0x0C, 1, 0, 0, 0, 0, 0, 0, sequence, 0xAA, 0xBB};
+	}
+
+	std::vector<uint8_t> join(std::vector<std::vector<uint8_t>> parts)
+	{
+		std::vector<uint8_t> joined;
+		for (auto& part : parts)
+			joined.insert(joined.end(), part.begin(), part.end());
+		return joined;
+	}
+
+	std::vector<uint8_t> readAll(ReplayTransport& replay)
+	{
+		std::vector<uint8_t> bytes;
+		uint8_t buffer[5];
+		while (!replay.drained())
+		{
+			auto count = replay.read(buffer, sizeof(buffer));
+			bytes.insert(bytes.end(), buffer, buffer + count);
+		}
+		return bytes;
+	}
+
+	void testCommandsInTheData(const std::string& path)
+	{
+		{
+			RawRecording recording(path, 115200);
+			recording.write(1000, start);
+			recording.read(2000, startAcknowledgement);
+			recording.read(3000, packet(1));
+			recording.write(4000, sync);
+			// Answer between two packets in the same read.
+			recording.read(5000, join({packet(2), syncAcknowledgement, packet(3)}));
+			recording.write(6000, unanswered);
+			recording.read(7000, packet(4));
+			recording.write(8000, stop);
+			recording.read(9000, join({startAcknowledgement, packet(5)}));
+		}
+
+		ReplayTransport replay(path, ReplayTransport::Timing::fastest, std::chrono::milliseconds(2));
+		CHECK_EQUAL(3u, replay.acknowledgementsRemoved());
+
+		// Nothing before the start command, and that is not the end of the recording.
+		uint8_t buffer[64];
+		CHECK_EQUAL(0u, replay.read(buffer, sizeof(buffer)));
+		CHECK(!replay.drained());
+
+		replay.write(start.data(), start.size());
+		CHECK_EQUAL(startAcknowledgement.size(), replay.read(buffer, sizeof(buffer)));
+		CHECK(std::vector<uint8_t>(buffer, buffer + startAcknowledgement.size()) == startAcknowledgement);
+
+		// A command now is answered ahead of the rest of the data.
+		CHECK_EQUAL(packet(1).size(), replay.read(buffer, sizeof(buffer)));
+		replay.write(sync.data(), sync.size());
+		CHECK(!replay.drained());
+		CHECK_EQUAL(syncAcknowledgement.size(), replay.read(buffer, sizeof(buffer)));
+		CHECK(std::vector<uint8_t>(buffer, buffer + syncAcknowledgement.size()) == syncAcknowledgement);
+
+		CHECK(readAll(replay) == join({packet(2), packet(3), packet(4), packet(5)}));
+		CHECK(replay.drained());
+
+		replay.write(stop.data(), stop.size());
+		CHECK(!replay.drained());
+		CHECK_EQUAL(startAcknowledgement.size(), replay.read(buffer, sizeof(buffer)));
+		CHECK(replay.drained());
+	}
+
+	// Recordings without a handshake start right away.
+	void testDataOnly(const std::string& path)
+	{
+		{
+			RawRecording recording(path, 115200);
+			recording.read(1000, packet(1));
+			recording.read(2000, packet(2));
+		}
+
+		ReplayTransport replay(path, ReplayTransport::Timing::fastest, std::chrono::milliseconds(2));
+		CHECK_EQUAL(0u, replay.acknowledgementsRemoved());
+		CHECK(readAll(replay) == join({packet(1), packet(2)}));
+	}
+}
+
+int main()
+{
+	std::string path = "/tmp/replay_transport_test.shmraw";
+
+	testCommandsInTheData(path);
+	testDataOnly(path);
+
+	std::remove(path.c_str());
+
+	return test::result();
+}
@@ -0,0 +1,213 @@
+#include <algorithm>
+#include <array>
+#include <cstdint>
+#include <cstdio>
+#include <functional>
+#include <string>
+#include <vector>
+
+#include "ring_buffer.h"
+#include "test.h"
+
+// Framing throughput of the receive buffer: the vector the parser used to erase from the front, against the ring
+// it uses now. Both run the same header search and packet extraction on a synthetic stream of 0xFF 0x06 framed
+// packets, fed in reads of a given size. The large reads are the backed-up case, the parser finding the buffer full.
+//
+//   ring_buffer_bench [packets, 2000000 by default]
+
+namespace
+{
+	const size_t headerLength = 3;
+	const size_t lengthByteIndex = 2;
+	const std::array<uint8_t, 2> startSequence = {{0xFF, 0x06}};
+
+	std::vector<uint8_t> makeStream(size_t packetCount)
+	{
+		std::vector<uint8_t> stream;
+		uint32_t seed = 12345;
+
+		for (size_t i = 0; i < packetCount; i++)
+		{
+			seed = seed * 1103515245 + 12345;
+			size_t payloadLength = 10 + (seed >> 16) % 40;
+
+			stream.push_back(0xFF);
+			stream.push_back(0x06);
+			stream.push_back(static_cast<uint8_t>(payloadLength + headerLength));
+			for (size_t j = 0; j < payloadLength; j++)
+			{
+				seed = seed * 1103515245 + 12345;
+				// No 0xFF in the payload, so there are no false headers in either buffer.
+				stream.push_back(static_cast<uint8_t>((seed >> 16) % 0xFF));
+			}
+		}
+
+		return stream;
+	}
+
+	// The parser before the ring: readData() appended into a vector reserved to 10000 bytes and taking no more
+	// than its capacity, parseAndLogPackets() erased every header and packet from its front.
+	class VectorParser
+	{
+	public:
+		explicit VectorParser(const std::function<void(std::vector<uint8_t>)>& callback) : m_callback(callback), m_currentPacketSize(0)
+		{
+			m_buffer.reserve(10000);
+		}
+
+		size_t freeSpace() const { return m_buffer.capacity() - m_buffer.size(); }
+
+		void feed(const uint8_t* data, size_t length)
+		{
+			for (size_t i = 0; i < length; i++)
+				m_buffer.push_back(data[i]);
+		}
+
+		void parse()
+		{
+			while (m_buffer.size() > 0)
+			{
+				if (m_currentPacketSize == 0)
+				{
+					if (m_buffer.size() < headerLength)
+						return;
+
+					auto start = std::search(m_buffer.begin(), m_buffer.end(), startSequence.begin(), startSequence.end());
+					if (start + lengthByteIndex >= m_buffer.end())
+					{
+						m_buffer.erase(m_buffer.begin(), m_buffer.end());
+						return;
+					}
+
+					m_currentPacketSize = *(start + lengthByteIndex) - headerLength;
+					m_buffer.erase(m_buffer.begin(), start + headerLength);
+				}
+
+				if (m_buffer.size() < m_currentPacketSize)
+					return;
+
+				m_callback(std::vector<uint8_t>(m_buffer.begin(), m_buffer.begin() + m_currentPacketSize));
+				m_buffer.erase(m_buffer.begin(), m_buffer.begin() + m_currentPacketSize);
+				m_currentPacketSize = 0;
+			}
+		}
+
+	private:
+		std::function<void(std::vector<uint8_t>)> m_callback;
+		std::vector<uint8_t> m_buffer;
+		size_t m_currentPacketSize;
+	};
+
+	// The same parse on the ring, as in the commit that introduced it.
+	class RingParser
+	{
+	public:
+		explicit RingParser(const std::function<void(std::vector<uint8_t>)>& callback) : m_callback(callback), m_buffer(10000), m_currentPacketSize(0)
+		{
+		}
+
+		size_t freeSpace() const { return m_buffer.freeSpace(); }
+
+		void feed(const uint8_t* data, size_t length)
+		{
+			m_buffer.write(data, length);
+		}
+
+		void parse()
+		{
+			while (m_buffer.size() > 0)
+			{
+				if (m_currentPacketSize == 0)
+				{
+					if (m_buffer.size() < headerLength)
+						return;
+
+					auto start = findPacketStart();
+					if (start + lengthByteIndex >= m_buffer.size())
+					{
+						m_buffer.clear();
+						return;
+					}
+
+					m_currentPacketSize = m_buffer.at(start + lengthByteIndex) - headerLength;
+					m_buffer.consume(start + headerLength);
+				}
+
+				if (m_buffer.size() < m_currentPacketSize)
+					return;
+
+				std::vector<uint8_t> packet(m_currentPacketSize);
+				m_buffer.read(packet.data(), packet.size());
+				m_callback(std::move(packet));
+				m_currentPacketSize = 0;
+			}
+		}
+
+	private:
+		size_t findPacketStart() const
+		{
+			auto size = m_buffer.size();
+			for (size_t i = 0; i + 1 < size; i++)
+				if (m_buffer.at(i) == startSequence[0] && m_buffer.at(i + 1) == startSequence[1])
+					return i;
+
+			return size;
+		}
+
+		std::function<void(std::vector<uint8_t>)> m_callback;
+		RingBuffer<uint8_t> m_buffer;
+		size_t m_currentPacketSize;
+	};
+
+	template <typename Parser>
+	double run(const std::vector<uint8_t>& stream, size_t readSize, size_t& packets)
+	{
+		packets = 0;
+		size_t payloadBytes = 0;
+		Parser parser([&](std::vector<uint8_t> packet) { packets++; payloadBytes += packet.size(); });
+
+		auto start = std::chrono::steady_clock::now();
+		size_t offset = 0;
+		while (offset < stream.size())
+		{
+			auto length = std::min(std::min(readSize, parser.freeSpace()), stream.size() - offset);
+			parser.feed(stream.data() + offset, length);
+			offset += length;
+			parser.parse();
+		}
+
+		auto seconds = test::secondsSince(start);
+		if (payloadBytes == 0)
+			std::printf("No packets parsed.\n");
+
+		return seconds;
+	}
+}
+
+int main(int argc, char* argv[])
+{
+	size_t packetCount = (argc > 1 ? std::stoul(argv[1]) : 2000000);
+	auto stream = makeStream(packetCount);
+	std::printf("%zu packets, %.1f MB\n", packetCount, stream.size() / 1e6);
+	std::printf("%-8s %14s %14s %8s\n", "read", "vector MB/s", "ring MB/s", "ratio");
+
+	const size_t readSizes[] = {50, 100, 1000, 10000};
+	for (auto readSize : readSizes)
+	{
+		size_t vectorPackets = 0;
+		size_t ringPackets = 0;
+		auto vectorSeconds = run<VectorParser>(stream, readSize, vectorPackets);
+		auto ringSeconds = run<RingParser>(stream, readSize, ringPackets);
+
+		if (vectorPackets != packetCount || ringPackets != packetCount)
+		{
+			std::printf("Lost packets: vector %zu, ring %zu of %zu.\n", vectorPackets, ringPackets, packetCount);
+			return 1;
+		}
+
+		std::printf("%-8zu %14.1f %14.1f %7.2fx\n", readSize, stream.size() / vectorSeconds / 1e6, stream.size() / ringSeconds / 1e6,
+			vectorSeconds / ringSeconds);
+	}
+
+	return 0;
+}
@@ -0,0 +1,172 @@
+#include <algorithm>
+#include <cstdint>
+#include <thread>
+#include <vector>
+
+#include "ring_buffer.h"
+#include "test.h"
+
+namespace
+{
+	void testCapacity()
+	{
+		RingBuffer<uint8_t> ring(1000);
+		CHECK_EQUAL(1024u, ring.capacity());
+		CHECK(ring.empty());
+		CHECK_EQUAL(1024u, ring.freeSpace());
+
+		RingBuffer<uint8_t> exact(64);
+		CHECK_EQUAL(64u, exact.capacity());
+	}
+
+	void testWriteAndReadBack()
+	{
+		RingBuffer<uint8_t> ring(8);
+		const uint8_t data[] = {1, 2, 3, 4, 5};
+
+		CHECK_EQUAL(5u, ring.write(data, sizeof(data)));
+		CHECK_EQUAL(5u, ring.size());
+		CHECK_EQUAL(3u, ring.freeSpace());
+		CHECK_EQUAL(1, ring.at(0));
+		CHECK_EQUAL(5, ring.at(4));
+
+		// Only what fits is taken.
+		CHECK_EQUAL(3u, ring.write(data, sizeof(data)));
+		CHECK_EQUAL(0u, ring.freeSpace());
+		CHECK(!ring.push(9));
+
+		uint8_t output[8] = {};
+		CHECK_EQUAL(8u, ring.read(output, sizeof(output)));
+		const uint8_t expected[] = {1, 2, 3, 4, 5, 1, 2, 3};
+		CHECK(std::equal(expected, expected + 8, output));
+		CHECK(ring.empty());
+
+		uint8_t item = 0;
+		CHECK(!ring.pop(item));
+	}
+
+	void testWraparound()
+	{
+		RingBuffer<uint8_t> ring(8);
+		const uint8_t first[] = {1, 2, 3, 4, 5, 6};
+		ring.write(first, sizeof(first));
+		ring.consume(5);
+
+		// Head is at 6, the next 7 bytes run over the end of the storage.
+		const uint8_t second[] = {10, 11, 12, 13, 14, 15, 16};
+		CHECK_EQUAL(7u, ring.write(second, sizeof(second)));
+		CHECK_EQUAL(8u, ring.size());
+
+		auto readable = ring.readableRegions();
+		CHECK_EQUAL(3u, readable.length[0]);
+		CHECK_EQUAL(5u, readable.length[1]);
+		CHECK_EQUAL(8u, readable.total());
+		CHECK_EQUAL(6, readable.data[0][0]);
+		CHECK_EQUAL(11, readable.data[0][2]);
+		CHECK_EQUAL(12, readable.data[1][0]);
+
+		// at() hides the wrap.
+		for (size_t i = 0; i < sizeof(second); i++)
+			CHECK_EQUAL(second[i], ring.at(i + 1));
+
+		ring.consume(6);
+		auto writable = ring.writableRegions();
+		CHECK_EQUAL(6u, writable.total());
+		CHECK_EQUAL(3u, writable.length[0]);
+		CHECK_EQUAL(3u, writable.length[1]);
+
+		// Filled in place like the serial read does.
+		for (size_t i = 0; i < 3; i++)
+		{
+			writable.data[0][i] = static_cast<uint8_t>(20 + i);
+			writable.data[1][i] = static_cast<uint8_t>(23 + i);
+		}
+		ring.commitWrite(6);
+
+		uint8_t output[8];
+		CHECK_EQUAL(8u, ring.read(output, sizeof(output)));
+		const uint8_t expected[] = {15, 16, 20, 21, 22, 23, 24, 25};
+		CHECK(std::equal(expected, expected + 8, output));
+	}
+
+	void testFreeRunningPositions()
+	{
+		RingBuffer<uint8_t> ring(4);
+		uint8_t item = 0;
+
+		for (int i = 0; i < 1000; i++)
+		{
+			CHECK(ring.push(static_cast<uint8_t>(i)));
+			CHECK(ring.pop(item));
+			CHECK_EQUAL(static_cast<uint8_t>(i), item);
+		}
+
+		CHECK_EQUAL(1000u, ring.writePosition());
+		CHECK_EQUAL(1000u, ring.readPosition());
+	}
+
+	// Producer and consumer on their own threads, every byte must come out once and in order.
+	void testConcurrentTransfer()
+	{
+		const size_t total = 20 * 1000 * 1000;
+		RingBuffer<uint8_t> ring(4096);
+
+		std::thread producer([&]
+		{
+			uint8_t chunk[333];
+			size_t written = 0;
+			while (written < total)
+			{
+				auto count = std::min(sizeof(chunk), total - written);
+				for (size_t i = 0; i < count; i++)
+					chunk[i] = static_cast<uint8_t>((written + i) * 7);
+
+				size_t offset = 0;
+				while (offset < count)
+				{
+					offset += ring.write(chunk + offset, count - offset);
+					if (offset < count)
+						std::this_thread::yield();
+				}
+
+				written += count;
+			}
+		});
+
+		size_t consumed = 0;
+		size_t mismatches = 0;
+		uint8_t chunk[500];
+		while (consumed < total)
+		{
+			auto count = ring.read(chunk, sizeof(chunk));
+			if (count == 0)
+			{
+				std::this_thread::yield();
+				continue;
+			}
+
+			for (size_t i = 0; i < count; i++)
+				if (chunk[i] != static_cast<uint8_t>((consumed + i) * 7))
+					mismatches++;
+
+			consumed += count;
+		}
+
+		producer.join();
+
+		CHECK_EQUAL(total, consumed);
+		CHECK_EQUAL(0u, mismatches);
+		CHECK(ring.empty());
+	}
+}
+
+int main()
+{
+	testCapacity();
+	testWriteAndReadBack();
+	testWraparound();
+	testFreeRunningPositions();
+	testConcurrentTransfer();
+
+	return test::result();
+}
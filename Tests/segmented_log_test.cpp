@@ -0,0 +1,127 @@
+#include <chrono>
+#include <cstdint>
+#include <cstdio>
+#include <fstream>
+#include <sstream>
+#include <string>
+#include <vector>
+
+#include <sys/stat.h>
+
+#include "segmented_log.h"
+#include "test.h"
+
+// Segments rolled over on every write, so the logging thread keeps catching the background thread while it opens
+// the next one. The manifest has to list them all, numbered one after the other, with every record in them.
+
+namespace
+{
+	struct ManifestLine
+	{
+		uint32_t number;
+		std::string file;
+		size_t records;
+	};
+
+	std::vector<ManifestLine> readManifest(const std::string& pathPrefix)
+	{
+		std::vector<ManifestLine> lines;
+		std::ifstream manifest(pathPrefix + " manifest.txt");
+		std::string line;
+		while (std::getline(manifest, line))
+		{
+			std::istringstream fields(line);
+			ManifestLine entry;
+			std::string field;
+			std::getline(fields, field, '\t');
+			entry.number = static_cast<uint32_t>(std::stoul(field));
+			std::getline(fields, entry.file, '\t');
+			std::getline(fields, field, '\t');
+			std::getline(fields, field, '\t');
+			std::getline(fields, field, '\t');
+			entry.records = std::stoul(field);
+			lines.push_back(entry);
+		}
+
+		return lines;
+	}
+
+	bool exists(const std::string& path)
+	{
+		struct stat status;
+		return stat(path.c_str(), &status) == 0;
+	}
+
+	void writeRecords(const std::string& pathPrefix, size_t recordCount, bool compress)
+	{
+		SegmentedLog log(pathPrefix, 64, std::chrono::minutes(0), compress);
+		log.setHeader("header\n");
+
+		auto time = std::chrono::system_clock::now();
+		for (size_t i = 0; i < recordCount; i++)
+		{
+			auto text = "record " + std::to_string(i) + " of the segment test\n";
+			log.write(text.data(), text.size(), 1, time, time);
+		}
+		log.close();
+
+		std::printf("%zu segments, %zu opened by the logging thread, %zu writes failed\n", log.segmentsFinished(), log.openStalls(), log.writeErrors());
+		CHECK_EQUAL(recordCount, log.segmentsFinished());
+		CHECK_EQUAL(0u, log.writeErrors());
+		CHECK_EQUAL(0u, log.compressionFailures());
+	}
+
+	void testSegmentsInOrder()
+	{
+		const std::string pathPrefix = "/tmp/segmented_log_test";
+		const size_t recordCount = 2000;
+		writeRecords(pathPrefix, recordCount, false);
+
+		auto manifest = readManifest(pathPrefix);
+		CHECK_EQUAL(recordCount, manifest.size());
+
+		for (size_t i = 0; i < manifest.size(); i++)
+		{
+			CHECK_EQUAL(i + 1, manifest[i].number);
+			CHECK_EQUAL(1u, manifest[i].records);
+
+			auto path = "/tmp/" + manifest[i].file;
+			std::ifstream segment(path);
+			std::string header, record;
+			std::getline(segment, header);
+			std::getline(segment, record);
+			CHECK(header == "header");
+			CHECK(record == "record " + std::to_string(i) + " of the segment test");
+			std::remove(path.c_str());
+		}
+
+		std::remove((pathPrefix + " manifest.txt").c_str());
+	}
+
+	// The path goes to gzip as it is, quotes and all, with no shell in between to make something of them.
+	void testCompressedWithQuotesInPath()
+	{
+		const std::string pathPrefix = "/tmp/segmented_log_test \"$(touch segmented_log_test_shell)\"";
+		writeRecords(pathPrefix, 10, true);
+
+		auto manifest = readManifest(pathPrefix);
+		CHECK_EQUAL(10u, manifest.size());
+		for (auto& line : manifest)
+		{
+			CHECK(line.file.size() > 3 && line.file.compare(line.file.size() - 3, 3, ".gz") == 0);
+			CHECK(exists("/tmp/" + line.file));
+			std::remove(("/tmp/" + line.file).c_str());
+		}
+
+		CHECK(!exists("segmented_log_test_shell"));
+		std::remove((pathPrefix + " manifest.txt").c_str());
+	}
+}
+
+int main()
+{
+	testSegmentsInOrder();
+	testCompressedWithQuotesInPath();
+
+	return test::result();
+}
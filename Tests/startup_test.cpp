@@ -0,0 +1,141 @@
+#include <algorithm>
+#include <chrono>
+#include <cstdio>
+#include <cstdlib>
+#include <memory>
+#include <string>
+#include <thread>
+#include <vector>
+
+#include "child_process.h"
+#include "posix_serial_transport.h"
+#include "pty_access_point.h"
+#include "simpliciti.h"
+#include "test.h"
+
+// Start and stop of the access point over a pseudo terminal. Against the simulator as a process of its own both
+// take about the round trip of the pty, no fixed sleeps, and a start must still work with the acknowledgement
+// coming in pieces.
+//
+//   startup_test [start/stop cycles, 20 by default]
+
+namespace
+{
+	std::string toolDirectory(const char* program)
+	{
+		std::string path(program);
+		auto slash = path.rfind('/');
+		return (slash == std::string::npos ? std::string(".") : path.substr(0, slash));
+	}
+
+	double percentile(std::vector<double> values, double fraction)
+	{
+		std::sort(values.begin(), values.end());
+		return values[static_cast<size_t>(fraction * (values.size() - 1))];
+	}
+
+	void testStartupTime(const std::string& simulatorPath, size_t cycles)
+	{
+		ChildProcess simulator({simulatorPath, "4", "10"});
+		auto banner = simulator.readLine();
+		auto pathStart = banner.find("/dev/");
+		CHECK(pathStart != std::string::npos);
+		if (pathStart == std::string::npos)
+			return;
+		auto devicePath = banner.substr(pathStart, banner.find(',', pathStart) - pathStart);
+
+		std::vector<double> starts;
+		std::vector<double> stops;
+		for (size_t i = 0; i < cycles; i++)
+		{
+			SimpliciTi simpliciTi(std::unique_ptr<SerialTransport>(new PosixSerialTransport(devicePath, 115200, 20)),
+				[](const PacketHeader&, ByteView, std::chrono::system_clock::time_point)
+				{
+				});
+
+			auto start = std::chrono::steady_clock::now();
+			simpliciTi.startAccessPoint();
+			starts.push_back(test::secondsSince(start) * 1000);
+
+			std::this_thread::sleep_for(std::chrono::milliseconds(20));
+
+			start = std::chrono::steady_clock::now();
+			simpliciTi.stopAccessPoint();
+			stops.push_back(test::secondsSince(start) * 1000);
+
+			CHECK_EQUAL(0u, simpliciTi.statistics().commandsFailed);
+		}
+
+		simulator.write("x\n");
+		simulator.finish();
+
+		std::printf("%zu cycles against the simulator: start p50 %.2f ms, max %.2f ms; stop p50 %.2f ms, max %.2f ms\n", cycles,
+			percentile(starts, 0.5), percentile(starts, 1.0), percentile(stops, 0.5), percentile(stops, 1.0));
+
+		// The handshake used to sleep 100 ms after each of its two commands. Stop also waits for the reader to come
+		// back from its last read, up to the 20 ms read timeout.
+		CHECK(percentile(starts, 0.5) < 20);
+		CHECK(percentile(stops, 0.5) < 50);
+	}
+
+	// Acknowledgements split over two reads, with a pause in between that the reader sees.
+	void testAcknowledgementInPieces()
+	{
+		PtyAccessPoint accessPoint;
+		accessPoint.setAcknowledge(false);
+
+		std::thread answering([&]
+		{
+			for (size_t answered = 0; answered < 2;)
+			{
+				auto commands = accessPoint.commands();
+				if (commands.size() <= answered)
+				{
+					std::this_thread::sleep_for(std::chrono::milliseconds(1));
+					continue;
+				}
+
+				auto acknowledgement = commands[answered++];
+				acknowledgement[1] = 0x06;
+				accessPoint.write(acknowledgement.data(), 2);
+				std::this_thread::sleep_for(std::chrono::milliseconds(10));
+				accessPoint.write(acknowledgement.data() + 2, acknowledgement.size() - 2);
+			}
+		});
+
+		SimpliciTi simpliciTi(std::unique_ptr<SerialTransport>(new PosixSerialTransport(accessPoint.path(), 115200, 20)),
+			[](const PacketHeader&, ByteView, std::chrono::system_clock::time_point)
+			{
+			});
+
+		auto start = std::chrono::steady_clock::now();
+		auto started = true;
+		try
+		{
+			simpliciTi.startAccessPoint();
+		}
+		catch (const std::exception&)
+		{
+			started = false;
+		}
+		auto milliseconds = test::secondsSince(start) * 1000;
+		answering.join();
+
+		std::printf("Start with acknowledgements in two pieces: %.1f ms\n", milliseconds);
+		CHECK(started);
+		CHECK_EQUAL(0u, simpliciTi.statistics().commandRetries);
+
+		accessPoint.setAcknowledge(true);
+		simpliciTi.stopAccessPoint();
+	}
+}
+
+int main(int argc, char* argv[])
+{
+	size_t cycles = (argc > 1 ? std::stoul(argv[1]) : 20);
+
+	testStartupTime(toolDirectory(argv[0]) + "/apsim", cycles);
+	testAcknowledgementInPieces();
+
+	return test::result();
+}
@@ -0,0 +1,253 @@
+#include <algorithm>
+#include <chrono>
+#include <cstdint>
+#include <cstdio>
+#include <string>
+#include <thread>
+#include <vector>
+
+#include <sys/socket.h>
+#include <sys/un.h>
+#include <sys/wait.h>
+#include <unistd.h>
+
+#include "stream_server.h"
+#include "test.h"
+
+// The stream server with many subscribers, each a process of its own that connects over the Unix socket, some
+// with a link filter. Every client has to get every frame it asked for, whole and in order. A client that stops
+// reading is disconnected under that policy without holding up the others.
+//
+//   stream_server_test [clients, 16 by default] [packets, 20000 by default]
+
+namespace
+{
+	const size_t frameHeaderLength = 24;
+	const uint8_t filteredLink = 2;
+
+	struct ClientResult
+	{
+		uint64_t frames;
+		uint64_t bad;		// Wrong length, link or sequence.
+	};
+
+	int connectTo(const std::string& path)
+	{
+		auto descriptor = socket(AF_UNIX, SOCK_STREAM, 0);
+		sockaddr_un address = {};
+		address.sun_family = AF_UNIX;
+		std::copy(path.begin(), path.end(), address.sun_path);
+		if (connect(descriptor, reinterpret_cast<sockaddr*>(&address), sizeof(address)) != 0)
+		{
+			close(descriptor);
+			return -1;
+		}
+
+		return descriptor;
+	}
+
+	// Packets are the link, then the sequence number in four bytes, then filler up to their length.
+	std::vector<uint8_t> packet(uint32_t sequence)
+	{
+		std::vector<uint8_t> data(5 + sequence % 40, static_cast<uint8_t>(sequence));
+		data[0] = static_cast<uint8_t>(1 + sequence % 4);
+		for (size_t i = 0; i < 4; i++)
+			data[1 + i] = static_cast<uint8_t>(sequence >> (8 * i));
+		return data;
+	}
+
+	// Runs in the client process until the server closes the connection.
+	ClientResult receiveFrames(const std::string& path, bool filtered)
+	{
+		ClientResult result = {0, 0};
+		auto descriptor = connectTo(path);
+		if (descriptor < 0)
+		{
+			result.bad = 1;
+			return result;
+		}
+
+		if (filtered)
+		{
+			uint8_t filter[] = {1, filteredLink};
+			if (send(descriptor, filter, sizeof(filter), 0) != sizeof(filter))
+				result.bad++;
+		}
+
+		std::vector<uint8_t> stream;
+		size_t offset = 0;
+		uint32_t expected = (filtered ? filteredLink - 1 : 0);
+		uint8_t buffer[65536];
+		ssize_t readBytes;
+		while ((readBytes = recv(descriptor, buffer, sizeof(buffer), 0)) > 0)
+		{
+			stream.insert(stream.end(), buffer, buffer + readBytes);
+
+			while (stream.size() - offset >= 4)
+			{
+				uint32_t length = stream[offset] | (stream[offset + 1] << 8) | (stream[offset + 2] << 16) | (static_cast<uint32_t>(stream[offset + 3]) << 24);
+				if (stream.size() - offset < 4 + length)
+					break;
+
+				auto data = &stream[offset + frameHeaderLength];
+				uint32_t sequence = data[1] | (data[2] << 8) | (data[3] << 16) | (static_cast<uint32_t>(data[4]) << 24);
+				if (sequence != expected || length + 4 != frameHeaderLength + packet(sequence).size() || (filtered && data[0] != filteredLink))
+					result.bad++;
+
+				expected = sequence + (filtered ? 4 : 1);
+				result.frames++;
+				offset += 4 + length;
+			}
+
+			stream.erase(stream.begin(), stream.begin() + offset);
+			offset = 0;
+		}
+
+		close(descriptor);
+		return result;
+	}
+
+	void testManyClientProcesses(size_t clientCount, uint32_t packetCount)
+	{
+		std::string path = "/tmp/stream_server_test.sock";
+		StreamServer server(path, StreamServer::SlowClientPolicy::dropFrames);
+		server.start();
+
+		int resultPipe[2];
+		CHECK(pipe(resultPipe) == 0);
+
+		std::vector<pid_t> clients;
+		size_t filteredClients = 0;
+		for (size_t i = 0; i < clientCount; i++)
+		{
+			auto filtered = (i % 4 == 3);
+			filteredClients += (filtered ? 1 : 0);
+
+			auto pid = fork();
+			if (pid == 0)
+			{
+				auto result = receiveFrames(path, filtered);
+				auto written = write(resultPipe[1], &result, sizeof(result));
+				_exit(written == sizeof(result) ? 0 : 1);
+			}
+			clients.push_back(pid);
+		}
+
+		auto start = std::chrono::steady_clock::now();
+		while (server.clientCount() < clientCount && test::secondsSince(start) < 5)
+			std::this_thread::sleep_for(std::chrono::milliseconds(1));
+		// The filters are read by now as well.
+		std::this_thread::sleep_for(std::chrono::milliseconds(100));
+		CHECK_EQUAL(clientCount, server.clientCount());
+
+		// At a pace the server keeps up with for all the clients, the point is them, not its queue.
+		auto packetsPerMillisecond = std::max<size_t>(16, 4096 / clientCount);
+		start = std::chrono::steady_clock::now();
+		for (uint32_t i = 0; i < packetCount; i++)
+		{
+			auto data = packet(i);
+			auto now = std::chrono::system_clock::now();
+			server.publish(0, now, now, data.data(), data.size());
+			if (i % packetsPerMillisecond == packetsPerMillisecond - 1)
+				std::this_thread::sleep_for(std::chrono::milliseconds(1));
+		}
+
+		size_t expectedFrames = (clientCount - filteredClients) * packetCount + filteredClients * (packetCount / 4);
+		while (server.framesSent() < expectedFrames && test::secondsSince(start) < 30)
+			std::this_thread::sleep_for(std::chrono::milliseconds(1));
+		auto seconds = test::secondsSince(start);
+		server.stop();
+
+		uint64_t frames = 0;
+		uint64_t bad = 0;
+		size_t results = 0;
+		for (size_t i = 0; i < clientCount; i++)
+		{
+			ClientResult result;
+			if (read(resultPipe[0], &result, sizeof(result)) != sizeof(result))
+				break;
+			frames += result.frames;
+			bad += result.bad;
+			results++;
+		}
+
+		for (auto pid : clients)
+			waitpid(pid, nullptr, 0);
+		close(resultPipe[0]);
+		close(resultPipe[1]);
+
+		auto latency = server.sendLatency();
+		std::printf("%zu client processes, %zu filtered: %llu frames in %.2f s, send latency p50 %llu us, p99 %llu us\n", clientCount,
+			filteredClients, static_cast<unsigned long long>(frames), seconds, static_cast<unsigned long long>(latency.percentile(0.5)), static_cast<unsigned long long>(latency.percentile(0.99)));
+
+		CHECK_EQUAL(clientCount, results);
+		CHECK_EQUAL(static_cast<uint64_t>(expectedFrames), frames);
+		CHECK_EQUAL(0u, bad);
+		CHECK_EQUAL(0u, server.framesDropped());
+		CHECK_EQUAL(0u, server.queueOverflows());
+	}
+
+	// One client never reads, under the disconnect policy it goes once its buffer is full and the other keeps
+	// getting everything.
+	void testSlowClientDisconnected()
+	{
+		std::string path = "/tmp/stream_server_test_slow.sock";
+		StreamServer server(path, StreamServer::SlowClientPolicy::disconnect, 16 * 1024);
+		server.start();
+
+		auto slow = connectTo(path);
+		auto fast = connectTo(path);
+		auto start = std::chrono::steady_clock::now();
+		while (server.clientCount() < 2 && test::secondsSince(start) < 5)
+			std::this_thread::sleep_for(std::chrono::milliseconds(1));
+
+		const uint32_t packetCount = 20000;
+		uint64_t fastBytes = 0;
+		uint64_t expectedBytes = 0;
+		uint8_t buffer[65536];
+		for (uint32_t i = 0; i < packetCount; i++)
+		{
+			auto data = packet(i);
+			expectedBytes += frameHeaderLength + data.size();
+			auto now = std::chrono::system_clock::now();
+			server.publish(0, now, now, data.data(), data.size());
+
+			if (i % 64 == 63)
+			{
+				std::this_thread::sleep_for(std::chrono::microseconds(200));
+				ssize_t readBytes;
+				while ((readBytes = recv(fast, buffer, sizeof(buffer), MSG_DONTWAIT)) > 0)
+					fastBytes += readBytes;
+			}
+		}
+
+		start = std::chrono::steady_clock::now();
+		while (fastBytes < expectedBytes && test::secondsSince(start) < 5)
+		{
+			auto readBytes = recv(fast, buffer, sizeof(buffer), MSG_DONTWAIT);
+			if (readBytes > 0)
+				fastBytes += readBytes;
+			else
+				std::this_thread::sleep_for(std::chrono::milliseconds(1));
+		}
+
+		CHECK_EQUAL(1u, server.slowClientsDisconnected());
+		CHECK_EQUAL(1u, server.clientCount());
+		CHECK_EQUAL(expectedBytes, fastBytes);
+
+		server.stop();
+		close(slow);
+		close(fast);
+	}
+}
+
+int main(int argc, char* argv[])
+{
+	size_t clientCount = (argc > 1 ? std::stoul(argv[1]) : 16);
+	uint32_t packetCount = static_cast<uint32_t>(argc > 2 ? std::stoul(argv[2]) : 20000);
+
+	testManyClientProcesses(clientCount, packetCount);
+	testSlowClientDisconnected();
+
+	return test::result();
+}
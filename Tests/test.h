@@ -0,0 +1,52 @@
+#pragma once
+
+#include <chrono>
+#include <cstdlib>
+#include <iostream>
+
+// Every test is a program of its own: CHECK reports a failed condition and keeps going, main returns
+// test::result() so "make test" stops at the first program with a failure.
+
+namespace test
+{
+	inline int& failures()
+	{
+		static int count = 0;
+		return count;
+	}
+
+	inline int result()
+	{
+		if (failures() == 0)
+			std::cout << "Passed." << std::endl;
+		else
+			std::cout << failures() << " checks failed." << std::endl;
+
+		return (failures() == 0 ? EXIT_SUCCESS : EXIT_FAILURE);
+	}
+
+	inline double secondsSince(std::chrono::steady_clock::time_point start)
+	{
+		return std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+	}
+}
+
+#define CHECK(condition) \
+	do \
+	{ \
+		if (!(condition)) \
+		{ \
+			std::cout << __FILE__ << ":" << __LINE__ << ": " << #condition << " failed." << std::endl; \
+			test::failures()++; \
+		} \
+	} while (false)
+
+#define CHECK_EQUAL(expected, actual) \
+	do \
+	{ \
+		if (!((expected) == (actual))) \
+		{ \
+			std::cout << __FILE__ << ":" << __LINE__ << ": expected " << #expected << " == " << #actual << ", got " << (actual) << "." << std::endl; \
+			test::failures()++; \
+		} \
+	} while (false)
@@ -0,0 +1,142 @@
+#include <chrono>
+#include <cstdint>
+#include <cstdio>
+#include <ctime>
+#include <string>
+#include <thread>
+#include <vector>
+
+#include "test.h"
+#include "timestamp_format.h"
+
+// Timestamp formatting cost per log record: localtime and strftime for the device timestamp ("%c") and for the
+// host time ("%H:%M:%S") the way every record was written before, against the TimestampFormatter instances the
+// log thread uses now. Device times advance a few packets per second like a capture; both ways must produce
+// the same text. The threaded runs show what the shared localtime costs when several threads format at once.
+//
+//   timestamp_format_bench [records, 2000000 by default]
+
+namespace
+{
+	const time_t firstTime = 1700000000;
+
+	// Record i happens at firstTime + i / 8 seconds.
+	time_t recordTime(size_t i)
+	{
+		return firstTime + static_cast<time_t>(i / 8);
+	}
+
+	void appendOld(std::string& buffer, time_t deviceTime, time_t hostTime)
+	{
+		auto timestampTm = std::localtime(&deviceTime);
+		std::string timestampAsString(30, 0);
+		auto timestampLength = std::strftime(const_cast<char*>(timestampAsString.data()), timestampAsString.capacity(), "%c", timestampTm);
+		timestampAsString.resize(timestampLength);
+
+		auto timeNowTm = std::localtime(&hostTime);
+		std::string timeAsString(30, 0);
+		auto stringLength = std::strftime(const_cast<char*>(timeAsString.data()), timeAsString.capacity(), "%H:%M:%S", timeNowTm);
+		timeAsString.resize(stringLength);
+
+		buffer += timeAsString;
+		buffer += timestampAsString;
+	}
+
+	struct NewFormatters
+	{
+		NewFormatters() : host("%H:%M:%S"), device("%c") {}
+
+		void append(std::string& buffer, time_t deviceTime, time_t hostTime)
+		{
+			host.append(buffer, hostTime);
+			device.append(buffer, deviceTime);
+		}
+
+		TimestampFormatter host;
+		TimestampFormatter device;
+	};
+
+	// Records per second over all threads, every thread formats recordCount records.
+	template <typename Format>
+	double run(size_t threadCount, size_t recordCount, Format format)
+	{
+		auto start = std::chrono::steady_clock::now();
+		std::vector<std::thread> threads;
+		for (size_t t = 0; t < threadCount; t++)
+		{
+			threads.push_back(std::thread([&]
+			{
+				format(recordCount);
+			}));
+		}
+
+		for (auto& thread : threads)
+			thread.join();
+
+		return threadCount * recordCount / test::secondsSince(start);
+	}
+
+	bool sameText(size_t recordCount)
+	{
+		NewFormatters formatters;
+		std::string oldText;
+		std::string newText;
+		for (size_t i = 0; i < recordCount; i += 37)
+		{
+			oldText.clear();
+			newText.clear();
+			appendOld(oldText, recordTime(i), recordTime(i) + 3);
+			formatters.append(newText, recordTime(i), recordTime(i) + 3);
+			if (oldText != newText)
+				return false;
+		}
+
+		return true;
+	}
+}
+
+int main(int argc, char* argv[])
+{
+	size_t recordCount = (argc > 1 ? std::stoul(argv[1]) : 2000000);
+
+	auto oldFormat = [](size_t count)
+	{
+		std::string buffer;
+		for (size_t i = 0; i < count; i++)
+		{
+			buffer.clear();
+			appendOld(buffer, recordTime(i), recordTime(i) + 3);
+		}
+	};
+
+	auto newFormat = [](size_t count)
+	{
+		NewFormatters formatters;
+		std::string buffer;
+		for (size_t i = 0; i < count; i++)
+		{
+			buffer.clear();
+			formatters.append(buffer, recordTime(i), recordTime(i) + 3);
+		}
+	};
+
+	std::printf("%zu records per thread, %u hardware threads\n", recordCount, std::thread::hardware_concurrency());
+	std::printf("%-22s %8s %14s %12s\n", "formatting", "threads", "records/s", "ns/record");
+
+	size_t threadCounts[] = {1, 4};
+	for (auto threads : threadCounts)
+	{
+		auto oldRate = run(threads, recordCount, oldFormat);
+		auto newRate = run(threads, recordCount, newFormat);
+		std::printf("%-22s %8zu %14.0f %12.1f\n", "localtime, strftime", threads, oldRate, 1e9 / oldRate);
+		std::printf("%-22s %8zu %14.0f %12.1f\n", "TimestampFormatter", threads, newRate, 1e9 / newRate);
+	}
+
+	if (!sameText(recordCount))
+	{
+		std::printf("The formatter differs from strftime.\n");
+		return 1;
+	}
+
+	return 0;
+}
@@ -0,0 +1,262 @@
+#include <array>
+#include <atomic>
+#include <chrono>
+#include <cstdio>
+#include <cstdlib>
+#include <memory>
+#include <mutex>
+#include <new>
+#include <ostream>
+#include <thread>
+#include <vector>
+
+#include "byte_format.h"
+#include "capture_session.h"
+#include "log_writer.h"
+#include "simpliciti.h"
+#include "test.h"
+#include "timestamp_format.h"
+
+// Steady state of the capture does not touch the heap: once everything is running and has seen some packets,
+// further packets go from the transport through parsing, ordering and the log queue without a single allocation.
+// Every operator new of the process is counted, on all threads, so whatever the pipeline allocates shows.
+
+namespace
+{
+	std::atomic<bool> countingAllocations(false);
+	std::atomic<size_t> allocationCount(0);
+}
+
+void* operator new(size_t size)
+{
+	if (countingAllocations)
+		allocationCount++;
+
+	if (auto memory = std::malloc(size == 0 ? 1 : size))
+		return memory;
+
+	throw std::bad_alloc();
+}
+
+void* operator new[](size_t size)
+{
+	return operator new(size);
+}
+
+void operator delete(void* memory) noexcept
+{
+	std::free(memory);
+}
+
+void operator delete[](void* memory) noexcept
+{
+	std::free(memory);
+}
+
+void operator delete(void* memory, size_t) noexcept
+{
+	std::free(memory);
+}
+
+void operator delete[](void* memory, size_t) noexcept
+{
+	std::free(memory);
+}
+
+namespace
+{
+	// Access point that makes up its packets while they are read, so feeding it allocates nothing either.
+	// Commands are acknowledged by echoing them back ahead of the packets.
+	class GeneratingTransport : public SerialTransport
+	{
+	public:
+		GeneratingTransport() : m_packetsAllowed(0), m_packetsGenerated(0), m_acknowledgementLength(0), m_acknowledgementRead(0), m_offset(0) {}
+
+		// Lets that many more packets through.
+		void allow(size_t packets) { m_packetsAllowed += packets; }
+		size_t generated() const { return m_packetsGenerated; }
+
+		using SerialTransport::read;
+		size_t read(uint8_t* buffer, size_t length)
+		{
+			{
+				std::lock_guard<std::mutex> guard(m_lock);
+				if (m_acknowledgementRead < m_acknowledgementLength)
+				{
+					auto count = std::min(length, m_acknowledgementLength - m_acknowledgementRead);
+					std::copy(m_acknowledgement.begin() + m_acknowledgementRead, m_acknowledgement.begin() + m_acknowledgementRead + count, buffer);
+					m_acknowledgementRead += count;
+					return count;
+				}
+			}
+
+			size_t count = 0;
+			while (count < length && m_packetsGenerated < m_packetsAllowed)
+			{
+				buffer[count++] = packetByte(m_packetsGenerated, m_offset++);
+				if (m_offset == packetLength)
+				{
+					m_offset = 0;
+					m_packetsGenerated++;
+				}
+			}
+
+			if (count == 0)
+				std::this_thread::sleep_for(std::chrono::milliseconds(1));
+
+			return count;
+		}
+
+		bool write(const uint8_t* data, size_t length)
+		{
+			std::lock_guard<std::mutex> guard(m_lock);
+			m_acknowledgementLength = std::min(length, m_acknowledgement.size());
+			std::copy(data, data + m_acknowledgementLength, m_acknowledgement.begin());
+			m_acknowledgement[1] = 0x06;
+			m_acknowledgementRead = 0;
+			return true;
+		}
+
+		void flush() {}
+		bool mustBeDrained() const { return false; }
+
+	private:
+		static const size_t packetLength = 3 + 7 + 20;
+
+		static uint8_t packetByte(size_t sequence, size_t offset)
+		{
+			switch (offset)
+			{
+			case 0: return 0xFF;
+			case 1: return 0x06;
+			case 2: return static_cast<uint8_t>(packetLength);
+			case 3: return static_cast<uint8_t>(1 + sequence % 4);		// Link.
+			case 4: return static_cast<uint8_t>(sequence / 1000);			// Timestamp, a second per 1000 packets.
+			case 5: return 0x2F;
+			case 6: return 0x67;
+			case 7: return 0x59;
+			case 8: return static_cast<uint8_t>(sequence % 1000 & 0xFF);	// Milliseconds.
+			case 9: return static_cast<uint8_t>(sequence % 1000 >> 8);
+			default: return static_cast<uint8_t>(sequence + offset);
+			}
+		}
+
+		std::atomic<size_t> m_packetsAllowed;
+		std::atomic<size_t> m_packetsGenerated;
+		std::mutex m_lock;
+		std::array<uint8_t, 64> m_acknowledgement;
+		size_t m_acknowledgementLength;
+		size_t m_acknowledgementRead;
+		size_t m_offset;
+	};
+
+	template <typename Condition>
+	bool waitFor(Condition condition)
+	{
+		auto deadline = std::chrono::steady_clock::now() + std::chrono::seconds(10);
+		while (!condition() && std::chrono::steady_clock::now() < deadline)
+			std::this_thread::sleep_for(std::chrono::milliseconds(1));
+
+		return condition();
+	}
+
+	const size_t warmUpPackets = 20000;
+	const size_t countedPackets = 100000;
+
+	// 50000 packets/s, a fraction of what the ordering reserves room for. A burst larger than that grows the
+	// storage once, that is not the steady state.
+	void allowPaced(GeneratingTransport& transport, size_t packets)
+	{
+		for (size_t allowed = 0; allowed < packets; allowed += 100)
+		{
+			transport.allow(std::min<size_t>(100, packets - allowed));
+			std::this_thread::sleep_for(std::chrono::milliseconds(2));
+		}
+	}
+
+	void testSimpliciTi()
+	{
+		auto transport = new GeneratingTransport();
+		std::atomic<size_t> packetsLogged(0);
+		std::atomic<size_t> payloadBytes(0);
+
+		SimpliciTi simpliciTi(std::unique_ptr<SerialTransport>(transport), [&](const PacketHeader& header, ByteView, std::chrono::system_clock::time_point)
+		{
+			payloadBytes += header.payload.size;
+			packetsLogged++;
+		});
+		simpliciTi.startAccessPoint();
+
+		transport->allow(warmUpPackets);
+		CHECK(waitFor([&]{ return packetsLogged == warmUpPackets; }));
+
+		allocationCount = 0;
+		countingAllocations = true;
+		transport->allow(countedPackets);
+		auto done = waitFor([&]{ return packetsLogged == warmUpPackets + countedPackets; });
+		countingAllocations = false;
+
+		CHECK(done);
+		std::printf("SimpliciTi: %zu allocations for %zu packets\n", allocationCount.load(), countedPackets);
+		CHECK_EQUAL(0u, allocationCount.load());
+		CHECK_EQUAL((warmUpPackets + countedPackets) * 20, payloadBytes.load());
+
+		simpliciTi.stopAccessPoint();
+	}
+
+	// As the AP tool runs it: ordering of the packets, drift correction and the text log.
+	void testCaptureSession()
+	{
+		auto transport = new GeneratingTransport();
+		std::vector<std::unique_ptr<SerialTransport>> transports;
+		transports.push_back(std::unique_ptr<SerialTransport>(transport));
+
+		// Formatted as the log would have it, the text goes nowhere.
+		size_t formattedBytes = 0;
+		std::ostream nowhere(nullptr);
+		TimestampFormatter timeFormatter("%H:%M:%S");
+		LogWriter logWriter(nowhere, [&](const LogWriter::Record& record, std::string& buffer)
+		{
+			timeFormatter.append(buffer, std::chrono::system_clock::to_time_t(record.receiveTime));
+			buffer += ", ";
+			appendNumber(buffer, record.length);
+			buffer += " bytes, ";
+			appendHex(buffer, record.data.data(), record.length);
+			buffer += '\n';
+			formattedBytes += record.length;
+		});
+
+		CaptureSession captureSession(std::move(transports), [&](const CaptureSession::CapturedPacket& packet)
+		{
+			logWriter.push(packet.accessPointId, packet.receiveTime, packet.deviceTime, packet.frame.data, packet.frame.size);
+		}, std::chrono::milliseconds(10));
+
+		captureSession.start();
+		logWriter.start();
+
+		allowPaced(*transport, warmUpPackets);
+		CHECK(waitFor([&]{ return logWriter.recordsWritten() == warmUpPackets; }));
+
+		allocationCount = 0;
+		countingAllocations = true;
+		allowPaced(*transport, countedPackets);
+		auto done = waitFor([&]{ return logWriter.recordsWritten() == warmUpPackets + countedPackets; });
+		countingAllocations = false;
+
+		CHECK(done);
+		std::printf("CaptureSession and LogWriter: %zu allocations for %zu packets\n", allocationCount.load(), countedPackets);
+		CHECK_EQUAL(0u, allocationCount.load());
+
+		captureSession.stop();
+		logWriter.stop();
+		CHECK_EQUAL((warmUpPackets + countedPackets) * 27, formattedBytes);
+	}
+}
+
+int main()
+{
+	testSimpliciTi();
+	testCaptureSession();
+
+	return test::result();
+}